@@ -26,6 +26,7 @@
 #include "inventory.h"
 #include "game_world.h"
 #include "camera.h"
+#include "udp_channel.h"
 #include "color_palette.h"
 #include "ui/ui.h"
 #include "common/util.h"
@@ -35,25 +36,37 @@
 #include "common/strings.h"
 #include "common/global.h"
 #include "common/packet.h"
+#include "common/recv_buffer.h"
+#include "common/snapshot.h"
+#include "common/datagram.h"
 #include "common/logger.h"
 #include "common/maths.h"
 #include "common/input_codes.h"
 #include "common/memory/memutils.h"
 #include "common/containers/ring_buffer.h"
+#include "common/containers/id_table.h"
 
-#define POLLFD_COUNT           2
+#define POLLFD_COUNT           3
 #define POLL_INFINITE_TIMEOUT -1
 
 extern vec2 main_window_size;
 
-static u32 remote_player_count = 0;
-static player_remote_t remote_players[MAX_PLAYER_COUNT];
+/* Keyed by player id, written by the network thread and read by the render loop under remote_players_lock */
+static id_table_t remote_players;
+static pthread_mutex_t remote_players_lock = PTHREAD_MUTEX_INITIALIZER;
 static player_self_t self_player;
 static b8 player_initialized = false;
+static snapshot_history_t snapshot_history; /* Snapshots received from the server, only touched by the network thread */
 
 static f32 server_update_accumulator = 0.0f;
 
 static struct pollfd pfds[POLLFD_COUNT];
+/* Bytes received from the server, a packet split over several reads waits here until all of it arrived.
+   Only touched by the network thread */
+static recv_buffer_t server_recv_buffer;
+
+STATIC_ASSERT(SERVER_RECV_BUFFER_SIZE >= sizeof(packet_header_t) + PACKET_MAX_SIZE,
+              "server receive buffer must fit the largest packet, otherwise it would never be parsed");
 
 static char input_buffer[INPUT_BUFFER_SIZE] = {0};
 static u32 input_count = 0;
@@ -192,59 +205,231 @@ static void handle_stdin_event(void)
     }
 }
 
-static void handle_socket_event(void)
+/* Turns the difference between two consecutive snapshots of a player into the same effects the game shows for local events */
+static void apply_player_snapshot(player_base_t *base, const snapshot_player_t *old, const snapshot_player_t *new)
 {
-    u8 recv_buffer[INPUT_BUFFER_SIZE + OVERFLOW_BUFFER_SIZE] = {0};
+    if (old != NULL && old->state == PLAYER_STATE_DEAD && new->state != PLAYER_STATE_DEAD) {
+        player_respawn(base, new);
+        return;
+    }
 
-    i64 bytes_read = net_recv(client_socket, recv_buffer, INPUT_BUFFER_SIZE, 0);
-    if (bytes_read <= 0) {
-        if (bytes_read == -1) {
-            LOG_ERROR("recv error: %s", strerror(errno));
-        } else if (bytes_read == 0) {
+    if (old != NULL && new->health < old->health) {
+        player_take_damage(base, old->health - new->health);
+    }
+
+    if (new->state == PLAYER_STATE_DEAD && base->state != PLAYER_STATE_DEAD) {
+        base->state = PLAYER_STATE_DEAD;
+        base->animation.player.keyframe_index = 0;
+        base->animation.player.accumulator = 0.0f;
+    }
+}
+
+static void apply_player_snapshot_changes(const snapshot_t *previous, const snapshot_t *current)
+{
+    for (u32 i = 0; i < current->count; i++) {
+        const snapshot_player_t *new = &current->players[i];
+        const snapshot_player_t *old = previous != NULL ? snapshot_find_player(previous, new->id) : NULL;
+
+        packet_player_update_t update = {
+            .seq_nr    = new->seq_nr,
+            .id        = new->id,
+            .position  = snapshot_player_position(new),
+            .direction = new->direction,
+            .state     = new->state
+        };
+
+        if (new->id == self_player.base.id) {
+            apply_player_snapshot(&self_player.base, old, new);
+            // Only the server's answer to new input is reconciled, the rest of the state is predicted locally
+            if (old != NULL && new->seq_nr != old->seq_nr && new->state != PLAYER_STATE_DEAD) {
+                player_self_handle_authoritative_update(&self_player, &update);
+            }
+            continue;
+        }
+
+        b8 moved = old == NULL || new->x != old->x || new->y != old->y || new->state != old->state || new->direction != old->direction;
+
+        pthread_mutex_lock(&remote_players_lock);
+        player_remote_t *remote_player = id_table_find(&remote_players, new->id);
+        // Snapshots may list a player before its PLAYER_ADD arrived, which carries the whole state anyway
+        if (remote_player != NULL) {
+            apply_player_snapshot(&remote_player->base, old, new);
+            if (moved && new->state != PLAYER_STATE_DEAD) {
+                player_remote_handle_authoritative_update(remote_player, &update);
+                server_update_accumulator = 0.0f;
+            }
+        }
+        pthread_mutex_unlock(&remote_players_lock);
+    }
+}
+
+static void send_player_snapshot_ack(u32 number)
+{
+    packet_player_snapshot_ack_t ack_packet = { .number = number };
+    if (!udp_channel_send(PACKET_TYPE_PLAYER_SNAPSHOT_ACK, &ack_packet) &&
+        !packet_send(client_socket, PACKET_TYPE_PLAYER_SNAPSHOT_ACK, &ack_packet)) {
+        LOG_ERROR("failed to send snapshot ack packet");
+    }
+}
+
+static void handle_player_snapshot(const packet_player_snapshot_t *packet)
+{
+    static snapshot_t snapshot; /* Only used by the network thread */
+
+    if (packet->number <= snapshot_history.latest) {
+        LOG_WARN("received snapshot %u which is not newer than %u, ignoring...", packet->number, snapshot_history.latest);
+        return;
+    }
+
+    const snapshot_t *baseline = snapshot_history_find(&snapshot_history, packet->baseline);
+    if ((packet->baseline != SNAPSHOT_NONE && baseline == NULL) || !snapshot_apply(baseline, packet, &snapshot)) {
+        LOG_ERROR("failed to apply snapshot %u on top of %u, requesting a full snapshot", packet->number, packet->baseline);
+        send_player_snapshot_ack(SNAPSHOT_NONE);
+        return;
+    }
+
+    apply_player_snapshot_changes(snapshot_history_find(&snapshot_history, snapshot_history.latest), &snapshot);
+    snapshot_history_push(&snapshot_history, &snapshot);
+    send_player_snapshot_ack(snapshot.number);
+}
+
+/* Snapshots arrive over UDP and may overtake a PLAYER_ADD, whose state is then older than the one already known */
+static void apply_latest_player_snapshot(player_remote_t *remote_player)
+{
+    const snapshot_t *latest = snapshot_history_find(&snapshot_history, snapshot_history.latest);
+    const snapshot_player_t *player = latest != NULL ? snapshot_find_player(latest, remote_player->base.id) : NULL;
+    if (player == NULL) {
+        return;
+    }
+
+    packet_player_update_t update = {
+        .seq_nr    = player->seq_nr,
+        .id        = player->id,
+        .position  = snapshot_player_position(player),
+        .direction = player->direction,
+        .state     = player->state
+    };
+    remote_player->base.health = player->health;
+    apply_player_snapshot(&remote_player->base, NULL, player);
+    if (player->state != PLAYER_STATE_DEAD) {
+        player_remote_handle_authoritative_update(remote_player, &update);
+    }
+}
+
+static void handle_udp_offer(const packet_udp_offer_t *packet)
+{
+#if CLIENT_UDP_ENABLED
+    if (udp_channel_open(client_socket, packet->token)) {
+        pfds[2].fd = udp_channel_get_socket();
+        pfds[2].events = POLLIN;
+    }
+#else
+    UNUSED(packet);
+#endif
+}
+
+static void handle_datagram_event(void)
+{
+    u8 buffer[DATAGRAM_MAX_SIZE];
+    u32 type, payload_size;
+    const u8 *payload;
+
+    while (udp_channel_receive(buffer, sizeof(buffer), &type, &payload, &payload_size)) {
+        union {
+            packet_udp_hello_t udp_hello;
+            packet_player_snapshot_t player_snapshot;
+        } packet;
+
+        if (type != PACKET_TYPE_UDP_HELLO && type != PACKET_TYPE_PLAYER_SNAPSHOT) {
+            continue;
+        }
+        if (!packet_deserialize(type, payload, payload_size, &packet)) {
+            LOG_ERROR("received malformed datagram (type=%u, size=%u), ignoring...", type, payload_size);
+            continue;
+        }
+
+        if (type == PACKET_TYPE_UDP_HELLO) {
+            udp_channel_handle_hello(&packet.udp_hello);
+        } else {
+            handle_player_snapshot(&packet.player_snapshot);
+        }
+    }
+}
+
+static void handle_socket_event(void)
+{
+    // Socket is blocking, but poll reported data so a single read doesn't wait
+    switch (recv_buffer_fill(&server_recv_buffer, client_socket)) {
+        case RECV_BUFFER_FILL_OK:
+            break;
+        case RECV_BUFFER_FILL_WOULD_BLOCK:
+            return;
+        case RECV_BUFFER_FILL_FULL: /* Can't happen as long as packet sizes are validated against the capacity */
+            LOG_ERROR("receive buffer is full, disconnecting");
+            close(client_socket);
+            exit(EXIT_FAILURE);
+        case RECV_BUFFER_FILL_CLOSED:
             LOG_INFO("orderly shutdown: disconnected from server");
             close(client_socket);
             exit(EXIT_FAILURE);
-        }
-        return;
+        case RECV_BUFFER_FILL_ERROR:
+            LOG_ERROR("recv error: %s", strerror(errno));
+            return;
     }
 
-    ASSERT_MSG(bytes_read >= PACKET_TYPE_SIZE[PACKET_TYPE_HEADER], "unimplemented: at least header size amount of bytes must be read");
+    const u32 packet_header_size = sizeof(packet_header_t);
+    while (recv_buffer_length(&server_recv_buffer) >= packet_header_size) {
+        packet_header_t *header = (packet_header_t *)recv_buffer_data(&server_recv_buffer);
 
-    // Check if multiple packets included in single tcp data reception
-    u8 *buffer = recv_buffer;
-    for (;;) {
-        packet_header_t *header = (packet_header_t *)buffer;
+        // The header is all there is to frame the stream with, so a bogus one can't be recovered from
+        if (header->type <= PACKET_TYPE_HEADER || header->type >= PACKET_TYPE_COUNT ||
+            header->size == 0 || header->size > PACKET_MAX_SIZE) {
+            LOG_ERROR("received malformed packet header (type=%u, size=%u), disconnecting", header->type, header->size);
+            close(client_socket);
+            exit(EXIT_FAILURE);
+        }
 
-        if (bytes_read - PACKET_TYPE_SIZE[PACKET_TYPE_HEADER] < header->size) {
-            u64 missing_bytes = header->size - (bytes_read - PACKET_TYPE_SIZE[PACKET_TYPE_HEADER]);
+        u32 packet_size = packet_header_size + header->size;
+        if (recv_buffer_length(&server_recv_buffer) < packet_size) {
 #if LOG_NETWORK
-            LOG_TRACE("not read the entire packet body. reading %lu more", missing_bytes);
+            LOG_TRACE("not read the entire packet body, %u more bytes to go", packet_size - recv_buffer_length(&server_recv_buffer));
 #endif
+            break; // Rest of the body hasn't arrived yet, it stays buffered until the next read
+        }
 
-            ASSERT_MSG(missing_bytes <= OVERFLOW_BUFFER_SIZE, "not enough space in overflow buffer. consider increasing the size");
-
-            // Read into OVERFLOW_BUFFER of the recv_buffer and proceed to packet interpretation
-            i64 new_bytes_read = net_recv(client_socket, &recv_buffer[INPUT_BUFFER_SIZE], missing_bytes, 0);
-            UNUSED(new_bytes_read); // prevents compiler warning in release mode
-            ASSERT(new_bytes_read == missing_bytes);
+        union {
+            packet_ping_t ping;
+            packet_message_t message;
+            packet_message_history_t message_history;
+            packet_player_init_t player_init;
+            packet_player_add_t player_add;
+            packet_player_remove_t player_remove;
+            packet_player_snapshot_t player_snapshot;
+            packet_game_world_init_t game_world_init;
+            packet_game_world_object_remove_t game_world_object_remove;
+            packet_chunk_response_t chunk_response;
+            packet_chunk_delta_t chunk_delta;
+            packet_udp_offer_t udp_offer;
+        } packet;
+
+        u32 packet_type = header->type;
+        // The stream can't be trusted any further once the server sent something which doesn't parse
+        if (!packet_deserialize(packet_type, recv_buffer_data(&server_recv_buffer) + packet_header_size, header->size, &packet)) {
+            LOG_ERROR("received malformed packet (type=%u, size=%u), disconnecting", header->type, header->size);
+            close(client_socket);
+            exit(EXIT_FAILURE);
         }
 
-        u32 received_data_size = 0;
-        switch (header->type) {
-            case PACKET_TYPE_NONE: {
-                LOG_WARN("received PACKET_TYPE_NONE, ignoring...");
-            } break;
+        switch (packet_type) {
             case PACKET_TYPE_PING: {
-                received_data_size = PACKET_TYPE_SIZE[PACKET_TYPE_PING];
-                packet_ping_t *data = (packet_ping_t *)(buffer + PACKET_TYPE_SIZE[PACKET_TYPE_HEADER]);
+                packet_ping_t *data = &packet.ping;
 
                 u64 time_now = clock_get_absolute_time_ns();
                 f64 ping_ms = (time_now - data->time) / 1000000.0;
                 LOG_TRACE("ping = %fms", ping_ms);
             } break;
             case PACKET_TYPE_MESSAGE: {
-                received_data_size = PACKET_TYPE_SIZE[PACKET_TYPE_MESSAGE];
-                packet_message_t *message = (packet_message_t *)(buffer + PACKET_TYPE_SIZE[PACKET_TYPE_HEADER]);
+                packet_message_t *message = &packet.message;
                 struct tm *local_time = localtime((time_t *)&message->timestamp);
                 LOG_TRACE("[%d-%02d-%02d %02d:%02d] %s: %s",
                     local_time->tm_year + 1900,
@@ -267,8 +452,7 @@ static void handle_socket_event(void)
                 }
             } break;
             case PACKET_TYPE_MESSAGE_HISTORY: {
-                received_data_size = PACKET_TYPE_SIZE[PACKET_TYPE_MESSAGE_HISTORY];
-                packet_message_history_t *message_history = (packet_message_history_t *)(buffer + PACKET_TYPE_SIZE[PACKET_TYPE_HEADER]);
+                packet_message_history_t *message_history = &packet.message_history;
                 for (u32 i = 0; i < message_history->count; i++) {
                     packet_message_t message = message_history->history[i];
                     if (message.type == MESSAGE_TYPE_SYSTEM) {
@@ -284,8 +468,7 @@ static void handle_socket_event(void)
                 }
             } break;
             case PACKET_TYPE_PLAYER_INIT: {
-                received_data_size = PACKET_TYPE_SIZE[PACKET_TYPE_PLAYER_INIT];
-                packet_player_init_t *player_init = (packet_player_init_t *)(buffer + PACKET_TYPE_SIZE[PACKET_TYPE_HEADER]);
+                packet_player_init_t *player_init = &packet.player_init;
                 player_self_create(username, player_init, &self_player);
                 LOG_INFO("initialized self: id=%u position=(%f,%f) color=(%f,%f,%f)",
                         self_player.base.id,
@@ -305,153 +488,58 @@ static void handle_socket_event(void)
                 event_system_fire(EVENT_CODE_PLAYER_INIT, (event_data_t){0});
             } break;
             case PACKET_TYPE_PLAYER_ADD: {
-                received_data_size = PACKET_TYPE_SIZE[PACKET_TYPE_PLAYER_ADD];
-                packet_player_add_t *player_add = (packet_player_add_t *)(buffer + PACKET_TYPE_SIZE[PACKET_TYPE_HEADER]);
-
-                b8 found_free_slot = false;
-                for (i32 i = 0; i < MAX_PLAYER_COUNT; i++) {
-                    if (remote_players[i].base.id == PLAYER_INVALID_ID) { /* Free slot */
-                        LOG_INFO("adding new remote player id=%u", player_add->id);
-                        player_remote_create(player_add, &remote_players[i]);
-                        remote_player_count++;
-                        found_free_slot = true;
-                        break;
-                    }
-                }
-                if (!found_free_slot) {
-                    LOG_ERROR("failed to add new remote player, no free slots - remote_player_count=%u", remote_player_count);
+                packet_player_add_t *player_add = &packet.player_add;
+
+                pthread_mutex_lock(&remote_players_lock);
+                player_remote_t *remote_player = id_table_insert(&remote_players, player_add->id);
+                if (remote_player != NULL) {
+                    LOG_INFO("adding new remote player id=%u", player_add->id);
+                    player_remote_create(player_add, remote_player);
+                    apply_latest_player_snapshot(remote_player);
+                } else {
+                    LOG_ERROR("failed to add new remote player, id=%u is already taken", player_add->id);
                 }
+                pthread_mutex_unlock(&remote_players_lock);
             } break;
             case PACKET_TYPE_PLAYER_REMOVE: {
-                received_data_size = PACKET_TYPE_SIZE[PACKET_TYPE_PLAYER_REMOVE];
-                packet_player_remove_t *player_remove = (packet_player_remove_t *)(buffer + PACKET_TYPE_SIZE[PACKET_TYPE_HEADER]);
-                b8 found_player_to_remove = false;
-                for (i32 i = 0; i < MAX_PLAYER_COUNT; i++) {
-                    if (remote_players[i].base.id == player_remove->id) {
-                        remote_players[i].base.id = PLAYER_INVALID_ID;
-                        found_player_to_remove = true;
-                        break;
-                    }
-                }
+                packet_player_remove_t *player_remove = &packet.player_remove;
+                pthread_mutex_lock(&remote_players_lock);
+                b8 found_player_to_remove = id_table_remove(&remote_players, player_remove->id);
+                pthread_mutex_unlock(&remote_players_lock);
                 if (!found_player_to_remove) {
                     LOG_ERROR("failed to find player to remove with id=%u", player_remove->id);
                 } else {
                     LOG_INFO("removed player with id=%d", player_remove->id);
                 }
             } break;
-            case PACKET_TYPE_PLAYER_UPDATE: {
-                received_data_size = PACKET_TYPE_SIZE[PACKET_TYPE_PLAYER_UPDATE];
-                packet_player_update_t *player_update = (packet_player_update_t *)(buffer + PACKET_TYPE_SIZE[PACKET_TYPE_HEADER]);
-
-                if (player_update->id == self_player.base.id) {
-                    player_self_handle_authoritative_update(&self_player, player_update);
-                    break;
-                }
-
-                b8 found_player_to_update = false;
-                for (i32 i = 0; i < MAX_PLAYER_COUNT; i++) {
-                    if (remote_players[i].base.id == player_update->id) {
-                        player_remote_handle_authoritative_update(&remote_players[i], player_update);
-                        found_player_to_update = true;
-                        server_update_accumulator = 0.0f;
-                        break;
-                    }
-                }
-                if (!found_player_to_update) {
-                    LOG_ERROR("failed to update player with id=%u", player_update->id);
-                }
+            case PACKET_TYPE_PLAYER_SNAPSHOT: {
+                handle_player_snapshot(&packet.player_snapshot);
             } break;
-            case PACKET_TYPE_PLAYER_HEALTH: {
-                received_data_size = PACKET_TYPE_SIZE[PACKET_TYPE_PLAYER_HEALTH];
-                packet_player_health_t *player_health_packet = (packet_player_health_t *)(buffer + PACKET_TYPE_SIZE[PACKET_TYPE_HEADER]);
-
-                if (player_health_packet->id == self_player.base.id) {
-                    player_take_damage(&self_player.base, player_health_packet->damage);
-                    break;
-                }
-
-                b8 found_player_to_update = false;
-                for (i32 i = 0; i < MAX_PLAYER_COUNT; i++) {
-                    if (remote_players[i].base.id == player_health_packet->id) {
-                        player_take_damage(&remote_players[i].base, player_health_packet->damage);
-                        found_player_to_update = true;
-                        break;
-                    }
-                }
-                if (!found_player_to_update) {
-                    LOG_ERROR("failed to update health of player with id=%u", player_health_packet->id);
-                }
-            } break;
-            case PACKET_TYPE_PLAYER_DEATH: {
-                received_data_size = PACKET_TYPE_SIZE[PACKET_TYPE_PLAYER_DEATH];
-                packet_player_death_t *player_death_packet = (packet_player_death_t *)(buffer + PACKET_TYPE_SIZE[PACKET_TYPE_HEADER]);
-
-                if (player_death_packet->id == self_player.base.id) {
-                    if (self_player.base.state != PLAYER_STATE_DEAD) {
-                        self_player.base.state = PLAYER_STATE_DEAD;
-                        self_player.base.animation.player.keyframe_index = 0;
-                        self_player.base.animation.player.accumulator = 0.0f;
-                    }
-                    break;
-                }
-
-                b8 found_player_to_update = false;
-                for (i32 i = 0; i < MAX_PLAYER_COUNT; i++) {
-                    if (remote_players[i].base.id == player_death_packet->id) {
-                        if (remote_players[i].base.state != PLAYER_STATE_DEAD) {
-                            remote_players[i].base.state = PLAYER_STATE_DEAD;
-                            remote_players[i].base.animation.player.keyframe_index = 0;
-                            remote_players[i].base.animation.player.accumulator = 0.0f;
-                        }
-                        found_player_to_update = true;
-                        break;
-                    }
-                }
-                if (!found_player_to_update) {
-                    LOG_ERROR("failed to update death of player with id=%u", player_death_packet->id);
-                }
-            } break;
-            case PACKET_TYPE_PLAYER_RESPAWN: {
-                received_data_size = PACKET_TYPE_SIZE[PACKET_TYPE_PLAYER_RESPAWN];
-                packet_player_respawn_t *player_respawn_packet = (packet_player_respawn_t *)(buffer + PACKET_TYPE_SIZE[PACKET_TYPE_HEADER]);
-
-                if (player_respawn_packet->id == self_player.base.id) {
-                    player_respawn(&self_player.base, player_respawn_packet);
-                    break;
-                }
-
-                b8 found_player_to_update = false;
-                for (i32 i = 0; i < MAX_PLAYER_COUNT; i++) {
-                    if (remote_players[i].base.id == player_respawn_packet->id) {
-                        player_respawn(&remote_players[i].base, player_respawn_packet);
-                        found_player_to_update = true;
-                        break;
-                    }
-                }
-                if (!found_player_to_update) {
-                    LOG_ERROR("failed to update respawn of player with id=%u", player_respawn_packet->id);
-                }
+            case PACKET_TYPE_UDP_OFFER: {
+                handle_udp_offer(&packet.udp_offer);
             } break;
             case PACKET_TYPE_GAME_WORLD_INIT: {
-                received_data_size = PACKET_TYPE_SIZE[PACKET_TYPE_GAME_WORLD_INIT];
-                packet_game_world_init_t *game_world_init_packet = (packet_game_world_init_t *)(buffer + PACKET_TYPE_SIZE[PACKET_TYPE_HEADER]);
+                packet_game_world_init_t *game_world_init_packet = &packet.game_world_init;
 
-                LOG_TRACE("game world init packet received: seed=%u, octave_count=%i, bias=%.2f",
+                LOG_TRACE("game world init packet received: seed=%u, octave_count=%i, bias=%.2f, chunk_streaming_mode=%u",
                           game_world_init_packet->map.seed,
                           game_world_init_packet->map.octave_count,
-                          game_world_init_packet->map.bias);
+                          game_world_init_packet->map.bias,
+                          game_world_init_packet->chunk_streaming_mode);
 
                 game_world_init(game_world_init_packet, &game_world);
                 event_system_fire(EVENT_CODE_GAME_WORLD_INIT, (event_data_t){0});
             } break;
             case PACKET_TYPE_GAME_WORLD_OBJECT_REMOVE: {
-                received_data_size = PACKET_TYPE_SIZE[PACKET_TYPE_GAME_WORLD_OBJECT_REMOVE];
-                packet_game_world_object_remove_t *game_world_object_remove_packet = (packet_game_world_object_remove_t *)(buffer + PACKET_TYPE_SIZE[PACKET_TYPE_HEADER]);
+                packet_game_world_object_remove_t *game_world_object_remove_packet = &packet.game_world_object_remove;
                 game_world_remove_object(&game_world, game_world_object_remove_packet);
             } break;
+            case PACKET_TYPE_CHUNK_DELTA: {
+                packet_chunk_delta_t *chunk_delta_packet = &packet.chunk_delta;
+                game_world_apply_chunk_delta(&game_world, chunk_delta_packet);
+            } break;
             case PACKET_TYPE_CHUNK_RESPONSE: {
-                received_data_size = PACKET_TYPE_SIZE[PACKET_TYPE_CHUNK_RESPONSE];
-                packet_chunk_response_t *response = (packet_chunk_response_t *)(buffer + PACKET_TYPE_SIZE[PACKET_TYPE_HEADER]);
+                packet_chunk_response_t *response = &packet.chunk_response;
                 void *packet_memory_addr = mem_alloc(sizeof(packet_chunk_response_t), MEMORY_TAG_NETWORK);
                 mem_copy(packet_memory_addr, response, sizeof(packet_chunk_response_t));
                 event_system_fire(EVENT_CODE_CHUNK_RECEIVED, (event_data_t){ .u64[0] = (u64)packet_memory_addr });
@@ -461,18 +549,14 @@ static void handle_socket_event(void)
             }
         }
 
-        u64 parsed_packet_size = PACKET_TYPE_SIZE[PACKET_TYPE_HEADER] + received_data_size;
-        buffer = (buffer + parsed_packet_size);
-        bytes_read -= parsed_packet_size;
-        packet_header_t *next_header = (packet_header_t *)buffer;
-        if (next_header->type <= PACKET_TYPE_NONE || next_header->type >= PACKET_TYPE_COUNT) {
-            break;
-        }
+        recv_buffer_consume(&server_recv_buffer, packet_size);
     }
 }
 
 static void *handle_networking(void *args)
 {
+    recv_buffer_create(SERVER_RECV_BUFFER_SIZE, &server_recv_buffer);
+
     while (connected) {
         i32 num_events = poll(pfds, POLLFD_COUNT, POLL_INFINITE_TIMEOUT);
 
@@ -491,6 +575,8 @@ static void *handle_networking(void *args)
                     handle_stdin_event();
                 } else if (pfds[i].fd == client_socket) { /* Server trying to send data */
                     handle_socket_event();
+                } else if (pfds[i].fd == udp_channel_get_socket()) { /* Snapshots and hello echo */
+                    handle_datagram_event();
                 }
             }
         }
@@ -502,6 +588,7 @@ static void *handle_networking(void *args)
         LOG_INFO("closed client socket");
     }
 
+    recv_buffer_destroy(&server_recv_buffer);
     return NULL;
 }
 
@@ -960,6 +1047,9 @@ static b8 client_attempt_connection(const char *ip, const char *port)
     pfds[1].fd = client_socket;
     pfds[1].events = POLLIN;
 
+    pfds[2].fd = -1; /* Ignored by poll until the server offers a UDP channel */
+    pfds[2].events = POLLIN;
+
     struct sigaction sa;
     sa.sa_flags = SA_RESTART; // Restart functions interruptable by EINTR like poll()
     sa.sa_handler = &signal_handler;
@@ -996,6 +1086,9 @@ static void client_init_game_resources(void)
 
     camera_create(&game_camera, vec2_zero());
 
+    id_table_create(sizeof(player_remote_t), REMOTE_PLAYER_TABLE_INITIAL_CAPACITY, &remote_players);
+    snapshot_history_reset(&snapshot_history);
+
     chat_init();
     player_load_animations();
 }
@@ -1041,6 +1134,10 @@ static void client_shutdown_game_resources(void)
 
     pthread_kill(network_thread, SIGUSR1);
     pthread_join(network_thread, NULL);
+
+    udp_channel_close();
+    datagram_shim_shutdown();
+    id_table_destroy(&remote_players);
 }
 
 static void run_connected_client(f64 delta_time)
@@ -1057,6 +1154,8 @@ static void run_connected_client(f64 delta_time)
         client_update_accumulator = 0.0f;
     }
 
+    udp_channel_update();
+
     renderer_reset_stats();
     renderer_clear_screen(vec4_create(0.3f, 0.3f, 0.3f, 1.0f));
 
@@ -1068,11 +1167,11 @@ static void run_connected_client(f64 delta_time)
     }
 
     // Render all other players
-    for (i32 i = 0; i < MAX_PLAYER_COUNT; i++) {
-        if (remote_players[i].base.id != PLAYER_INVALID_ID) {
-            player_remote_render(&remote_players[i], delta_time, server_update_accumulator);
-        }
+    pthread_mutex_lock(&remote_players_lock);
+    for (u64 i = 0; i < id_table_length(&remote_players); i++) {
+        player_remote_render(id_table_at(&remote_players, i), delta_time, server_update_accumulator);
     }
+    pthread_mutex_unlock(&remote_players_lock);
 
     // Render ourselves
     if (self_player.base.id != PLAYER_INVALID_ID) {
@@ -1171,6 +1270,16 @@ int main(int argc, char *argv[])
 
     mem_copy(username, argv[1], strlen(argv[1]));
 
+    const char *shim_spec = getenv(DATAGRAM_SHIM_ENV);
+    if (shim_spec != NULL) {
+        datagram_shim_config_t shim_config;
+        if (!datagram_shim_parse(shim_spec, &shim_config)) {
+            LOG_FATAL("invalid %s='%s'", DATAGRAM_SHIM_ENV, shim_spec);
+            exit(EXIT_FAILURE);
+        }
+        datagram_shim_configure(&shim_config);
+    }
+
     if (!window_create(DEFAULT_WINDOW_WIDTH, DEFAULT_WINDOW_HEIGHT, "StarLore")) {
         LOG_ERROR("failed to create window");
         exit(EXIT_FAILURE);
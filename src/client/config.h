@@ -5,12 +5,13 @@
 
 #define VSYNC_ENABLED 1
 
-#define INPUT_BUFFER_SIZE    KiB(8)
-#define OVERFLOW_BUFFER_SIZE KiB(4)
+#define INPUT_BUFFER_SIZE       KiB(8)
+#define SERVER_RECV_BUFFER_SIZE KiB(16) /* Must fit the largest packet the server sends, header included */
 
 #define PLAYER_ANIMATION_FPS 10
 #define PLAYER_KEYPRESS_RING_BUFFER_CAPACITY 256
 #define PLAYER_DAMAGED_HIGHLIGHT_DURATION 0.2f
+#define REMOTE_PLAYER_TABLE_INITIAL_CAPACITY 64
 
 #define CAMERA_MOVE_SPEED_PPS 1200
 #define CAMERA_MOVE_BORDER_OFFSET 5
@@ -21,6 +22,10 @@
 
 #define CHUNK_CACHE_MAX_ITEMS 48
 
+#define CLIENT_UDP_ENABLED 1 /* Accept the server's UDP offer and move input and snapshots over to it */
+#define UDP_CHANNEL_HELLO_INTERVAL_MS 100
+#define UDP_CHANNEL_HELLO_ATTEMPTS    20
+
 #define LOG_TEXTURE_CREATE               0
 #define LOG_REACH_CHUNK_CACHE_SIZE_LIMIT 0
 #define LOG_CHUNK_TRANSACTIONS           0
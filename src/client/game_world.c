@@ -12,6 +12,7 @@
 #include "common/logger.h"
 #include "common/asserts.h"
 #include "common/input_codes.h"
+#include "common/terrain.h"
 #include "common/perlin_noise.h"
 #include "common/memory/memutils.h"
 #include "common/containers/darray.h"
@@ -32,6 +33,10 @@ static chunk_t *chunks;
 static texture_t terrain_spritesheet;
 static texture_t vegetation_spritesheet;
 static pending_chunk_data_t *pending_chunk_requests;
+static packet_chunk_request_t *queued_chunk_requests; /* Missing chunks found this frame, sent in batches after rendering */
+static vec2 chunk_request_origin; /* Camera position the queued requests are ordered by */
+static chunk_streaming_mode_e chunk_streaming_mode;
+static terrain_generator_t terrain; /* Only used with CHUNK_STREAMING_MODE_SEED */
 
 #if defined(DEBUG)
 static b8 show_grid_coords = false;
@@ -53,6 +58,11 @@ void game_world_init(packet_game_world_init_t *packet, game_world_t *out_game_wo
     ASSERT(out_game_world);
 
     mem_copy(&out_game_world->map, &packet->map, sizeof(game_map_t));
+
+    chunk_streaming_mode = packet->chunk_streaming_mode;
+    if (chunk_streaming_mode == CHUNK_STREAMING_MODE_SEED) {
+        terrain_generator_create(packet->map, &terrain);
+    }
 }
 
 void game_world_destroy(game_world_t *game_world)
@@ -65,6 +75,8 @@ void game_world_destroy(game_world_t *game_world)
 #endif
 
     darray_destroy(chunks);
+    darray_destroy(pending_chunk_requests);
+    darray_destroy(queued_chunk_requests);
     texture_destroy(&terrain_spritesheet);
     texture_destroy(&vegetation_spritesheet);
 }
@@ -73,6 +85,7 @@ void game_world_load_resources(game_world_t *game_world)
 {
     chunks = darray_create(sizeof(chunk_t));
     pending_chunk_requests = darray_create(sizeof(pending_chunk_data_t));
+    queued_chunk_requests = darray_create(sizeof(packet_chunk_request_t));
     load_textures();
 }
 
@@ -184,10 +197,38 @@ void game_world_remove_object(game_world_t *game_world, packet_game_world_object
         chunk_t *chunk = &chunks[i];
         if (chunk->base.x == packet->chunk_x && chunk->base.y == packet->chunk_y) {
             chunk->base.tiles[packet->tile_idx].object_index = INVALID_OBJECT_INDEX;
+            // If earlier modifications were missed, keep the old revision so the pending delta still gets applied
+            if (packet->revision == chunk->base.revision + 1) {
+                chunk->base.revision = packet->revision;
+            }
         }
     }
 }
 
+void game_world_apply_chunk_delta(game_world_t *game_world, packet_chunk_delta_t *packet)
+{
+    u64 chunks_length = darray_length(chunks);
+    for (u64 i = 0; i < chunks_length; i++) {
+        chunk_t *chunk = &chunks[i];
+        if (chunk->base.x != packet->x || chunk->base.y != packet->y) {
+            continue;
+        }
+
+        if (packet->revision > chunk->base.revision) {
+            for (u32 j = 0; j < packet->removed_object_count; j++) {
+                chunk->base.tiles[packet->removed_object_tiles[j]].object_index = INVALID_OBJECT_INDEX;
+            }
+            chunk->base.revision = packet->revision;
+        }
+        return;
+    }
+
+    // Evicted in the meantime, the delta is requested again together with the regenerated chunk
+#if LOG_CHUNK_TRANSACTIONS
+    LOG_TRACE("dropped delta for chunk %i:%i which is no longer cached", packet->x, packet->y);
+#endif
+}
+
 static void game_world_render_chunk(chunk_t *chunk, i32 x, i32 y)
 {
 #if defined(DEBUG)
@@ -254,32 +295,89 @@ static void game_world_render_pending_chunk(i32 x, i32 y)
     renderer_draw_text(message, FA64, text_position, 1.0f, COLOR_MILK, 1.0f);
 }
 
-static void game_world_request_chunk(game_world_t *game_world, i32 x, i32 y)
+/* Queues the chunk for the next batch request. Returns it right away with CHUNK_STREAMING_MODE_SEED,
+   otherwise NULL until the response arrives */
+static chunk_t *game_world_request_chunk(game_world_t *game_world, i32 x, i32 y, const camera_t *const camera)
 {
+    packet_chunk_request_t request = { .x = x, .y = y };
+
+    if (chunk_streaming_mode == CHUNK_STREAMING_MODE_SEED) {
+        // Terrain is available right away, the request only asks the server for modifications of the chunk
+        chunk_base_t generated_chunk;
+        terrain_generate_chunk(&terrain, x, y, &generated_chunk);
+        game_world_add_chunk(&generated_chunk, camera);
+        darray_push(queued_chunk_requests, request);
+
+        u64 chunks_length = darray_length(chunks);
+        for (u64 i = 0; i < chunks_length; i++) {
+            if (chunks[i].base.x == x && chunks[i].base.y == y) {
+                return &chunks[i];
+            }
+        }
+        return NULL;
+    }
+
     u64 pending_requests_length = darray_length(pending_chunk_requests);
     for (u64 i = 0; i < pending_requests_length; i++) {
         pending_chunk_data_t *pending_chunk = &pending_chunk_requests[i];
         if (pending_chunk->x == x && pending_chunk->y == y) {
             // Requested chunk is already pending to be received
-            return;
+            return NULL;
         }
     }
 
-    packet_chunk_request_t request = { .x = x, .y = y };
-    if (!packet_send(client_socket, PACKET_TYPE_CHUNK_REQUEST, &request)) {
-        LOG_ERROR("failed to send chunk request packet");
-    }
-#if LOG_CHUNK_TRANSACTIONS
-    else {
-        LOG_TRACE("send request for chunk %i:%i", x, y);
-    }
-#endif
+    darray_push(queued_chunk_requests, request);
 
     pending_chunk_data_t new_pending_chunk = { .x = x, .y = y };
     darray_push(pending_chunk_requests, new_pending_chunk);
 #if LOG_CHUNK_TRANSACTIONS
     LOG_TRACE("pushed pending data for chunk %i:%i", x, y);
 #endif
+    return NULL;
+}
+
+static f32 chunk_request_distance_squared(const packet_chunk_request_t *request)
+{
+    f32 dx = request->x * CHUNK_WIDTH_PX  - chunk_request_origin.x;
+    f32 dy = request->y * CHUNK_HEIGHT_PX - chunk_request_origin.y;
+    return dx*dx + dy*dy;
+}
+
+static i32 compare_chunk_requests(const void *a, const void *b)
+{
+    f32 distance_a = chunk_request_distance_squared(a);
+    f32 distance_b = chunk_request_distance_squared(b);
+    return (distance_a > distance_b) - (distance_a < distance_b);
+}
+
+/* Sends the chunks queued this frame nearest to the camera first, the server streams them back in that order */
+static void game_world_send_chunk_requests(const camera_t *const camera)
+{
+    u64 queued_count = darray_length(queued_chunk_requests);
+    if (queued_count == 0) {
+        return;
+    }
+
+    chunk_request_origin = camera->position;
+    qsort(queued_chunk_requests, queued_count, sizeof(packet_chunk_request_t), compare_chunk_requests);
+
+    for (u64 first = 0; first < queued_count; first += CHUNK_BATCH_REQUEST_MAX_COUNT) {
+        u64 remaining = queued_count - first;
+        packet_chunk_batch_request_t batch;
+        batch.count = remaining < CHUNK_BATCH_REQUEST_MAX_COUNT ? remaining : CHUNK_BATCH_REQUEST_MAX_COUNT;
+        mem_copy(batch.chunks, &queued_chunk_requests[first], sizeof(packet_chunk_request_t) * batch.count);
+
+        if (!packet_send(client_socket, PACKET_TYPE_CHUNK_BATCH_REQUEST, &batch)) {
+            LOG_ERROR("failed to send chunk batch request packet");
+        }
+#if LOG_CHUNK_TRANSACTIONS
+        else {
+            LOG_TRACE("sent batch request for %u chunks", batch.count);
+        }
+#endif
+    }
+
+    darray_clear(queued_chunk_requests);
 }
 
 void game_world_render(game_world_t *game_world, const camera_t *const camera)
@@ -304,7 +402,10 @@ void game_world_render(game_world_t *game_world, const camera_t *const camera)
             }
 
             if (chunk == NULL) {
-                game_world_request_chunk(game_world, x, y);
+                chunk = game_world_request_chunk(game_world, x, y, camera);
+            }
+
+            if (chunk == NULL) {
                 game_world_render_pending_chunk(x, y);
             } else {
                 game_world_render_chunk(chunk, x, y);
@@ -312,6 +413,8 @@ void game_world_render(game_world_t *game_world, const camera_t *const camera)
         }
     }
 
+    game_world_send_chunk_requests(camera);
+
 #if defined(DEBUG)
     if (show_grid_coords) {
         u64 chunks_length = darray_length(chunks);
@@ -8,6 +8,7 @@
 #include "texture.h"
 #include "renderer.h"
 #include "color_palette.h"
+#include "udp_channel.h"
 #include "common/global.h"
 #include "common/asserts.h"
 #include "common/logger.h"
@@ -327,7 +328,8 @@ void player_self_update(player_self_t *player, f64 delta_time)
         return;
     }
 
-    if (!packet_send(client_socket, PACKET_TYPE_PLAYER_KEYPRESS, &player_keypress_packet)) {
+    if (!udp_channel_send_keypress(&player_keypress_packet) &&
+        !packet_send(client_socket, PACKET_TYPE_PLAYER_KEYPRESS, &player_keypress_packet)) {
         LOG_ERROR("failed to send player keypress packet");
     }
 }
@@ -552,17 +554,17 @@ void player_remote_render(player_remote_t *player, f64 delta_time, f32 server_up
     renderer_draw_text(buffer, FA16, username_position, 1.0f, COLOR_MILK, 1.0f);
 }
 
-void player_respawn(player_base_t *player, packet_player_respawn_t *packet)
+void player_respawn(player_base_t *player, const snapshot_player_t *snapshot_player)
 {
     if (player->state != PLAYER_STATE_DEAD) {
         LOG_WARN("tried to respawn player (id=%u) but not dead", player->id);
         return;
     }
 
-    player->state = packet->state;
-    player->health = packet->health;
-    player->position = packet->position;
-    player->direction = packet->direction;
+    player->state = snapshot_player->state;
+    player->health = snapshot_player->health;
+    player->position = snapshot_player_position(snapshot_player);
+    player->direction = snapshot_player->direction;
 
     player->animation.player.keyframe_index = 0;
     player->animation.player.accumulator = 0.0f;
@@ -2,6 +2,7 @@
 
 #include "event.h"
 #include "common/packet.h"
+#include "common/snapshot.h"
 #include "common/player_types.h"
 
 void player_load_animations(void);
@@ -21,7 +22,7 @@ void player_take_damage(player_base_t *player, u32 damage);
 void player_self_render(player_self_t *player, f64 delta_time);
 void player_remote_render(player_remote_t *player, f64 delta_time, f32 server_update_accumulator);
 
-void player_respawn(player_base_t *player, packet_player_respawn_t *packet);
+void player_respawn(player_base_t *player, const snapshot_player_t *snapshot_player);
 
 b8 player_key_pressed_event_callback(event_code_e code, event_data_t data);
 b8 player_key_released_event_callback(event_code_e code, event_data_t data);
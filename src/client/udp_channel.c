@@ -0,0 +1,167 @@
+#include "udp_channel.h"
+
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <sys/socket.h>
+
+#include "config.h"
+#include "common/net.h"
+#include "common/clock.h"
+#include "common/logger.h"
+#include "common/datagram.h"
+#include "common/memory/memutils.h"
+
+typedef enum {
+    UDP_CHANNEL_STATE_CLOSED,
+    UDP_CHANNEL_STATE_OFFERED,     /* Hello is being sent, no echo yet */
+    UDP_CHANNEL_STATE_ESTABLISHED,
+} udp_channel_state_e;
+
+/* Socket and token are written before the state, which is what the main loop looks at */
+static _Atomic udp_channel_state_e state = UDP_CHANNEL_STATE_CLOSED;
+static i32 udp_socket = -1;
+static u64 udp_token;
+
+/* Only touched by the main loop */
+static u64 last_hello_time;
+static u32 hello_attempts;
+static packet_player_input_t recent_input;
+
+b8 udp_channel_open(i32 tcp_socket, u64 token)
+{
+    if (state != UDP_CHANNEL_STATE_CLOSED) {
+        LOG_WARN("received another UDP offer, keeping the current channel");
+        return false;
+    }
+
+    // Datagrams go to the same address and port the TCP connection was made to
+    struct sockaddr_storage server_address;
+    socklen_t server_address_length = sizeof(server_address);
+    if (getpeername(tcp_socket, (struct sockaddr *)&server_address, &server_address_length) == -1) {
+        LOG_ERROR("getpeername error: %s", strerror(errno));
+        return false;
+    }
+
+    i32 new_socket = socket(server_address.ss_family, SOCK_DGRAM, 0);
+    if (new_socket == -1) {
+        LOG_ERROR("failed to create UDP socket: %s", strerror(errno));
+        return false;
+    }
+
+    // Connecting filters out datagrams from anyone else and lets us send without an address
+    if (connect(new_socket, (struct sockaddr *)&server_address, server_address_length) == -1 ||
+        !net_set_nonblocking(new_socket)) {
+        LOG_ERROR("failed to set up UDP socket: %s", strerror(errno));
+        close(new_socket);
+        return false;
+    }
+
+    udp_socket = new_socket;
+    udp_token = token;
+    state = UDP_CHANNEL_STATE_OFFERED;
+    return true;
+}
+
+void udp_channel_close(void)
+{
+    if (udp_socket != -1) {
+        close(udp_socket);
+    }
+
+    state = UDP_CHANNEL_STATE_CLOSED;
+    udp_socket = -1;
+    udp_token = 0;
+}
+
+i32 udp_channel_get_socket(void)
+{
+    return udp_socket;
+}
+
+b8 udp_channel_is_established(void)
+{
+    return state == UDP_CHANNEL_STATE_ESTABLISHED;
+}
+
+void udp_channel_update(void)
+{
+    datagram_shim_flush();
+
+    if (state != UDP_CHANNEL_STATE_OFFERED) {
+        return;
+    }
+
+    u64 now = clock_get_absolute_time_ns();
+    if (now - last_hello_time < UDP_CHANNEL_HELLO_INTERVAL_MS * 1000000ULL) {
+        return;
+    }
+
+    if (hello_attempts == UDP_CHANNEL_HELLO_ATTEMPTS) {
+        // Most likely blocked somewhere on the way, TCP keeps working on its own
+        LOG_WARN("no answer to %u UDP hellos, staying on TCP", hello_attempts);
+        hello_attempts++;
+        return;
+    } else if (hello_attempts > UDP_CHANNEL_HELLO_ATTEMPTS) {
+        return;
+    }
+
+    packet_udp_hello_t hello_packet = { .time = now };
+    datagram_send(udp_socket, udp_token, PACKET_TYPE_UDP_HELLO, &hello_packet, NULL, 0);
+    last_hello_time = now;
+    hello_attempts++;
+}
+
+b8 udp_channel_receive(u8 *buffer, u32 capacity, u32 *out_type, const u8 **out_payload, u32 *out_payload_size)
+{
+    for (;;) {
+        i64 size = net_recv_from(udp_socket, buffer, capacity, NULL, NULL);
+        if (size == -1) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                // e.g. ECONNREFUSED bounced back from an earlier datagram, the next read may succeed
+                LOG_TRACE("UDP recv error: %s", strerror(errno));
+            }
+            return false;
+        }
+
+        u64 token;
+        if (datagram_decode(buffer, (u32)size, &token, out_type, out_payload, out_payload_size) && token == udp_token) {
+            return true;
+        }
+    }
+}
+
+void udp_channel_handle_hello(const packet_udp_hello_t *packet)
+{
+    if (state != UDP_CHANNEL_STATE_OFFERED) {
+        return; // Echo of a repeated hello
+    }
+
+    f64 rtt_ms = (clock_get_absolute_time_ns() - packet->time) / 1000000.0;
+    LOG_INFO("UDP channel established, rtt = %fms", rtt_ms);
+    state = UDP_CHANNEL_STATE_ESTABLISHED;
+}
+
+b8 udp_channel_send(u32 type, void *packet_data)
+{
+    if (state != UDP_CHANNEL_STATE_ESTABLISHED) {
+        return false;
+    }
+
+    // A datagram which could not be sent is no different from one lost on the way
+    datagram_send(udp_socket, udp_token, type, packet_data, NULL, 0);
+    return true;
+}
+
+b8 udp_channel_send_keypress(const packet_player_keypress_t *keypress)
+{
+    // Every datagram repeats the latest keypresses, so a single lost one costs nothing
+    if (recent_input.count == PLAYER_INPUT_REDUNDANCY) {
+        mem_move(&recent_input.keypresses[0], &recent_input.keypresses[1], (PLAYER_INPUT_REDUNDANCY - 1) * sizeof(packet_player_keypress_t));
+        recent_input.count--;
+    }
+    recent_input.keypresses[recent_input.count++] = *keypress;
+
+    return udp_channel_send(PACKET_TYPE_PLAYER_INPUT, &recent_input);
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include "defines.h"
+#include "common/packet.h"
+
+/*
+ * Client end of the UDP channel offered by the server during the handshake (see common/datagram.h).
+ * The network thread opens it and receives on it, the main loop sends input through it and keeps
+ * repeating the hello until the server echoes it. Until then, or if it never does, everything keeps
+ * going over TCP.
+ */
+
+b8   udp_channel_open(i32 tcp_socket, u64 token);
+void udp_channel_close(void);
+i32  udp_channel_get_socket(void); /* -1 while closed, for polling */
+b8   udp_channel_is_established(void);
+void udp_channel_update(void);
+
+/* Reads the next datagram carrying our token, returns false once there is nothing left to read */
+b8   udp_channel_receive(u8 *buffer, u32 capacity, u32 *out_type, const u8 **out_payload, u32 *out_payload_size);
+void udp_channel_handle_hello(const packet_udp_hello_t *packet);
+
+/* Both return false when the packet has to be sent over TCP instead */
+b8   udp_channel_send(u32 type, void *packet_data);
+b8   udp_channel_send_keypress(const packet_player_keypress_t *keypress);
@@ -0,0 +1,169 @@
+#include "hashmap.h"
+
+#include <stddef.h>
+
+#include "common/asserts.h"
+#include "common/memory/memutils.h"
+
+/* splitmix64 finalizer - packed coordinates and sequential ids are far from uniformly distributed */
+INLINE u64 hash_u64(u64 key)
+{
+    key ^= key >> 30;
+    key *= 0xBF58476D1CE4E5B9ULL;
+    key ^= key >> 27;
+    key *= 0x94D049BB133111EBULL;
+    key ^= key >> 31;
+    return key;
+}
+
+static u64 round_up_power_of_two(u64 value)
+{
+    u64 result = 1;
+    while (result < value) {
+        result <<= 1;
+    }
+    return result;
+}
+
+static void hashmap_insert_entry(hashmap_t *hashmap, u64 key, u64 value)
+{
+    u64 mask = hashmap->capacity - 1;
+    u64 index = hash_u64(key) & mask;
+    for (;;) {
+        hashmap_entry_t *entry = &hashmap->entries[index];
+        if (!entry->occupied) {
+            entry->key = key;
+            entry->value = value;
+            entry->occupied = true;
+            hashmap->length++;
+            return;
+        }
+        if (entry->key == key) {
+            entry->value = value;
+            return;
+        }
+        index = (index + 1) & mask;
+    }
+}
+
+static void hashmap_grow(hashmap_t *hashmap)
+{
+    u64 old_capacity = hashmap->capacity;
+    hashmap_entry_t *old_entries = hashmap->entries;
+
+    hashmap->capacity = old_capacity * 2;
+    hashmap->length = 0;
+    hashmap->entries = mem_alloc(hashmap->capacity * sizeof(hashmap_entry_t), MEMORY_TAG_HASHTABLE);
+
+    for (u64 i = 0; i < old_capacity; i++) {
+        if (old_entries[i].occupied) {
+            hashmap_insert_entry(hashmap, old_entries[i].key, old_entries[i].value);
+        }
+    }
+
+    mem_free(old_entries, old_capacity * sizeof(hashmap_entry_t), MEMORY_TAG_HASHTABLE);
+}
+
+void hashmap_create(u64 initial_capacity, hashmap_t *out_hashmap)
+{
+    ASSERT(out_hashmap);
+
+    if (initial_capacity < 2) {
+        initial_capacity = 2;
+    }
+
+    out_hashmap->capacity = round_up_power_of_two(initial_capacity);
+    out_hashmap->length = 0;
+    // mem_alloc hands out zeroed memory, so every entry starts unoccupied
+    out_hashmap->entries = mem_alloc(out_hashmap->capacity * sizeof(hashmap_entry_t), MEMORY_TAG_HASHTABLE);
+}
+
+void hashmap_destroy(hashmap_t *hashmap)
+{
+    ASSERT(hashmap && hashmap->entries);
+
+    mem_free(hashmap->entries, hashmap->capacity * sizeof(hashmap_entry_t), MEMORY_TAG_HASHTABLE);
+    hashmap->entries = NULL;
+    hashmap->capacity = 0;
+    hashmap->length = 0;
+}
+
+void hashmap_set(hashmap_t *hashmap, u64 key, u64 value)
+{
+    ASSERT(hashmap && hashmap->entries);
+
+    if ((hashmap->length + 1) * 100 > hashmap->capacity * HASHMAP_MAX_LOAD_PERCENT) {
+        hashmap_grow(hashmap);
+    }
+
+    hashmap_insert_entry(hashmap, key, value);
+}
+
+b8 hashmap_get(hashmap_t *hashmap, u64 key, u64 *out_value)
+{
+    ASSERT(hashmap && hashmap->entries);
+
+    u64 mask = hashmap->capacity - 1;
+    u64 index = hash_u64(key) & mask;
+    for (;;) {
+        hashmap_entry_t *entry = &hashmap->entries[index];
+        if (!entry->occupied) {
+            return false;
+        }
+        if (entry->key == key) {
+            if (out_value) {
+                *out_value = entry->value;
+            }
+            return true;
+        }
+        index = (index + 1) & mask;
+    }
+}
+
+b8 hashmap_remove(hashmap_t *hashmap, u64 key)
+{
+    ASSERT(hashmap && hashmap->entries);
+
+    u64 mask = hashmap->capacity - 1;
+    u64 index = hash_u64(key) & mask;
+    for (;;) {
+        hashmap_entry_t *entry = &hashmap->entries[index];
+        if (!entry->occupied) {
+            return false;
+        }
+        if (entry->key == key) {
+            break;
+        }
+        index = (index + 1) & mask;
+    }
+
+    // Shift following entries of the cluster back into the hole unless that would move them before their home slot
+    u64 hole = index;
+    u64 next = (hole + 1) & mask;
+    while (hashmap->entries[next].occupied) {
+        u64 home = hash_u64(hashmap->entries[next].key) & mask;
+        if (((next - home) & mask) >= ((next - hole) & mask)) {
+            hashmap->entries[hole] = hashmap->entries[next];
+            hole = next;
+        }
+        next = (next + 1) & mask;
+    }
+
+    hashmap->entries[hole].occupied = false;
+    hashmap->length--;
+    return true;
+}
+
+void hashmap_clear(hashmap_t *hashmap)
+{
+    ASSERT(hashmap && hashmap->entries);
+
+    mem_zero(hashmap->entries, hashmap->capacity * sizeof(hashmap_entry_t));
+    hashmap->length = 0;
+}
+
+u64 hashmap_length(hashmap_t *hashmap)
+{
+    ASSERT(hashmap);
+    return hashmap->length;
+}
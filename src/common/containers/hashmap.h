@@ -0,0 +1,35 @@
+#pragma once
+
+#include "defines.h"
+
+/********************************************************************************
+ *  Open-addressing hash map from u64 keys to u64 values (usually pointers).    *
+ *  Linear probing with backward-shift deletion, so there are no tombstones     *
+ *  and probe sequences stay short after many removals. The table doubles once  *
+ *  it is more than HASHMAP_MAX_LOAD_PERCENT full.                              *
+ ********************************************************************************/
+
+#define HASHMAP_DEFAULT_CAPACITY 64
+#define HASHMAP_MAX_LOAD_PERCENT 70
+
+typedef struct {
+    u64 key;
+    u64 value;
+    b8  occupied;
+} hashmap_entry_t;
+
+typedef struct {
+    u64 capacity;
+    u64 length;
+    hashmap_entry_t *entries;
+} hashmap_t;
+
+void hashmap_create (u64 initial_capacity, hashmap_t *out_hashmap);
+void hashmap_destroy(hashmap_t *hashmap);
+
+/* Inserts or overwrites the value stored under key */
+void hashmap_set    (hashmap_t *hashmap, u64 key, u64 value);
+b8   hashmap_get    (hashmap_t *hashmap, u64 key, u64 *out_value);
+b8   hashmap_remove (hashmap_t *hashmap, u64 key);
+void hashmap_clear  (hashmap_t *hashmap);
+u64  hashmap_length (hashmap_t *hashmap);
@@ -0,0 +1,120 @@
+#include "id_table.h"
+
+#include <stddef.h>
+
+#include "common/asserts.h"
+#include "common/memory/memutils.h"
+
+static void id_table_grow(id_table_t *table, u64 new_capacity)
+{
+    u8 *new_elements = mem_alloc(new_capacity * table->stride, MEMORY_TAG_ARRAY);
+    u64 *new_ids = mem_alloc(new_capacity * sizeof(u64), MEMORY_TAG_ARRAY);
+
+    if (table->length > 0) {
+        mem_copy(new_elements, table->elements, table->length * table->stride);
+        mem_copy(new_ids, table->ids, table->length * sizeof(u64));
+    }
+
+    mem_free(table->elements, table->capacity * table->stride, MEMORY_TAG_ARRAY);
+    mem_free(table->ids, table->capacity * sizeof(u64), MEMORY_TAG_ARRAY);
+
+    table->elements = new_elements;
+    table->ids = new_ids;
+    table->capacity = new_capacity;
+}
+
+void id_table_create(u64 stride, u64 initial_capacity, id_table_t *out_table)
+{
+    ASSERT(out_table);
+    ASSERT(stride > 0);
+
+    if (initial_capacity == 0) {
+        initial_capacity = 1;
+    }
+
+    out_table->stride = stride;
+    out_table->length = 0;
+    out_table->capacity = initial_capacity;
+    out_table->elements = mem_alloc(initial_capacity * stride, MEMORY_TAG_ARRAY);
+    out_table->ids = mem_alloc(initial_capacity * sizeof(u64), MEMORY_TAG_ARRAY);
+    hashmap_create(initial_capacity, &out_table->indices);
+}
+
+void id_table_destroy(id_table_t *table)
+{
+    ASSERT(table && table->elements);
+
+    mem_free(table->elements, table->capacity * table->stride, MEMORY_TAG_ARRAY);
+    mem_free(table->ids, table->capacity * sizeof(u64), MEMORY_TAG_ARRAY);
+    hashmap_destroy(&table->indices);
+
+    table->elements = NULL;
+    table->ids = NULL;
+    table->stride = 0;
+    table->length = 0;
+    table->capacity = 0;
+}
+
+void *id_table_insert(id_table_t *table, u64 id)
+{
+    ASSERT(table);
+
+    if (hashmap_get(&table->indices, id, NULL)) {
+        return NULL;
+    }
+
+    if (table->length == table->capacity) {
+        id_table_grow(table, table->capacity * 2);
+    }
+
+    u64 index = table->length++;
+    table->ids[index] = id;
+    hashmap_set(&table->indices, id, index);
+
+    void *element = id_table_at(table, index);
+    mem_zero(element, table->stride);
+    return element;
+}
+
+void *id_table_find(id_table_t *table, u64 id)
+{
+    ASSERT(table);
+
+    u64 index;
+    if (!hashmap_get(&table->indices, id, &index)) {
+        return NULL;
+    }
+
+    return id_table_at(table, index);
+}
+
+b8 id_table_remove(id_table_t *table, u64 id)
+{
+    ASSERT(table);
+
+    u64 index;
+    if (!hashmap_get(&table->indices, id, &index)) {
+        return false;
+    }
+
+    hashmap_remove(&table->indices, id);
+
+    // Fill the hole with the last element to keep the array dense
+    u64 last = table->length - 1;
+    if (index != last) {
+        mem_copy(id_table_at(table, index), id_table_at(table, last), table->stride);
+        table->ids[index] = table->ids[last];
+        hashmap_set(&table->indices, table->ids[index], index);
+    }
+    table->length = last;
+
+    return true;
+}
+
+void id_table_clear(id_table_t *table)
+{
+    ASSERT(table);
+
+    hashmap_clear(&table->indices);
+    table->length = 0;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "defines.h"
+#include "common/containers/hashmap.h"
+
+/********************************************************************************
+ *  Densely packed array of fixed-size elements addressed by a u64 id. A        *
+ *  hashmap maps every id to its element's index, so lookups stay O(1) no       *
+ *  matter how many elements there are, and iterating by index only ever        *
+ *  touches live elements. Removal moves the last element into the freed index, *
+ *  so element pointers and indices are invalidated by insertions and removals. *
+ ********************************************************************************/
+
+typedef struct {
+    u8 *elements;
+    u64 *ids; /* Id of the element at the same index */
+    u64 stride;
+    u64 length;
+    u64 capacity;
+    hashmap_t indices;
+} id_table_t;
+
+void  id_table_create (u64 stride, u64 initial_capacity, id_table_t *out_table);
+void  id_table_destroy(id_table_t *table);
+
+/* Returns a zeroed element for the new id, or NULL if the id is already present */
+void *id_table_insert (id_table_t *table, u64 id);
+void *id_table_find   (id_table_t *table, u64 id);
+b8    id_table_remove (id_table_t *table, u64 id);
+void  id_table_clear  (id_table_t *table);
+
+INLINE u64 id_table_length(id_table_t *table)
+{
+    return table->length;
+}
+
+INLINE void *id_table_at(id_table_t *table, u64 index)
+{
+    return table->elements + index * table->stride;
+}
+
+/* Index of an element of the table, only valid until the next insertion or removal */
+INLINE u64 id_table_index_of(id_table_t *table, const void *element)
+{
+    return ((const u8 *)element - table->elements) / table->stride;
+}
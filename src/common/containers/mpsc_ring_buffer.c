@@ -0,0 +1,132 @@
+#include "mpsc_ring_buffer.h"
+
+#include <stddef.h>
+
+#include "common/asserts.h"
+#include "common/memory/memutils.h"
+
+/* Cell layout: _Atomic u64 sequence followed by 'stride' bytes of element data */
+#define CELL_HEADER_SIZE sizeof(_Atomic u64)
+
+static u64 round_up_power_of_two(u64 value)
+{
+    u64 result = 1;
+    while (result < value) {
+        result <<= 1;
+    }
+    return result;
+}
+
+INLINE _Atomic u64 *cell_sequence(mpsc_ring_buffer_t *ring_buffer, u64 position)
+{
+    return (_Atomic u64 *)(ring_buffer->cells + (position & ring_buffer->mask) * ring_buffer->cell_size);
+}
+
+INLINE void *cell_data(mpsc_ring_buffer_t *ring_buffer, u64 position)
+{
+    return ring_buffer->cells + (position & ring_buffer->mask) * ring_buffer->cell_size + CELL_HEADER_SIZE;
+}
+
+void mpsc_ring_buffer_create(u64 capacity, u64 stride, mpsc_ring_buffer_t *out_ring_buffer)
+{
+    ASSERT(out_ring_buffer);
+    ASSERT(capacity > 0);
+    ASSERT(stride > 0);
+
+    capacity = round_up_power_of_two(capacity);
+
+    out_ring_buffer->capacity = capacity;
+    out_ring_buffer->mask = capacity - 1;
+    out_ring_buffer->stride = stride;
+    // Keep every cell's sequence number 8-byte aligned
+    out_ring_buffer->cell_size = (CELL_HEADER_SIZE + stride + 7) & ~(u64)7;
+    out_ring_buffer->cells = mem_alloc(capacity * out_ring_buffer->cell_size, MEMORY_TAG_RING_BUFFER);
+
+    for (u64 i = 0; i < capacity; i++) {
+        atomic_init(cell_sequence(out_ring_buffer, i), i);
+    }
+
+    atomic_init(&out_ring_buffer->head, 0);
+    atomic_init(&out_ring_buffer->tail, 0);
+}
+
+void mpsc_ring_buffer_destroy(mpsc_ring_buffer_t *ring_buffer)
+{
+    ASSERT(ring_buffer && ring_buffer->cells);
+
+    mem_free(ring_buffer->cells, ring_buffer->capacity * ring_buffer->cell_size, MEMORY_TAG_RING_BUFFER);
+    ring_buffer->cells = NULL;
+    ring_buffer->capacity = 0;
+    ring_buffer->mask = 0;
+    ring_buffer->stride = 0;
+    ring_buffer->cell_size = 0;
+}
+
+b8 mpsc_ring_buffer_enqueue(mpsc_ring_buffer_t *ring_buffer, const void *element)
+{
+    ASSERT(ring_buffer && ring_buffer->cells);
+    ASSERT(element);
+
+    u64 position = atomic_load_explicit(&ring_buffer->head, memory_order_relaxed);
+    for (;;) {
+        u64 sequence = atomic_load_explicit(cell_sequence(ring_buffer, position), memory_order_acquire);
+        i64 difference = (i64)sequence - (i64)position;
+        if (difference == 0) {
+            // Cell is free for this position - try to claim it
+            if (atomic_compare_exchange_weak_explicit(&ring_buffer->head, &position, position + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+            // Failed CAS reloaded 'position' with the current head
+        } else if (difference < 0) {
+            // Consumer hasn't released this cell from the previous lap yet - buffer is full
+            return false;
+        } else {
+            // Another producer claimed this position in the meantime
+            position = atomic_load_explicit(&ring_buffer->head, memory_order_relaxed);
+        }
+    }
+
+    mem_copy(cell_data(ring_buffer, position), element, ring_buffer->stride);
+    atomic_store_explicit(cell_sequence(ring_buffer, position), position + 1, memory_order_release);
+    return true;
+}
+
+b8 mpsc_ring_buffer_dequeue(mpsc_ring_buffer_t *ring_buffer, void *out_element)
+{
+    return mpsc_ring_buffer_dequeue_batch(ring_buffer, out_element, 1) == 1;
+}
+
+u64 mpsc_ring_buffer_dequeue_batch(mpsc_ring_buffer_t *ring_buffer, void *out_elements, u64 max_count)
+{
+    ASSERT(ring_buffer && ring_buffer->cells);
+    ASSERT(out_elements);
+
+    u64 position = atomic_load_explicit(&ring_buffer->tail, memory_order_relaxed);
+    u64 count = 0;
+    while (count < max_count) {
+        _Atomic u64 *sequence = cell_sequence(ring_buffer, position);
+        if (atomic_load_explicit(sequence, memory_order_acquire) != position + 1) {
+            // Empty, or the producer which claimed this cell hasn't finished writing it yet
+            break;
+        }
+
+        mem_copy((u8 *)out_elements + count * ring_buffer->stride, cell_data(ring_buffer, position), ring_buffer->stride);
+        // Hand the cell back to producers for the next lap
+        atomic_store_explicit(sequence, position + ring_buffer->capacity, memory_order_release);
+        position++;
+        count++;
+    }
+
+    atomic_store_explicit(&ring_buffer->tail, position, memory_order_relaxed);
+    return count;
+}
+
+u64 mpsc_ring_buffer_length(mpsc_ring_buffer_t *ring_buffer)
+{
+    ASSERT(ring_buffer);
+
+    u64 tail = atomic_load_explicit(&ring_buffer->tail, memory_order_relaxed);
+    u64 head = atomic_load_explicit(&ring_buffer->head, memory_order_relaxed);
+    return head > tail ? head - tail : 0;
+}
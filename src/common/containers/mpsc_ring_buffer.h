@@ -0,0 +1,41 @@
+#pragma once
+
+#include "defines.h"
+
+#include <stdatomic.h>
+
+#define CACHE_LINE_SIZE 64
+
+/********************************************************************************
+ *  Bounded lock-free multi-producer/single-consumer ring buffer.               *
+ *  Every cell carries a sequence number telling whether it is free for the     *
+ *  producer claiming position 'pos' (sequence == pos) or holds data ready for  *
+ *  the consumer (sequence == pos + 1). Producers claim positions with a CAS    *
+ *  on head, the consumer owns tail. head and tail live on separate cache lines *
+ *  so producers and the consumer don't invalidate each other's line.           *
+ *  Capacity is rounded up to the next power of two.                            *
+ ********************************************************************************/
+
+typedef struct {
+    _Alignas(CACHE_LINE_SIZE) _Atomic u64 head;
+    _Alignas(CACHE_LINE_SIZE) _Atomic u64 tail;
+    _Alignas(CACHE_LINE_SIZE) u64 capacity;
+    u64 mask;
+    u64 stride;
+    u64 cell_size;
+    u8 *cells;
+} mpsc_ring_buffer_t;
+
+void mpsc_ring_buffer_create (u64 capacity, u64 stride, mpsc_ring_buffer_t *out_ring_buffer);
+void mpsc_ring_buffer_destroy(mpsc_ring_buffer_t *ring_buffer);
+
+/* Safe to call from any number of threads, returns false if the buffer is full */
+b8   mpsc_ring_buffer_enqueue(mpsc_ring_buffer_t *ring_buffer, const void *element);
+
+/* Must only be called from the single consumer thread */
+b8   mpsc_ring_buffer_dequeue(mpsc_ring_buffer_t *ring_buffer, void *out_element);
+/* Dequeues up to max_count elements into a contiguous out_elements array, returns the amount dequeued */
+u64  mpsc_ring_buffer_dequeue_batch(mpsc_ring_buffer_t *ring_buffer, void *out_elements, u64 max_count);
+
+/* Approximate when producers are active */
+u64  mpsc_ring_buffer_length(mpsc_ring_buffer_t *ring_buffer);
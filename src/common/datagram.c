@@ -0,0 +1,212 @@
+#include "datagram.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "common/net.h"
+#include "common/clock.h"
+#include "common/asserts.h"
+#include "common/logger.h"
+#include "common/memory/memutils.h"
+
+typedef struct {
+    i32 socket;
+    u64 due_time_ns;
+    struct sockaddr_storage address;
+    u32 address_length;
+    u32 size;
+    u8 *data;
+} delayed_datagram_t;
+
+static pthread_mutex_t shim_lock = PTHREAD_MUTEX_INITIALIZER;
+static datagram_shim_config_t shim_config;
+static u64 shim_random_state;
+static delayed_datagram_t delayed_datagrams[DATAGRAM_SHIM_MAX_DELAYED];
+static u32 delayed_count;
+
+u32 datagram_encode(u64 token, u32 type, const void *packet_data, u8 *out_buffer, u32 capacity)
+{
+    ASSERT(out_buffer);
+
+    if (capacity < sizeof(token)) {
+        return 0;
+    }
+
+    u32 packet_size = packet_encode(type, packet_data, out_buffer + sizeof(token), capacity - sizeof(token));
+    if (packet_size == 0) {
+        return 0;
+    }
+    mem_copy(out_buffer, &token, sizeof(token));
+
+    return sizeof(token) + packet_size;
+}
+
+b8 datagram_decode(const u8 *buffer, u32 size, u64 *out_token, u32 *out_type, const u8 **out_payload, u32 *out_payload_size)
+{
+    ASSERT(buffer);
+
+    if (size < sizeof(u64) + sizeof(packet_header_t)) {
+        return false;
+    }
+
+    packet_header_t header;
+    mem_copy(out_token, buffer, sizeof(u64));
+    mem_copy(&header, buffer + sizeof(u64), sizeof(header));
+
+    // A datagram carries exactly one packet, anything else means it was truncated or forged
+    if (header.type <= PACKET_TYPE_HEADER || header.type >= PACKET_TYPE_COUNT ||
+        header.size != size - sizeof(u64) - sizeof(packet_header_t)) {
+        return false;
+    }
+
+    *out_type = header.type;
+    *out_payload = buffer + sizeof(u64) + sizeof(packet_header_t);
+    *out_payload_size = header.size;
+    return true;
+}
+
+/* xorshift64, the shim only needs to be reproducible for a given seed */
+static f32 shim_random(void)
+{
+    shim_random_state ^= shim_random_state << 13;
+    shim_random_state ^= shim_random_state >> 7;
+    shim_random_state ^= shim_random_state << 17;
+    return (f32)(shim_random_state >> 40) / (f32)(1 << 24);
+}
+
+static b8 datagram_send_now(i32 socket, const u8 *data, u32 size, const struct sockaddr *address, u32 address_length)
+{
+    i64 bytes_sent = address != NULL ? net_send_to(socket, data, size, address, address_length)
+                                     : net_send(socket, data, size, MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (bytes_sent == -1) {
+        // Datagrams are allowed to get lost, a full socket buffer is just another way of losing one
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != ECONNREFUSED) {
+            LOG_ERROR("datagram send error: %s", strerror(errno));
+        }
+        return false;
+    }
+
+    return true;
+}
+
+b8 datagram_send(i32 socket, u64 token, u32 type, const void *packet_data, const struct sockaddr *address, u32 address_length)
+{
+    u8 buffer[DATAGRAM_MAX_SIZE];
+    u32 size = datagram_encode(token, type, packet_data, buffer, sizeof(buffer));
+    if (size == 0) {
+        LOG_ERROR("datagram_send error: failed to serialize packet of type %u", type);
+        return false;
+    }
+
+    pthread_mutex_lock(&shim_lock);
+
+    if (shim_config.loss > 0.0f && shim_random() < shim_config.loss) {
+        pthread_mutex_unlock(&shim_lock);
+        return true;
+    }
+
+    if (shim_config.latency_ms == 0 && shim_config.jitter_ms == 0) {
+        pthread_mutex_unlock(&shim_lock);
+        return datagram_send_now(socket, buffer, size, address, address_length);
+    }
+
+    if (delayed_count >= DATAGRAM_SHIM_MAX_DELAYED) {
+        pthread_mutex_unlock(&shim_lock);
+        return true;
+    }
+
+    u64 delay_ms = shim_config.latency_ms + (u64)(shim_random() * shim_config.jitter_ms);
+    delayed_datagram_t *delayed = &delayed_datagrams[delayed_count++];
+    delayed->socket = socket;
+    delayed->due_time_ns = clock_get_absolute_time_ns() + delay_ms * 1000 * 1000;
+    delayed->address_length = address != NULL ? address_length : 0;
+    if (address != NULL) {
+        mem_copy(&delayed->address, address, address_length);
+    }
+    delayed->size = size;
+    delayed->data = mem_alloc(size, MEMORY_TAG_NETWORK);
+    mem_copy(delayed->data, buffer, size);
+
+    pthread_mutex_unlock(&shim_lock);
+    return true;
+}
+
+b8 datagram_shim_parse(const char *spec, datagram_shim_config_t *out_config)
+{
+    ASSERT(spec);
+    ASSERT(out_config);
+
+    mem_zero(out_config, sizeof(datagram_shim_config_t));
+    out_config->seed = 1;
+
+    char buffer[256];
+    strncpy(buffer, spec, sizeof(buffer) - 1);
+    buffer[sizeof(buffer) - 1] = 0;
+
+    char *save_ptr = NULL;
+    for (char *option = strtok_r(buffer, ",", &save_ptr); option != NULL; option = strtok_r(NULL, ",", &save_ptr)) {
+        char *value = strchr(option, '=');
+        if (value == NULL) {
+            return false;
+        }
+        *value++ = 0;
+
+        if (strcmp(option, "loss") == 0) {
+            out_config->loss = strtof(value, NULL);
+        } else if (strcmp(option, "latency") == 0) {
+            out_config->latency_ms = strtoul(value, NULL, 10);
+        } else if (strcmp(option, "jitter") == 0) {
+            out_config->jitter_ms = strtoul(value, NULL, 10);
+        } else if (strcmp(option, "seed") == 0) {
+            out_config->seed = strtoul(value, NULL, 10);
+        } else {
+            return false;
+        }
+    }
+
+    return out_config->loss >= 0.0f && out_config->loss <= 1.0f;
+}
+
+void datagram_shim_configure(const datagram_shim_config_t *config)
+{
+    ASSERT(config);
+
+    pthread_mutex_lock(&shim_lock);
+    shim_config = *config;
+    shim_random_state = config->seed != 0 ? config->seed : 1;
+    pthread_mutex_unlock(&shim_lock);
+}
+
+void datagram_shim_flush(void)
+{
+    pthread_mutex_lock(&shim_lock);
+
+    u64 now = clock_get_absolute_time_ns();
+    for (u32 i = 0; i < delayed_count;) {
+        delayed_datagram_t *delayed = &delayed_datagrams[i];
+        if (delayed->due_time_ns > now) {
+            i++;
+            continue;
+        }
+
+        datagram_send_now(delayed->socket, delayed->data, delayed->size,
+                          delayed->address_length > 0 ? (struct sockaddr *)&delayed->address : NULL, delayed->address_length);
+        mem_free(delayed->data, delayed->size, MEMORY_TAG_NETWORK);
+        // Order among due datagrams doesn't matter, jitter reorders them anyway
+        *delayed = delayed_datagrams[--delayed_count];
+    }
+
+    pthread_mutex_unlock(&shim_lock);
+}
+
+void datagram_shim_shutdown(void)
+{
+    pthread_mutex_lock(&shim_lock);
+    for (u32 i = 0; i < delayed_count; i++) {
+        mem_free(delayed_datagrams[i].data, delayed_datagrams[i].size, MEMORY_TAG_NETWORK);
+    }
+    delayed_count = 0;
+    pthread_mutex_unlock(&shim_lock);
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "defines.h"
+#include "common/packet.h"
+
+#include <sys/socket.h>
+
+#define DATAGRAM_MAX_SIZE (sizeof(u64) + sizeof(packet_header_t) + PACKET_MAX_SIZE)
+#define DATAGRAM_SHIM_ENV "STARLORE_UDP_SHIM"
+#define DATAGRAM_SHIM_MAX_DELAYED 1024 /* Datagrams held back by the shim at once, the rest is dropped */
+
+/********************************************************************************
+ *  Unreliable channel for high-frequency state next to the TCP stream.         *
+ *  Every datagram is a u64 token followed by one framed packet. The server     *
+ *  hands the token out over TCP during the handshake, so a datagram can be     *
+ *  tied to its connection no matter which address it arrives from.            *
+ *                                                                              *
+ *  All datagrams are sent through a shim which can drop and delay them to      *
+ *  test the channel over loopback, e.g.                                        *
+ *    STARLORE_UDP_SHIM="loss=0.1,latency=50,jitter=20"                         *
+ *  drops 10% of the datagrams and delivers the rest after 50-70 ms.            *
+ ********************************************************************************/
+
+typedef struct {
+    f32 loss;       /* Probability of dropping a datagram, 0 to 1 */
+    u32 latency_ms; /* Added to every datagram */
+    u32 jitter_ms;  /* Random extra delay on top of the latency, reorders datagrams */
+    u32 seed;
+} datagram_shim_config_t;
+
+/* Writes the datagram into out_buffer, returns its size or 0 if it did not fit into capacity */
+u32 datagram_encode(u64 token, u32 type, const void *packet_data, u8 *out_buffer, u32 capacity);
+/* Validates the framing, the payload still has to be deserialized */
+b8  datagram_decode(const u8 *buffer, u32 size, u64 *out_token, u32 *out_type, const u8 **out_payload, u32 *out_payload_size);
+
+/* NULL address for sockets connected to their peer */
+b8  datagram_send(i32 socket, u64 token, u32 type, const void *packet_data, const struct sockaddr *address, u32 address_length);
+
+/* Parses a spec like the one above, unknown keys make it fail */
+b8   datagram_shim_parse(const char *spec, datagram_shim_config_t *out_config);
+void datagram_shim_configure(const datagram_shim_config_t *config);
+/* Sends the delayed datagrams which are due, has to be called regularly while the shim delays datagrams */
+void datagram_shim_flush(void);
+void datagram_shim_shutdown(void);
@@ -10,7 +10,7 @@ typedef u8 tile_type_t;
 #define CLIENT_TICK_DURATION (1.0f / CLIENT_TICK_RATE)
 #define SERVER_TICK_RATE 64
 
-#define MAX_PLAYER_COUNT 5
+#define MAX_PLAYER_COUNT 512 /* Enforced by the server, players are looked up by id on both sides */
 #define MAX_MESSAGE_HISTORY_LENGTH 8
 
 #define PLAYER_INVALID_ID 0
@@ -46,6 +46,7 @@ typedef u8 tile_type_t;
 
 typedef struct {
     i32 x, y;
+    u32 revision; /* 0 for a chunk as generated, bumped by the server on every modification */
     game_tile_t tiles[CHUNK_NUM_TILES];
     game_object_t objects[CHUNK_NUM_TILES];
 #if defined(DEBUG)
@@ -17,6 +17,12 @@ f32 math_cosf(f32 value)
     return cosf(value);
 }
 
+void math_random_seed(u32 seed)
+{
+    srand(seed);
+    rand_seeded = true;
+}
+
 i32 math_random(void)
 {
     if (!rand_seeded) {
@@ -42,6 +48,23 @@ f32 math_frandom_range(f32 min, f32 max)
     return min + ((f32)math_random() / ((f32)RAND_MAX / (max - min)));
 }
 
+u64 math_hash_u64(u64 value)
+{
+    // splitmix64
+    value += 0x9E3779B97F4A7C15ULL;
+    value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    value = (value ^ (value >> 27)) * 0x94D049BB133111EBULL;
+    return value ^ (value >> 31);
+}
+
+f32 math_frandom_hash(u32 seed, i32 x, i32 y, u32 index)
+{
+    u64 hash = math_hash_u64(((u64)seed << 32) | index);
+    hash = math_hash_u64(hash ^ (((u64)(u32)x << 32) | (u64)(u32)y));
+    // Top 24 bits fill the f32 mantissa exactly
+    return (f32)(hash >> 40) * (1.0f / (f32)(1 << 24));
+}
+
 f32 math_floor(f32 value)
 {
     return floorf(value);
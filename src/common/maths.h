@@ -77,6 +77,8 @@ typedef struct {
 f32 math_sinf(f32 value);
 f32 math_cosf(f32 value);
 
+/* Makes the values returned by the functions below reproducible, otherwise they are seeded from the clock */
+void math_random_seed(u32 seed);
 /* returns value between 0 (inclusive) and RAND_MAX(INT_MAX) (exclusive) */
 i32 math_random(void);
 /* min is inclusive, max is exclusive */
@@ -87,6 +89,12 @@ f32 math_frandom(void);
 /* min is inclusive, max is exclusive */
 f32 math_frandom_range(f32 min, f32 max);
 
+/* Stateless counter-based generator - the same inputs always give the same output, on any thread.
+   Meant for world generation, where every tile needs its own reproducible random value */
+u64 math_hash_u64(u64 value);
+/* returns value between 0.0 (inclusive) and 1.0 (exclusive) for the given seed, chunk coordinates and tile index */
+f32 math_frandom_hash(u32 seed, i32 x, i32 y, u32 index);
+
 f32 math_floor(f32 value);
 f32 math_ceil(f32 value);
 f32 math_round(f32 value);
@@ -16,6 +16,7 @@ static const char *memory_tag_strings[MEMORY_TAG_COUNT] = {
     "hashtable  ",
     "ring_buffer",
     "arena_alloc",
+    "pool_alloc ",
     "renderer   ",
     "game       ",
     "opengl     ",
@@ -23,9 +24,10 @@ static const char *memory_tag_strings[MEMORY_TAG_COUNT] = {
     "network    "
 };
 
+/* Atomic since memory is allocated from the network, tick and chunk worker threads */
 typedef struct {
-    u64 total_allocated;
-    u64 tagged_allocations[MEMORY_TAG_COUNT];
+    _Atomic u64 total_allocated;
+    _Atomic u64 tagged_allocations[MEMORY_TAG_COUNT];
 } memory_stats_t;
 
 static memory_stats_t stats;
@@ -72,6 +74,13 @@ void* mem_copy(void* dest, const void* source, u64 size)
     return memcpy(dest, source, size);
 }
 
+void* mem_move(void* dest, const void* source, u64 size)
+{
+    ASSERT(dest);
+    ASSERT(source);
+    return memmove(dest, source, size);
+}
+
 void* mem_set(void* dest, i32 value, u64 size)
 {
     ASSERT(dest);
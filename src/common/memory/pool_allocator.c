@@ -0,0 +1,87 @@
+#include "pool_allocator.h"
+
+#include <stddef.h>
+
+#include "common/asserts.h"
+#include "common/memory/memutils.h"
+
+/* Slab header is padded so that blocks following it keep 16-byte alignment */
+#define SLAB_HEADER_SIZE 16
+
+STATIC_ASSERT(sizeof(pool_allocator_slab_t) <= SLAB_HEADER_SIZE, "slab header does not fit into its padding");
+
+INLINE u64 slab_size(pool_allocator_t *allocator)
+{
+    return SLAB_HEADER_SIZE + allocator->block_size * allocator->blocks_per_slab;
+}
+
+static void pool_allocator_add_slab(pool_allocator_t *allocator)
+{
+    pool_allocator_slab_t *slab = mem_alloc(slab_size(allocator), MEMORY_TAG_POOL_ALLOCATOR);
+    slab->next = allocator->slabs;
+    allocator->slabs = slab;
+    allocator->slab_count++;
+
+    // Thread the new blocks onto the free list back to front, so they are handed out in address order
+    u8 *blocks = (u8 *)slab + SLAB_HEADER_SIZE;
+    for (u64 i = allocator->blocks_per_slab; i > 0; i--) {
+        void *block = blocks + (i - 1) * allocator->block_size;
+        *(void **)block = allocator->free_list;
+        allocator->free_list = block;
+    }
+}
+
+void pool_allocator_create(u64 block_size, u64 blocks_per_slab, pool_allocator_t *out_allocator)
+{
+    ASSERT(out_allocator);
+    ASSERT(blocks_per_slab > 0);
+
+    // Every free block stores the free list link in its first bytes
+    if (block_size < sizeof(void *)) {
+        block_size = sizeof(void *);
+    }
+
+    mem_zero(out_allocator, sizeof(pool_allocator_t));
+    out_allocator->block_size = (block_size + 15) & ~(u64)15;
+    out_allocator->blocks_per_slab = blocks_per_slab;
+}
+
+void pool_allocator_destroy(pool_allocator_t *allocator)
+{
+    ASSERT(allocator);
+
+    pool_allocator_slab_t *slab = allocator->slabs;
+    while (slab != NULL) {
+        pool_allocator_slab_t *next = slab->next;
+        mem_free(slab, slab_size(allocator), MEMORY_TAG_POOL_ALLOCATOR);
+        slab = next;
+    }
+
+    mem_zero(allocator, sizeof(pool_allocator_t));
+}
+
+void *pool_allocator_allocate(pool_allocator_t *allocator)
+{
+    ASSERT(allocator && allocator->block_size > 0);
+
+    if (allocator->free_list == NULL) {
+        pool_allocator_add_slab(allocator);
+    }
+
+    void *block = allocator->free_list;
+    allocator->free_list = *(void **)block;
+    allocator->allocated_count++;
+
+    mem_zero(block, allocator->block_size);
+    return block;
+}
+
+void pool_allocator_free(pool_allocator_t *allocator, void *block)
+{
+    ASSERT(allocator && block);
+    ASSERT(allocator->allocated_count > 0);
+
+    *(void **)block = allocator->free_list;
+    allocator->free_list = block;
+    allocator->allocated_count--;
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "defines.h"
+
+/********************************************************************************
+ *  Fixed-size block allocator. Blocks are carved out of slabs which are never  *
+ *  moved or returned to the system until the pool is destroyed, so a pointer   *
+ *  to an allocated block stays valid until it is freed, no matter how many     *
+ *  blocks are allocated after it. Freed blocks are reused via a free list.     *
+ ********************************************************************************/
+
+typedef struct pool_allocator_slab {
+    struct pool_allocator_slab *next;
+} pool_allocator_slab_t;
+
+typedef struct {
+    u64 block_size;
+    u64 blocks_per_slab;
+    u64 slab_count;
+    u64 allocated_count;
+    void *free_list;
+    pool_allocator_slab_t *slabs;
+} pool_allocator_t;
+
+void  pool_allocator_create   (u64 block_size, u64 blocks_per_slab, pool_allocator_t *out_allocator);
+void  pool_allocator_destroy  (pool_allocator_t *allocator);
+/* Returns a zeroed block of block_size bytes */
+void *pool_allocator_allocate (pool_allocator_t *allocator);
+void  pool_allocator_free     (pool_allocator_t *allocator, void *block);
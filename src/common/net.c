@@ -1,13 +1,17 @@
 #include "net.h"
 
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdatomic.h>
 #include <sys/socket.h>
 
 #define STAT_UPDATE_PERIOD 1.0f
 
 static f32 accumulator;
 
-static u64 bytes_per_sec_up;
-static u64 bytes_per_sec_down;
+/* Updated by every thread doing socket I/O */
+static _Atomic u64 bytes_per_sec_up;
+static _Atomic u64 bytes_per_sec_down;
 static u64 last_bytes_per_sec_up;
 static u64 last_bytes_per_sec_down;
 
@@ -21,6 +25,22 @@ i64 net_send(i32 socket, const void *buffer, u64 size, i32 flags)
     return bytes_sent;
 }
 
+i64 net_sendv(i32 socket, const struct iovec *iov, u32 iov_count)
+{
+    struct msghdr message = {
+        .msg_iov = (struct iovec *)iov,
+        .msg_iovlen = iov_count
+    };
+
+    // Never block the caller and never raise SIGPIPE on a connection closed by the peer
+    i64 bytes_sent = sendmsg(socket, &message, MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (bytes_sent > 0) {
+        bytes_per_sec_up += bytes_sent;
+    }
+
+    return bytes_sent;
+}
+
 i64 net_recv(i32 socket, void *buffer, u64 size, i32 flags)
 {
     i64 bytes_read = recv(socket, buffer, size, flags);
@@ -31,6 +51,46 @@ i64 net_recv(i32 socket, void *buffer, u64 size, i32 flags)
     return bytes_read;
 }
 
+i64 net_send_to(i32 socket, const void *buffer, u64 size, const struct sockaddr *address, u32 address_length)
+{
+    i64 bytes_sent = sendto(socket, buffer, size, MSG_DONTWAIT | MSG_NOSIGNAL, address, address_length);
+    if (bytes_sent > 0) {
+        bytes_per_sec_up += bytes_sent;
+    }
+
+    return bytes_sent;
+}
+
+i64 net_recv_from(i32 socket, void *buffer, u64 size, struct sockaddr_storage *out_address, u32 *out_address_length)
+{
+    socklen_t address_length = sizeof(struct sockaddr_storage);
+    i64 bytes_read = recvfrom(socket, buffer, size, MSG_DONTWAIT, (struct sockaddr *)out_address, &address_length);
+    if (bytes_read > 0) {
+        bytes_per_sec_down += bytes_read;
+    }
+    if (out_address_length != NULL) {
+        *out_address_length = address_length;
+    }
+
+    return bytes_read;
+}
+
+b8 net_set_nonblocking(i32 socket)
+{
+    i32 flags = fcntl(socket, F_GETFL, 0);
+    if (flags == -1) {
+        return false;
+    }
+
+    return fcntl(socket, F_SETFL, flags | O_NONBLOCK) != -1;
+}
+
+b8 net_is_nonblocking(i32 socket)
+{
+    i32 flags = fcntl(socket, F_GETFL, 0);
+    return flags != -1 && (flags & O_NONBLOCK) != 0;
+}
+
 void net_get_bandwidth(u64 *up, u64 *down)
 {
     *up = last_bytes_per_sec_up;
@@ -41,10 +101,8 @@ void net_update(f64 delta_time)
 {
     accumulator += delta_time;
     if (accumulator >= STAT_UPDATE_PERIOD) {
-        last_bytes_per_sec_up = bytes_per_sec_up;
-        last_bytes_per_sec_down = bytes_per_sec_down;
-        bytes_per_sec_up = 0;
-        bytes_per_sec_down = 0;
+        last_bytes_per_sec_up = atomic_exchange(&bytes_per_sec_up, 0);
+        last_bytes_per_sec_down = atomic_exchange(&bytes_per_sec_down, 0);
         accumulator = 0.0f;
     }
 }
@@ -2,7 +2,15 @@
 
 #include "defines.h"
 
+#include <sys/uio.h>
+#include <sys/socket.h>
+
 i64 net_send(i32 socket, const void *buffer, u64 size, i32 flags);
+i64 net_sendv(i32 socket, const struct iovec *iov, u32 iov_count);
 i64 net_recv(i32 socket, void *buffer, u64 size, i32 flags);
+i64 net_send_to(i32 socket, const void *buffer, u64 size, const struct sockaddr *address, u32 address_length);
+i64 net_recv_from(i32 socket, void *buffer, u64 size, struct sockaddr_storage *out_address, u32 *out_address_length);
+b8 net_set_nonblocking(i32 socket);
+b8 net_is_nonblocking(i32 socket);
 void net_get_bandwidth(u64 *up, u64 *down);
 void net_update(f64 delta_time);
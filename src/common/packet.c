@@ -2,6 +2,7 @@
 
 #include <errno.h>
 #include <stdlib.h>
+#include <string.h>
 #include <memory.h>
 #include <sys/socket.h>
 
@@ -10,42 +11,845 @@
 #include "common/logger.h"
 #include "common/memory/memutils.h"
 
-static u64 packet_sequence_number = 0;
+static u64 packet_sequence_number = 1; /* 0 is never used, the server reads it as no input processed yet */
 
-b8 packet_send(i32 socket, u32 type, void *packet_data)
+typedef struct {
+    u8 *data;
+    u32 capacity;
+    u32 size;
+    b8 overflow;
+} packet_writer_t;
+
+typedef struct {
+    const u8 *data;
+    u32 size;
+    u32 offset;
+    b8 error;
+} packet_reader_t;
+
+static void write_bytes(packet_writer_t *writer, const void *data, u32 size)
 {
-    ASSERT(type > PACKET_TYPE_NONE && type < PACKET_TYPE_COUNT);
+    if (writer->overflow || writer->capacity - writer->size < size) {
+        writer->overflow = true;
+        return;
+    }
+    mem_copy(writer->data + writer->size, data, size);
+    writer->size += size;
+}
+
+static void read_bytes(packet_reader_t *reader, void *out_data, u32 size)
+{
+    if (reader->error || reader->size - reader->offset < size) {
+        reader->error = true;
+        mem_zero(out_data, size);
+        return;
+    }
+    mem_copy(out_data, reader->data + reader->offset, size);
+    reader->offset += size;
+}
+
+INLINE void write_u8 (packet_writer_t *writer, u8 value)  { write_bytes(writer, &value, sizeof(value)); }
+INLINE void write_u16(packet_writer_t *writer, u16 value) { write_bytes(writer, &value, sizeof(value)); }
+INLINE void write_u32(packet_writer_t *writer, u32 value) { write_bytes(writer, &value, sizeof(value)); }
+INLINE void write_u64(packet_writer_t *writer, u64 value) { write_bytes(writer, &value, sizeof(value)); }
+INLINE void write_i32(packet_writer_t *writer, i32 value) { write_bytes(writer, &value, sizeof(value)); }
+INLINE void write_i64(packet_writer_t *writer, i64 value) { write_bytes(writer, &value, sizeof(value)); }
+INLINE void write_f32(packet_writer_t *writer, f32 value) { write_bytes(writer, &value, sizeof(value)); }
+
+INLINE u8  read_u8 (packet_reader_t *reader) { u8  value; read_bytes(reader, &value, sizeof(value)); return value; }
+INLINE u16 read_u16(packet_reader_t *reader) { u16 value; read_bytes(reader, &value, sizeof(value)); return value; }
+INLINE u32 read_u32(packet_reader_t *reader) { u32 value; read_bytes(reader, &value, sizeof(value)); return value; }
+INLINE u64 read_u64(packet_reader_t *reader) { u64 value; read_bytes(reader, &value, sizeof(value)); return value; }
+INLINE i32 read_i32(packet_reader_t *reader) { i32 value; read_bytes(reader, &value, sizeof(value)); return value; }
+INLINE i64 read_i64(packet_reader_t *reader) { i64 value; read_bytes(reader, &value, sizeof(value)); return value; }
+INLINE f32 read_f32(packet_reader_t *reader) { f32 value; read_bytes(reader, &value, sizeof(value)); return value; }
+
+/* LEB128, 7 bits per byte with the top bit set on every byte but the last */
+static void write_varint(packet_writer_t *writer, u32 value)
+{
+    while (value >= 0x80) {
+        write_u8(writer, (u8)(value | 0x80));
+        value >>= 7;
+    }
+    write_u8(writer, (u8)value);
+}
+
+static u32 read_varint(packet_reader_t *reader)
+{
+    u32 value = 0;
+    for (u32 shift = 0; shift < 32; shift += 7) {
+        u8 byte = read_u8(reader);
+        value |= (u32)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            return value;
+        }
+    }
+    reader->error = true;
+    return 0;
+}
+
+/* Zigzag maps small negative deltas to small varints too */
+INLINE void write_varint_signed(packet_writer_t *writer, i32 value) { write_varint(writer, ((u32)value << 1) ^ (u32)(value >> 31)); }
+INLINE i32  read_varint_signed (packet_reader_t *reader) { u32 value = read_varint(reader); return (i32)(value >> 1) ^ -(i32)(value & 1); }
+
+static void write_vec2(packet_writer_t *writer, vec2 value)
+{
+    write_f32(writer, value.x);
+    write_f32(writer, value.y);
+}
+
+static vec2 read_vec2(packet_reader_t *reader)
+{
+    vec2 value;
+    value.x = read_f32(reader);
+    value.y = read_f32(reader);
+    return value;
+}
+
+static void write_vec3(packet_writer_t *writer, vec3 value)
+{
+    write_f32(writer, value.x);
+    write_f32(writer, value.y);
+    write_f32(writer, value.z);
+}
+
+static vec3 read_vec3(packet_reader_t *reader)
+{
+    vec3 value;
+    value.x = read_f32(reader);
+    value.y = read_f32(reader);
+    value.z = read_f32(reader);
+    return value;
+}
+
+/* Only the used part of the array is written, 'capacity' bytes if it is not NUL-terminated */
+static void write_string(packet_writer_t *writer, const char *string, u32 capacity)
+{
+    u16 length = (u16)strnlen(string, capacity);
+    write_u16(writer, length);
+    write_bytes(writer, string, length);
+}
+
+/* Zero-fills the rest of the array, so shorter strings come out NUL-terminated */
+static void read_string(packet_reader_t *reader, char *out_string, u32 capacity)
+{
+    u16 length = read_u16(reader);
+    if (length > capacity) {
+        reader->error = true;
+        return;
+    }
+    mem_zero(out_string, capacity);
+    read_bytes(reader, out_string, length);
+}
+
+static void serialize_ping(packet_writer_t *writer, const void *packet_data)
+{
+    const packet_ping_t *packet = packet_data;
+    write_u64(writer, packet->time);
+}
+
+static void deserialize_ping(packet_reader_t *reader, void *out_packet_data)
+{
+    packet_ping_t *packet = out_packet_data;
+    packet->time = read_u64(reader);
+}
+
+static void serialize_message(packet_writer_t *writer, const void *packet_data)
+{
+    const packet_message_t *packet = packet_data;
+    write_u8(writer, (u8)packet->type);
+    write_i64(writer, packet->timestamp);
+    write_string(writer, packet->author, PLAYER_MAX_NAME_LENGTH);
+    write_string(writer, packet->content, MESSAGE_MAX_CONTENT_LENGTH);
+}
+
+static void deserialize_message(packet_reader_t *reader, void *out_packet_data)
+{
+    packet_message_t *packet = out_packet_data;
+    packet->type = read_u8(reader);
+    if (packet->type >= MESSAGE_TYPE_COUNT) {
+        reader->error = true;
+        return;
+    }
+    packet->timestamp = read_i64(reader);
+    read_string(reader, packet->author, PLAYER_MAX_NAME_LENGTH);
+    read_string(reader, packet->content, MESSAGE_MAX_CONTENT_LENGTH);
+}
+
+static void serialize_message_history(packet_writer_t *writer, const void *packet_data)
+{
+    const packet_message_history_t *packet = packet_data;
+    ASSERT(packet->count <= MAX_MESSAGE_HISTORY_LENGTH);
+
+    write_u8(writer, (u8)packet->count);
+    for (u32 i = 0; i < packet->count; i++) {
+        serialize_message(writer, &packet->history[i]);
+    }
+}
+
+static void deserialize_message_history(packet_reader_t *reader, void *out_packet_data)
+{
+    packet_message_history_t *packet = out_packet_data;
+    packet->count = read_u8(reader);
+    if (packet->count > MAX_MESSAGE_HISTORY_LENGTH) {
+        reader->error = true;
+        return;
+    }
+    for (u32 i = 0; i < packet->count; i++) {
+        deserialize_message(reader, &packet->history[i]);
+    }
+}
+
+static void serialize_player_init(packet_writer_t *writer, const void *packet_data)
+{
+    const packet_player_init_t *packet = packet_data;
+    write_u32(writer, packet->id);
+    write_vec2(writer, packet->position);
+    write_vec3(writer, packet->color);
+    write_i32(writer, packet->health);
+    write_u8(writer, (u8)packet->state);
+    write_u8(writer, (u8)packet->direction);
+}
+
+static void deserialize_player_init(packet_reader_t *reader, void *out_packet_data)
+{
+    packet_player_init_t *packet = out_packet_data;
+    packet->id = read_u32(reader);
+    packet->position = read_vec2(reader);
+    packet->color = read_vec3(reader);
+    packet->health = read_i32(reader);
+    packet->state = read_u8(reader);
+    packet->direction = read_u8(reader);
+}
+
+static void serialize_player_init_confirm(packet_writer_t *writer, const void *packet_data)
+{
+    const packet_player_init_confirm_t *packet = packet_data;
+    write_u32(writer, packet->id);
+    write_string(writer, packet->name, PLAYER_MAX_NAME_LENGTH);
+}
+
+static void deserialize_player_init_confirm(packet_reader_t *reader, void *out_packet_data)
+{
+    packet_player_init_confirm_t *packet = out_packet_data;
+    packet->id = read_u32(reader);
+    read_string(reader, packet->name, PLAYER_MAX_NAME_LENGTH);
+}
+
+static void serialize_player_add(packet_writer_t *writer, const void *packet_data)
+{
+    const packet_player_add_t *packet = packet_data;
+    write_u32(writer, packet->id);
+    write_string(writer, packet->name, PLAYER_MAX_NAME_LENGTH);
+    write_vec2(writer, packet->position);
+    write_vec3(writer, packet->color);
+    write_i32(writer, packet->health);
+    write_u8(writer, (u8)packet->state);
+    write_u8(writer, (u8)packet->direction);
+}
+
+static void deserialize_player_add(packet_reader_t *reader, void *out_packet_data)
+{
+    packet_player_add_t *packet = out_packet_data;
+    packet->id = read_u32(reader);
+    read_string(reader, packet->name, PLAYER_MAX_NAME_LENGTH);
+    packet->position = read_vec2(reader);
+    packet->color = read_vec3(reader);
+    packet->health = read_i32(reader);
+    packet->state = read_u8(reader);
+    packet->direction = read_u8(reader);
+}
+
+/* PLAYER_REMOVE only carries the player id */
+static void serialize_player_id(packet_writer_t *writer, const void *packet_data)
+{
+    write_u32(writer, *(const player_id *)packet_data);
+}
+
+static void deserialize_player_id(packet_reader_t *reader, void *out_packet_data)
+{
+    *(player_id *)out_packet_data = read_u32(reader);
+}
+
+static void serialize_player_update(packet_writer_t *writer, const void *packet_data)
+{
+    const packet_player_update_t *packet = packet_data;
+    write_u32(writer, packet->seq_nr);
+    write_u32(writer, packet->id);
+    write_vec2(writer, packet->position);
+    write_u8(writer, packet->direction);
+    write_u8(writer, packet->state);
+}
+
+static void deserialize_player_update(packet_reader_t *reader, void *out_packet_data)
+{
+    packet_player_update_t *packet = out_packet_data;
+    packet->seq_nr = read_u32(reader);
+    packet->id = read_u32(reader);
+    packet->position = read_vec2(reader);
+    packet->direction = read_u8(reader);
+    packet->state = read_u8(reader);
+}
+
+/********************************************************************************
+ *  Player snapshot encoding:                                                   *
+ *    varint number, varint baseline, varint count                              *
+ *    per entry, in increasing id order:                                        *
+ *      varint id - previous id (0 for the first one), u8 fields                *
+ *      zigzag varint x_delta, y_delta          if SNAPSHOT_FIELD_POSITION      *
+ *      u8 (state << 4) | direction             if SNAPSHOT_FIELD_STATE         *
+ *      zigzag varint health_delta              if SNAPSHOT_FIELD_HEALTH        *
+ *      varint seq_nr_delta                     if SNAPSHOT_FIELD_SEQ_NR        *
+ *  A walking player costs about 5 bytes, an unchanged one costs nothing.       *
+ ********************************************************************************/
+
+STATIC_ASSERT(PLAYER_STATE_COUNT <= 16 && PLAYER_DIRECTION_COUNT <= 16, "state and direction must share a byte");
+
+#define SNAPSHOT_FIELD_MASK (SNAPSHOT_FIELD_POSITION | SNAPSHOT_FIELD_STATE | SNAPSHOT_FIELD_HEALTH | SNAPSHOT_FIELD_SEQ_NR | SNAPSHOT_FIELD_REMOVED)
+
+static void serialize_player_snapshot(packet_writer_t *writer, const void *packet_data)
+{
+    const packet_player_snapshot_t *packet = packet_data;
+    ASSERT(packet->count <= MAX_PLAYER_COUNT);
+
+    write_varint(writer, packet->number);
+    write_varint(writer, packet->baseline);
+    write_varint(writer, packet->count);
+
+    player_id previous_id = 0;
+    for (u32 i = 0; i < packet->count; i++) {
+        const packet_player_snapshot_entry_t *entry = &packet->entries[i];
+        ASSERT(entry->id > previous_id || i == 0);
+
+        write_varint(writer, entry->id - previous_id);
+        write_u8(writer, entry->fields);
+        if (entry->fields & SNAPSHOT_FIELD_POSITION) {
+            write_varint_signed(writer, entry->x_delta);
+            write_varint_signed(writer, entry->y_delta);
+        }
+        if (entry->fields & SNAPSHOT_FIELD_STATE) {
+            write_u8(writer, (u8)((entry->state << 4) | entry->direction));
+        }
+        if (entry->fields & SNAPSHOT_FIELD_HEALTH) {
+            write_varint_signed(writer, entry->health_delta);
+        }
+        if (entry->fields & SNAPSHOT_FIELD_SEQ_NR) {
+            write_varint(writer, entry->seq_nr_delta);
+        }
+        previous_id = entry->id;
+    }
+}
+
+static void deserialize_player_snapshot(packet_reader_t *reader, void *out_packet_data)
+{
+    packet_player_snapshot_t *packet = out_packet_data;
+    packet->number = read_varint(reader);
+    packet->baseline = read_varint(reader);
+    packet->count = read_varint(reader);
+    if (packet->count > MAX_PLAYER_COUNT || packet->baseline >= packet->number) {
+        reader->error = true;
+        return;
+    }
+
+    player_id previous_id = 0;
+    for (u32 i = 0; i < packet->count && !reader->error; i++) {
+        packet_player_snapshot_entry_t *entry = &packet->entries[i];
+        mem_zero(entry, sizeof(packet_player_snapshot_entry_t));
+
+        u32 id_delta = read_varint(reader);
+        entry->id = previous_id + id_delta;
+        entry->fields = read_u8(reader);
+        if ((id_delta == 0 && i > 0) || entry->id < previous_id || (entry->fields & ~SNAPSHOT_FIELD_MASK) ||
+            ((entry->fields & SNAPSHOT_FIELD_REMOVED) && entry->fields != SNAPSHOT_FIELD_REMOVED)) {
+            reader->error = true;
+            return;
+        }
+
+        if (entry->fields & SNAPSHOT_FIELD_POSITION) {
+            entry->x_delta = read_varint_signed(reader);
+            entry->y_delta = read_varint_signed(reader);
+        }
+        if (entry->fields & SNAPSHOT_FIELD_STATE) {
+            u8 state_direction = read_u8(reader);
+            entry->state = state_direction >> 4;
+            entry->direction = state_direction & 0x0f;
+            if (entry->state >= PLAYER_STATE_COUNT || entry->direction >= PLAYER_DIRECTION_COUNT) {
+                reader->error = true;
+                return;
+            }
+        }
+        if (entry->fields & SNAPSHOT_FIELD_HEALTH) {
+            entry->health_delta = read_varint_signed(reader);
+        }
+        if (entry->fields & SNAPSHOT_FIELD_SEQ_NR) {
+            entry->seq_nr_delta = read_varint(reader);
+        }
+        previous_id = entry->id;
+    }
+}
+
+static void serialize_player_snapshot_ack(packet_writer_t *writer, const void *packet_data)
+{
+    const packet_player_snapshot_ack_t *packet = packet_data;
+    write_varint(writer, packet->number);
+}
+
+static void deserialize_player_snapshot_ack(packet_reader_t *reader, void *out_packet_data)
+{
+    packet_player_snapshot_ack_t *packet = out_packet_data;
+    packet->number = read_varint(reader);
+}
+
+static void serialize_player_keypress(packet_writer_t *writer, const void *packet_data)
+{
+    const packet_player_keypress_t *packet = packet_data;
+    write_u32(writer, packet->id);
+    write_u32(writer, packet->seq_nr);
+    write_u32(writer, packet->key);
+    write_u32(writer, packet->mods);
+    write_u32(writer, packet->action);
+}
+
+static void deserialize_player_keypress(packet_reader_t *reader, void *out_packet_data)
+{
+    packet_player_keypress_t *packet = out_packet_data;
+    packet->id = read_u32(reader);
+    packet->seq_nr = read_u32(reader);
+    packet->key = read_u32(reader);
+    packet->mods = read_u32(reader);
+    packet->action = read_u32(reader);
+}
+
+static void serialize_player_input(packet_writer_t *writer, const void *packet_data)
+{
+    const packet_player_input_t *packet = packet_data;
+    ASSERT(packet->count <= PLAYER_INPUT_REDUNDANCY);
+
+    write_u8(writer, (u8)packet->count);
+    for (u32 i = 0; i < packet->count; i++) {
+        serialize_player_keypress(writer, &packet->keypresses[i]);
+    }
+}
+
+static void deserialize_player_input(packet_reader_t *reader, void *out_packet_data)
+{
+    packet_player_input_t *packet = out_packet_data;
+    packet->count = read_u8(reader);
+    if (packet->count > PLAYER_INPUT_REDUNDANCY) {
+        reader->error = true;
+        return;
+    }
+    for (u32 i = 0; i < packet->count; i++) {
+        deserialize_player_keypress(reader, &packet->keypresses[i]);
+    }
+}
+
+/* Shared by UDP_OFFER and UDP_HELLO, both carry a single u64 */
+static void serialize_u64_field(packet_writer_t *writer, const void *packet_data)
+{
+    write_u64(writer, *(const u64 *)packet_data);
+}
+
+static void deserialize_u64_field(packet_reader_t *reader, void *out_packet_data)
+{
+    *(u64 *)out_packet_data = read_u64(reader);
+}
+
+static void serialize_game_world_init(packet_writer_t *writer, const void *packet_data)
+{
+    const packet_game_world_init_t *packet = packet_data;
+    write_u32(writer, packet->map.seed);
+    write_i32(writer, packet->map.octave_count);
+    write_f32(writer, packet->map.bias);
+    write_u8(writer, (u8)packet->chunk_streaming_mode);
+}
+
+static void deserialize_game_world_init(packet_reader_t *reader, void *out_packet_data)
+{
+    packet_game_world_init_t *packet = out_packet_data;
+    packet->map.seed = read_u32(reader);
+    packet->map.octave_count = read_i32(reader);
+    packet->map.bias = read_f32(reader);
+    packet->chunk_streaming_mode = read_u8(reader);
+    if (packet->chunk_streaming_mode >= CHUNK_STREAMING_MODE_COUNT) {
+        reader->error = true;
+    }
+}
+
+static void serialize_game_world_object_remove(packet_writer_t *writer, const void *packet_data)
+{
+    const packet_game_world_object_remove_t *packet = packet_data;
+    write_i32(writer, packet->chunk_x);
+    write_i32(writer, packet->chunk_y);
+    write_u32(writer, packet->revision);
+    write_u32(writer, packet->tile_idx);
+    write_u8(writer, (u8)packet->type);
+}
+
+static void deserialize_game_world_object_remove(packet_reader_t *reader, void *out_packet_data)
+{
+    packet_game_world_object_remove_t *packet = out_packet_data;
+    packet->chunk_x = read_i32(reader);
+    packet->chunk_y = read_i32(reader);
+    packet->revision = read_u32(reader);
+    packet->tile_idx = read_u32(reader);
+    packet->type = read_u8(reader);
+}
+
+static void serialize_chunk_request(packet_writer_t *writer, const void *packet_data)
+{
+    const packet_chunk_request_t *packet = packet_data;
+    write_i32(writer, packet->x);
+    write_i32(writer, packet->y);
+}
+
+static void deserialize_chunk_request(packet_reader_t *reader, void *out_packet_data)
+{
+    packet_chunk_request_t *packet = out_packet_data;
+    packet->x = read_i32(reader);
+    packet->y = read_i32(reader);
+}
+
+static void serialize_chunk_batch_request(packet_writer_t *writer, const void *packet_data)
+{
+    const packet_chunk_batch_request_t *packet = packet_data;
+    ASSERT(packet->count <= CHUNK_BATCH_REQUEST_MAX_COUNT);
+
+    write_u16(writer, (u16)packet->count);
+    for (u32 i = 0; i < packet->count; i++) {
+        serialize_chunk_request(writer, &packet->chunks[i]);
+    }
+}
+
+static void deserialize_chunk_batch_request(packet_reader_t *reader, void *out_packet_data)
+{
+    packet_chunk_batch_request_t *packet = out_packet_data;
+    packet->count = read_u16(reader);
+    if (packet->count > CHUNK_BATCH_REQUEST_MAX_COUNT) {
+        reader->error = true;
+        return;
+    }
+    for (u32 i = 0; i < packet->count; i++) {
+        deserialize_chunk_request(reader, &packet->chunks[i]);
+    }
+}
+
+/********************************************************************************
+ *  Chunk response encoding:                                                    *
+ *    i32 x, y, u32 revision                                                    *
+ *    u8 palette_count, u8 palette[palette_count]  - tile types of the chunk    *
+ *    u8 runs[]  - (palette_index << run_bits) | (run_length - 1), where        *
+ *                 palette_index takes as few bits as the palette needs and     *
+ *                 the rest of the byte holds the run length, until all         *
+ *                 CHUNK_NUM_TILES tiles are covered                            *
+ *    u16 object_count, { u8 tile_idx, u8 type }[object_count]                  *
+ *    u8 has_noise_data, u8 noise[CHUNK_NUM_TILES] if set (debug builds only)   *
+ *  Objects are renumbered in tile order on decode, only the tile they stand    *
+ *  on and their type are meaningful to the client.                             *
+ ********************************************************************************/
+
+STATIC_ASSERT(CHUNK_NUM_TILES <= 256, "chunk tile indices must fit into a u8");
+STATIC_ASSERT(TILE_TYPE_COUNT <= 8, "tile palette indices must fit into 3 bits");
+
+static u32 chunk_palette_index_bits(u32 palette_count)
+{
+    u32 bits = 0;
+    while ((1u << bits) < palette_count) {
+        bits++;
+    }
+    return bits;
+}
+
+static void serialize_chunk_response(packet_writer_t *writer, const void *packet_data)
+{
+    const chunk_base_t *chunk = &((const packet_chunk_response_t *)packet_data)->chunk;
+    write_i32(writer, chunk->x);
+    write_i32(writer, chunk->y);
+    write_u32(writer, chunk->revision);
+
+    u8 palette[TILE_TYPE_COUNT];
+    i32 palette_indices[TILE_TYPE_COUNT];
+    u32 palette_count = 0;
+    for (u32 i = 0; i < TILE_TYPE_COUNT; i++) {
+        palette_indices[i] = -1;
+    }
+    for (u32 i = 0; i < CHUNK_NUM_TILES; i++) {
+        tile_type_e type = chunk->tiles[i].type;
+        ASSERT(type < TILE_TYPE_COUNT);
+        if (palette_indices[type] == -1) {
+            palette_indices[type] = palette_count;
+            palette[palette_count++] = (u8)type;
+        }
+    }
+    write_u8(writer, (u8)palette_count);
+    write_bytes(writer, palette, palette_count);
+
+    u32 run_bits = 8 - chunk_palette_index_bits(palette_count);
+    u32 max_run_length = 1u << run_bits;
+    for (u32 i = 0; i < CHUNK_NUM_TILES;) {
+        tile_type_e type = chunk->tiles[i].type;
+        u32 run_length = 1;
+        while (i + run_length < CHUNK_NUM_TILES && run_length < max_run_length && chunk->tiles[i + run_length].type == type) {
+            run_length++;
+        }
+        write_u8(writer, (u8)((palette_indices[type] << run_bits) | (run_length - 1)));
+        i += run_length;
+    }
+
+    u16 object_count = 0;
+    for (u32 i = 0; i < CHUNK_NUM_TILES; i++) {
+        if (chunk->tiles[i].object_index != INVALID_OBJECT_INDEX) {
+            object_count++;
+        }
+    }
+    write_u16(writer, object_count);
+    for (u32 i = 0; i < CHUNK_NUM_TILES; i++) {
+        i32 object_index = chunk->tiles[i].object_index;
+        if (object_index != INVALID_OBJECT_INDEX) {
+            write_u8(writer, (u8)i);
+            write_u8(writer, (u8)chunk->objects[object_index].type);
+        }
+    }
+
+#if defined(DEBUG)
+    // Only used to draw the noise overlay, so a byte per tile is plenty
+    write_u8(writer, true);
+    for (u32 i = 0; i < CHUNK_NUM_TILES; i++) {
+        f32 value = chunk->noise_data[i];
+        value = value < 0.0f ? 0.0f : (value > 1.0f ? 1.0f : value);
+        write_u8(writer, (u8)(value * 255.0f));
+    }
+#else
+    write_u8(writer, false);
+#endif
+}
+
+static void deserialize_chunk_response(packet_reader_t *reader, void *out_packet_data)
+{
+    chunk_base_t *chunk = &((packet_chunk_response_t *)out_packet_data)->chunk;
+    mem_zero(chunk, sizeof(chunk_base_t));
+    chunk->x = read_i32(reader);
+    chunk->y = read_i32(reader);
+    chunk->revision = read_u32(reader);
+
+    u8 palette[TILE_TYPE_COUNT];
+    u32 palette_count = read_u8(reader);
+    if (palette_count == 0 || palette_count > TILE_TYPE_COUNT) {
+        reader->error = true;
+        return;
+    }
+    read_bytes(reader, palette, palette_count);
+    for (u32 i = 0; i < palette_count; i++) {
+        if (palette[i] >= TILE_TYPE_COUNT) {
+            reader->error = true;
+            return;
+        }
+    }
+
+    u32 run_bits = 8 - chunk_palette_index_bits(palette_count);
+    for (u32 i = 0; i < CHUNK_NUM_TILES && !reader->error;) {
+        u8 run = read_u8(reader);
+        u32 palette_index = run >> run_bits;
+        u32 run_length = (run & ((1u << run_bits) - 1)) + 1;
+        if (palette_index >= palette_count || i + run_length > CHUNK_NUM_TILES) {
+            reader->error = true;
+            return;
+        }
+        for (u32 j = 0; j < run_length; j++, i++) {
+            chunk->tiles[i].type = palette[palette_index];
+            chunk->tiles[i].object_index = INVALID_OBJECT_INDEX;
+        }
+    }
+
+    u32 object_count = read_u16(reader);
+    if (object_count > CHUNK_NUM_TILES) {
+        reader->error = true;
+        return;
+    }
+    for (u32 i = 0; i < object_count && !reader->error; i++) {
+        u8 tile_idx = read_u8(reader);
+        u8 type = read_u8(reader);
+        if (type >= GAME_OBJECT_TYPE_COUNT || chunk->tiles[tile_idx].object_index != INVALID_OBJECT_INDEX) {
+            reader->error = true;
+            return;
+        }
+        chunk->objects[i].type = type;
+        chunk->tiles[tile_idx].object_index = i;
+    }
+
+    if (read_u8(reader)) {
+        u8 noise[CHUNK_NUM_TILES];
+        read_bytes(reader, noise, sizeof(noise));
+#if defined(DEBUG)
+        for (u32 i = 0; i < CHUNK_NUM_TILES; i++) {
+            // Centered within the quantization step, so converting back to a byte gives the same value
+            chunk->noise_data[i] = (noise[i] + 0.5f) / 255.0f;
+        }
+#endif
+    }
+}
+
+static void serialize_chunk_delta(packet_writer_t *writer, const void *packet_data)
+{
+    const packet_chunk_delta_t *packet = packet_data;
+    ASSERT(packet->removed_object_count <= CHUNK_NUM_TILES);
+
+    write_i32(writer, packet->x);
+    write_i32(writer, packet->y);
+    write_u32(writer, packet->revision);
+    write_u16(writer, (u16)packet->removed_object_count);
+    write_bytes(writer, packet->removed_object_tiles, packet->removed_object_count);
+}
+
+static void deserialize_chunk_delta(packet_reader_t *reader, void *out_packet_data)
+{
+    packet_chunk_delta_t *packet = out_packet_data;
+    packet->x = read_i32(reader);
+    packet->y = read_i32(reader);
+    packet->revision = read_u32(reader);
+    packet->removed_object_count = read_u16(reader);
+    if (packet->removed_object_count > CHUNK_NUM_TILES) {
+        reader->error = true;
+        return;
+    }
+    read_bytes(reader, packet->removed_object_tiles, packet->removed_object_count);
+}
+
+typedef void (*packet_serialize_pfn)(packet_writer_t *writer, const void *packet_data);
+typedef void (*packet_deserialize_pfn)(packet_reader_t *reader, void *out_packet_data);
+
+static const struct {
+    packet_serialize_pfn serialize;
+    packet_deserialize_pfn deserialize;
+} PACKET_SERIALIZERS[PACKET_TYPE_COUNT] = {
+    [PACKET_TYPE_PING]                     = { serialize_ping,                     deserialize_ping },
+    [PACKET_TYPE_MESSAGE]                  = { serialize_message,                  deserialize_message },
+    [PACKET_TYPE_MESSAGE_HISTORY]          = { serialize_message_history,          deserialize_message_history },
+    [PACKET_TYPE_PLAYER_INIT]              = { serialize_player_init,              deserialize_player_init },
+    [PACKET_TYPE_PLAYER_INIT_CONF]         = { serialize_player_init_confirm,      deserialize_player_init_confirm },
+    [PACKET_TYPE_PLAYER_ADD]               = { serialize_player_add,               deserialize_player_add },
+    [PACKET_TYPE_PLAYER_REMOVE]            = { serialize_player_id,                deserialize_player_id },
+    [PACKET_TYPE_PLAYER_UPDATE]            = { serialize_player_update,            deserialize_player_update },
+    [PACKET_TYPE_PLAYER_SNAPSHOT]          = { serialize_player_snapshot,          deserialize_player_snapshot },
+    [PACKET_TYPE_PLAYER_SNAPSHOT_ACK]      = { serialize_player_snapshot_ack,      deserialize_player_snapshot_ack },
+    [PACKET_TYPE_PLAYER_KEYPRESS]          = { serialize_player_keypress,          deserialize_player_keypress },
+    [PACKET_TYPE_GAME_WORLD_INIT]          = { serialize_game_world_init,          deserialize_game_world_init },
+    [PACKET_TYPE_GAME_WORLD_OBJECT_REMOVE] = { serialize_game_world_object_remove, deserialize_game_world_object_remove },
+    [PACKET_TYPE_CHUNK_REQUEST]            = { serialize_chunk_request,            deserialize_chunk_request },
+    [PACKET_TYPE_CHUNK_RESPONSE]           = { serialize_chunk_response,           deserialize_chunk_response },
+    [PACKET_TYPE_CHUNK_DELTA]              = { serialize_chunk_delta,              deserialize_chunk_delta },
+    [PACKET_TYPE_CHUNK_BATCH_REQUEST]      = { serialize_chunk_batch_request,      deserialize_chunk_batch_request },
+    [PACKET_TYPE_UDP_OFFER]                = { serialize_u64_field,                deserialize_u64_field },
+    [PACKET_TYPE_UDP_HELLO]                = { serialize_u64_field,                deserialize_u64_field },
+    [PACKET_TYPE_PLAYER_INPUT]             = { serialize_player_input,             deserialize_player_input }
+};
+
+u32 packet_serialize(u32 type, const void *packet_data, u8 *out_buffer, u32 capacity)
+{
+    ASSERT(type > PACKET_TYPE_HEADER && type < PACKET_TYPE_COUNT);
     ASSERT(packet_data);
+    ASSERT(out_buffer);
+
+    packet_writer_t writer = {
+        .data = out_buffer,
+        .capacity = capacity
+    };
+    PACKET_SERIALIZERS[type].serialize(&writer, packet_data);
 
+    return writer.overflow ? 0 : writer.size;
+}
+
+b8 packet_deserialize(u32 type, const u8 *buffer, u32 size, void *out_packet_data)
+{
+    ASSERT(out_packet_data);
+
+    // The type comes straight off the wire, it must name a packet the table has a deserializer for
+    if (type <= PACKET_TYPE_HEADER || type >= PACKET_TYPE_COUNT || PACKET_SERIALIZERS[type].deserialize == NULL) {
+        return false;
+    }
+
+    packet_reader_t reader = {
+        .data = buffer,
+        .size = size
+    };
+    PACKET_SERIALIZERS[type].deserialize(&reader, out_packet_data);
+
+    // Trailing bytes mean the sender disagrees with us on the layout, treat it the same as a short payload
+    return !reader.error && reader.offset == size;
+}
+
+u32 packet_encode(u32 type, const void *packet_data, u8 *out_buffer, u32 capacity)
+{
+    ASSERT(out_buffer);
+
+    if (capacity < sizeof(packet_header_t)) {
+        return 0;
+    }
+
+    u32 payload_capacity = capacity - sizeof(packet_header_t);
     packet_header_t header = {
         .type = type,
-        .size = PACKET_TYPE_SIZE[type]
+        .size = packet_serialize(type, packet_data, out_buffer + sizeof(packet_header_t),
+                                 payload_capacity < PACKET_MAX_SIZE ? payload_capacity : PACKET_MAX_SIZE)
     };
+    if (header.size == 0) {
+        return 0;
+    }
+    mem_copy(out_buffer, (void *)&header, sizeof(packet_header_t));
 
-    // TODO: Replace with arena allocator
-    u32 buffer_size = sizeof(packet_header_t) + header.size;
-    b8 *buffer = (b8 *)mem_alloc(buffer_size, MEMORY_TAG_NETWORK);
+    return sizeof(packet_header_t) + header.size;
+}
 
-    mem_copy(buffer, (void *)&header, sizeof(packet_header_t));
-    mem_copy(buffer + sizeof(packet_header_t), packet_data, header.size);
+b8 packet_send(i32 socket, u32 type, void *packet_data)
+{
+    ASSERT(type > PACKET_TYPE_NONE && type < PACKET_TYPE_COUNT);
+    ASSERT(packet_data);
+    ASSERT_MSG(!net_is_nonblocking(socket), "packet_send would have to wait on a non-blocking socket, use packet_enqueue");
+
+    u8 buffer[sizeof(packet_header_t) + PACKET_MAX_SIZE];
+    u32 buffer_size = packet_encode(type, packet_data, buffer, sizeof(buffer));
+    if (buffer_size == 0) {
+        LOG_ERROR("packet_send error: failed to serialize packet of type %u", type);
+        return false;
+    }
 
-    // TODO: Change it to add data to the queue instead of sending it straightaway
     i64 bytes_sent_total = 0;
     i64 bytes_sent = 0;
     while (bytes_sent_total < buffer_size) {
-        bytes_sent = net_send(socket, buffer + bytes_sent, buffer_size - bytes_sent, 0);
+        bytes_sent = net_send(socket, buffer + bytes_sent_total, buffer_size - bytes_sent_total, 0);
         if (bytes_sent == -1) {
-            LOG_ERROR("packet_enqueue error: %s", strerror(errno));
-            return false;
+            if (errno == EINTR) {
+                continue;
+            }
+            LOG_ERROR("packet_send error: %s", strerror(errno));
+            break;
         }
         bytes_sent_total += bytes_sent;
     }
 
-    mem_free(buffer, buffer_size, MEMORY_TAG_NETWORK);
-
     return bytes_sent_total == buffer_size;
 }
 
+b8 packet_enqueue(send_queue_t *queue, u32 type, void *packet_data)
+{
+    ASSERT(queue);
+    ASSERT(type > PACKET_TYPE_NONE && type < PACKET_TYPE_COUNT);
+    ASSERT(packet_data);
+
+    u8 buffer[sizeof(packet_header_t) + PACKET_MAX_SIZE];
+    u32 buffer_size = packet_encode(type, packet_data, buffer, sizeof(buffer));
+    if (buffer_size == 0) {
+        LOG_ERROR("packet_enqueue error: failed to serialize packet of type %u", type);
+        return false;
+    }
+
+    struct iovec parts[1] = {
+        { .iov_base = buffer, .iov_len = buffer_size }
+    };
+
+    return send_queue_push(queue, parts, ARRAY_SIZE(parts));
+}
+
 u64 packet_get_next_sequence_number(void)
 {
     return packet_sequence_number++;
@@ -5,8 +5,13 @@
 #include "common/global.h"
 #include "common/player_types.h"
 #include "common/game_world_types.h"
+#include "common/send_queue.h"
 
 #define MAX_GAME_OBJECTS_TRANSFER 16
+#define CHUNK_BATCH_REQUEST_MAX_COUNT 64
+#define SNAPSHOT_NONE 0
+#define SNAPSHOT_POSITION_SCALE 16 /* Snapshot positions are fixed point with 1/16 pixel precision */
+#define PLAYER_INPUT_REDUNDANCY 8  /* Latest keypresses repeated in every input datagram */
 
 typedef enum {
     PACKET_TYPE_NONE,
@@ -19,14 +24,18 @@ typedef enum {
     PACKET_TYPE_PLAYER_ADD,
     PACKET_TYPE_PLAYER_REMOVE,
     PACKET_TYPE_PLAYER_UPDATE,
-    PACKET_TYPE_PLAYER_HEALTH,
-    PACKET_TYPE_PLAYER_DEATH,
-    PACKET_TYPE_PLAYER_RESPAWN,
+    PACKET_TYPE_PLAYER_SNAPSHOT,
+    PACKET_TYPE_PLAYER_SNAPSHOT_ACK,
     PACKET_TYPE_PLAYER_KEYPRESS,
     PACKET_TYPE_GAME_WORLD_INIT,
     PACKET_TYPE_GAME_WORLD_OBJECT_REMOVE,
     PACKET_TYPE_CHUNK_REQUEST,
     PACKET_TYPE_CHUNK_RESPONSE,
+    PACKET_TYPE_CHUNK_DELTA,
+    PACKET_TYPE_CHUNK_BATCH_REQUEST,
+    PACKET_TYPE_UDP_OFFER,
+    PACKET_TYPE_UDP_HELLO,
+    PACKET_TYPE_PLAYER_INPUT,
     PACKET_TYPE_COUNT
 } packet_type_e;
 
@@ -37,6 +46,12 @@ typedef enum {
     MESSAGE_TYPE_COUNT
 } message_type_e;
 
+typedef enum {
+    CHUNK_STREAMING_MODE_FULL, /* server answers chunk requests with the whole chunk */
+    CHUNK_STREAMING_MODE_SEED, /* client generates chunks from the map, server only answers with deltas of modified chunks */
+    CHUNK_STREAMING_MODE_COUNT
+} chunk_streaming_mode_e;
+
 typedef struct {
     u32 type;
     u32 size;
@@ -94,22 +109,37 @@ typedef struct {
     u8 state;
 } packet_player_update_t;
 
+/* Fields carried by a snapshot entry, the rest is unchanged since the baseline */
+typedef enum {
+    SNAPSHOT_FIELD_POSITION = 1 << 0,
+    SNAPSHOT_FIELD_STATE    = 1 << 1, /* state and direction */
+    SNAPSHOT_FIELD_HEALTH   = 1 << 2,
+    SNAPSHOT_FIELD_SEQ_NR   = 1 << 3, /* only ever sent for the receiving player */
+    SNAPSHOT_FIELD_REMOVED  = 1 << 4  /* player is gone, no other field is set */
+} snapshot_field_e;
+
+/* Differences against the same player in the baseline, players missing from it have a zero baseline */
 typedef struct {
     player_id id;
-    u32 damage;
-} packet_player_health_t;
+    u8 fields;
+    i32 x_delta, y_delta; /* fixed point, see SNAPSHOT_POSITION_SCALE */
+    i32 health_delta;
+    u32 seq_nr_delta;
+    u8 state;
+    u8 direction;
+} packet_player_snapshot_entry_t;
 
+/* Every player which changed since the baseline snapshot the client acknowledged, sorted by id */
 typedef struct {
-    player_id id;
-} packet_player_death_t;
+    u32 number;   /* Increases whenever the state of any player changes */
+    u32 baseline; /* SNAPSHOT_NONE if the entries are absolute */
+    u32 count;
+    packet_player_snapshot_entry_t entries[MAX_PLAYER_COUNT];
+} packet_player_snapshot_t;
 
 typedef struct {
-    player_id id;
-    i32 health;
-    vec2 position;
-    player_state_e state;
-    player_direction_e direction;
-} packet_player_respawn_t;
+    u32 number; /* SNAPSHOT_NONE asks for a full snapshot */
+} packet_player_snapshot_ack_t;
 
 typedef struct {
     player_id id;
@@ -119,12 +149,31 @@ typedef struct {
     u32 action;
 } packet_player_keypress_t;
 
+/* Keypresses sent over UDP, oldest first. Every datagram repeats the latest ones,
+   the server skips those it already processed by their sequence number */
+typedef struct {
+    u32 count;
+    packet_player_keypress_t keypresses[PLAYER_INPUT_REDUNDANCY];
+} packet_player_input_t;
+
+/* Sent by the server over TCP right after validation, the client may then switch to UDP */
+typedef struct {
+    u64 token; /* Prefixes every datagram of the connection */
+} packet_udp_offer_t;
+
+/* Sent by the client until the server echoes it back, which tells both sides the channel works */
+typedef struct {
+    u64 time;
+} packet_udp_hello_t;
+
 typedef struct {
     game_map_t map;
+    chunk_streaming_mode_e chunk_streaming_mode;
 } packet_game_world_init_t;
 
 typedef struct {
     i32 chunk_x, chunk_y;
+    u32 revision; /* Revision of the chunk after the removal */
     u32 tile_idx;
     game_object_type_e type;
 } packet_game_world_object_remove_t;
@@ -133,30 +182,42 @@ typedef struct {
     i32 x, y;
 } packet_chunk_request_t;
 
+/* Ordered by priority, nearest to the camera first - the server answers in the same order */
+typedef struct {
+    u32 count;
+    packet_chunk_request_t chunks[CHUNK_BATCH_REQUEST_MAX_COUNT];
+} packet_chunk_batch_request_t;
+
 typedef struct {
     chunk_base_t chunk;
 } packet_chunk_response_t;
 
-static const u32 PACKET_TYPE_SIZE[PACKET_TYPE_COUNT] = {
-    [PACKET_TYPE_NONE]                      = 0,
-    [PACKET_TYPE_HEADER]                    = sizeof(packet_header_t),
-    [PACKET_TYPE_PING]                      = sizeof(packet_ping_t),
-    [PACKET_TYPE_MESSAGE]                   = sizeof(packet_message_t),
-    [PACKET_TYPE_MESSAGE_HISTORY]           = sizeof(packet_message_history_t),
-    [PACKET_TYPE_PLAYER_INIT]               = sizeof(packet_player_init_t),
-    [PACKET_TYPE_PLAYER_INIT_CONF]          = sizeof(packet_player_init_confirm_t),
-    [PACKET_TYPE_PLAYER_ADD]                = sizeof(packet_player_add_t),
-    [PACKET_TYPE_PLAYER_REMOVE]             = sizeof(packet_player_remove_t),
-    [PACKET_TYPE_PLAYER_UPDATE]             = sizeof(packet_player_update_t),
-    [PACKET_TYPE_PLAYER_HEALTH]             = sizeof(packet_player_health_t),
-    [PACKET_TYPE_PLAYER_DEATH]              = sizeof(packet_player_death_t),
-    [PACKET_TYPE_PLAYER_RESPAWN]            = sizeof(packet_player_respawn_t),
-    [PACKET_TYPE_PLAYER_KEYPRESS]           = sizeof(packet_player_keypress_t),
-    [PACKET_TYPE_GAME_WORLD_INIT]           = sizeof(packet_game_world_init_t),
-    [PACKET_TYPE_GAME_WORLD_OBJECT_REMOVE]  = sizeof(packet_game_world_object_remove_t),
-    [PACKET_TYPE_CHUNK_REQUEST]             = sizeof(packet_chunk_request_t),
-    [PACKET_TYPE_CHUNK_RESPONSE]            = sizeof(packet_chunk_response_t)
-};
-
+/* Every modification of a chunk relative to how it was generated, so a newer delta supersedes older ones */
+typedef struct {
+    i32 x, y;
+    u32 revision;
+    u32 removed_object_count;
+    u8 removed_object_tiles[CHUNK_NUM_TILES];
+} packet_chunk_delta_t;
+
+/********************************************************************************
+ *  Wire format: packet_header_t followed by header.size bytes of payload.      *
+ *  Payloads are written field by field by per-type serializers, so the structs *
+ *  above are only the in-memory representation. Strings are sent with a u16    *
+ *  length prefix instead of their full NUL-padded arrays.                      *
+ ********************************************************************************/
+
+#define PACKET_MAX_SIZE KiB(8) /* Upper bound of a serialized payload, header excluded */
+
+/* Writes the payload of the packet into out_buffer, returns its size or 0 if it did not fit into capacity */
+u32 packet_serialize(u32 type, const void *packet_data, u8 *out_buffer, u32 capacity);
+/* Fills the packet struct from exactly 'size' bytes of payload, returns false if the payload is malformed */
+b8  packet_deserialize(u32 type, const u8 *buffer, u32 size, void *out_packet_data);
+/* Writes the header followed by the payload, returns the total size or 0 if it did not fit into capacity */
+u32 packet_encode(u32 type, const void *packet_data, u8 *out_buffer, u32 capacity);
+
+/* Writes the packet right away and blocks until all of it was sent, so it is only meant for the client's
+   blocking TCP socket. The server's sockets are non-blocking, it queues packets with packet_enqueue instead */
 b8 packet_send(i32 socket, u32 type, void *packet_data);
+b8 packet_enqueue(send_queue_t *queue, u32 type, void *packet_data);
 u64 packet_get_next_sequence_number(void);
@@ -6,10 +6,20 @@
 
 #include "common/asserts.h"
 
-#define PERLIN_SIZE 256
-
-static i32 perm[PERLIN_SIZE * 2];
-static f32 grad[PERLIN_SIZE * 2][2];
+#if defined(__x86_64__) || defined(__i386__)
+    #include <immintrin.h>
+    #if defined(__SSE2__)
+        #define PERLIN_NOISE_HAS_SSE2 1
+    #else
+        #define PERLIN_NOISE_HAS_SSE2 0
+    #endif
+    #define PERLIN_NOISE_HAS_AVX2 1
+    /* Compiled for AVX2 regardless of -march, only called after checking the cpu supports it */
+    #define AVX2_TARGET __attribute__((target("avx2")))
+#else
+    #define PERLIN_NOISE_HAS_SSE2 0
+    #define PERLIN_NOISE_HAS_AVX2 0
+#endif
 
 static f32 fade(f32 t)
 {
@@ -29,7 +39,7 @@ static f32 grad_dot(i32 hash, f32 x, f32 y)
     return ((h & 1) ? -u : u) + ((h & 2) ? -2.0 * v : 2.0 * v);
 }
 
-static f32 perlin(f32 x, f32 y)
+static f32 perlin(const i32 *perm, f32 x, f32 y)
 {
     i32 X = (i32)floor(x) & (PERLIN_SIZE - 1);
     i32 Y = (i32)floor(y) & (PERLIN_SIZE - 1);
@@ -48,16 +58,20 @@ static f32 perlin(f32 x, f32 y)
     );
 }
 
-void init_perlin_noise(u32 seed)
+void perlin_context_create(u32 seed, perlin_context_t *out_context)
 {
+    ASSERT(out_context);
+
+    out_context->seed = seed;
+    i32 *perm = out_context->perm;
+
     srand(seed);
     for (i32 i = 0; i < PERLIN_SIZE; i++) {
         perm[i] = i;
-        grad[i][0] = (f32)(rand() % (PERLIN_SIZE * 2) - PERLIN_SIZE) / PERLIN_SIZE;
-        grad[i][1] = (f32)(rand() % (PERLIN_SIZE * 2) - PERLIN_SIZE) / PERLIN_SIZE;
-        f32 length = sqrt(grad[i][0] * grad[i][0] + grad[i][1] * grad[i][1]);
-        grad[i][0] /= length;
-        grad[i][1] /= length;
+        // Gradients are implied by the hash in grad_dot(), but the two draws per entry are kept
+        // so the shuffle below, and therefore every existing world, stays the same for a given seed
+        (void)rand();
+        (void)rand();
     }
     for (i32 i = PERLIN_SIZE - 1; i > 0; i--) {
         i32 j = rand() % (i + 1);
@@ -67,16 +81,12 @@ void init_perlin_noise(u32 seed)
     }
     for (i32 i = 0; i < PERLIN_SIZE; i++) {
         perm[PERLIN_SIZE + i] = perm[i];
-        grad[PERLIN_SIZE + i][0] = grad[i][0];
-        grad[PERLIN_SIZE + i][1] = grad[i][1];
     }
 }
 
-void perlin_noise_generate_2d(perlin_noise_config_t config, f32 *output)
+void perlin_noise_generate_2d_scalar(const perlin_context_t *context, perlin_noise_config_t config, f32 *output)
 {
-    ASSERT(output);
-
-    init_perlin_noise(config.seed);
+    ASSERT(context && output);
 
     for (i32 x = 0; x < config.width; x++) {
         for (i32 y = 0; y < config.height; y++) {
@@ -93,7 +103,7 @@ void perlin_noise_generate_2d(perlin_noise_config_t config, f32 *output)
                 f32 sample_x = (config.pos_x + x) / pitch;
                 f32 sample_y = (config.pos_y + y) / pitch;
 
-                noise += perlin(sample_x, sample_y) * scale;
+                noise += perlin(context->perm, sample_x, sample_y) * scale;
                 scale_accumulator += scale;
                 scale /= config.scaling_bias;
             }
@@ -106,3 +116,246 @@ void perlin_noise_generate_2d(perlin_noise_config_t config, f32 *output)
         }
     }
 }
+
+/********************************************************************************
+ *  SIMD kernels. Each lane evaluates one output column of a row, going through *
+ *  exactly the same sequence of f32 operations as the scalar version - no FMA, *
+ *  same evaluation order - so results are identical whenever the scalar code's *
+ *  f64 intermediates in grad_dot() are exact, which holds for chunk-aligned    *
+ *  samples with power-of-two widths. See PERLIN_NOISE_SIMD_TOLERANCE.          *
+ ********************************************************************************/
+
+#if PERLIN_NOISE_HAS_SSE2
+
+INLINE __m128 sse2_floor(__m128 x)
+{
+    // SSE2 only truncates towards zero, so step down for negative non-integers
+    __m128 truncated = _mm_cvtepi32_ps(_mm_cvttps_epi32(x));
+    return _mm_sub_ps(truncated, _mm_and_ps(_mm_cmpgt_ps(truncated, x), _mm_set1_ps(1.0f)));
+}
+
+INLINE __m128 sse2_fade(__m128 t)
+{
+    __m128 inner = _mm_add_ps(_mm_mul_ps(t, _mm_sub_ps(_mm_mul_ps(t, _mm_set1_ps(6.0f)), _mm_set1_ps(15.0f))), _mm_set1_ps(10.0f));
+    return _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(t, t), t), inner);
+}
+
+INLINE __m128 sse2_lerp(__m128 t, __m128 a, __m128 b)
+{
+    return _mm_add_ps(a, _mm_mul_ps(t, _mm_sub_ps(b, a)));
+}
+
+INLINE __m128 sse2_grad_dot(__m128i hash, __m128 x, __m128 y)
+{
+    __m128i h = _mm_and_si128(hash, _mm_set1_epi32(7));
+    __m128 swap = _mm_castsi128_ps(_mm_cmplt_epi32(h, _mm_set1_epi32(4)));
+    __m128 u = _mm_or_ps(_mm_and_ps(swap, x), _mm_andnot_ps(swap, y));
+    __m128 v = _mm_or_ps(_mm_and_ps(swap, y), _mm_andnot_ps(swap, x));
+    // Negation by flipping the sign bit, taken straight from bits 0 and 1 of the hash
+    __m128 u_sign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(h, _mm_set1_epi32(1)), 31));
+    __m128 v_sign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(h, _mm_set1_epi32(2)), 30));
+    return _mm_add_ps(_mm_xor_ps(u, u_sign), _mm_xor_ps(_mm_mul_ps(v, _mm_set1_ps(2.0f)), v_sign));
+}
+
+INLINE __m128i sse2_gather(const i32 *table, __m128i indices)
+{
+    // No gather instruction before AVX2
+    i32 idx[4];
+    _mm_storeu_si128((__m128i *)idx, indices);
+    return _mm_setr_epi32(table[idx[0]], table[idx[1]], table[idx[2]], table[idx[3]]);
+}
+
+INLINE __m128 sse2_perlin(const i32 *perm, __m128 x, __m128 y)
+{
+    __m128 floor_x = sse2_floor(x);
+    __m128 floor_y = sse2_floor(y);
+    __m128i mask = _mm_set1_epi32(PERLIN_SIZE - 1);
+    __m128i one = _mm_set1_epi32(1);
+    __m128i X = _mm_and_si128(_mm_cvttps_epi32(floor_x), mask);
+    __m128i Y = _mm_and_si128(_mm_cvttps_epi32(floor_y), mask);
+    x = _mm_sub_ps(x, floor_x);
+    y = _mm_sub_ps(y, floor_y);
+    __m128 u = sse2_fade(x);
+    __m128 v = sse2_fade(y);
+    __m128i a = sse2_gather(perm, X);
+    __m128i b = sse2_gather(perm, _mm_add_epi32(X, one));
+    __m128i aa = _mm_add_epi32(a, Y);
+    __m128i ab = _mm_add_epi32(aa, one);
+    __m128i ba = _mm_add_epi32(b, Y);
+    __m128i bb = _mm_add_epi32(ba, one);
+    __m128 x1 = _mm_sub_ps(x, _mm_set1_ps(1.0f));
+    __m128 y1 = _mm_sub_ps(y, _mm_set1_ps(1.0f));
+    return sse2_lerp(
+        v,
+        sse2_lerp(u, sse2_grad_dot(sse2_gather(perm, aa), x, y ), sse2_grad_dot(sse2_gather(perm, ba), x1, y )),
+        sse2_lerp(u, sse2_grad_dot(sse2_gather(perm, ab), x, y1), sse2_grad_dot(sse2_gather(perm, bb), x1, y1))
+    );
+}
+
+static void perlin_noise_generate_2d_sse2(const perlin_context_t *context, perlin_noise_config_t config, f32 *output)
+{
+    for (u32 y = 0; y < config.height; y++) {
+        for (u32 x = 0; x < config.width; x += 4) {
+            __m128 noise = _mm_setzero_ps();
+            f32 scale_accumulator = 0.0f;
+            f32 scale = 1.0f;
+
+            __m128i column = _mm_add_epi32(_mm_set1_epi32(config.pos_x + x), _mm_setr_epi32(0, 1, 2, 3));
+            __m128 row = _mm_set1_ps((f32)(config.pos_y + (i32)y));
+            __m128 column_f = _mm_cvtepi32_ps(column);
+
+            for (i32 o = 0; o < config.octave_count; o++) {
+                f32 pitch = config.width >> o;
+                if (pitch == 0) {
+                    pitch = 1;
+                }
+
+                __m128 pitch_v = _mm_set1_ps(pitch);
+                __m128 sample = sse2_perlin(context->perm, _mm_div_ps(column_f, pitch_v), _mm_div_ps(row, pitch_v));
+                noise = _mm_add_ps(noise, _mm_mul_ps(sample, _mm_set1_ps(scale)));
+                scale_accumulator += scale;
+                scale /= config.scaling_bias;
+            }
+
+            noise = _mm_div_ps(noise, _mm_set1_ps(scale_accumulator));
+            noise = _mm_div_ps(_mm_add_ps(noise, _mm_set1_ps(1.0f)), _mm_set1_ps(2.0f));
+            noise = _mm_min_ps(_mm_max_ps(noise, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+            _mm_storeu_ps(&output[y * config.width + x], noise);
+        }
+    }
+}
+
+#endif // PERLIN_NOISE_HAS_SSE2
+
+#if PERLIN_NOISE_HAS_AVX2
+
+AVX2_TARGET INLINE __m256 avx2_fade(__m256 t)
+{
+    __m256 inner = _mm256_add_ps(_mm256_mul_ps(t, _mm256_sub_ps(_mm256_mul_ps(t, _mm256_set1_ps(6.0f)), _mm256_set1_ps(15.0f))), _mm256_set1_ps(10.0f));
+    return _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(t, t), t), inner);
+}
+
+AVX2_TARGET INLINE __m256 avx2_lerp(__m256 t, __m256 a, __m256 b)
+{
+    return _mm256_add_ps(a, _mm256_mul_ps(t, _mm256_sub_ps(b, a)));
+}
+
+AVX2_TARGET INLINE __m256 avx2_grad_dot(__m256i hash, __m256 x, __m256 y)
+{
+    __m256i h = _mm256_and_si256(hash, _mm256_set1_epi32(7));
+    __m256 swap = _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_set1_epi32(4), h));
+    __m256 u = _mm256_blendv_ps(y, x, swap);
+    __m256 v = _mm256_blendv_ps(x, y, swap);
+    __m256 u_sign = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(h, _mm256_set1_epi32(1)), 31));
+    __m256 v_sign = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(h, _mm256_set1_epi32(2)), 30));
+    return _mm256_add_ps(_mm256_xor_ps(u, u_sign), _mm256_xor_ps(_mm256_mul_ps(v, _mm256_set1_ps(2.0f)), v_sign));
+}
+
+AVX2_TARGET INLINE __m256 avx2_perlin(const i32 *perm, __m256 x, __m256 y)
+{
+    __m256 floor_x = _mm256_floor_ps(x);
+    __m256 floor_y = _mm256_floor_ps(y);
+    __m256i mask = _mm256_set1_epi32(PERLIN_SIZE - 1);
+    __m256i one = _mm256_set1_epi32(1);
+    __m256i X = _mm256_and_si256(_mm256_cvttps_epi32(floor_x), mask);
+    __m256i Y = _mm256_and_si256(_mm256_cvttps_epi32(floor_y), mask);
+    x = _mm256_sub_ps(x, floor_x);
+    y = _mm256_sub_ps(y, floor_y);
+    __m256 u = avx2_fade(x);
+    __m256 v = avx2_fade(y);
+    __m256i a = _mm256_i32gather_epi32(perm, X, 4);
+    __m256i b = _mm256_i32gather_epi32(perm, _mm256_add_epi32(X, one), 4);
+    __m256i aa = _mm256_add_epi32(a, Y);
+    __m256i ab = _mm256_add_epi32(aa, one);
+    __m256i ba = _mm256_add_epi32(b, Y);
+    __m256i bb = _mm256_add_epi32(ba, one);
+    __m256 x1 = _mm256_sub_ps(x, _mm256_set1_ps(1.0f));
+    __m256 y1 = _mm256_sub_ps(y, _mm256_set1_ps(1.0f));
+    return avx2_lerp(
+        v,
+        avx2_lerp(u, avx2_grad_dot(_mm256_i32gather_epi32(perm, aa, 4), x, y ), avx2_grad_dot(_mm256_i32gather_epi32(perm, ba, 4), x1, y )),
+        avx2_lerp(u, avx2_grad_dot(_mm256_i32gather_epi32(perm, ab, 4), x, y1), avx2_grad_dot(_mm256_i32gather_epi32(perm, bb, 4), x1, y1))
+    );
+}
+
+AVX2_TARGET static void perlin_noise_generate_2d_avx2(const perlin_context_t *context, perlin_noise_config_t config, f32 *output)
+{
+    for (u32 y = 0; y < config.height; y++) {
+        for (u32 x = 0; x < config.width; x += 8) {
+            __m256 noise = _mm256_setzero_ps();
+            f32 scale_accumulator = 0.0f;
+            f32 scale = 1.0f;
+
+            __m256i column = _mm256_add_epi32(_mm256_set1_epi32(config.pos_x + x), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+            __m256 row = _mm256_set1_ps((f32)(config.pos_y + (i32)y));
+            __m256 column_f = _mm256_cvtepi32_ps(column);
+
+            for (i32 o = 0; o < config.octave_count; o++) {
+                f32 pitch = config.width >> o;
+                if (pitch == 0) {
+                    pitch = 1;
+                }
+
+                __m256 pitch_v = _mm256_set1_ps(pitch);
+                __m256 sample = avx2_perlin(context->perm, _mm256_div_ps(column_f, pitch_v), _mm256_div_ps(row, pitch_v));
+                noise = _mm256_add_ps(noise, _mm256_mul_ps(sample, _mm256_set1_ps(scale)));
+                scale_accumulator += scale;
+                scale /= config.scaling_bias;
+            }
+
+            noise = _mm256_div_ps(noise, _mm256_set1_ps(scale_accumulator));
+            noise = _mm256_div_ps(_mm256_add_ps(noise, _mm256_set1_ps(1.0f)), _mm256_set1_ps(2.0f));
+            noise = _mm256_min_ps(_mm256_max_ps(noise, _mm256_setzero_ps()), _mm256_set1_ps(1.0f));
+            _mm256_storeu_ps(&output[y * config.width + x], noise);
+        }
+    }
+}
+
+#endif // PERLIN_NOISE_HAS_AVX2
+
+perlin_noise_kernel_e perlin_noise_select_kernel(u32 width)
+{
+#if PERLIN_NOISE_HAS_AVX2
+    if (width % 8 == 0 && __builtin_cpu_supports("avx2")) {
+        return PERLIN_NOISE_KERNEL_AVX2;
+    }
+#endif
+#if PERLIN_NOISE_HAS_SSE2
+    if (width % 4 == 0) {
+        return PERLIN_NOISE_KERNEL_SSE2;
+    }
+#endif
+    UNUSED(width);
+    return PERLIN_NOISE_KERNEL_SCALAR;
+}
+
+const char *perlin_noise_kernel_name(perlin_noise_kernel_e kernel)
+{
+    switch (kernel) {
+        case PERLIN_NOISE_KERNEL_SCALAR: return "scalar";
+        case PERLIN_NOISE_KERNEL_SSE2:   return "sse2";
+        case PERLIN_NOISE_KERNEL_AVX2:   return "avx2";
+    }
+    return "unknown";
+}
+
+void perlin_noise_generate_2d(const perlin_context_t *context, perlin_noise_config_t config, f32 *output)
+{
+    ASSERT(context && output);
+
+    switch (perlin_noise_select_kernel(config.width)) {
+#if PERLIN_NOISE_HAS_AVX2
+        case PERLIN_NOISE_KERNEL_AVX2:
+            perlin_noise_generate_2d_avx2(context, config, output);
+            return;
+#endif
+#if PERLIN_NOISE_HAS_SSE2
+        case PERLIN_NOISE_KERNEL_SSE2:
+            perlin_noise_generate_2d_sse2(context, config, output);
+            return;
+#endif
+        default:
+            perlin_noise_generate_2d_scalar(context, config, output);
+            return;
+    }
+}
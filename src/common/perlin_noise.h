@@ -2,14 +2,38 @@
 
 #include "defines.h"
 
+#define PERLIN_SIZE 256
+
+/* Permutation table for a single seed. Built once per world and only read afterwards, so generation using it is reentrant */
+typedef struct {
+    u32 seed;
+    i32 perm[PERLIN_SIZE * 2];
+} perlin_context_t;
+
 typedef struct {
     i32 pos_x;
     i32 pos_y;
     u32 width;
     u32 height;
-    u32 seed;
     i32 octave_count;
     f32 scaling_bias;
 } perlin_noise_config_t;
 
-void perlin_noise_generate_2d(perlin_noise_config_t config, f32 *output);
+void perlin_context_create(u32 seed, perlin_context_t *out_context);
+/* SIMD kernels match the scalar one bit-for-bit for chunk-aligned power-of-two widths, for other sizes
+   the scalar f64 intermediates can round differently and results stay within this absolute difference */
+#define PERLIN_NOISE_SIMD_TOLERANCE 1e-6f
+
+typedef enum {
+    PERLIN_NOISE_KERNEL_SCALAR,
+    PERLIN_NOISE_KERNEL_SSE2,
+    PERLIN_NOISE_KERNEL_AVX2
+} perlin_noise_kernel_e;
+
+/* Picks the widest kernel the cpu supports whose lane count divides width */
+perlin_noise_kernel_e perlin_noise_select_kernel(u32 width);
+const char           *perlin_noise_kernel_name(perlin_noise_kernel_e kernel);
+
+void perlin_noise_generate_2d(const perlin_context_t *context, perlin_noise_config_t config, f32 *output);
+/* Reference implementation, always evaluates one sample at a time */
+void perlin_noise_generate_2d_scalar(const perlin_context_t *context, perlin_noise_config_t config, f32 *output);
@@ -0,0 +1,77 @@
+#include "recv_buffer.h"
+
+#include <errno.h>
+#include <stddef.h>
+
+#include "common/net.h"
+#include "common/asserts.h"
+#include "common/memory/memutils.h"
+
+void recv_buffer_create(u32 capacity, recv_buffer_t *out_buffer)
+{
+    ASSERT(out_buffer);
+    ASSERT(capacity > 0);
+
+    out_buffer->data = mem_alloc(capacity, MEMORY_TAG_NETWORK);
+    out_buffer->capacity = capacity;
+    out_buffer->read_offset = 0;
+    out_buffer->write_offset = 0;
+}
+
+void recv_buffer_destroy(recv_buffer_t *buffer)
+{
+    ASSERT(buffer && buffer->data);
+
+    mem_free(buffer->data, buffer->capacity, MEMORY_TAG_NETWORK);
+    buffer->data = NULL;
+    buffer->capacity = 0;
+    buffer->read_offset = 0;
+    buffer->write_offset = 0;
+}
+
+recv_buffer_fill_result_e recv_buffer_fill(recv_buffer_t *buffer, i32 socket)
+{
+    ASSERT(buffer && buffer->data);
+
+    // Move the partial packet left over from previous reads to the front to make room behind it
+    if (buffer->read_offset > 0) {
+        u32 length = recv_buffer_length(buffer);
+        if (length > 0) {
+            mem_move(buffer->data, buffer->data + buffer->read_offset, length);
+        }
+        buffer->read_offset = 0;
+        buffer->write_offset = length;
+    }
+
+    if (buffer->write_offset == buffer->capacity) {
+        return RECV_BUFFER_FILL_FULL;
+    }
+
+    for (;;) {
+        i64 bytes_read = net_recv(socket, buffer->data + buffer->write_offset, buffer->capacity - buffer->write_offset, 0);
+        if (bytes_read > 0) {
+            buffer->write_offset += bytes_read;
+            return RECV_BUFFER_FILL_OK;
+        }
+        if (bytes_read == 0) {
+            return RECV_BUFFER_FILL_CLOSED;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        return (errno == EAGAIN || errno == EWOULDBLOCK) ? RECV_BUFFER_FILL_WOULD_BLOCK : RECV_BUFFER_FILL_ERROR;
+    }
+}
+
+void recv_buffer_consume(recv_buffer_t *buffer, u32 size)
+{
+    ASSERT(buffer);
+    ASSERT(size <= recv_buffer_length(buffer));
+
+    buffer->read_offset += size;
+    if (buffer->read_offset == buffer->write_offset) {
+        // Nothing left unread, next read can start at the front without moving anything
+        buffer->read_offset = 0;
+        buffer->write_offset = 0;
+    }
+}
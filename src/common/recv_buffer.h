@@ -0,0 +1,45 @@
+#pragma once
+
+#include "defines.h"
+
+/********************************************************************************
+ *  Inbound byte buffer which lives as long as its connection. Bytes read from  *
+ *  a non-blocking socket accumulate across readiness events, so a packet split *
+ *  over several TCP segments is only handed out once all of its bytes arrived. *
+ *  Consumed bytes are discarded lazily, the unread tail is moved back to the   *
+ *  front right before the next read.                                           *
+ ********************************************************************************/
+
+typedef struct {
+    u8 *data;
+    u32 capacity;
+    u32 read_offset;
+    u32 write_offset;
+} recv_buffer_t;
+
+typedef enum {
+    RECV_BUFFER_FILL_OK,          /* new bytes were appended */
+    RECV_BUFFER_FILL_WOULD_BLOCK, /* socket has no more data for now */
+    RECV_BUFFER_FILL_FULL,        /* no space left, unread bytes have to be consumed first */
+    RECV_BUFFER_FILL_CLOSED,      /* peer performed an orderly shutdown */
+    RECV_BUFFER_FILL_ERROR        /* connection is broken, see errno */
+} recv_buffer_fill_result_e;
+
+void recv_buffer_create (u32 capacity, recv_buffer_t *out_buffer);
+void recv_buffer_destroy(recv_buffer_t *buffer);
+
+/* Performs a single non-blocking read into the free space at the end of the buffer */
+recv_buffer_fill_result_e recv_buffer_fill(recv_buffer_t *buffer, i32 socket);
+
+/* Drops 'size' bytes from the front once they have been parsed */
+void recv_buffer_consume(recv_buffer_t *buffer, u32 size);
+
+INLINE u8 *recv_buffer_data(recv_buffer_t *buffer)
+{
+    return buffer->data + buffer->read_offset;
+}
+
+INLINE u32 recv_buffer_length(recv_buffer_t *buffer)
+{
+    return buffer->write_offset - buffer->read_offset;
+}
@@ -0,0 +1,199 @@
+#include "send_queue.h"
+
+#include <errno.h>
+
+#include "common/net.h"
+#include "common/asserts.h"
+#include "common/memory/memutils.h"
+
+static send_queue_block_t *send_queue_block_acquire(send_queue_t *queue)
+{
+    send_queue_block_t *block = queue->free_blocks;
+    if (block != NULL) {
+        queue->free_blocks = block->next;
+        queue->free_block_count--;
+    } else {
+        block = mem_alloc(sizeof(send_queue_block_t), MEMORY_TAG_NETWORK);
+    }
+
+    block->next = NULL;
+    block->read_offset = 0;
+    block->write_offset = 0;
+    return block;
+}
+
+static void send_queue_block_release(send_queue_t *queue, send_queue_block_t *block)
+{
+    if (queue->free_block_count < SEND_QUEUE_MAX_FREE_BLOCKS) {
+        block->next = queue->free_blocks;
+        queue->free_blocks = block;
+        queue->free_block_count++;
+    } else {
+        mem_free(block, sizeof(send_queue_block_t), MEMORY_TAG_NETWORK);
+    }
+}
+
+void send_queue_create(u64 max_size, send_queue_t *out_queue)
+{
+    ASSERT(out_queue);
+    ASSERT(max_size > 0);
+
+    mem_zero(out_queue, sizeof(send_queue_t));
+    out_queue->max_size = max_size;
+    pthread_mutex_init(&out_queue->lock, NULL);
+}
+
+void send_queue_destroy(send_queue_t *queue)
+{
+    ASSERT(queue);
+
+    pthread_mutex_lock(&queue->lock);
+
+    send_queue_block_t *block = queue->head;
+    while (block != NULL) {
+        send_queue_block_t *next = block->next;
+        mem_free(block, sizeof(send_queue_block_t), MEMORY_TAG_NETWORK);
+        block = next;
+    }
+
+    block = queue->free_blocks;
+    while (block != NULL) {
+        send_queue_block_t *next = block->next;
+        mem_free(block, sizeof(send_queue_block_t), MEMORY_TAG_NETWORK);
+        block = next;
+    }
+
+    queue->head = NULL;
+    queue->tail = NULL;
+    queue->free_blocks = NULL;
+    queue->free_block_count = 0;
+    queue->size = 0;
+
+    pthread_mutex_unlock(&queue->lock);
+    pthread_mutex_destroy(&queue->lock);
+}
+
+b8 send_queue_push(send_queue_t *queue, const struct iovec *parts, u32 part_count)
+{
+    ASSERT(queue);
+    ASSERT(parts);
+
+    u64 total_size = 0;
+    for (u32 i = 0; i < part_count; i++) {
+        total_size += parts[i].iov_len;
+    }
+
+    pthread_mutex_lock(&queue->lock);
+
+    if (queue->size + total_size > queue->max_size) {
+        pthread_mutex_unlock(&queue->lock);
+        return false;
+    }
+
+    for (u32 i = 0; i < part_count; i++) {
+        const u8 *source = parts[i].iov_base;
+        u64 remaining = parts[i].iov_len;
+        while (remaining > 0) {
+            if (queue->tail == NULL || queue->tail->write_offset == SEND_QUEUE_BLOCK_SIZE) {
+                send_queue_block_t *block = send_queue_block_acquire(queue);
+                if (queue->tail != NULL) {
+                    queue->tail->next = block;
+                } else {
+                    queue->head = block;
+                }
+                queue->tail = block;
+            }
+
+            send_queue_block_t *tail = queue->tail;
+            u64 space = SEND_QUEUE_BLOCK_SIZE - tail->write_offset;
+            u64 to_copy = remaining < space ? remaining : space;
+            mem_copy(tail->data + tail->write_offset, source, to_copy);
+            tail->write_offset += to_copy;
+            source += to_copy;
+            remaining -= to_copy;
+        }
+    }
+
+    queue->size += total_size;
+
+    pthread_mutex_unlock(&queue->lock);
+    return true;
+}
+
+void send_queue_clear(send_queue_t *queue)
+{
+    ASSERT(queue);
+
+    pthread_mutex_lock(&queue->lock);
+
+    while (queue->head != NULL) {
+        send_queue_block_t *head = queue->head;
+        queue->head = head->next;
+        send_queue_block_release(queue, head);
+    }
+    queue->tail = NULL;
+    queue->size = 0;
+
+    pthread_mutex_unlock(&queue->lock);
+}
+
+send_queue_flush_result_e send_queue_flush(send_queue_t *queue, i32 socket)
+{
+    ASSERT(queue);
+
+    send_queue_flush_result_e result = SEND_QUEUE_FLUSH_DONE;
+
+    pthread_mutex_lock(&queue->lock);
+
+    while (queue->size > 0) {
+        struct iovec iov[SEND_QUEUE_MAX_IOVECS];
+        u32 iov_count = 0;
+        for (send_queue_block_t *block = queue->head; block != NULL && iov_count < SEND_QUEUE_MAX_IOVECS; block = block->next) {
+            iov[iov_count].iov_base = block->data + block->read_offset;
+            iov[iov_count].iov_len = block->write_offset - block->read_offset;
+            iov_count++;
+        }
+
+        i64 bytes_sent = net_sendv(socket, iov, iov_count);
+        if (bytes_sent == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            result = (errno == EAGAIN || errno == EWOULDBLOCK) ? SEND_QUEUE_FLUSH_WOULD_BLOCK : SEND_QUEUE_FLUSH_ERROR;
+            break;
+        }
+
+        queue->size -= bytes_sent;
+
+        // Consume written bytes, recycling every block that was fully sent
+        while (bytes_sent > 0) {
+            send_queue_block_t *head = queue->head;
+            u64 available = head->write_offset - head->read_offset;
+            if ((u64)bytes_sent < available) {
+                head->read_offset += bytes_sent;
+                break;
+            }
+
+            bytes_sent -= available;
+            queue->head = head->next;
+            if (queue->head == NULL) {
+                queue->tail = NULL;
+            }
+            send_queue_block_release(queue, head);
+        }
+    }
+
+    pthread_mutex_unlock(&queue->lock);
+    return result;
+}
+
+u64 send_queue_size(send_queue_t *queue)
+{
+    ASSERT(queue);
+
+    pthread_mutex_lock(&queue->lock);
+    u64 size = queue->size;
+    pthread_mutex_unlock(&queue->lock);
+
+    return size;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "defines.h"
+
+#include <pthread.h>
+#include <sys/uio.h>
+
+#define SEND_QUEUE_BLOCK_SIZE       KiB(16)
+#define SEND_QUEUE_MAX_IOVECS       64
+#define SEND_QUEUE_MAX_FREE_BLOCKS  4
+
+/********************************************************************************
+ *  Outbound byte queue made of fixed-size blocks, so appending never moves     *
+ *  already queued data and flushing can hand all blocks to a single sendmsg.   *
+ *  Pushes and flushes are serialized by the queue's mutex, which lets many     *
+ *  threads produce data while another one flushes it to the socket.            *
+ ********************************************************************************/
+
+typedef struct send_queue_block {
+    struct send_queue_block *next;
+    u32 read_offset;
+    u32 write_offset;
+    u8 data[SEND_QUEUE_BLOCK_SIZE];
+} send_queue_block_t;
+
+typedef struct {
+    send_queue_block_t *head;
+    send_queue_block_t *tail;
+    send_queue_block_t *free_blocks;
+    u32 free_block_count;
+    u64 size;
+    u64 max_size;
+    pthread_mutex_t lock;
+} send_queue_t;
+
+typedef enum {
+    SEND_QUEUE_FLUSH_DONE,        /* all queued bytes were written */
+    SEND_QUEUE_FLUSH_WOULD_BLOCK, /* socket buffer is full, remaining bytes stay queued */
+    SEND_QUEUE_FLUSH_ERROR        /* connection is broken, see errno */
+} send_queue_flush_result_e;
+
+void send_queue_create (u64 max_size, send_queue_t *out_queue);
+void send_queue_destroy(send_queue_t *queue);
+
+/* Appends all parts atomically - either every byte is queued or nothing is (when max_size would be exceeded) */
+b8   send_queue_push   (send_queue_t *queue, const struct iovec *parts, u32 part_count);
+
+/* Drops all queued data without writing it anywhere */
+void send_queue_clear(send_queue_t *queue);
+
+/* Writes as much queued data as the socket accepts without blocking */
+send_queue_flush_result_e send_queue_flush(send_queue_t *queue, i32 socket);
+
+u64  send_queue_size   (send_queue_t *queue);
@@ -0,0 +1,237 @@
+#include "snapshot.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+#include "common/asserts.h"
+#include "common/memory/memutils.h"
+
+static const snapshot_player_t zero_player = {0};
+
+i32 snapshot_quantize(f32 value)
+{
+    return (i32)floorf(value * SNAPSHOT_POSITION_SCALE + 0.5f);
+}
+
+vec2 snapshot_player_position(const snapshot_player_t *player)
+{
+    return vec2_create((f32)player->x / SNAPSHOT_POSITION_SCALE, (f32)player->y / SNAPSHOT_POSITION_SCALE);
+}
+
+static i32 snapshot_player_compare(const void *a, const void *b)
+{
+    player_id id_a = ((const snapshot_player_t *)a)->id;
+    player_id id_b = ((const snapshot_player_t *)b)->id;
+    return (id_a > id_b) - (id_a < id_b);
+}
+
+void snapshot_sort(snapshot_t *snapshot)
+{
+    ASSERT(snapshot);
+    qsort(snapshot->players, snapshot->count, sizeof(snapshot_player_t), snapshot_player_compare);
+}
+
+const snapshot_player_t *snapshot_find_player(const snapshot_t *snapshot, player_id id)
+{
+    ASSERT(snapshot);
+    snapshot_player_t key = { .id = id };
+    return bsearch(&key, snapshot->players, snapshot->count, sizeof(snapshot_player_t), snapshot_player_compare);
+}
+
+static b8 snapshot_player_equal(const snapshot_player_t *a, const snapshot_player_t *b)
+{
+    return a->id == b->id && a->seq_nr == b->seq_nr && a->x == b->x && a->y == b->y &&
+           a->health == b->health && a->state == b->state && a->direction == b->direction;
+}
+
+b8 snapshot_equal(const snapshot_t *a, const snapshot_t *b)
+{
+    ASSERT(a && b);
+    if (a->count != b->count) {
+        return false;
+    }
+    for (u32 i = 0; i < a->count; i++) {
+        if (!snapshot_player_equal(&a->players[i], &b->players[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void snapshot_filter(const snapshot_t *snapshot, const player_id *ids, u32 count, snapshot_t *out_snapshot)
+{
+    ASSERT(snapshot && out_snapshot);
+    ASSERT(count == 0 || ids);
+
+    out_snapshot->number = snapshot->number;
+    out_snapshot->count = 0;
+
+    // Looked up one by one, so the cost follows the amount of ids rather than the size of the snapshot
+    for (u32 i = 0; i < count; i++) {
+        const snapshot_player_t *player = snapshot_find_player(snapshot, ids[i]);
+        if (player != NULL) {
+            out_snapshot->players[out_snapshot->count++] = *player;
+        }
+    }
+}
+
+/* Returns false if there is nothing to send for the player */
+static b8 snapshot_player_diff(const snapshot_player_t *old, const snapshot_player_t *new, b8 is_receiver,
+                               packet_player_snapshot_entry_t *out_entry)
+{
+    mem_zero(out_entry, sizeof(packet_player_snapshot_entry_t));
+    out_entry->id = new->id;
+
+    if (new->x != old->x || new->y != old->y) {
+        out_entry->fields |= SNAPSHOT_FIELD_POSITION;
+        out_entry->x_delta = new->x - old->x;
+        out_entry->y_delta = new->y - old->y;
+    }
+    if (new->state != old->state || new->direction != old->direction) {
+        out_entry->fields |= SNAPSHOT_FIELD_STATE;
+        out_entry->state = new->state;
+        out_entry->direction = new->direction;
+    }
+    if (new->health != old->health) {
+        out_entry->fields |= SNAPSHOT_FIELD_HEALTH;
+        out_entry->health_delta = new->health - old->health;
+    }
+    if (is_receiver && new->seq_nr != old->seq_nr) {
+        out_entry->fields |= SNAPSHOT_FIELD_SEQ_NR;
+        out_entry->seq_nr_delta = new->seq_nr - old->seq_nr;
+    }
+
+    // Players missing from the baseline are always listed, even if all of their fields happen to be zero
+    return out_entry->fields != 0 || old == &zero_player;
+}
+
+void snapshot_diff(const snapshot_t *baseline, const snapshot_t *current, player_id receiver_id, packet_player_snapshot_t *out_packet)
+{
+    ASSERT(current);
+    ASSERT(out_packet);
+
+    u32 baseline_count = baseline != NULL ? baseline->count : 0;
+    out_packet->number = current->number;
+    out_packet->baseline = baseline != NULL ? baseline->number : SNAPSHOT_NONE;
+    out_packet->count = 0;
+
+    u32 i = 0, j = 0;
+    while (i < baseline_count || j < current->count) {
+        const snapshot_player_t *old = i < baseline_count ? &baseline->players[i] : NULL;
+        const snapshot_player_t *new = j < current->count ? &current->players[j] : NULL;
+        packet_player_snapshot_entry_t *entry = &out_packet->entries[out_packet->count];
+
+        if (new == NULL || (old != NULL && old->id < new->id)) {
+            mem_zero(entry, sizeof(packet_player_snapshot_entry_t));
+            entry->id = old->id;
+            entry->fields = SNAPSHOT_FIELD_REMOVED;
+            out_packet->count++;
+            i++;
+            continue;
+        }
+
+        if (old == NULL || new->id < old->id) {
+            old = &zero_player;
+        } else {
+            i++;
+        }
+        if (snapshot_player_diff(old, new, new->id == receiver_id, entry)) {
+            out_packet->count++;
+        }
+        j++;
+    }
+}
+
+b8 snapshot_apply(const snapshot_t *baseline, const packet_player_snapshot_t *packet, snapshot_t *out_snapshot)
+{
+    ASSERT(packet);
+    ASSERT(out_snapshot);
+    ASSERT(baseline != out_snapshot);
+
+    u32 baseline_count = baseline != NULL ? baseline->count : 0;
+    if ((baseline != NULL ? baseline->number : SNAPSHOT_NONE) != packet->baseline) {
+        return false;
+    }
+
+    out_snapshot->number = packet->number;
+    out_snapshot->count = 0;
+
+    u32 i = 0, j = 0;
+    while (i < baseline_count || j < packet->count) {
+        const snapshot_player_t *old = i < baseline_count ? &baseline->players[i] : NULL;
+        const packet_player_snapshot_entry_t *entry = j < packet->count ? &packet->entries[j] : NULL;
+
+        if (entry == NULL || (old != NULL && old->id < entry->id)) {
+            out_snapshot->players[out_snapshot->count++] = *old;
+            i++;
+            continue;
+        }
+
+        if (old == NULL || entry->id < old->id) {
+            if (entry->fields & SNAPSHOT_FIELD_REMOVED) {
+                return false; // Can't remove a player the baseline doesn't have
+            }
+            old = &zero_player;
+        } else {
+            i++;
+        }
+        j++;
+
+        if (entry->fields & SNAPSHOT_FIELD_REMOVED) {
+            continue;
+        }
+        if (out_snapshot->count >= MAX_PLAYER_COUNT) {
+            return false;
+        }
+
+        snapshot_player_t *new = &out_snapshot->players[out_snapshot->count++];
+        *new = *old;
+        new->id = entry->id;
+        if (entry->fields & SNAPSHOT_FIELD_POSITION) {
+            new->x += entry->x_delta;
+            new->y += entry->y_delta;
+        }
+        if (entry->fields & SNAPSHOT_FIELD_STATE) {
+            new->state = entry->state;
+            new->direction = entry->direction;
+        }
+        if (entry->fields & SNAPSHOT_FIELD_HEALTH) {
+            new->health += entry->health_delta;
+        }
+        if (entry->fields & SNAPSHOT_FIELD_SEQ_NR) {
+            new->seq_nr += entry->seq_nr_delta;
+        }
+    }
+
+    return true;
+}
+
+void snapshot_history_reset(snapshot_history_t *history)
+{
+    ASSERT(history);
+    mem_zero(history, sizeof(snapshot_history_t));
+}
+
+const snapshot_t *snapshot_history_find(const snapshot_history_t *history, u32 number)
+{
+    ASSERT(history);
+    if (number == SNAPSHOT_NONE) {
+        return NULL;
+    }
+
+    const snapshot_t *snapshot = &history->snapshots[number % SNAPSHOT_HISTORY_LENGTH];
+    return snapshot->number == number ? snapshot : NULL;
+}
+
+void snapshot_history_push(snapshot_history_t *history, const snapshot_t *snapshot)
+{
+    ASSERT(history);
+    ASSERT(snapshot);
+    ASSERT(snapshot->number > history->latest);
+
+    snapshot_t *slot = &history->snapshots[snapshot->number % SNAPSHOT_HISTORY_LENGTH];
+    slot->number = snapshot->number;
+    slot->count = snapshot->count;
+    mem_copy(slot->players, snapshot->players, snapshot->count * sizeof(snapshot_player_t));
+    history->latest = snapshot->number;
+}
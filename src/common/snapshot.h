@@ -0,0 +1,56 @@
+#pragma once
+
+#include "defines.h"
+#include "common/maths.h"
+#include "common/global.h"
+#include "common/packet.h"
+
+#define SNAPSHOT_HISTORY_LENGTH 32 /* Half a second of snapshots at 64 Hz, older baselines fall back to a full snapshot */
+
+/********************************************************************************
+ *  Per-tick state of every player. The server keeps the last snapshots it      *
+ *  produced and encodes each new one against the latest snapshot a client has  *
+ *  acknowledged, the client keeps the snapshots it received to resolve those   *
+ *  deltas. Players are sorted by id, so diffing two snapshots is a merge.      *
+ ********************************************************************************/
+
+typedef struct {
+    player_id id;
+    u32 seq_nr; /* Last keypress processed by the server, only kept up to date for the receiving player */
+    i32 x, y;   /* fixed point, see SNAPSHOT_POSITION_SCALE */
+    i32 health;
+    u8 state;
+    u8 direction;
+} snapshot_player_t;
+
+typedef struct {
+    u32 number;
+    u32 count;
+    snapshot_player_t players[MAX_PLAYER_COUNT];
+} snapshot_t;
+
+typedef struct {
+    snapshot_t snapshots[SNAPSHOT_HISTORY_LENGTH];
+    u32 latest; /* SNAPSHOT_NONE until the first snapshot is stored */
+} snapshot_history_t;
+
+i32  snapshot_quantize(f32 value);
+vec2 snapshot_player_position(const snapshot_player_t *player);
+
+/* Call after adding players in any order */
+void snapshot_sort(snapshot_t *snapshot);
+const snapshot_player_t *snapshot_find_player(const snapshot_t *snapshot, player_id id);
+b8   snapshot_equal(const snapshot_t *a, const snapshot_t *b);
+/* Copies the players whose id is listed, ids have to be sorted */
+void snapshot_filter(const snapshot_t *snapshot, const player_id *ids, u32 count, snapshot_t *out_snapshot);
+
+/* Lists the players which differ between the snapshots, a NULL baseline makes every entry absolute */
+void snapshot_diff(const snapshot_t *baseline, const snapshot_t *current, player_id receiver_id, packet_player_snapshot_t *out_packet);
+/* Reverse of snapshot_diff, returns false if the packet doesn't fit the baseline */
+b8   snapshot_apply(const snapshot_t *baseline, const packet_player_snapshot_t *packet, snapshot_t *out_snapshot);
+
+void snapshot_history_reset(snapshot_history_t *history);
+/* Returns NULL for SNAPSHOT_NONE and for snapshots which have already been overwritten */
+const snapshot_t *snapshot_history_find(const snapshot_history_t *history, u32 number);
+/* Stores a copy of the snapshot, its number must be greater than the latest one */
+void snapshot_history_push(snapshot_history_t *history, const snapshot_t *snapshot);
@@ -0,0 +1,84 @@
+#include "terrain.h"
+
+#include "common/maths.h"
+#include "common/asserts.h"
+#include "common/memory/memutils.h"
+
+void terrain_generator_create(game_map_t map, terrain_generator_t *out_generator)
+{
+    ASSERT(out_generator);
+
+    out_generator->map = map;
+    perlin_context_create(map.seed, &out_generator->perlin_context);
+}
+
+void terrain_generate_noise(const terrain_generator_t *generator, i32 x, i32 y, f32 *out_noise_data)
+{
+    ASSERT(generator);
+    ASSERT(out_noise_data);
+
+    perlin_noise_config_t config = {
+        .pos_x = x * CHUNK_LENGTH,
+        .pos_y = y * CHUNK_LENGTH,
+        .width = CHUNK_LENGTH,
+        .height = CHUNK_LENGTH,
+        .octave_count = generator->map.octave_count,
+        .scaling_bias = generator->map.bias
+    };
+
+    perlin_noise_generate_2d(&generator->perlin_context, config, out_noise_data);
+}
+
+void terrain_generate_chunk(const terrain_generator_t *generator, i32 x, i32 y, chunk_base_t *out_chunk)
+{
+    ASSERT(generator);
+    ASSERT(out_chunk);
+
+    f32 *perlin_noise_data = mem_alloc(CHUNK_NUM_TILES * sizeof(f32), MEMORY_TAG_GAME);
+    terrain_generate_noise(generator, x, y, perlin_noise_data);
+
+    mem_zero(out_chunk, sizeof(chunk_base_t));
+    out_chunk->x = x;
+    out_chunk->y = y;
+#if defined(DEBUG)
+    mem_copy(out_chunk->noise_data, perlin_noise_data, CHUNK_NUM_TILES * sizeof(f32));
+#endif
+
+    u32 seed = generator->map.seed;
+    u32 object_count = 0;
+    for (u32 i = 0; i < CHUNK_NUM_TILES; i++) {
+        tile_type_t tile_type = TILE_TYPE_NONE;
+        f32 value = perlin_noise_data[i];
+        if (value < 0.4f) {
+            tile_type = TILE_TYPE_WATER;
+        } else if (value < 0.45f) {
+            tile_type = TILE_TYPE_DIRT;
+        } else if (value < 0.8f) {
+            tile_type = TILE_TYPE_GRASS;
+        } else {
+            tile_type = TILE_TYPE_STONE;
+        }
+
+        ASSERT(tile_type > TILE_TYPE_NONE && tile_type < TILE_TYPE_COUNT);
+        out_chunk->tiles[i].type = tile_type;
+        out_chunk->tiles[i].object_index = INVALID_OBJECT_INDEX;
+
+        if (tile_type == TILE_TYPE_WATER) {
+            f32 random_value = math_frandom_hash(seed, x, y, i);
+            if (0.0f <= random_value && random_value <= 0.01f) {
+                out_chunk->objects[object_count].type = GAME_OBJECT_TYPE_LILY;
+                out_chunk->tiles[i].object_index = object_count;
+                object_count++;
+            }
+        } else if (tile_type == TILE_TYPE_GRASS) {
+            f32 random_value = math_frandom_hash(seed, x, y, i);
+            if (0.0f <= random_value && random_value <= 0.01f) {
+                out_chunk->objects[object_count].type = GAME_OBJECT_TYPE_BUSH;
+                out_chunk->tiles[i].object_index = object_count;
+                object_count++;
+            }
+        }
+    }
+
+    mem_free(perlin_noise_data, CHUNK_NUM_TILES * sizeof(f32), MEMORY_TAG_GAME);
+}
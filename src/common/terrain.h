@@ -0,0 +1,24 @@
+#pragma once
+
+#include "defines.h"
+#include "common/global.h"
+#include "common/perlin_noise.h"
+#include "common/game_world_types.h"
+
+/********************************************************************************
+ *  Deterministic chunk generation from the world parameters. The server and    *
+ *  the client run the same code, so a chunk generated from the same map is     *
+ *  identical on both sides and only later modifications have to be sent over   *
+ *  the network.                                                                *
+ ********************************************************************************/
+
+typedef struct {
+    game_map_t map;
+    perlin_context_t perlin_context;
+} terrain_generator_t;
+
+void terrain_generator_create(game_map_t map, terrain_generator_t *out_generator);
+
+/* Both only read the generator, so any number of threads may share one */
+void terrain_generate_noise(const terrain_generator_t *generator, i32 x, i32 y, f32 *out_noise_data);
+void terrain_generate_chunk(const terrain_generator_t *generator, i32 x, i32 y, chunk_base_t *out_chunk);
@@ -0,0 +1,217 @@
+#include "chunk_generator.h"
+
+#include <pthread.h>
+
+#include "config.h"
+#include "chunk_store.h"
+#include "common/logger.h"
+#include "common/asserts.h"
+#include "common/terrain.h"
+#include "common/perlin_noise.h"
+#include "common/containers/darray.h"
+#include "common/containers/hashmap.h"
+#include "common/memory/memutils.h"
+
+typedef struct chunk_job {
+    struct chunk_job *next;
+    i32 x, y;
+    i32 *requesters; // darray
+} chunk_job_t;
+
+static terrain_generator_t terrain;
+static chunk_ready_callback_t chunk_ready_callback;
+
+static pthread_t *workers;
+static u32 worker_count;
+static b8 running;
+
+/* Guards everything below */
+static pthread_mutex_t generator_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t job_available = PTHREAD_COND_INITIALIZER;
+static chunk_job_t *job_queue_head;
+static chunk_job_t *job_queue_tail;
+/* Queued and currently generating jobs keyed by packed chunk coordinates */
+static hashmap_t jobs_in_flight;
+
+/* Lists the objects a loaded chunk lacks compared to its generated version. Done once on the worker,
+   afterwards the chunk store keeps the list up to date as objects are removed */
+static u32 find_removed_objects(const chunk_base_t *chunk, u8 *out_tiles)
+{
+    chunk_base_t generated_chunk;
+    terrain_generate_chunk(&terrain, chunk->x, chunk->y, &generated_chunk);
+
+    u32 removed_count = 0;
+    for (u32 i = 0; i < CHUNK_NUM_TILES; i++) {
+        if (generated_chunk.tiles[i].object_index != INVALID_OBJECT_INDEX && chunk->tiles[i].object_index == INVALID_OBJECT_INDEX) {
+            out_tiles[removed_count++] = (u8)i;
+        }
+    }
+
+    return removed_count;
+}
+
+static void *chunk_generator_worker(void *args)
+{
+    UNUSED(args);
+
+    for (;;) {
+        pthread_mutex_lock(&generator_lock);
+        while (running && job_queue_head == NULL) {
+            pthread_cond_wait(&job_available, &generator_lock);
+        }
+
+        if (!running) {
+            pthread_mutex_unlock(&generator_lock);
+            break;
+        }
+
+        chunk_job_t *job = job_queue_head;
+        job_queue_head = job->next;
+        if (job_queue_head == NULL) {
+            job_queue_tail = NULL;
+        }
+
+        pthread_mutex_unlock(&generator_lock);
+
+        // Chunks saved by an earlier run are loaded as they were, including removed objects
+        chunk_base_t new_chunk;
+        chunk_base_t *chunk = NULL;
+        if (chunk_store_load(job->x, job->y, &new_chunk)) {
+#if defined(DEBUG)
+            terrain_generate_noise(&terrain, job->x, job->y, new_chunk.noise_data);
+#endif
+            u8 removed_tiles[CHUNK_NUM_TILES];
+            u32 removed_count = 0;
+            if (new_chunk.revision > 0) {
+                removed_count = find_removed_objects(&new_chunk, removed_tiles);
+            }
+            chunk = chunk_store_insert(&new_chunk, removed_tiles, removed_count, false);
+        } else {
+            terrain_generate_chunk(&terrain, job->x, job->y, &new_chunk);
+            chunk = chunk_store_insert(&new_chunk, NULL, 0, true);
+        }
+
+        // The chunk is already in the store, so requests arriving after the job is removed find it there
+        pthread_mutex_lock(&generator_lock);
+        hashmap_remove(&jobs_in_flight, chunk_coords_pack(job->x, job->y));
+        pthread_mutex_unlock(&generator_lock);
+
+        u64 requester_count = darray_length(job->requesters);
+#if LOG_CHUNK_TRANSACTIONS
+        LOG_TRACE("loaded chunk %i:%i for %llu requester(s)", job->x, job->y, requester_count);
+#endif
+        for (u64 i = 0; i < requester_count; i++) {
+            chunk_ready_callback(chunk, job->requesters[i]);
+        }
+        chunk_store_release(chunk);
+
+        darray_destroy(job->requesters);
+        mem_free(job, sizeof(chunk_job_t), MEMORY_TAG_GAME);
+    }
+
+    return NULL;
+}
+
+void chunk_generator_init(game_map_t game_map, u32 count, chunk_ready_callback_t on_chunk_ready)
+{
+    ASSERT(count > 0);
+    ASSERT(on_chunk_ready);
+
+    chunk_ready_callback = on_chunk_ready;
+    terrain_generator_create(game_map, &terrain);
+    LOG_INFO("perlin noise kernel: %s", perlin_noise_kernel_name(perlin_noise_select_kernel(CHUNK_LENGTH)));
+
+    hashmap_create(HASHMAP_DEFAULT_CAPACITY, &jobs_in_flight);
+    job_queue_head = NULL;
+    job_queue_tail = NULL;
+    running = true;
+
+    worker_count = count;
+    workers = mem_alloc(sizeof(pthread_t) * worker_count, MEMORY_TAG_GAME);
+    for (u32 i = 0; i < worker_count; i++) {
+        pthread_create(&workers[i], NULL, chunk_generator_worker, NULL);
+    }
+
+    LOG_INFO("started %u chunk generation workers", worker_count);
+}
+
+void chunk_generator_shutdown(void)
+{
+    pthread_mutex_lock(&generator_lock);
+    running = false;
+    pthread_cond_broadcast(&job_available);
+    pthread_mutex_unlock(&generator_lock);
+
+    for (u32 i = 0; i < worker_count; i++) {
+        pthread_join(workers[i], NULL);
+    }
+
+    mem_free(workers, sizeof(pthread_t) * worker_count, MEMORY_TAG_GAME);
+    workers = NULL;
+    worker_count = 0;
+
+    // Jobs nobody picked up before shutdown
+    chunk_job_t *job = job_queue_head;
+    while (job != NULL) {
+        chunk_job_t *next = job->next;
+        darray_destroy(job->requesters);
+        mem_free(job, sizeof(chunk_job_t), MEMORY_TAG_GAME);
+        job = next;
+    }
+
+    job_queue_head = NULL;
+    job_queue_tail = NULL;
+    hashmap_destroy(&jobs_in_flight);
+}
+
+void chunk_generator_request(i32 x, i32 y, i32 requester)
+{
+    chunk_base_t *chunk = chunk_store_find(x, y);
+    if (chunk != NULL) {
+        chunk_ready_callback(chunk, requester);
+        chunk_store_release(chunk);
+        return;
+    }
+
+    u64 key = chunk_coords_pack(x, y);
+    u64 value;
+
+    pthread_mutex_lock(&generator_lock);
+
+    if (hashmap_get(&jobs_in_flight, key, &value)) {
+        chunk_job_t *job = (chunk_job_t *)(uptr)value;
+        darray_push(job->requesters, requester);
+        pthread_mutex_unlock(&generator_lock);
+#if LOG_CHUNK_TRANSACTIONS
+        LOG_TRACE("joined in-flight generation of chunk %i:%i", x, y);
+#endif
+        return;
+    }
+
+    // The job may have finished between the lookup above and taking the lock
+    chunk = chunk_store_find(x, y);
+    if (chunk != NULL) {
+        pthread_mutex_unlock(&generator_lock);
+        chunk_ready_callback(chunk, requester);
+        chunk_store_release(chunk);
+        return;
+    }
+
+    chunk_job_t *job = mem_alloc(sizeof(chunk_job_t), MEMORY_TAG_GAME);
+    job->x = x;
+    job->y = y;
+    job->requesters = darray_create(sizeof(i32));
+    darray_push(job->requesters, requester);
+
+    if (job_queue_tail != NULL) {
+        job_queue_tail->next = job;
+    } else {
+        job_queue_head = job;
+    }
+    job_queue_tail = job;
+
+    hashmap_set(&jobs_in_flight, key, (u64)(uptr)job);
+    pthread_cond_signal(&job_available);
+
+    pthread_mutex_unlock(&generator_lock);
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "defines.h"
+#include "common/global.h"
+#include "common/game_world_types.h"
+
+/* Called once per requester when its chunk is available, either on the requesting thread or on a worker thread */
+typedef void (*chunk_ready_callback_t)(const chunk_base_t *chunk, i32 requester);
+
+/********************************************************************************
+ *  Loads chunks from region files or generates them on a fixed pool of worker  *
+ *  threads, so exploring players never stall the network thread. Requests for  *
+ *  a chunk which is already in flight join that job instead of starting        *
+ *  another, and every waiting requester is notified once the chunk lands in    *
+ *  the chunk store.                                                            *
+ ********************************************************************************/
+
+void chunk_generator_init(game_map_t game_map, u32 count, chunk_ready_callback_t on_chunk_ready);
+void chunk_generator_shutdown(void);
+
+/* Notifies the requester immediately if the chunk is already stored, otherwise queues or joins its generation */
+void chunk_generator_request(i32 x, i32 y, i32 requester);
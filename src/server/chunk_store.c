@@ -0,0 +1,473 @@
+#include "chunk_store.h"
+
+#include <pthread.h>
+
+#include "config.h"
+#include "region_file.h"
+#include "common/util.h"
+#include "common/logger.h"
+#include "common/asserts.h"
+#include "common/containers/darray.h"
+#include "common/containers/hashmap.h"
+#include "common/memory/memutils.h"
+#include "common/memory/pool_allocator.h"
+
+#define CHUNK_ENTRY_NOT_DIRTY ((u64)-1)
+
+typedef struct {
+    chunk_base_t chunk; // Must stay first, chunk pointers handed out are cast back to their entry
+    u32 pin_count;
+    b8 is_referenced;   // Second chance bit for the CLOCK sweep
+    u64 resident_index; // Position in resident_entries
+    u64 dirty_index;    // Position in dirty_entries or CHUNK_ENTRY_NOT_DIRTY
+    u32 removed_count;  // Objects removed since generation, a tile loses its object at most once
+    u8 removed_tiles[CHUNK_NUM_TILES];
+} chunk_entry_t;
+
+STATIC_ASSERT(CHUNK_NUM_TILES <= 256, "removed object tiles are stored as u8");
+
+static hashmap_t chunk_index;
+static pool_allocator_t chunk_pool;
+/* Every resident entry, swept by the CLOCK hand when over budget */
+static chunk_entry_t **resident_entries;
+static u64 clock_hand;
+/* Entries changed since they were last written to their region file */
+static chunk_entry_t **dirty_entries;
+static u64 max_resident_chunks;
+static chunk_store_stats_t stats;
+static pthread_mutex_t chunk_store_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Copy of a modified chunk waiting for the writer thread, kept until it is on disk so loads see it meanwhile */
+typedef struct {
+    chunk_base_t chunk;
+    b8 is_queued; // In write_queue or failed_writes, a chunk queued again while being written is written twice
+} pending_write_t;
+
+/* Region files are written on their own thread, so disk I/O never happens under chunk_store_lock.
+   When both are needed, chunk_store_lock is taken first */
+static pthread_t writer_thread;
+static b8 writer_running;
+static pthread_mutex_t writer_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t write_available = PTHREAD_COND_INITIALIZER;
+/* Pending writes keyed by packed chunk coordinates */
+static hashmap_t pending_writes;
+static pending_write_t **write_queue;
+/* Writes that failed, they are queued again by the next flush */
+static pending_write_t **failed_writes;
+
+/* Swap-removes element at index from a darray of entry pointers, fixing up the index of the moved entry */
+#define ENTRY_ARRAY_REMOVE(array, index, index_field)           \
+    {                                                           \
+        u64 last = darray_length(array) - 1;                    \
+        if ((index) != last) {                                  \
+            array[index] = array[last];                         \
+            array[index]->index_field = (index);                \
+        }                                                       \
+        _darray_field_set(array, DARRAY_FIELD_LENGTH, last);    \
+    }
+
+static void *chunk_writer_thread(void *args)
+{
+    UNUSED(args);
+
+    // Written from a private copy, so the chunk can be queued again while the write is in progress
+    static chunk_base_t chunk;
+
+    pthread_mutex_lock(&writer_lock);
+    for (;;) {
+        while (writer_running && darray_length(write_queue) == 0) {
+            pthread_cond_wait(&write_available, &writer_lock);
+        }
+
+        // Everything queued before shutdown is still written
+        if (darray_length(write_queue) == 0) {
+            break;
+        }
+
+        pending_write_t *write;
+        darray_pop(write_queue, &write);
+        write->is_queued = false;
+        mem_copy(&chunk, &write->chunk, sizeof(chunk_base_t));
+
+        pthread_mutex_unlock(&writer_lock);
+        b8 is_saved = region_storage_save_chunk(&chunk);
+        pthread_mutex_lock(&writer_lock);
+
+        if (write->is_queued) {
+            continue; // Modified again meanwhile, the newer copy is written next
+        }
+
+        if (is_saved) {
+            hashmap_remove(&pending_writes, chunk_coords_pack(chunk.x, chunk.y));
+            mem_free(write, sizeof(pending_write_t), MEMORY_TAG_GAME);
+        } else {
+            write->is_queued = true;
+            darray_push(failed_writes, write);
+        }
+    }
+    pthread_mutex_unlock(&writer_lock);
+
+    return NULL;
+}
+
+/* Hands a copy of the chunk to the writer thread, replacing an older copy which is still waiting */
+static void chunk_writer_enqueue(const chunk_base_t *chunk)
+{
+    u64 key = chunk_coords_pack(chunk->x, chunk->y);
+    u64 value;
+
+    pthread_mutex_lock(&writer_lock);
+
+    pending_write_t *write;
+    if (hashmap_get(&pending_writes, key, &value)) {
+        write = (pending_write_t *)(uptr)value;
+    } else {
+        write = mem_alloc(sizeof(pending_write_t), MEMORY_TAG_GAME);
+        write->is_queued = false;
+        hashmap_set(&pending_writes, key, (u64)(uptr)write);
+    }
+
+    mem_copy(&write->chunk, chunk, sizeof(chunk_base_t));
+    if (!write->is_queued) {
+        write->is_queued = true;
+        darray_push(write_queue, write);
+        pthread_cond_signal(&write_available);
+    }
+
+    pthread_mutex_unlock(&writer_lock);
+}
+
+/* Functions below must be called with chunk_store_lock held */
+
+static void chunk_entry_mark_dirty(chunk_entry_t *entry)
+{
+    if (entry->dirty_index == CHUNK_ENTRY_NOT_DIRTY) {
+        entry->dirty_index = darray_length(dirty_entries);
+        darray_push(dirty_entries, entry);
+    }
+}
+
+static void chunk_entry_mark_clean(chunk_entry_t *entry)
+{
+    if (entry->dirty_index != CHUNK_ENTRY_NOT_DIRTY) {
+        u64 index = entry->dirty_index;
+        ENTRY_ARRAY_REMOVE(dirty_entries, index, dirty_index);
+        entry->dirty_index = CHUNK_ENTRY_NOT_DIRTY;
+    }
+}
+
+static void chunk_entry_evict(chunk_entry_t *entry)
+{
+    // The writer thread saves a copy, so the entry is freed right away and the lock is never held for disk I/O
+    if (entry->dirty_index != CHUNK_ENTRY_NOT_DIRTY) {
+        chunk_writer_enqueue(&entry->chunk);
+        chunk_entry_mark_clean(entry);
+        stats.writebacks++;
+    }
+
+    hashmap_remove(&chunk_index, chunk_coords_pack(entry->chunk.x, entry->chunk.y));
+    u64 index = entry->resident_index;
+    ENTRY_ARRAY_REMOVE(resident_entries, index, resident_index);
+    pool_allocator_free(&chunk_pool, entry);
+    stats.evictions++;
+}
+
+static void chunk_store_evict_down_to(u64 target_count)
+{
+    // Two full sweeps clear every reference bit, anything still left is pinned
+    u64 steps_left = darray_length(resident_entries) * 2;
+    while (darray_length(resident_entries) > target_count && steps_left > 0) {
+        steps_left--;
+
+        if (clock_hand >= darray_length(resident_entries)) {
+            clock_hand = 0;
+        }
+
+        chunk_entry_t *entry = resident_entries[clock_hand];
+        if (entry->pin_count > 0) {
+            clock_hand++;
+        } else if (entry->is_referenced) {
+            entry->is_referenced = false;
+            clock_hand++;
+        } else {
+            chunk_entry_evict(entry);
+        }
+        // On eviction the last entry moved into the hand's slot, so the hand stays put
+    }
+}
+
+void chunk_store_init(u64 max_resident)
+{
+    ASSERT(max_resident > 0);
+
+    max_resident_chunks = max_resident;
+    clock_hand = 0;
+    mem_zero(&stats, sizeof(stats));
+
+    hashmap_create(CHUNK_STORE_INITIAL_CAPACITY, &chunk_index);
+    pool_allocator_create(sizeof(chunk_entry_t), CHUNK_STORE_CHUNKS_PER_SLAB, &chunk_pool);
+    resident_entries = darray_create(sizeof(chunk_entry_t *));
+    dirty_entries = darray_create(sizeof(chunk_entry_t *));
+
+    hashmap_create(HASHMAP_DEFAULT_CAPACITY, &pending_writes);
+    write_queue = darray_create(sizeof(pending_write_t *));
+    failed_writes = darray_create(sizeof(pending_write_t *));
+    writer_running = true;
+    pthread_create(&writer_thread, NULL, chunk_writer_thread, NULL);
+}
+
+void chunk_store_shutdown(void)
+{
+    pthread_mutex_lock(&writer_lock);
+    writer_running = false;
+    pthread_cond_signal(&write_available);
+    pthread_mutex_unlock(&writer_lock);
+
+    pthread_join(writer_thread, NULL);
+
+    // Only writes which failed are left
+    if (hashmap_length(&pending_writes) > 0) {
+        LOG_ERROR("failed to save %llu modified chunks", hashmap_length(&pending_writes));
+    }
+    for (u64 i = 0; i < pending_writes.capacity; i++) {
+        if (pending_writes.entries[i].occupied) {
+            mem_free((pending_write_t *)(uptr)pending_writes.entries[i].value, sizeof(pending_write_t), MEMORY_TAG_GAME);
+        }
+    }
+    hashmap_destroy(&pending_writes);
+    darray_destroy(write_queue);
+    darray_destroy(failed_writes);
+
+    pthread_mutex_lock(&chunk_store_lock);
+    hashmap_destroy(&chunk_index);
+    pool_allocator_destroy(&chunk_pool);
+    darray_destroy(resident_entries);
+    darray_destroy(dirty_entries);
+    pthread_mutex_unlock(&chunk_store_lock);
+}
+
+chunk_base_t *chunk_store_find(i32 x, i32 y)
+{
+    u64 value = 0;
+
+    pthread_mutex_lock(&chunk_store_lock);
+
+    if (!hashmap_get(&chunk_index, chunk_coords_pack(x, y), &value)) {
+        pthread_mutex_unlock(&chunk_store_lock);
+        return NULL;
+    }
+
+    chunk_entry_t *entry = (chunk_entry_t *)(uptr)value;
+    entry->pin_count++;
+    entry->is_referenced = true;
+    stats.hits++;
+
+    pthread_mutex_unlock(&chunk_store_lock);
+    return &entry->chunk;
+}
+
+chunk_base_t *chunk_store_insert(const chunk_base_t *chunk, const u8 *removed_tiles, u32 removed_count, b8 is_dirty)
+{
+    ASSERT(chunk);
+    ASSERT(removed_count <= CHUNK_NUM_TILES);
+    ASSERT(removed_tiles || removed_count == 0);
+
+    u64 key = chunk_coords_pack(chunk->x, chunk->y);
+    u64 value = 0;
+
+    pthread_mutex_lock(&chunk_store_lock);
+
+    if (hashmap_get(&chunk_index, key, &value)) {
+        chunk_entry_t *entry = (chunk_entry_t *)(uptr)value;
+        entry->pin_count++;
+        entry->is_referenced = true;
+        pthread_mutex_unlock(&chunk_store_lock);
+        return &entry->chunk;
+    }
+
+    stats.misses++;
+
+    // Make room before allocating, so freed blocks are reused and the pool never grows past the budget
+    if (darray_length(resident_entries) >= max_resident_chunks) {
+        chunk_store_evict_down_to(max_resident_chunks - 1);
+    }
+
+    chunk_entry_t *entry = pool_allocator_allocate(&chunk_pool);
+    mem_copy(&entry->chunk, chunk, sizeof(chunk_base_t));
+    entry->pin_count = 1;
+    entry->is_referenced = true;
+    entry->dirty_index = CHUNK_ENTRY_NOT_DIRTY;
+    entry->removed_count = removed_count;
+    if (removed_count > 0) {
+        mem_copy(entry->removed_tiles, removed_tiles, removed_count);
+    }
+    entry->resident_index = darray_length(resident_entries);
+    darray_push(resident_entries, entry);
+    hashmap_set(&chunk_index, key, (u64)(uptr)entry);
+    if (is_dirty) {
+        chunk_entry_mark_dirty(entry);
+    }
+
+#if LOG_CHUNK_MEMORY_FOOTPRINT
+    static u64 prev_size_checkpoint = KiB(40);
+    u64 chunks_allocated_memory_size = chunk_pool.slab_count * chunk_pool.blocks_per_slab * chunk_pool.block_size;
+    if (chunks_allocated_memory_size > prev_size_checkpoint) {
+        f32 converted_value;
+        const char *unit = get_size_unit(chunks_allocated_memory_size, &converted_value);
+        LOG_INFO("allocated memory size for chunks crossed %0.2f %s", converted_value, unit);
+        while (prev_size_checkpoint < chunks_allocated_memory_size) {
+            prev_size_checkpoint *= 2;
+        }
+    }
+#endif
+
+    pthread_mutex_unlock(&chunk_store_lock);
+    return &entry->chunk;
+}
+
+void chunk_store_release(chunk_base_t *chunk)
+{
+    ASSERT(chunk);
+
+    pthread_mutex_lock(&chunk_store_lock);
+
+    chunk_entry_t *entry = (chunk_entry_t *)chunk;
+    ASSERT(entry->pin_count > 0);
+    entry->pin_count--;
+
+    // Entries that were pinned while over budget could not be evicted at insertion time
+    if (entry->pin_count == 0 && darray_length(resident_entries) > max_resident_chunks) {
+        chunk_store_evict_down_to(max_resident_chunks);
+    }
+
+    pthread_mutex_unlock(&chunk_store_lock);
+}
+
+void chunk_store_mark_dirty(chunk_base_t *chunk)
+{
+    ASSERT(chunk);
+
+    pthread_mutex_lock(&chunk_store_lock);
+    chunk_entry_mark_dirty((chunk_entry_t *)chunk);
+    pthread_mutex_unlock(&chunk_store_lock);
+}
+
+b8 chunk_store_remove_object(chunk_base_t *chunk, u32 tile_index, game_object_type_e *out_type, u32 *out_revision)
+{
+    ASSERT(chunk);
+    ASSERT(tile_index < CHUNK_NUM_TILES);
+    ASSERT(out_type);
+    ASSERT(out_revision);
+
+    pthread_mutex_lock(&chunk_store_lock);
+
+    chunk_entry_t *entry = (chunk_entry_t *)chunk;
+    game_tile_t *tile = &chunk->tiles[tile_index];
+    if (tile->object_index == INVALID_OBJECT_INDEX) {
+        pthread_mutex_unlock(&chunk_store_lock);
+        return false;
+    }
+
+    ASSERT(entry->removed_count < CHUNK_NUM_TILES);
+    *out_type = chunk->objects[tile->object_index].type;
+    tile->object_index = INVALID_OBJECT_INDEX;
+    *out_revision = ++chunk->revision;
+    entry->removed_tiles[entry->removed_count++] = (u8)tile_index;
+    chunk_entry_mark_dirty(entry);
+
+    pthread_mutex_unlock(&chunk_store_lock);
+    return true;
+}
+
+u32 chunk_store_get_removed_objects(const chunk_base_t *chunk, u8 *out_tiles, u32 *out_revision)
+{
+    ASSERT(chunk);
+    ASSERT(out_tiles);
+    ASSERT(out_revision);
+
+    pthread_mutex_lock(&chunk_store_lock);
+
+    const chunk_entry_t *entry = (const chunk_entry_t *)chunk;
+    u32 removed_count = entry->removed_count;
+    mem_copy(out_tiles, entry->removed_tiles, removed_count);
+    *out_revision = chunk->revision;
+
+    pthread_mutex_unlock(&chunk_store_lock);
+    return removed_count;
+}
+
+void chunk_store_lock_contents(void)
+{
+    pthread_mutex_lock(&chunk_store_lock);
+}
+
+void chunk_store_unlock_contents(void)
+{
+    pthread_mutex_unlock(&chunk_store_lock);
+}
+
+u32 chunk_store_flush_dirty(void)
+{
+    pthread_mutex_lock(&chunk_store_lock);
+
+    u32 queued_count = (u32)darray_length(dirty_entries);
+    for (u32 i = 0; i < queued_count; i++) {
+        chunk_writer_enqueue(&dirty_entries[i]->chunk);
+        dirty_entries[i]->dirty_index = CHUNK_ENTRY_NOT_DIRTY;
+    }
+
+    _darray_field_set(dirty_entries, DARRAY_FIELD_LENGTH, 0);
+
+    pthread_mutex_unlock(&chunk_store_lock);
+
+    // Writes that failed since the last flush get another chance
+    pthread_mutex_lock(&writer_lock);
+    pending_write_t *write;
+    while (darray_length(failed_writes) > 0) {
+        darray_pop(failed_writes, &write);
+        darray_push(write_queue, write);
+    }
+    pthread_cond_signal(&write_available);
+    pthread_mutex_unlock(&writer_lock);
+
+    return queued_count;
+}
+
+b8 chunk_store_load(i32 x, i32 y, chunk_base_t *out_chunk)
+{
+    ASSERT(out_chunk);
+
+    u64 value;
+
+    // A copy waiting to be written is newer than what the region file holds
+    pthread_mutex_lock(&writer_lock);
+    if (hashmap_get(&pending_writes, chunk_coords_pack(x, y), &value)) {
+        mem_copy(out_chunk, &((pending_write_t *)(uptr)value)->chunk, sizeof(chunk_base_t));
+        pthread_mutex_unlock(&writer_lock);
+        return true;
+    }
+    pthread_mutex_unlock(&writer_lock);
+
+    // Region file is up to date, a write leaves the pending map only once it is on disk
+    return region_storage_load_chunk(x, y, out_chunk);
+}
+
+u64 chunk_store_count(void)
+{
+    pthread_mutex_lock(&chunk_store_lock);
+    u64 count = hashmap_length(&chunk_index);
+    pthread_mutex_unlock(&chunk_store_lock);
+
+    return count;
+}
+
+void chunk_store_get_stats(chunk_store_stats_t *out_stats)
+{
+    ASSERT(out_stats);
+
+    pthread_mutex_lock(&chunk_store_lock);
+    *out_stats = stats;
+    out_stats->resident = darray_length(resident_entries);
+    out_stats->dirty = darray_length(dirty_entries);
+    pthread_mutex_unlock(&chunk_store_lock);
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "defines.h"
+#include "common/global.h"
+#include "common/game_world_types.h"
+
+/********************************************************************************
+ *  Server-side storage of resident chunks. Chunks live in a pool allocator and *
+ *  are indexed by their packed coordinates in an open-addressing hash map. At  *
+ *  most max_resident_chunks stay in memory: when the budget is exceeded, a     *
+ *  CLOCK sweep evicts chunks that are not pinned and have not been used since  *
+ *  the last sweep. Copies of dirty chunks are written to their region files by *
+ *  a background thread, both on flush and on eviction, so the store lock is    *
+ *  never held for disk I/O. Until a write is done, loads are served from its   *
+ *  copy.                                                                       *
+ ********************************************************************************/
+
+INLINE u64 chunk_coords_pack(i32 x, i32 y)
+{
+    return ((u64)(u32)x << 32) | (u64)(u32)y;
+}
+
+typedef struct {
+    u64 hits;       // Lookups served from memory
+    u64 misses;     // Chunks that had to be loaded from a region file or generated
+    u64 evictions;
+    u64 writebacks; // Evicted chunks that were dirty and queued for their region file first
+    u64 resident;
+    u64 dirty;
+} chunk_store_stats_t;
+
+void          chunk_store_init(u64 max_resident_chunks);
+void          chunk_store_shutdown(void);
+
+/* Returns NULL if the chunk is not resident. A returned chunk is pinned and can't be evicted until released */
+chunk_base_t *chunk_store_find(i32 x, i32 y);
+/* Copies the chunk into the store and returns it pinned. If a chunk with the same coordinates is already stored,
+   that one is kept and returned. Dirty chunks are written to their region file by the next flush or on eviction.
+   removed_tiles lists the objects the chunk lacks compared to its generated version, NULL if there are none */
+chunk_base_t *chunk_store_insert(const chunk_base_t *chunk, const u8 *removed_tiles, u32 removed_count, b8 is_dirty);
+void          chunk_store_release(chunk_base_t *chunk);
+/* Call after modifying a stored chunk */
+void          chunk_store_mark_dirty(chunk_base_t *chunk);
+/* Clears the object on the tile, bumps the revision and marks the chunk dirty in one step.
+   Returns false if the tile holds no object, otherwise the removed type and the new revision */
+b8            chunk_store_remove_object(chunk_base_t *chunk, u32 tile_index, game_object_type_e *out_type, u32 *out_revision);
+/* Copies the tiles of every object removed since the chunk was generated together with the matching revision,
+   so a delta can be sent without regenerating the chunk. out_tiles must hold CHUNK_NUM_TILES, returns the count */
+u32           chunk_store_get_removed_objects(const chunk_base_t *chunk, u8 *out_tiles, u32 *out_revision);
+/* The tick thread modifies pinned chunks while I/O threads and generator workers send them, both sides
+   hold this around touching a stored chunk's tiles, objects or revision. Don't call other chunk_store
+   functions while holding it, it is the same lock that guards the store itself */
+void          chunk_store_lock_contents(void);
+void          chunk_store_unlock_contents(void);
+/* Queues a copy of every dirty chunk for the writer thread, returns the amount queued.
+   Chunks still waiting are written by chunk_store_shutdown */
+u32           chunk_store_flush_dirty(void);
+/* Loads a chunk which isn't resident, from a copy still waiting to be written or else from its region file.
+   Returns false if the chunk has never been saved */
+b8            chunk_store_load(i32 x, i32 y, chunk_base_t *out_chunk);
+u64           chunk_store_count(void);
+void          chunk_store_get_stats(chunk_store_stats_t *out_stats);
@@ -0,0 +1,143 @@
+#include "chunk_stream.h"
+
+#include "common/packet.h"
+#include "common/logger.h"
+#include "common/asserts.h"
+#include "common/memory/memutils.h"
+#include "common/containers/darray.h"
+
+static void chunk_stream_entry_release(chunk_stream_entry_t *entry)
+{
+    if (entry->packet != NULL) {
+        mem_free(entry->packet, entry->size, MEMORY_TAG_NETWORK);
+        entry->packet = NULL;
+    }
+}
+
+void chunk_stream_create(u32 max_entries, chunk_stream_t *out_stream)
+{
+    ASSERT(out_stream);
+    ASSERT(max_entries > 0);
+
+    out_stream->entries = darray_reserve(max_entries, sizeof(chunk_stream_entry_t));
+    out_stream->max_entries = max_entries;
+    pthread_mutex_init(&out_stream->lock, NULL);
+}
+
+void chunk_stream_destroy(chunk_stream_t *stream)
+{
+    ASSERT(stream && stream->entries);
+
+    pthread_mutex_lock(&stream->lock);
+
+    u64 entries_length = darray_length(stream->entries);
+    for (u64 i = 0; i < entries_length; i++) {
+        chunk_stream_entry_release(&stream->entries[i]);
+    }
+    darray_destroy(stream->entries);
+    stream->entries = NULL;
+
+    pthread_mutex_unlock(&stream->lock);
+    pthread_mutex_destroy(&stream->lock);
+}
+
+b8 chunk_stream_push(chunk_stream_t *stream, i32 x, i32 y)
+{
+    ASSERT(stream);
+
+    pthread_mutex_lock(&stream->lock);
+
+    u64 entries_length = darray_length(stream->entries);
+    if (entries_length >= stream->max_entries) {
+        pthread_mutex_unlock(&stream->lock);
+        return false;
+    }
+
+    for (u64 i = 0; i < entries_length; i++) {
+        if (stream->entries[i].x == x && stream->entries[i].y == y) {
+            pthread_mutex_unlock(&stream->lock);
+            return false;
+        }
+    }
+
+    chunk_stream_entry_t entry = { .x = x, .y = y };
+    darray_push(stream->entries, entry);
+
+    pthread_mutex_unlock(&stream->lock);
+    return true;
+}
+
+void chunk_stream_complete(chunk_stream_t *stream, i32 x, i32 y, u32 type, const void *packet_data)
+{
+    ASSERT(stream);
+
+    // Encoded outside of the lock, chunk responses take a while to compress
+    u8 buffer[sizeof(packet_header_t) + PACKET_MAX_SIZE];
+    u32 size = 0;
+    if (packet_data != NULL) {
+        size = packet_encode(type, packet_data, buffer, sizeof(buffer));
+        if (size == 0) {
+            LOG_ERROR("failed to encode chunk %i:%i packet of type %u", x, y, type);
+        }
+    }
+
+    pthread_mutex_lock(&stream->lock);
+
+    u64 entries_length = darray_length(stream->entries);
+    for (u64 i = 0; i < entries_length; i++) {
+        chunk_stream_entry_t *entry = &stream->entries[i];
+        if (entry->x != x || entry->y != y || entry->ready) {
+            continue;
+        }
+
+        entry->ready = true;
+        if (size > 0) {
+            entry->packet = mem_alloc(size, MEMORY_TAG_NETWORK);
+            entry->size = size;
+            mem_copy(entry->packet, buffer, size);
+        }
+        break;
+    }
+
+    pthread_mutex_unlock(&stream->lock);
+}
+
+u32 chunk_stream_flush(chunk_stream_t *stream, send_queue_t *queue, u32 byte_budget)
+{
+    ASSERT(stream);
+    ASSERT(queue);
+
+    u32 bytes_moved = 0;
+
+    pthread_mutex_lock(&stream->lock);
+
+    // Chunks still being generated are skipped rather than waited for, so they don't hold back the ones behind them
+    u64 i = 0;
+    while (i < darray_length(stream->entries)) {
+        chunk_stream_entry_t *entry = &stream->entries[i];
+        if (!entry->ready) {
+            i++;
+            continue;
+        }
+
+        if (entry->packet != NULL) {
+            if (bytes_moved + entry->size > byte_budget) {
+                break;
+            }
+
+            struct iovec parts[1] = {
+                { .iov_base = entry->packet, .iov_len = entry->size }
+            };
+            if (!send_queue_push(queue, parts, ARRAY_SIZE(parts))) {
+                break;
+            }
+            bytes_moved += entry->size;
+        }
+
+        chunk_stream_entry_release(entry);
+        darray_pop_at(stream->entries, i, NULL);
+    }
+
+    pthread_mutex_unlock(&stream->lock);
+    return bytes_moved;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "defines.h"
+#include "common/send_queue.h"
+
+#include <pthread.h>
+
+/********************************************************************************
+ *  Per-connection queue of requested chunks, kept in the order the client      *
+ *  asked for them (nearest to its camera first). Answers are filled in by      *
+ *  whichever thread has the chunk ready and held back until the connection's   *
+ *  I/O thread moves them to the send queue, at most a fixed amount of bytes    *
+ *  per tick, so a burst of chunks never delays the player updates behind it.   *
+ ********************************************************************************/
+
+typedef struct {
+    i32 x, y;
+    b8 ready;   /* Answer is known, packet is NULL when there is nothing to send */
+    u32 size;
+    u8 *packet; /* Encoded packet, header included */
+} chunk_stream_entry_t;
+
+typedef struct {
+    pthread_mutex_t lock;
+    chunk_stream_entry_t *entries; /* darray */
+    u32 max_entries;
+} chunk_stream_t;
+
+void chunk_stream_create (u32 max_entries, chunk_stream_t *out_stream);
+void chunk_stream_destroy(chunk_stream_t *stream);
+
+/* Returns false if the chunk is already queued or the stream is full */
+b8   chunk_stream_push(chunk_stream_t *stream, i32 x, i32 y);
+
+/* Sets the answer of a queued chunk, packet_data of NULL completes it without sending anything */
+void chunk_stream_complete(chunk_stream_t *stream, i32 x, i32 y, u32 type, const void *packet_data);
+
+/* Moves ready answers to the send queue in priority order until byte_budget is used up, returns the bytes moved */
+u32  chunk_stream_flush(chunk_stream_t *stream, send_queue_t *queue, u32 byte_budget);
@@ -1,14 +1,41 @@
 #pragma once
 
 #define INPUT_BUFFER_SIZE 4096
-#define INPUT_OVERFLOW_BUFFER_SIZE 256
 
-#define SERVER_BACKLOG 10
-#define INPUT_RING_BUFFER_CAPACITY 256
+#define SERVER_BACKLOG 128
+#define SERVER_MAX_EVENTS 64
+#define SERVER_USE_EPOLL 1 /* 0 falls back to poll() over a linear array of pollfds */
+#define SERVER_IO_THREAD_COUNT 4 /* Each owns a SO_REUSEPORT listener and the connections accepted on it */
+#define SERVER_UDP_ENABLED 1 /* Offer clients a UDP channel on the same port for input and snapshots */
+
+#define CONNECTION_TABLE_INITIAL_CAPACITY 64
+#define CONNECTION_SEND_QUEUE_MAX_SIZE    MiB(1)
+#define CONNECTION_HANDSHAKE_TIMEOUT_MS   5000    /* From accept to the player init confirmation */
+#define CONNECTION_RECV_BUFFER_SIZE       KiB(4)  /* Must fit the largest packet a client sends, header included */
+#define CONNECTION_CHUNK_BYTES_PER_TICK   KiB(16) /* Chunk answers sent per tick, must fit the largest packet */
+#define CONNECTION_CHUNK_STREAM_CAPACITY  256     /* Requested chunks a client may have outstanding */
+#define INPUT_RING_BUFFER_CAPACITY 1024 /* Client events from all I/O threads waiting for the next tick */
 #define PROCESSED_INPUT_LIMIT_PER_UPDATE 256
 
+#define TICK_CATCH_UP_LIMIT             4    /* Late ticks run back to back up to this many, the rest are dropped */
+#define TICK_REPORT_INTERVAL_SECONDS    10.0 /* How often work time, slack and overruns of the ticks are logged */
+
+#define CHUNK_STORE_INITIAL_CAPACITY    1024
+#define CHUNK_STORE_CHUNKS_PER_SLAB     64
+#define CHUNK_STORE_MAX_RESIDENT_CHUNKS 4096 /* About 12 MiB of chunk data in release builds */
+#define CHUNK_GENERATOR_WORKER_COUNT    4
+#define CHUNK_FLUSH_INTERVAL_SECONDS    5.0  /* How often modified chunks are written back to their region files */
+#define CHUNK_STREAMING_MODE            CHUNK_STREAMING_MODE_SEED /* CHUNK_STREAMING_MODE_FULL sends every requested chunk */
+
+#define SERVER_DEFAULT_WORLD_DIRECTORY "world"
+
+#define PLAYER_TABLE_INITIAL_CAPACITY 64 /* Grows on demand up to MAX_PLAYER_COUNT */
 #define PLAYER_SPAWN_POSITION_X 0
 #define PLAYER_SPAWN_POSITION_Y 0
 
+#define INTEREST_RADIUS_CHUNKS         3   /* Players see other players and world changes this many chunks around them */
+#define INTEREST_GRID_INITIAL_CAPACITY 256 /* Occupied chunks, grows on demand */
+
 #define LOG_CHUNK_TRANSACTIONS           0
 #define LOG_CHUNK_MEMORY_FOOTPRINT       1
+#define LOG_TICK_STATS                   1
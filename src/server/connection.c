@@ -0,0 +1,227 @@
+#include "connection.h"
+
+#include <errno.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/socket.h>
+
+#include "config.h"
+#include "common/packet.h"
+#include "common/logger.h"
+#include "common/asserts.h"
+#include "common/memory/memutils.h"
+#include "common/containers/darray.h"
+
+STATIC_ASSERT(CONNECTION_CHUNK_BYTES_PER_TICK >= sizeof(packet_header_t) + PACKET_MAX_SIZE,
+              "chunk byte budget must fit the largest packet, otherwise it would never be sent");
+
+/* Connections are indexed directly by their socket fd, since the kernel hands out the lowest free descriptor */
+static connection_t **connections;
+static u32 connections_capacity;
+/* Connections owned by each I/O thread, so flushing a shard doesn't walk the whole fd-indexed table */
+static connection_t **shard_connections[SERVER_IO_THREAD_COUNT];
+static pthread_rwlock_t connections_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+void connection_system_init(void)
+{
+    connections_capacity = CONNECTION_TABLE_INITIAL_CAPACITY;
+    connections = mem_alloc(sizeof(connection_t *) * connections_capacity, MEMORY_TAG_NETWORK);
+
+    for (u32 i = 0; i < SERVER_IO_THREAD_COUNT; i++) {
+        shard_connections[i] = darray_create(sizeof(connection_t *));
+    }
+}
+
+void connection_system_shutdown(void)
+{
+    pthread_rwlock_wrlock(&connections_lock);
+
+    for (u32 i = 0; i < connections_capacity; i++) {
+        if (connections[i] != NULL) {
+            send_queue_destroy(&connections[i]->send_queue);
+            recv_buffer_destroy(&connections[i]->recv_buffer);
+            chunk_stream_destroy(&connections[i]->chunk_stream);
+            mem_free(connections[i], sizeof(connection_t), MEMORY_TAG_NETWORK);
+        }
+    }
+
+    mem_free(connections, sizeof(connection_t *) * connections_capacity, MEMORY_TAG_NETWORK);
+    connections = NULL;
+    connections_capacity = 0;
+
+    for (u32 i = 0; i < SERVER_IO_THREAD_COUNT; i++) {
+        darray_destroy(shard_connections[i]);
+        shard_connections[i] = NULL;
+    }
+
+    pthread_rwlock_unlock(&connections_lock);
+}
+
+b8 connection_open(i32 socket, u32 shard)
+{
+    ASSERT(socket >= 0);
+    ASSERT(shard < SERVER_IO_THREAD_COUNT);
+
+    pthread_rwlock_wrlock(&connections_lock);
+
+    if ((u32)socket >= connections_capacity) {
+        u32 new_capacity = connections_capacity;
+        while ((u32)socket >= new_capacity) {
+            new_capacity *= 2;
+        }
+
+        connection_t **new_connections = mem_alloc(sizeof(connection_t *) * new_capacity, MEMORY_TAG_NETWORK);
+        mem_copy(new_connections, connections, sizeof(connection_t *) * connections_capacity);
+        mem_free(connections, sizeof(connection_t *) * connections_capacity, MEMORY_TAG_NETWORK);
+        connections = new_connections;
+        connections_capacity = new_capacity;
+    }
+
+    if (connections[socket] != NULL) {
+        pthread_rwlock_unlock(&connections_lock);
+        LOG_ERROR("connection with socket fd=%d is already open", socket);
+        return false;
+    }
+
+    connection_t *connection = mem_alloc(sizeof(connection_t), MEMORY_TAG_NETWORK);
+    connection->socket = socket;
+    connection->state = CONNECTION_STATE_VALIDATING;
+    connection->puzzle_answer = 0;
+    connection->handshake_deadline_ns = 0;
+    connection->shard = shard;
+    atomic_init(&connection->is_overloaded, false);
+    send_queue_create(CONNECTION_SEND_QUEUE_MAX_SIZE, &connection->send_queue);
+    recv_buffer_create(CONNECTION_RECV_BUFFER_SIZE, &connection->recv_buffer);
+    chunk_stream_create(CONNECTION_CHUNK_STREAM_CAPACITY, &connection->chunk_stream);
+    connections[socket] = connection;
+
+    connection->shard_index = darray_length(shard_connections[shard]);
+    darray_push(shard_connections[shard], connection);
+
+    pthread_rwlock_unlock(&connections_lock);
+    return true;
+}
+
+void connection_close(i32 socket)
+{
+    pthread_rwlock_wrlock(&connections_lock);
+
+    if (socket < 0 || (u32)socket >= connections_capacity || connections[socket] == NULL) {
+        pthread_rwlock_unlock(&connections_lock);
+        LOG_ERROR("did not find connection with socket fd=%d to close", socket);
+        return;
+    }
+
+    connection_t *connection = connections[socket];
+    connections[socket] = NULL;
+
+    // Swap-remove from the shard's list, fixing up the position of the connection moved into the gap
+    connection_t **owned = shard_connections[connection->shard];
+    u64 last = darray_length(owned) - 1;
+    if (connection->shard_index != last) {
+        owned[connection->shard_index] = owned[last];
+        owned[connection->shard_index]->shard_index = connection->shard_index;
+    }
+    _darray_field_set(owned, DARRAY_FIELD_LENGTH, last);
+
+    pthread_rwlock_unlock(&connections_lock);
+
+    send_queue_destroy(&connection->send_queue);
+    recv_buffer_destroy(&connection->recv_buffer);
+    chunk_stream_destroy(&connection->chunk_stream);
+    mem_free(connection, sizeof(connection_t), MEMORY_TAG_NETWORK);
+}
+
+connection_t *connection_get(i32 socket)
+{
+    pthread_rwlock_rdlock(&connections_lock);
+
+    connection_t *connection = NULL;
+    if (socket >= 0 && (u32)socket < connections_capacity) {
+        connection = connections[socket];
+    }
+
+    pthread_rwlock_unlock(&connections_lock);
+    return connection;
+}
+
+b8 connection_send_packet(i32 socket, u32 type, void *packet_data)
+{
+    pthread_rwlock_rdlock(&connections_lock);
+
+    if (socket < 0 || (u32)socket >= connections_capacity || connections[socket] == NULL) {
+        pthread_rwlock_unlock(&connections_lock);
+        return false;
+    }
+
+    connection_t *connection = connections[socket];
+    if (atomic_load(&connection->is_overloaded)) {
+        pthread_rwlock_unlock(&connections_lock);
+        return false;
+    }
+
+    b8 status = packet_enqueue(&connection->send_queue, type, packet_data);
+    if (!status && !atomic_exchange(&connection->is_overloaded, true)) {
+        // The client would silently diverge if it carried on without the packet, so the connection is
+        // shut down instead and the owning I/O thread reports the disconnect
+        LOG_WARN("failed to queue packet of type %u for connection with socket fd=%d, kicking the client", type, socket);
+        if (shutdown(socket, SHUT_RDWR) == -1) {
+            LOG_ERROR("failed to shut down socket with fd=%d: %s", socket, strerror(errno));
+        }
+    }
+
+    pthread_rwlock_unlock(&connections_lock);
+    return status;
+}
+
+void connection_complete_chunk(i32 socket, i32 x, i32 y, u32 type, const void *packet_data)
+{
+    pthread_rwlock_rdlock(&connections_lock);
+
+    // The client may have disconnected while its chunk was being generated
+    if (socket >= 0 && (u32)socket < connections_capacity && connections[socket] != NULL) {
+        chunk_stream_complete(&connections[socket]->chunk_stream, x, y, type, packet_data);
+    }
+
+    pthread_rwlock_unlock(&connections_lock);
+}
+
+void connection_flush_shard(u32 shard)
+{
+    pthread_rwlock_rdlock(&connections_lock);
+
+    ASSERT(shard < SERVER_IO_THREAD_COUNT);
+
+    connection_t **owned = shard_connections[shard];
+    u64 owned_count = darray_length(owned);
+    for (u64 i = 0; i < owned_count; i++) {
+        connection_t *connection = owned[i];
+
+        // Chunks are only topped up while the socket keeps up, otherwise they would pile up in the send queue
+        // in front of the next player updates
+        if (send_queue_size(&connection->send_queue) < CONNECTION_CHUNK_BYTES_PER_TICK) {
+            chunk_stream_flush(&connection->chunk_stream, &connection->send_queue, CONNECTION_CHUNK_BYTES_PER_TICK);
+        }
+
+        // Whatever did not fit into the socket buffer stays queued until the next tick,
+        // so a slow client never stalls the tick. Broken connections are closed by the reading side.
+        if (send_queue_flush(&connection->send_queue, connection->socket) == SEND_QUEUE_FLUSH_ERROR) {
+            LOG_ERROR("failed to flush send queue of connection with socket fd=%d: %s", connection->socket, strerror(errno));
+        }
+    }
+
+    pthread_rwlock_unlock(&connections_lock);
+}
+
+void connection_discard_pending(void)
+{
+    pthread_rwlock_rdlock(&connections_lock);
+
+    for (u32 i = 0; i < connections_capacity; i++) {
+        if (connections[i] != NULL) {
+            send_queue_clear(&connections[i]->send_queue);
+        }
+    }
+
+    pthread_rwlock_unlock(&connections_lock);
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stdatomic.h>
+
+#include "defines.h"
+#include "common/send_queue.h"
+#include "common/recv_buffer.h"
+#include "chunk_stream.h"
+
+typedef enum {
+    CONNECTION_STATE_VALIDATING, /* validation puzzle sent, waiting for the answer */
+    CONNECTION_STATE_JOINING,    /* validated, waiting for the player init confirmation */
+    CONNECTION_STATE_ESTABLISHED
+} connection_state_e;
+
+typedef struct {
+    i32 socket;
+    u32 shard;       /* Index of the I/O thread which owns the socket */
+    u64 shard_index; /* Position in the owning shard's connection list */
+    connection_state_e state;
+    u64 puzzle_answer;
+    u64 handshake_deadline_ns; /* Connection is dropped if it is still handshaking past this point */
+    send_queue_t send_queue;
+    recv_buffer_t recv_buffer;
+    chunk_stream_t chunk_stream; /* Chunk answers waiting for their share of the per-tick byte budget */
+    atomic_bool is_overloaded;   /* Send queue ran full, the connection is being kicked */
+} connection_t;
+
+void connection_system_init(void);
+void connection_system_shutdown(void);
+
+b8   connection_open(i32 socket, u32 shard);
+void connection_close(i32 socket);
+
+/* Only the I/O thread owning the socket may use the returned connection, it does so without holding the table lock */
+connection_t *connection_get(i32 socket);
+
+/* Appends the packet to the connection's send queue, it is written to the socket by connection_flush_shard.
+   A client which can't keep up with its send queue is kicked instead of silently missing packets */
+b8   connection_send_packet(i32 socket, u32 type, void *packet_data);
+
+/* Sets the answer to a chunk queued on the connection's chunk stream, safe to call from any thread.
+   packet_data of NULL means the client needs nothing for this chunk */
+void connection_complete_chunk(i32 socket, i32 x, i32 y, u32 type, const void *packet_data);
+
+/* Called by every I/O thread once per tick - tops up the send queues of the connections it owns
+   with pending chunk answers and writes them out with a single vectored send each */
+void connection_flush_shard(u32 shard);
+
+/* Drops everything queued on every connection instead of writing it out, for replays which have no sockets */
+void connection_discard_pending(void);
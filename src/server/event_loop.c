@@ -0,0 +1,182 @@
+#include "event_loop.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "common/logger.h"
+#include "common/asserts.h"
+#include "common/memory/memutils.h"
+
+void server_pfd_init(u32 initial_capacity, server_pfd_t *out_server_pfd)
+{
+    ASSERT(out_server_pfd);
+    ASSERT(initial_capacity > 0);
+
+    out_server_pfd->count = 0;
+    out_server_pfd->capacity = initial_capacity;
+    out_server_pfd->fds = mem_alloc(sizeof(struct pollfd) * initial_capacity, MEMORY_TAG_NETWORK);
+}
+
+void server_pfd_shutdown(server_pfd_t *server_pfd)
+{
+    ASSERT(server_pfd);
+
+    mem_free(server_pfd->fds, sizeof(struct pollfd) * server_pfd->capacity, MEMORY_TAG_NETWORK);
+    server_pfd->count = 0;
+    server_pfd->capacity = 0;
+    server_pfd->fds = NULL;
+}
+
+void server_pfd_add(server_pfd_t *pfd, i32 fd)
+{
+    ASSERT(pfd);
+
+    if (pfd->count + 1 >= pfd->capacity) { /* Resize */
+        u32 new_capacity = pfd->capacity * 2;
+        struct pollfd *new_fds = mem_alloc(sizeof(struct pollfd) * new_capacity, MEMORY_TAG_NETWORK);
+        mem_copy(new_fds, pfd->fds, sizeof(struct pollfd) * pfd->count);
+        mem_free(pfd->fds, sizeof(struct pollfd) * pfd->capacity, MEMORY_TAG_NETWORK);
+        pfd->fds = new_fds;
+        pfd->capacity = new_capacity;
+    }
+
+    pfd->fds[pfd->count].fd = fd;
+    pfd->fds[pfd->count].events = POLLIN;
+    pfd->fds[pfd->count].revents = 0;
+    pfd->count++;
+}
+
+void server_pfd_remove(server_pfd_t *pfd, i32 fd)
+{
+    ASSERT(pfd);
+
+    for (u32 i = 0; i < pfd->count; i++) {
+        if (pfd->fds[i].fd == fd) {
+            pfd->fds[i] = pfd->fds[pfd->count-1]; /* Replace old fd with the last one */
+            pfd->count--;
+            return;
+        }
+    }
+
+    LOG_ERROR("did not find fd=%d in the array of pfds", fd);
+}
+
+b8 event_loop_create(u32 max_events, event_loop_t *out_event_loop)
+{
+    ASSERT(out_event_loop);
+    ASSERT(max_events > 0);
+
+    out_event_loop->max_events = max_events;
+
+#if SERVER_USE_EPOLL
+    out_event_loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (out_event_loop->epoll_fd == -1) {
+        LOG_ERROR("epoll_create1 error: %s", strerror(errno));
+        return false;
+    }
+
+    out_event_loop->epoll_events = mem_alloc(sizeof(struct epoll_event) * max_events, MEMORY_TAG_NETWORK);
+    LOG_INFO("using epoll event loop backend");
+#else
+    server_pfd_init(max_events, &out_event_loop->pfd);
+    LOG_INFO("using poll event loop backend");
+#endif
+
+    return true;
+}
+
+void event_loop_destroy(event_loop_t *event_loop)
+{
+    ASSERT(event_loop);
+
+#if SERVER_USE_EPOLL
+    if (close(event_loop->epoll_fd) == -1) {
+        LOG_ERROR("error while closing epoll fd: %s", strerror(errno));
+    }
+    mem_free(event_loop->epoll_events, sizeof(struct epoll_event) * event_loop->max_events, MEMORY_TAG_NETWORK);
+    event_loop->epoll_events = NULL;
+    event_loop->epoll_fd = -1;
+#else
+    server_pfd_shutdown(&event_loop->pfd);
+#endif
+}
+
+b8 event_loop_add(event_loop_t *event_loop, i32 fd)
+{
+    ASSERT(event_loop);
+
+#if SERVER_USE_EPOLL
+    struct epoll_event event = {
+        .events = EPOLLIN | EPOLLRDHUP | EPOLLET,
+        .data.fd = fd
+    };
+    if (epoll_ctl(event_loop->epoll_fd, EPOLL_CTL_ADD, fd, &event) == -1) {
+        LOG_ERROR("epoll_ctl add error for fd=%d: %s", fd, strerror(errno));
+        return false;
+    }
+#else
+    server_pfd_add(&event_loop->pfd, fd);
+#endif
+
+    return true;
+}
+
+void event_loop_remove(event_loop_t *event_loop, i32 fd)
+{
+    ASSERT(event_loop);
+
+#if SERVER_USE_EPOLL
+    if (epoll_ctl(event_loop->epoll_fd, EPOLL_CTL_DEL, fd, NULL) == -1) {
+        LOG_ERROR("epoll_ctl del error for fd=%d: %s", fd, strerror(errno));
+    }
+#else
+    server_pfd_remove(&event_loop->pfd, fd);
+#endif
+}
+
+i32 event_loop_wait(event_loop_t *event_loop, event_loop_event_t *out_events, i32 timeout_ms)
+{
+    ASSERT(event_loop);
+    ASSERT(out_events);
+
+#if SERVER_USE_EPOLL
+    i32 num_events = epoll_wait(event_loop->epoll_fd, event_loop->epoll_events, event_loop->max_events, timeout_ms);
+    if (num_events == -1) {
+        return -1;
+    }
+
+    for (i32 i = 0; i < num_events; i++) {
+        u32 events = event_loop->epoll_events[i].events;
+        out_events[i].fd = event_loop->epoll_events[i].data.fd;
+        out_events[i].flags = ((events & EPOLLIN)                ? EVENT_LOOP_FLAG_READABLE : 0) |
+                              ((events & (EPOLLHUP | EPOLLRDHUP)) ? EVENT_LOOP_FLAG_HANGUP   : 0) |
+                              ((events & EPOLLERR)               ? EVENT_LOOP_FLAG_ERROR    : 0);
+    }
+
+    return num_events;
+#else
+    server_pfd_t *pfd = &event_loop->pfd;
+    i32 num_ready = poll(pfd->fds, pfd->count, timeout_ms);
+    if (num_ready == -1) {
+        return -1;
+    }
+
+    // Copy ready descriptors out, so that the caller is free to add/remove fds while handling the events
+    i32 num_events = 0;
+    for (u32 i = 0; i < pfd->count && num_events < event_loop->max_events && num_events < num_ready; i++) {
+        i16 revents = pfd->fds[i].revents;
+        if (revents == 0) {
+            continue;
+        }
+
+        out_events[num_events].fd = pfd->fds[i].fd;
+        out_events[num_events].flags = ((revents & POLLIN)  ? EVENT_LOOP_FLAG_READABLE : 0) |
+                                       ((revents & POLLHUP) ? EVENT_LOOP_FLAG_HANGUP   : 0) |
+                                       ((revents & POLLERR) ? EVENT_LOOP_FLAG_ERROR    : 0);
+        num_events++;
+    }
+
+    return num_events;
+#endif
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "config.h"
+#include "defines.h"
+
+#include <poll.h>
+#if SERVER_USE_EPOLL
+    #include <sys/epoll.h>
+#endif
+
+#define EVENT_LOOP_INFINITE_TIMEOUT -1
+
+typedef enum {
+    EVENT_LOOP_FLAG_READABLE = BIT(0),
+    EVENT_LOOP_FLAG_HANGUP   = BIT(1),
+    EVENT_LOOP_FLAG_ERROR    = BIT(2)
+} event_loop_flag_e;
+
+typedef struct {
+    i32 fd;
+    u32 flags;
+} event_loop_event_t;
+
+/* Fallback backend used when epoll is disabled - linear array of pollfds */
+typedef struct {
+    struct pollfd *fds;
+    u32 count;
+    u32 capacity;
+} server_pfd_t;
+
+typedef struct {
+#if SERVER_USE_EPOLL
+    i32 epoll_fd;
+    struct epoll_event *epoll_events;
+#else
+    server_pfd_t pfd;
+#endif
+    u32 max_events;
+} event_loop_t;
+
+b8   event_loop_create  (u32 max_events, event_loop_t *out_event_loop);
+void event_loop_destroy (event_loop_t *event_loop);
+
+/* Sockets added to the event loop are expected to be non-blocking, since with epoll they are
+   registered as edge-triggered and the caller has to drain them until EAGAIN on every event */
+b8   event_loop_add     (event_loop_t *event_loop, i32 fd);
+void event_loop_remove  (event_loop_t *event_loop, i32 fd);
+
+/* Returns number of events written to out_events (at most max_events) or -1 on error with errno set */
+i32  event_loop_wait    (event_loop_t *event_loop, event_loop_event_t *out_events, i32 timeout_ms);
+
+void server_pfd_init    (u32 initial_capacity, server_pfd_t *out_server_pfd);
+void server_pfd_shutdown(server_pfd_t *server_pfd);
+void server_pfd_add     (server_pfd_t *pfd, i32 fd);
+void server_pfd_remove  (server_pfd_t *pfd, i32 fd);
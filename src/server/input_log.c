@@ -0,0 +1,142 @@
+#include "input_log.h"
+
+#include <errno.h>
+#include <string.h>
+
+#include "common/logger.h"
+#include "common/asserts.h"
+
+#define INPUT_LOG_BUFFER_SIZE KiB(64)
+
+typedef struct {
+    u32 magic;
+    u32 version;
+    u32 tick_rate;
+    u32 random_seed;
+    u32 map_seed;
+    i32 map_octave_count;
+    f32 map_bias;
+} input_log_file_header_t;
+
+typedef struct {
+    u64 tick;
+    u32 size;
+    u32 reserved;
+} input_log_record_header_t;
+
+b8 input_log_create(const char *path, const input_log_header_t *header, input_log_t *out_log)
+{
+    ASSERT(path);
+    ASSERT(header);
+    ASSERT(out_log);
+
+    FILE *file = fopen(path, "wb");
+    if (file == NULL) {
+        LOG_ERROR("failed to create input log %s: %s", path, strerror(errno));
+        return false;
+    }
+    setvbuf(file, NULL, _IOFBF, INPUT_LOG_BUFFER_SIZE);
+
+    input_log_file_header_t file_header = {
+        .magic            = INPUT_LOG_MAGIC,
+        .version          = INPUT_LOG_VERSION,
+        .tick_rate        = header->tick_rate,
+        .random_seed      = header->random_seed,
+        .map_seed         = header->map.seed,
+        .map_octave_count = header->map.octave_count,
+        .map_bias         = header->map.bias
+    };
+    if (fwrite(&file_header, sizeof(file_header), 1, file) != 1) {
+        LOG_ERROR("failed to write header of input log %s: %s", path, strerror(errno));
+        fclose(file);
+        return false;
+    }
+
+    out_log->file = file;
+    out_log->tick_count = 0;
+    out_log->byte_count = sizeof(file_header);
+    return true;
+}
+
+b8 input_log_open(const char *path, input_log_header_t *out_header, input_log_t *out_log)
+{
+    ASSERT(path);
+    ASSERT(out_header);
+    ASSERT(out_log);
+
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        LOG_ERROR("failed to open input log %s: %s", path, strerror(errno));
+        return false;
+    }
+    setvbuf(file, NULL, _IOFBF, INPUT_LOG_BUFFER_SIZE);
+
+    input_log_file_header_t file_header;
+    if (fread(&file_header, sizeof(file_header), 1, file) != 1 ||
+        file_header.magic != INPUT_LOG_MAGIC || file_header.version != INPUT_LOG_VERSION) {
+        LOG_ERROR("input log %s is damaged or has an incompatible format", path);
+        fclose(file);
+        return false;
+    }
+
+    out_header->tick_rate = file_header.tick_rate;
+    out_header->random_seed = file_header.random_seed;
+    out_header->map.seed = file_header.map_seed;
+    out_header->map.octave_count = file_header.map_octave_count;
+    out_header->map.bias = file_header.map_bias;
+
+    out_log->file = file;
+    out_log->tick_count = 0;
+    out_log->byte_count = sizeof(file_header);
+    return true;
+}
+
+void input_log_close(input_log_t *log)
+{
+    ASSERT(log);
+
+    if (log->file != NULL) {
+        fclose(log->file);
+        log->file = NULL;
+    }
+}
+
+b8 input_log_write_tick(input_log_t *log, u64 tick, const void *data, u32 size)
+{
+    ASSERT(log && log->file);
+    ASSERT(data || size == 0);
+
+    input_log_record_header_t record = { .tick = tick, .size = size };
+    if (fwrite(&record, sizeof(record), 1, log->file) != 1 || (size > 0 && fwrite(data, size, 1, log->file) != 1)) {
+        LOG_ERROR("failed to write tick %llu to input log: %s", tick, strerror(errno));
+        return false;
+    }
+
+    log->tick_count++;
+    log->byte_count += sizeof(record) + size;
+    return true;
+}
+
+b8 input_log_read_tick(input_log_t *log, u64 *out_tick, void *buffer, u32 capacity, u32 *out_size)
+{
+    ASSERT(log && log->file);
+    ASSERT(out_tick);
+    ASSERT(buffer);
+    ASSERT(out_size);
+
+    input_log_record_header_t record;
+    if (fread(&record, sizeof(record), 1, log->file) != 1) {
+        return false;
+    }
+
+    if (record.size > capacity || (record.size > 0 && fread(buffer, record.size, 1, log->file) != 1)) {
+        LOG_ERROR("input log record of tick %llu is damaged", record.tick);
+        return false;
+    }
+
+    *out_tick = record.tick;
+    *out_size = record.size;
+    log->tick_count++;
+    log->byte_count += sizeof(record) + record.size;
+    return true;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stdio.h>
+
+#include "defines.h"
+#include "common/game_world_types.h"
+
+#define INPUT_LOG_MAGIC   0x4e494c53 /* "SLIN" */
+#define INPUT_LOG_VERSION 1
+#define INPUT_LOG_ENV     "STARLORE_INPUT_LOG" /* Path the server records its input to, not recording if unset */
+
+/********************************************************************************
+ *  Binary log of everything the simulation consumed, so a session can be       *
+ *  replayed offline. A header holding what the simulation starts from (tick    *
+ *  rate, random seed, world map) is followed by one record per tick which      *
+ *  dequeued any client events: the tick number, the size of the tick's data    *
+ *  and the data itself. Ticks without events are left out, what the data      *
+ *  contains is up to the caller. Writes are buffered, the log is only          *
+ *  guaranteed to be complete once it has been closed.                          *
+ *                                                                              *
+ *  A session is recorded and replayed headless as fast as possible with, e.g.  *
+ *    STARLORE_INPUT_LOG=session.bin ./server 8080                              *
+ *    ./server --replay session.bin                                             *
+ ********************************************************************************/
+
+typedef struct {
+    u32 tick_rate;
+    u32 random_seed; /* math_random is seeded with it before the first tick */
+    game_map_t map;
+} input_log_header_t;
+
+typedef struct {
+    FILE *file;
+    u64 tick_count; /* Records written or read so far */
+    u64 byte_count;
+} input_log_t;
+
+/* Truncates the file at path and writes the header */
+b8   input_log_create(const char *path, const input_log_header_t *header, input_log_t *out_log);
+/* Opens an existing log for reading and checks its header */
+b8   input_log_open(const char *path, input_log_header_t *out_header, input_log_t *out_log);
+void input_log_close(input_log_t *log);
+
+b8   input_log_write_tick(input_log_t *log, u64 tick, const void *data, u32 size);
+/* Returns false at the end of the log, or if the next record is damaged or larger than capacity */
+b8   input_log_read_tick(input_log_t *log, u64 *out_tick, void *buffer, u32 capacity, u32 *out_size);
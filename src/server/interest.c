@@ -0,0 +1,125 @@
+#include "interest.h"
+
+#include <stdlib.h>
+
+#include "common/asserts.h"
+#include "common/containers/darray.h"
+
+INLINE u64 chunk_key(vec2i chunk)
+{
+    return ((u64)(u32)chunk.x << 32) | (u32)chunk.y;
+}
+
+void interest_grid_create(u64 initial_capacity, interest_grid_t *out_grid)
+{
+    ASSERT(out_grid);
+
+    hashmap_create(initial_capacity, &out_grid->cells);
+}
+
+void interest_grid_destroy(interest_grid_t *grid)
+{
+    ASSERT(grid);
+
+    for (u64 i = 0; i < grid->cells.capacity; i++) {
+        if (grid->cells.entries[i].occupied) {
+            darray_destroy((player_id *)grid->cells.entries[i].value);
+        }
+    }
+    hashmap_destroy(&grid->cells);
+}
+
+void interest_grid_insert(interest_grid_t *grid, player_id id, vec2i chunk)
+{
+    ASSERT(grid);
+
+    u64 key = chunk_key(chunk);
+    u64 value;
+    player_id *ids = hashmap_get(&grid->cells, key, &value) ? (player_id *)value : darray_create(sizeof(player_id));
+    darray_push(ids, id);
+    // Pushing may have moved the array
+    hashmap_set(&grid->cells, key, (u64)ids);
+}
+
+void interest_grid_remove(interest_grid_t *grid, player_id id, vec2i chunk)
+{
+    ASSERT(grid);
+
+    u64 key = chunk_key(chunk);
+    u64 value;
+    if (!hashmap_get(&grid->cells, key, &value)) {
+        return;
+    }
+
+    player_id *ids = (player_id *)value;
+    u64 length = darray_length(ids);
+    for (u64 i = 0; i < length; i++) {
+        if (ids[i] == id) {
+            darray_pop_at(ids, i, NULL);
+            break;
+        }
+    }
+
+    // Empty cells are dropped, otherwise every chunk ever walked through would keep its cell
+    if (darray_length(ids) == 0) {
+        darray_destroy(ids);
+        hashmap_remove(&grid->cells, key);
+    }
+}
+
+u32 interest_grid_query(interest_grid_t *grid, vec2i chunk, u32 radius, interest_candidate_t *out_candidates, u32 capacity)
+{
+    ASSERT(grid);
+    ASSERT(out_candidates);
+
+    u32 count = 0;
+    for (i32 y = chunk.y - (i32)radius; y <= chunk.y + (i32)radius; y++) {
+        for (i32 x = chunk.x - (i32)radius; x <= chunk.x + (i32)radius; x++) {
+            vec2i cell = { .x = x, .y = y };
+            u64 value;
+            if (!hashmap_get(&grid->cells, chunk_key(cell), &value)) {
+                continue;
+            }
+
+            player_id *ids = (player_id *)value;
+            u32 distance = interest_chunk_distance(chunk, cell);
+            u64 length = darray_length(ids);
+            for (u64 i = 0; i < length && count < capacity; i++) {
+                out_candidates[count++] = (interest_candidate_t){ .id = ids[i], .distance = distance };
+            }
+        }
+    }
+
+    return count;
+}
+
+u32 interest_grid_query_area(interest_grid_t *grid, vec2i min_chunk, vec2i max_chunk, player_id *out_ids, u32 capacity)
+{
+    ASSERT(grid);
+    ASSERT(out_ids);
+
+    u32 count = 0;
+    for (i32 y = min_chunk.y; y <= max_chunk.y; y++) {
+        for (i32 x = min_chunk.x; x <= max_chunk.x; x++) {
+            u64 value;
+            if (!hashmap_get(&grid->cells, chunk_key((vec2i){ .x = x, .y = y }), &value)) {
+                continue;
+            }
+
+            player_id *ids = (player_id *)value;
+            u64 length = darray_length(ids);
+            for (u64 i = 0; i < length && count < capacity; i++) {
+                out_ids[count++] = ids[i];
+            }
+        }
+    }
+
+    return count;
+}
+
+u32 interest_chunk_distance(vec2i a, vec2i b)
+{
+    u32 dx = (u32)abs(a.x - b.x);
+    u32 dy = (u32)abs(a.y - b.y);
+    return dx > dy ? dx : dy;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "defines.h"
+#include "common/maths.h"
+#include "common/global.h"
+#include "common/containers/hashmap.h"
+
+/********************************************************************************
+ *  Area of interest on the chunk grid. Every player in the world is filed     *
+ *  under the chunk it stands in, so finding the players near a chunk only     *
+ *  looks at the cells around it instead of at every player. A player is        *
+ *  subscribed to the chunks within INTEREST_RADIUS_CHUNKS of its own: it sees  *
+ *  the players standing in them and hears about changes made to them.         *
+ ********************************************************************************/
+
+typedef struct {
+    player_id id;
+    u32 distance; /* In chunks, the larger of the horizontal and vertical distance */
+} interest_candidate_t;
+
+typedef struct {
+    hashmap_t cells; /* chunk key -> darray of the ids of the players standing in that chunk */
+} interest_grid_t;
+
+void interest_grid_create (u64 initial_capacity, interest_grid_t *out_grid);
+void interest_grid_destroy(interest_grid_t *grid);
+
+void interest_grid_insert(interest_grid_t *grid, player_id id, vec2i chunk);
+void interest_grid_remove(interest_grid_t *grid, player_id id, vec2i chunk);
+
+/* Collects the players standing within radius chunks of the given one, returns how many were written */
+u32  interest_grid_query(interest_grid_t *grid, vec2i chunk, u32 radius, interest_candidate_t *out_candidates, u32 capacity);
+/* Collects the players standing in the chunks from min_chunk to max_chunk inclusive, returns how many were written */
+u32  interest_grid_query_area(interest_grid_t *grid, vec2i min_chunk, vec2i max_chunk, player_id *out_ids, u32 capacity);
+
+u32  interest_chunk_distance(vec2i a, vec2i b);
@@ -0,0 +1,105 @@
+#include "player_store.h"
+
+#include "config.h"
+#include "common/asserts.h"
+#include "common/player_types.h"
+
+u32 player_store_add(player_store_t *store)
+{
+    ASSERT(store);
+    ASSERT(store->count < MAX_PLAYER_COUNT);
+
+    u32 index = store->count++;
+    store->positions[index] = vec2_create(0.0f, 0.0f);
+    store->roll_starts[index] = 0.0f;
+    store->states[index] = PLAYER_STATE_IDLE;
+    store->directions[index] = PLAYER_DIRECTION_DOWN;
+    store->health[index] = 0;
+    store->pending_damage[index] = 0;
+    store->attack_cooldowns[index] = 0.0f;
+    store->roll_cooldowns[index] = 0.0f;
+    store->attack_accumulators[index] = 0.0f;
+    store->roll_accumulators[index] = 0.0f;
+    store->respawn_cooldowns[index] = 0.0f;
+
+    return index;
+}
+
+void player_store_remove(player_store_t *store, u32 index)
+{
+    ASSERT(store);
+    ASSERT(index < store->count);
+
+    u32 last = --store->count;
+    if (index == last) {
+        return;
+    }
+
+    store->positions[index] = store->positions[last];
+    store->roll_starts[index] = store->roll_starts[last];
+    store->states[index] = store->states[last];
+    store->directions[index] = store->directions[last];
+    store->health[index] = store->health[last];
+    store->pending_damage[index] = store->pending_damage[last];
+    store->attack_cooldowns[index] = store->attack_cooldowns[last];
+    store->roll_cooldowns[index] = store->roll_cooldowns[last];
+    store->attack_accumulators[index] = store->attack_accumulators[last];
+    store->roll_accumulators[index] = store->roll_accumulators[last];
+    store->respawn_cooldowns[index] = store->respawn_cooldowns[last];
+}
+
+void player_store_update(player_store_t *store, f32 delta_time)
+{
+    ASSERT(store);
+
+    // Each loop only touches a few of the arrays, and apart from the respawn one they are
+    // kept free of branches - values are computed first and stored unconditionally - so they vectorize
+    u32 count = store->count;
+
+    // Cooldowns stop at zero, a player can act again as soon as they are no longer positive
+    for (u32 i = 0; i < count; i++) {
+        f32 attack_cooldown = store->attack_cooldowns[i] - delta_time;
+        f32 roll_cooldown = store->roll_cooldowns[i] - delta_time;
+        store->attack_cooldowns[i] = attack_cooldown > 0.0f ? attack_cooldown : 0.0f;
+        store->roll_cooldowns[i] = roll_cooldown > 0.0f ? roll_cooldown : 0.0f;
+    }
+
+    // A dead player comes back the tick after its respawn cooldown ran out, rare enough to branch on
+    for (u32 i = 0; i < count; i++) {
+        if (store->states[i] != PLAYER_STATE_DEAD || store->respawn_cooldowns[i] > 0.0f) {
+            continue;
+        }
+
+        store->states[i] = PLAYER_STATE_IDLE;
+        store->directions[i] = PLAYER_DIRECTION_DOWN;
+        store->health[i] = PLAYER_START_HEALTH;
+        store->positions[i] = vec2_create(PLAYER_SPAWN_POSITION_X, PLAYER_SPAWN_POSITION_Y);
+    }
+
+    // Timers only run in their own state
+    for (u32 i = 0; i < count; i++) {
+        u8 state = store->states[i];
+        f32 roll_step = state == PLAYER_STATE_ROLL ? delta_time : 0.0f;
+        f32 attack_step = state == PLAYER_STATE_ATTACK ? delta_time : 0.0f;
+        f32 respawn_step = state == PLAYER_STATE_DEAD ? delta_time : 0.0f;
+        store->roll_accumulators[i] += roll_step;
+        store->attack_accumulators[i] += attack_step;
+        store->respawn_cooldowns[i] -= respawn_step;
+    }
+
+    // Rolls and attacks which ran their full duration end
+    for (u32 i = 0; i < count; i++) {
+        u8 state = store->states[i];
+        f32 roll_accumulator = store->roll_accumulators[i];
+        b8 roll_ended = (state == PLAYER_STATE_ROLL) & (roll_accumulator >= PLAYER_ROLL_DURATION);
+        store->roll_accumulators[i] = roll_ended ? 0.0f : roll_accumulator;
+        store->states[i] = roll_ended ? PLAYER_STATE_IDLE : state;
+    }
+    for (u32 i = 0; i < count; i++) {
+        u8 state = store->states[i];
+        f32 attack_accumulator = store->attack_accumulators[i];
+        b8 attack_ended = (state == PLAYER_STATE_ATTACK) & (attack_accumulator >= PLAYER_ATTACK_DURATION);
+        store->attack_accumulators[i] = attack_ended ? 0.0f : attack_accumulator;
+        store->states[i] = attack_ended ? PLAYER_STATE_IDLE : state;
+    }
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "defines.h"
+#include "common/maths.h"
+#include "common/global.h"
+
+/********************************************************************************
+ *  Per-tick player state kept as a structure of arrays. Everything the         *
+ *  simulation reads or writes every tick lives here, one array per field, so   *
+ *  the batched update streams through only the fields it needs and the         *
+ *  compiler can vectorize it. Rarely touched data (name, socket, UDP address,  *
+ *  visible set) stays in the server's player table. Elements are kept dense    *
+ *  the same way the table keeps its own, so index i of every array belongs to  *
+ *  the player at index i of the table as long as both see the same inserts     *
+ *  and removals.                                                               *
+ ********************************************************************************/
+
+typedef struct {
+    u32 count;
+    vec2 positions[MAX_PLAYER_COUNT];
+    f32 roll_starts[MAX_PLAYER_COUNT];        /* Coordinate the current roll started at, along its direction */
+    u8 states[MAX_PLAYER_COUNT];              /* player_state_e */
+    u8 directions[MAX_PLAYER_COUNT];          /* player_direction_e */
+    i32 health[MAX_PLAYER_COUNT];
+    u32 pending_damage[MAX_PLAYER_COUNT];     /* Damage dealt to the player during the current tick */
+    f32 attack_cooldowns[MAX_PLAYER_COUNT];
+    f32 roll_cooldowns[MAX_PLAYER_COUNT];
+    f32 attack_accumulators[MAX_PLAYER_COUNT];
+    f32 roll_accumulators[MAX_PLAYER_COUNT];
+    f32 respawn_cooldowns[MAX_PLAYER_COUNT];
+} player_store_t;
+
+/* Appends a zeroed player and returns its index */
+u32  player_store_add   (player_store_t *store);
+/* Moves the last player into the freed index, like id_table_remove */
+void player_store_remove(player_store_t *store, u32 index);
+
+/* Advances cooldowns and the attack, roll and death timers of every player, ending the states which ran out.
+   Respawned players are moved to the spawn point, their chunk has to be refiled by the caller */
+void player_store_update(player_store_t *store, f32 delta_time);
@@ -0,0 +1,343 @@
+#include "region_file.h"
+
+#include <stdio.h>
+#include <stddef.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "common/logger.h"
+#include "common/asserts.h"
+#include "common/filesystem.h"
+#include "common/containers/hashmap.h"
+#include "common/memory/memutils.h"
+
+#define REGION_DIRECTORY_MAX_LENGTH 192
+#define REGION_FILE_PATH_MAX_LENGTH 256
+#define REGION_RECORDS_OFFSET (sizeof(region_file_header_t) + REGION_CHUNK_COUNT * sizeof(u32))
+
+typedef struct {
+    i32 fd;
+    i32 region_x;
+    i32 region_y;
+    u32 chunk_count;
+    u32 slots[REGION_CHUNK_COUNT];
+    u8 *mapping;
+    u64 mapping_size;
+} region_file_t;
+
+static char storage_directory[REGION_DIRECTORY_MAX_LENGTH];
+/* Open region files keyed by packed region coordinates */
+static hashmap_t regions;
+static pthread_mutex_t storage_lock = PTHREAD_MUTEX_INITIALIZER;
+
+INLINE i32 floor_div(i32 value, i32 divisor)
+{
+    i32 quotient = value / divisor;
+    return (value % divisor != 0 && value < 0) ? quotient - 1 : quotient;
+}
+
+INLINE u64 region_coords_pack(i32 x, i32 y)
+{
+    return ((u64)(u32)x << 32) | (u64)(u32)y;
+}
+
+static b8 region_file_remap(region_file_t *region)
+{
+    struct stat file_stat;
+    if (fstat(region->fd, &file_stat) == -1) {
+        LOG_ERROR("failed to stat region file %i:%i: %s", region->region_x, region->region_y, strerror(errno));
+        return false;
+    }
+
+    if (region->mapping != NULL) {
+        munmap(region->mapping, region->mapping_size);
+        region->mapping = NULL;
+        region->mapping_size = 0;
+    }
+
+    void *mapping = mmap(NULL, file_stat.st_size, PROT_READ, MAP_SHARED, region->fd, 0);
+    if (mapping == MAP_FAILED) {
+        LOG_ERROR("failed to map region file %i:%i: %s", region->region_x, region->region_y, strerror(errno));
+        return false;
+    }
+
+    region->mapping = mapping;
+    region->mapping_size = file_stat.st_size;
+    return true;
+}
+
+static void region_file_close(region_file_t *region)
+{
+    if (region->mapping != NULL) {
+        munmap(region->mapping, region->mapping_size);
+    }
+
+    fdatasync(region->fd);
+    close(region->fd);
+    mem_free(region, sizeof(region_file_t), MEMORY_TAG_GAME);
+}
+
+/* Writes the header and an empty slot table into a fresh file */
+static b8 region_file_initialize(region_file_t *region, region_file_header_t *out_header)
+{
+    *out_header = (region_file_header_t){
+        .magic = REGION_FILE_MAGIC,
+        .version = REGION_FILE_VERSION,
+        .region_length = REGION_LENGTH,
+        .record_size = sizeof(region_chunk_record_t),
+        .region_x = region->region_x,
+        .region_y = region->region_y,
+        .chunk_count = 0
+    };
+    mem_zero(region->slots, sizeof(region->slots));
+
+    return pwrite(region->fd, out_header, sizeof(*out_header), 0) == sizeof(*out_header) &&
+           pwrite(region->fd, region->slots, sizeof(region->slots), sizeof(*out_header)) == sizeof(region->slots);
+}
+
+static region_file_t *region_file_open(i32 region_x, i32 region_y)
+{
+    char path[REGION_FILE_PATH_MAX_LENGTH];
+    snprintf(path, sizeof(path), "%s/r.%i.%i.region", storage_directory, region_x, region_y);
+
+    i32 fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd == -1) {
+        LOG_ERROR("failed to open region file %s: %s", path, strerror(errno));
+        return NULL;
+    }
+
+    region_file_t *region = mem_alloc(sizeof(region_file_t), MEMORY_TAG_GAME);
+    region->fd = fd;
+    region->region_x = region_x;
+    region->region_y = region_y;
+
+    region_file_header_t header = {0};
+    ssize_t bytes_read = pread(fd, &header, sizeof(header), 0);
+    b8 is_compatible = bytes_read == sizeof(header) &&
+                       header.magic == REGION_FILE_MAGIC && header.version == REGION_FILE_VERSION &&
+                       header.region_length == REGION_LENGTH && header.record_size == sizeof(region_chunk_record_t) &&
+                       pread(fd, region->slots, sizeof(region->slots), sizeof(header)) == sizeof(region->slots);
+    if (bytes_read != 0 && !is_compatible) {
+        // Its chunks are generated again from the seed, the old file is kept next to the new one in case it's wanted back
+        char old_path[REGION_FILE_PATH_MAX_LENGTH + 4];
+        snprintf(old_path, sizeof(old_path), "%s.old", path);
+        LOG_WARN("region file %s is corrupted or has an incompatible format, moving it to %s and starting over", path, old_path);
+
+        close(fd);
+        fd = -1;
+        if (rename(path, old_path) == 0) {
+            fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+        }
+        if (fd == -1) {
+            LOG_ERROR("failed to recreate region file %s: %s", path, strerror(errno));
+            mem_free(region, sizeof(region_file_t), MEMORY_TAG_GAME);
+            return NULL;
+        }
+        region->fd = fd;
+        bytes_read = 0;
+    }
+
+    if (bytes_read == 0 && !region_file_initialize(region, &header)) {
+        LOG_ERROR("failed to initialize region file %s: %s", path, strerror(errno));
+        close(fd);
+        mem_free(region, sizeof(region_file_t), MEMORY_TAG_GAME);
+        return NULL;
+    }
+
+    region->chunk_count = header.chunk_count;
+
+    if (!region_file_remap(region)) {
+        close(fd);
+        mem_free(region, sizeof(region_file_t), MEMORY_TAG_GAME);
+        return NULL;
+    }
+
+    return region;
+}
+
+/* Must be called with storage_lock held */
+static region_file_t *region_get(i32 chunk_x, i32 chunk_y, u32 *out_index)
+{
+    i32 region_x = floor_div(chunk_x, REGION_LENGTH);
+    i32 region_y = floor_div(chunk_y, REGION_LENGTH);
+    *out_index = (chunk_y - region_y * REGION_LENGTH) * REGION_LENGTH + (chunk_x - region_x * REGION_LENGTH);
+
+    u64 key = region_coords_pack(region_x, region_y);
+    u64 value;
+    if (hashmap_get(&regions, key, &value)) {
+        return (region_file_t *)(uptr)value;
+    }
+
+    region_file_t *region = region_file_open(region_x, region_y);
+    if (region != NULL) {
+        hashmap_set(&regions, key, (u64)(uptr)region);
+    }
+
+    return region;
+}
+
+b8 region_storage_init(const char *directory)
+{
+    ASSERT(directory);
+
+    if (strlen(directory) >= REGION_DIRECTORY_MAX_LENGTH) {
+        LOG_ERROR("world directory path '%s' is too long", directory);
+        return false;
+    }
+
+    if (!filesystem_exists(directory) && mkdir(directory, 0755) == -1) {
+        LOG_ERROR("failed to create world directory %s: %s", directory, strerror(errno));
+        return false;
+    }
+
+    strcpy(storage_directory, directory);
+    hashmap_create(HASHMAP_DEFAULT_CAPACITY, &regions);
+    return true;
+}
+
+void region_storage_shutdown(void)
+{
+    pthread_mutex_lock(&storage_lock);
+
+    for (u64 i = 0; i < regions.capacity; i++) {
+        if (regions.entries[i].occupied) {
+            region_file_close((region_file_t *)(uptr)regions.entries[i].value);
+        }
+    }
+
+    hashmap_destroy(&regions);
+
+    pthread_mutex_unlock(&storage_lock);
+}
+
+b8 region_storage_load_chunk(i32 x, i32 y, chunk_base_t *out_chunk)
+{
+    ASSERT(out_chunk);
+
+    pthread_mutex_lock(&storage_lock);
+
+    u32 index;
+    region_file_t *region = region_get(x, y, &index);
+    if (region == NULL || region->slots[index] == 0) {
+        pthread_mutex_unlock(&storage_lock);
+        return false;
+    }
+
+    u64 offset = REGION_RECORDS_OFFSET + (u64)(region->slots[index] - 1) * sizeof(region_chunk_record_t);
+    if (offset + sizeof(region_chunk_record_t) > region->mapping_size && !region_file_remap(region)) {
+        pthread_mutex_unlock(&storage_lock);
+        return false;
+    }
+
+    const region_chunk_record_t *record = (const region_chunk_record_t *)(region->mapping + offset);
+    mem_zero(out_chunk, sizeof(chunk_base_t));
+    out_chunk->x = record->x;
+    out_chunk->y = record->y;
+    out_chunk->revision = record->revision;
+    mem_copy(out_chunk->tiles, record->tiles, sizeof(record->tiles));
+    mem_copy(out_chunk->objects, record->objects, sizeof(record->objects));
+
+    pthread_mutex_unlock(&storage_lock);
+
+    ASSERT_MSG(out_chunk->x == x && out_chunk->y == y, "region file slot table points at the wrong chunk");
+    return true;
+}
+
+b8 region_storage_save_chunk(const chunk_base_t *chunk)
+{
+    ASSERT(chunk);
+
+    region_chunk_record_t record;
+    record.x = chunk->x;
+    record.y = chunk->y;
+    record.revision = chunk->revision;
+    mem_copy(record.tiles, chunk->tiles, sizeof(record.tiles));
+    mem_copy(record.objects, chunk->objects, sizeof(record.objects));
+
+    pthread_mutex_lock(&storage_lock);
+
+    u32 index;
+    region_file_t *region = region_get(chunk->x, chunk->y, &index);
+    if (region == NULL) {
+        pthread_mutex_unlock(&storage_lock);
+        return false;
+    }
+
+    b8 is_new_record = region->slots[index] == 0;
+    u32 slot = is_new_record ? region->chunk_count + 1 : region->slots[index];
+    u64 offset = REGION_RECORDS_OFFSET + (u64)(slot - 1) * sizeof(region_chunk_record_t);
+
+    // Record goes first so the slot table never points at a partially written chunk
+    if (pwrite(region->fd, &record, sizeof(record), offset) != sizeof(record)) {
+        LOG_ERROR("failed to write chunk %i:%i to region file: %s", chunk->x, chunk->y, strerror(errno));
+        pthread_mutex_unlock(&storage_lock);
+        return false;
+    }
+
+    if (is_new_record) {
+        u32 chunk_count = region->chunk_count + 1;
+        if (pwrite(region->fd, &slot, sizeof(slot), sizeof(region_file_header_t) + index * sizeof(u32)) != sizeof(slot) ||
+            pwrite(region->fd, &chunk_count, sizeof(chunk_count), offsetof(region_file_header_t, chunk_count)) != sizeof(chunk_count)) {
+            LOG_ERROR("failed to update region file table for chunk %i:%i: %s", chunk->x, chunk->y, strerror(errno));
+            pthread_mutex_unlock(&storage_lock);
+            return false;
+        }
+
+        region->slots[index] = slot;
+        region->chunk_count = chunk_count;
+    }
+
+    pthread_mutex_unlock(&storage_lock);
+    return true;
+}
+
+b8 region_storage_load_map(game_map_t *out_map)
+{
+    ASSERT(out_map);
+
+    char path[REGION_FILE_PATH_MAX_LENGTH];
+    snprintf(path, sizeof(path), "%s/world.dat", storage_directory);
+
+    i32 fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        return false;
+    }
+
+    b8 status = read(fd, out_map, sizeof(game_map_t)) == sizeof(game_map_t);
+    close(fd);
+
+    if (!status) {
+        LOG_ERROR("failed to read world parameters from %s", path);
+    }
+
+    return status;
+}
+
+b8 region_storage_save_map(const game_map_t *map)
+{
+    ASSERT(map);
+
+    char path[REGION_FILE_PATH_MAX_LENGTH];
+    snprintf(path, sizeof(path), "%s/world.dat", storage_directory);
+
+    i32 fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) {
+        LOG_ERROR("failed to create %s: %s", path, strerror(errno));
+        return false;
+    }
+
+    b8 status = write(fd, map, sizeof(game_map_t)) == sizeof(game_map_t);
+    fdatasync(fd);
+    close(fd);
+
+    if (!status) {
+        LOG_ERROR("failed to write world parameters to %s", path);
+    }
+
+    return status;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "defines.h"
+#include "common/global.h"
+#include "common/game_world_types.h"
+
+/********************************************************************************
+ *  Region file layout (one file per REGION_LENGTH x REGION_LENGTH chunks):     *
+ *    region_file_header_t header                                               *
+ *    u32 slots[REGION_CHUNK_COUNT]  - 1-based record slot of each chunk,       *
+ *                                     0 if the chunk was never saved           *
+ *    region_chunk_record_t records[header.chunk_count]                         *
+ *  Records are fixed-size and never move, so saving a chunk again overwrites   *
+ *  its record in place and a new chunk only appends one record and updates one *
+ *  table entry. Reads go through a read-only mapping of the file.              *
+ ********************************************************************************/
+
+#define REGION_LENGTH      32
+#define REGION_CHUNK_COUNT (REGION_LENGTH * REGION_LENGTH)
+
+#define REGION_FILE_MAGIC   0x47524C53 /* "SLRG" */
+#define REGION_FILE_VERSION 2
+
+typedef struct {
+    u32 magic;
+    u32 version;
+    u32 region_length;
+    u32 record_size;
+    i32 region_x;
+    i32 region_y;
+    u32 chunk_count;
+    u32 reserved;
+} region_file_header_t;
+
+/* Chunk as stored on disk, without the debug-only noise data so debug and release builds share files */
+typedef struct {
+    i32 x, y;
+    u32 revision;
+    game_tile_t tiles[CHUNK_NUM_TILES];
+    game_object_t objects[CHUNK_NUM_TILES];
+} region_chunk_record_t;
+
+/* Creates the directory if it doesn't exist yet */
+b8   region_storage_init(const char *directory);
+/* Syncs and closes every open region file */
+void region_storage_shutdown(void);
+
+/* Returns false if the chunk has never been saved. Debug noise data of the loaded chunk is left zeroed */
+b8   region_storage_load_chunk(i32 x, i32 y, chunk_base_t *out_chunk);
+b8   region_storage_save_chunk(const chunk_base_t *chunk);
+
+/* World parameters are stored next to the regions, since chunks are only valid for the seed that generated them */
+b8   region_storage_load_map(game_map_t *out_map);
+b8   region_storage_save_map(const game_map_t *map);
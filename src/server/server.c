@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <string.h>
 #include <sys/socket.h>
 #include <sys/types.h>
@@ -11,49 +12,56 @@
 #include <errno.h>
 #include <signal.h>
 #include <pthread.h>
+#include <sched.h>
+#include <sys/eventfd.h>
+#include <sys/random.h>
 
 #include "config.h"
 #include "defines.h"
+#include "event_loop.h"
+#include "connection.h"
+#include "chunk_store.h"
+#include "chunk_generator.h"
+#include "region_file.h"
+#include "interest.h"
+#include "tick_scheduler.h"
+#include "player_store.h"
+#include "input_log.h"
 #include "common/net.h"
 #include "common/util.h"
 #include "common/clock.h"
 #include "common/player_types.h"
 #include "common/global.h"
 #include "common/packet.h"
+#include "common/snapshot.h"
+#include "common/datagram.h"
 #include "common/logger.h"
 #include "common/asserts.h"
 #include "common/maths.h"
 #include "common/input_codes.h"
-#include "common/perlin_noise.h"
 #include "common/game_world_types.h"
 #include "common/memory/memutils.h"
 #include "common/containers/darray.h"
-#include "common/containers/ring_buffer.h"
-
-#define POLL_INFINITE_TIMEOUT -1
-
-typedef struct {
-    struct pollfd *fds;
-    u32 count;
-    u32 capacity;
-} server_pfd_t;
+#include "common/containers/hashmap.h"
+#include "common/containers/id_table.h"
+#include "common/containers/mpsc_ring_buffer.h"
 
+/* What the simulation only touches now and then, the per-tick state is kept in the player store */
 typedef struct {
     i32 socket;
     player_id id;
     u32 seq_nr;
     char name[PLAYER_MAX_NAME_LENGTH];
-    vec2 position;
     vec3 color;
-    i32 health;
-    player_direction_e direction;
-    player_state_e state;
-    f32 respawn_cooldown;
-    f32 attack_cooldown;
-    f32 attack_accumulator;
-    f32 roll_start;
-    f32 roll_cooldown;
-    f32 roll_accumulator;
+    u32 acked_snapshot; /* Latest snapshot the client confirmed, new ones are delta-encoded against it */
+    u64 udp_token;      /* Handed out during the handshake, every datagram of the client starts with it */
+    struct sockaddr_storage udp_address;
+    u32 udp_address_length; /* 0 until the client's UDP hello arrived, snapshots go over TCP until then */
+    b8 in_world;            /* Set once the client confirmed its player, only then other players can see it */
+    vec2i chunk;            /* Chunk the player is filed under in the interest grid */
+    u32 interest_snapshot;  /* First snapshot sent with the current visible set, acks of older ones are useless */
+    u32 visible_count;
+    player_id visible_ids[MAX_PLAYER_COUNT]; /* Players this client knows about, sorted and including itself */
 } player_t;
 
 typedef struct {
@@ -63,195 +71,298 @@ typedef struct {
     char content[MESSAGE_MAX_CONTENT_LENGTH];
 } message_t;
 
-static b8 running;
-static i32 server_socket;
-static server_pfd_t fds;
-static player_t players[MAX_PLAYER_COUNT];
+typedef enum {
+    CLIENT_EVENT_CONNECT,    /* client passed validation and waits for its player */
+    CLIENT_EVENT_DISCONNECT, /* connection broke, its I/O thread no longer watches the socket */
+    CLIENT_EVENT_PACKET      /* packet which changes the game state */
+} client_event_type_e;
+
+typedef struct {
+    packet_udp_hello_t hello;
+    struct sockaddr_storage address;
+    u32 address_length;
+} udp_hello_event_t;
+
+typedef struct {
+    client_event_type_e type;
+    i32 socket;
+    u32 packet_type;
+    u64 udp_token; /* Token handed out on connect, or the one a datagram came with - 0 for packets received over TCP */
+    union {
+        packet_player_keypress_t keypress;
+        packet_player_init_confirm_t init_confirm;
+        packet_message_t message;
+        packet_player_update_t update;
+        packet_player_remove_t remove;
+        packet_player_snapshot_ack_t snapshot_ack;
+        packet_player_input_t input;
+        udp_hello_event_t udp_hello;
+    } packet;
+} client_event_t;
+
+/* Every I/O thread has its own SO_REUSEPORT listener, so the kernel spreads new connections
+   across threads and each thread only ever reads from the connections it accepted */
+typedef struct {
+    u32 index;
+    pthread_t thread;
+    i32 listen_socket;
+    i32 wakeup_fd; /* eventfd written by the tick thread once outbound packets are ready, and on shutdown */
+    i32 udp_socket; /* Only the first I/O thread receives datagrams, -1 on the others. Sent to by the tick thread */
+    event_loop_t event_loop;
+    i32 *handshakes; /* darray of owned sockets which haven't finished the handshake yet */
+} io_thread_t;
+
+static _Atomic b8 running;
+static io_thread_t io_threads[SERVER_IO_THREAD_COUNT];
+static id_table_t players;             /* player_id -> player_t, only touched by the tick thread */
+static player_store_t player_store;    /* Per-tick state of the player at the same index in 'players' */
+static hashmap_t player_ids_by_socket; /* socket -> player_id, for client events which only know their connection */
 static player_id current_player_id = 1000;
-static void *input_ring_buffer;
+static mpsc_ring_buffer_t client_events; /* Filled by the I/O threads, drained by the tick thread */
 static message_t *messages;
+static snapshot_history_t snapshot_history; /* Only touched by the tick thread */
+static interest_grid_t interest_grid;       /* In-world players by chunk, only touched by the tick thread */
 
 static game_world_t game_world;
-static chunk_base_t *chunks;
+static input_log_t input_log; /* Open while the session is recorded or replayed, meanwhile only touched by the tick thread */
+static u64 tick_number;       /* Ticks simulated so far, only touched by the tick thread */
+static b8 replaying;          /* Sockets of replayed events are just numbers from the log, nothing may be done with them */
 
-static void generate_chunk(i32 x, i32 y, chunk_base_t **out_chunk);
-
-void server_pfd_init(u32 initial_capacity, server_pfd_t *out_server_pfd)
+void *get_in_addr(struct sockaddr *addr)
 {
-    out_server_pfd->count = 0;
-    out_server_pfd->capacity = initial_capacity;
+    if (addr->sa_family == AF_INET) {
+        return &((struct sockaddr_in *)addr)->sin_addr;
+    }
 
-    u32 fds_size = sizeof(struct pollfd) * initial_capacity;
-    out_server_pfd->fds = malloc(fds_size);
-    memset(out_server_pfd->fds, 0, fds_size);
+    return &((struct sockaddr_in6 *)addr)->sin6_addr;
 }
 
-void server_pfd_shutdown(server_pfd_t *server_pfd)
+/* Index of the player's state in the player store, only valid until a player joins or leaves */
+INLINE u32 player_index(player_t *player)
 {
-    server_pfd->count = 0;
-    server_pfd->capacity = 0;
-    free(server_pfd->fds);
+    return (u32)id_table_index_of(&players, player);
 }
 
-void server_pfd_add(server_pfd_t *pfd, i32 fd)
+/* The simulation never closes a socket owned by an I/O thread, it only shuts it down -
+   the owning thread then sees the hangup and reports the disconnect back */
+static void kick_client(i32 client_socket)
 {
-    if (pfd->count + 1 >= pfd->capacity) { /* Resize */
-        void *ptr = realloc((void *)pfd->fds, pfd->capacity * 2);
-        if (ptr != NULL) {
-            pfd->capacity = pfd->capacity * 2;
-            pfd->fds = ptr;
-        } else {
-            LOG_ERROR("failed to resize pollfd array");
-        }
+    if (replaying) {
+        return; // The log also holds the disconnect the kick caused
     }
 
-    pfd->fds[pfd->count].fd = fd;
-    pfd->fds[pfd->count].events = POLLIN;
-    pfd->count++;
+    if (shutdown(client_socket, SHUT_RDWR) == -1) {
+        LOG_ERROR("failed to shut down socket with fd=%d: %s", client_socket, strerror(errno));
+    }
 }
 
-void server_pfd_remove(server_pfd_t *pfd, i32 fd)
+/* Queues the packet for every player except 'excluded_id', PLAYER_INVALID_ID includes everyone */
+static void broadcast_packet(u32 type, void *packet_data, player_id excluded_id)
 {
-    for (i32 i = 0; i < pfd->count; i++) {
-        if (pfd->fds[i].fd == fd) {
-            pfd->fds[i].fd = pfd->fds[pfd->count-1].fd; /* Replace old fd with the last one */
-            pfd->count--;
-            return;
+    for (u64 i = 0; i < id_table_length(&players); i++) {
+        player_t *player = id_table_at(&players, i);
+        if (player->id != excluded_id && !connection_send_packet(player->socket, type, packet_data)) {
+            LOG_ERROR("failed to send packet of type %u to player with id=%u", type, player->id);
         }
     }
+}
 
-    LOG_ERROR("did not find fd=%d in the array of pfds", fd);
+static vec2i player_position_to_chunk_position(vec2 player_position)
+{
+    return (vec2i){
+        .x = (player_position.x + (player_position.x < 0 ? -1 : 1) * (CHUNK_WIDTH_PX  * 0.5f)) / CHUNK_WIDTH_PX,
+        .y = (player_position.y + (player_position.y < 0 ? -1 : 1) * (CHUNK_HEIGHT_PX * 0.5f)) / CHUNK_HEIGHT_PX
+     };
 }
 
-void *get_in_addr(struct sockaddr *addr)
+/* Queues the packet for every player subscribed to the chunk */
+static void send_to_chunk_subscribers(vec2i chunk, u32 type, void *packet_data)
 {
-    if (addr->sa_family == AF_INET) {
-        return &((struct sockaddr_in *)addr)->sin_addr;
+    static interest_candidate_t candidates[MAX_PLAYER_COUNT]; /* Only used by the tick thread */
+
+    u32 count = interest_grid_query(&interest_grid, chunk, INTEREST_RADIUS_CHUNKS, candidates, MAX_PLAYER_COUNT);
+    for (u32 i = 0; i < count; i++) {
+        player_t *player = id_table_find(&players, candidates[i].id);
+        if (player != NULL && !connection_send_packet(player->socket, type, packet_data)) {
+            LOG_ERROR("failed to send packet of type %u to player with id=%u", type, player->id);
+        }
+    }
+}
+
+static void send_player_add(i32 client_socket, player_t *player)
+{
+    u32 index = player_index(player);
+    packet_player_add_t player_add_packet = {
+        .id        = player->id,
+        .position  = player_store.positions[index],
+        .color     = player->color,
+        .health    = player_store.health[index],
+        .state     = player_store.states[index],
+        .direction = player_store.directions[index]
+    };
+    memcpy(player_add_packet.name, player->name, strlen(player->name));
+
+    if (!connection_send_packet(client_socket, PACKET_TYPE_PLAYER_ADD, &player_add_packet)) {
+        LOG_ERROR("failed to send player add packet");
     }
+}
 
-    return &((struct sockaddr_in6 *)addr)->sin6_addr;
+/* Lists the objects removed from the chunk since it was generated, as recorded by the chunk store */
+static void build_chunk_delta(const chunk_base_t *chunk, packet_chunk_delta_t *out_delta)
+{
+    out_delta->x = chunk->x;
+    out_delta->y = chunk->y;
+    // Revision and removals are copied together, or a client could skip the removal that follows
+    out_delta->removed_object_count = chunk_store_get_removed_objects(chunk, out_delta->removed_object_tiles, &out_delta->revision);
 }
 
-static b8 receive_client_data(i32 client_socket, u8 *recv_buffer, u32 buffer_size, i64 *bytes_read);
+/* Modifications made while the chunk was out of the player's reach, a cached copy on the client may lack them */
+static void send_chunk_catch_up(player_t *player, vec2i old_chunk, vec2i new_chunk)
+{
+    for (i32 y = new_chunk.y - INTEREST_RADIUS_CHUNKS; y <= new_chunk.y + INTEREST_RADIUS_CHUNKS; y++) {
+        for (i32 x = new_chunk.x - INTEREST_RADIUS_CHUNKS; x <= new_chunk.x + INTEREST_RADIUS_CHUNKS; x++) {
+            vec2i chunk_position = { .x = x, .y = y };
+            if (interest_chunk_distance(old_chunk, chunk_position) <= INTEREST_RADIUS_CHUNKS) {
+                continue; // Was subscribed already
+            }
+
+            // Chunks which aren't resident haven't been touched in a while, the client requests them if needed
+            chunk_base_t *chunk = chunk_store_find(x, y);
+            if (chunk == NULL) {
+                continue;
+            }
+            // Only the tick thread modifies chunks, so the revision can be checked without the store lock
+            if (chunk->revision > 0) {
+                packet_chunk_delta_t delta;
+                build_chunk_delta(chunk, &delta);
+                if (!connection_send_packet(player->socket, PACKET_TYPE_CHUNK_DELTA, &delta)) {
+                    LOG_ERROR("failed to send chunk delta to player with id=%u", player->id);
+                }
+            }
+            chunk_store_release(chunk);
+        }
+    }
+}
 
-b8 validate_incoming_client(i32 client_socket)
+/* Keeps the player filed under the chunk it stands in, call whenever its position changed */
+static void player_update_chunk(player_t *player)
 {
-    u64 puzzle_value = clock_get_absolute_time_ns();
+    vec2i chunk = player_position_to_chunk_position(player_store.positions[player_index(player)]);
+    if (!player->in_world || (chunk.x == player->chunk.x && chunk.y == player->chunk.y)) {
+        return;
+    }
 
-    i64 bytes_read, bytes_sent;
+    interest_grid_remove(&interest_grid, player->id, player->chunk);
+    interest_grid_insert(&interest_grid, player->id, chunk);
+    send_chunk_catch_up(player, player->chunk, chunk);
+    player->chunk = chunk;
+}
 
-    bytes_sent = net_send(client_socket, (void *)&puzzle_value, sizeof(puzzle_value), 0);
-    if (bytes_sent == -1) {
-        LOG_ERROR("validation: send error: %s", strerror(errno));
-        return false;
-    } else if (bytes_sent != sizeof(puzzle_value)) {
-        LOG_ERROR("validation: failed to send %lu bytes of validation data", sizeof(puzzle_value));
-        return false;
+static player_t *find_player_by_socket(i32 client_socket)
+{
+    u64 id;
+    if (!hashmap_get(&player_ids_by_socket, client_socket, &id)) {
+        return NULL;
     }
 
-    u64 answer = puzzle_value ^ 0xDEADBEEFCAFEBABE; /* TODO: Come up with a better validation function */
+    return id_table_find(&players, id);
+}
 
-    u64 result_buffer;
-    bytes_read = net_recv(client_socket, (void *)&result_buffer, sizeof(result_buffer), 0);
-    if (bytes_read <= 0) {
-        if (bytes_read == -1) {
-            LOG_ERROR("validation: recv error: %s", strerror(errno));
-        } else if (bytes_read == 0) {
-            LOG_ERROR("validation: orderly shutdown");
-            /* Socket closed by the handler */
-        }
-        return false;
+/* Packets name the player they are about, which has to be the one playing on the socket they arrived on,
+   otherwise any client could move or remove someone else */
+static player_t *find_packet_sender(i32 client_socket, player_id id)
+{
+    player_t *sender = find_player_by_socket(client_socket);
+    if (sender == NULL || sender->id != id) {
+        return NULL;
     }
 
-    if (bytes_read == sizeof(result_buffer)) {
-        b8 status_buffer = result_buffer == answer;
-        bytes_sent = net_send(client_socket, (void *)&status_buffer, sizeof(status_buffer), 0);
-        if (bytes_sent == -1) {
-            LOG_ERROR("validation status: send error: %s", strerror(errno));
-            return false;
-        } else if (bytes_sent != sizeof(status_buffer)) {
-            LOG_ERROR("validation status: failed to send %lu bytes of validation data", sizeof(puzzle_value));
-            return false;
-        }
+    return sender;
+}
 
-        return status_buffer;
+/* The low half names the connection, so a datagram can be matched to its player without a lookup table */
+static u64 create_udp_token(i32 client_socket)
+{
+    u32 random;
+    if (getrandom(&random, sizeof(random), 0) != sizeof(random)) {
+        random = (u32)clock_get_absolute_time_ns();
     }
 
-    LOG_ERROR("validation: received incorrect number of bytes");
-    return false;
+    return ((u64)(random | 1) << 32) | (u32)client_socket;
+}
+
+INLINE i32 udp_token_get_socket(u64 token)
+{
+    return (i32)(u32)token;
 }
 
-void handle_new_player_connection(i32 client_socket)
+static void handle_player_join(i32 client_socket, u64 udp_token)
 {
+    if (id_table_length(&players) >= MAX_PLAYER_COUNT) {
+        LOG_ERROR("player limit of %u reached, rejecting client with socket fd=%d", MAX_PLAYER_COUNT, client_socket);
+        kick_client(client_socket);
+        return;
+    }
+
     // Assign player to the new client
     f32 red   = math_frandom_range(0.0, 1.0);
     f32 green = math_frandom_range(0.0, 1.0);
     f32 blue  = math_frandom_range(0.0, 1.0);
-    i32 new_player_idx;
-    for (new_player_idx = 0; new_player_idx < MAX_PLAYER_COUNT; new_player_idx++) {
-        if (players[new_player_idx].id == PLAYER_INVALID_ID) { /* Free slot */
-            players[new_player_idx].socket   = client_socket;
-            players[new_player_idx].id       = current_player_id;
-            players[new_player_idx].position = vec2_create(PLAYER_SPAWN_POSITION_X, PLAYER_SPAWN_POSITION_Y);
-            players[new_player_idx].color    = vec3_create(red, green, blue);
-            players[new_player_idx].health   = PLAYER_START_HEALTH;
-            break;
-        }
-    }
+
+    player_t *new_player  = id_table_insert(&players, current_player_id);
+    new_player->socket    = client_socket;
+    new_player->id        = current_player_id;
+    new_player->color     = vec3_create(red, green, blue);
+    new_player->udp_token = udp_token;
+    hashmap_set(&player_ids_by_socket, client_socket, new_player->id);
+
+    // Lands at the same index as the player's table entry
+    u32 index = player_store_add(&player_store);
+    player_store.positions[index]  = vec2_create(PLAYER_SPAWN_POSITION_X, PLAYER_SPAWN_POSITION_Y);
+    player_store.health[index]     = PLAYER_START_HEALTH;
+    player_store.states[index]     = PLAYER_STATE_IDLE;
+    player_store.directions[index] = PLAYER_DIRECTION_DOWN;
 
     packet_player_init_t player_init_packet = {
-        .id        = current_player_id,
-        .position  = vec2_create(PLAYER_SPAWN_POSITION_X, PLAYER_SPAWN_POSITION_Y),
-        .color     = vec3_create(red, green, blue),
-        .health    = PLAYER_START_HEALTH,
-        .state     = PLAYER_STATE_IDLE,
-        .direction = PLAYER_DIRECTION_DOWN
+        .id        = new_player->id,
+        .position  = player_store.positions[index],
+        .color     = new_player->color,
+        .health    = player_store.health[index],
+        .state     = player_store.states[index],
+        .direction = player_store.directions[index]
     };
-    if (!packet_send(client_socket, PACKET_TYPE_PLAYER_INIT, &player_init_packet)) {
+    if (!connection_send_packet(client_socket, PACKET_TYPE_PLAYER_INIT, &player_init_packet)) {
         LOG_ERROR("failed to send player init packet");
     }
 
-    const u64 packet_size = PACKET_TYPE_SIZE[PACKET_TYPE_HEADER] + PACKET_TYPE_SIZE[PACKET_TYPE_PLAYER_INIT_CONF];
-    u8 buffer[INPUT_BUFFER_SIZE] = {0};
-    i64 bytes_read;
-    if (!receive_client_data(client_socket, buffer, packet_size, &bytes_read)) {
-        LOG_ERROR("failed to receive player init confirm packet from socket with fd=%d", client_socket);
+    current_player_id++;
+}
+
+/* Rest of the join, once the client confirmed its player and sent its name */
+static void handle_player_init_confirm(i32 client_socket, packet_player_init_confirm_t *player_init_confirm_packet)
+{
+    player_t *new_player = find_player_by_socket(client_socket);
+    if (new_player == NULL) {
+        LOG_ERROR("received player init confirm packet from socket with fd=%d which has no player", client_socket);
         return;
     }
 
-    if (bytes_read == packet_size) {
-        packet_player_init_confirm_t *player_init_confirm_packet = (packet_player_init_confirm_t *)(buffer + PACKET_TYPE_SIZE[PACKET_TYPE_HEADER]);
-        if (player_init_confirm_packet->id != current_player_id) {
-            LOG_ERROR("mismatched player init confirm id: expected=%d, actual=%d", current_player_id, player_init_confirm_packet->id);
-            return;
-        }
-
-        memset(players[new_player_idx].name, 0, sizeof(players[new_player_idx].name));
-        memcpy(players[new_player_idx].name, player_init_confirm_packet->name, strlen(player_init_confirm_packet->name));
-    } else {
-        LOG_ERROR("failed to read all required bytes for the player init confirm packet from socket with fd=%d", client_socket);
+    if (player_init_confirm_packet->id != new_player->id) {
+        LOG_ERROR("mismatched player init confirm id: expected=%d, actual=%d", new_player->id, player_init_confirm_packet->id);
+        kick_client(client_socket);
         return;
     }
 
-    current_player_id++;
-
-    // Send the rest of the players to the new player
-    for (i32 i = 0; i < MAX_PLAYER_COUNT; i++) {
-        if (players[i].id != PLAYER_INVALID_ID && players[i].id != player_init_packet.id) {
-            packet_player_add_t player_add_packet = {
-                .id        = players[i].id,
-                .position  = players[i].position,
-                .color     = players[i].color,
-                .health    = players[i].health,
-                .state     = players[i].state,
-                .direction = players[i].direction
-            };
-            memcpy(player_add_packet.name, players[i].name, strlen(players[i].name));
+    // Name comes straight from the wire, make sure it is terminated
+    player_init_confirm_packet->name[PLAYER_MAX_NAME_LENGTH - 1] = 0;
+    memset(new_player->name, 0, sizeof(new_player->name));
+    memcpy(new_player->name, player_init_confirm_packet->name, strlen(player_init_confirm_packet->name));
 
-            if (!packet_send(client_socket, PACKET_TYPE_PLAYER_ADD, &player_add_packet)) {
-                LOG_ERROR("failed to send player add packet");
-            }
-        }
+    // Players nearby and the new player learn about each other with the next snapshot
+    if (!new_player->in_world) {
+        new_player->in_world = true;
+        new_player->chunk = player_position_to_chunk_position(player_store.positions[player_index(new_player)]);
+        interest_grid_insert(&interest_grid, new_player->id, new_player->chunk);
     }
 
     // Send messages history
@@ -271,7 +382,7 @@ void handle_new_player_connection(i32 client_socket)
         memcpy(&message_history_packet.history[counter++], &message_packet, sizeof(message_packet));
         if (counter >= MAX_MESSAGE_HISTORY_LENGTH) {
             message_history_packet.count = counter;
-            if (!packet_send(client_socket, PACKET_TYPE_MESSAGE_HISTORY, &message_history_packet)) {
+            if (!connection_send_packet(client_socket, PACKET_TYPE_MESSAGE_HISTORY, &message_history_packet)) {
                 LOG_ERROR("failed to send %u messages in the message history packet", counter);
             }
             counter = 0;
@@ -279,39 +390,17 @@ void handle_new_player_connection(i32 client_socket)
     }
     if (counter > 0) {
         message_history_packet.count = counter;
-        if (!packet_send(client_socket, PACKET_TYPE_MESSAGE_HISTORY, &message_history_packet)) {
+        if (!connection_send_packet(client_socket, PACKET_TYPE_MESSAGE_HISTORY, &message_history_packet)) {
             LOG_ERROR("failed to send %u messages in the message history packet", counter);
         }
     }
 
-    // Update other players with the new player and send system message to all
+    // Send system message to all
     packet_message_t message_packet = {0};
     message_packet.type = MESSAGE_TYPE_SYSTEM;
-    snprintf(message_packet.content, sizeof(message_packet.content), "new player <%s> joined the game!", players[new_player_idx].name);
-
-    for (i32 i = 0; i < MAX_PLAYER_COUNT; i++) {
-        if (players[i].id != PLAYER_INVALID_ID) {
-            if (players[i].id != player_init_packet.id) {
-                packet_player_add_t player_add_packet = {
-                    .id        = player_init_packet.id,
-                    .position  = player_init_packet.position,
-                    .color     = player_init_packet.color,
-                    .health    = player_init_packet.health,
-                    .state     = player_init_packet.state,
-                    .direction = player_init_packet.direction
-                };
-                memcpy(player_add_packet.name, players[new_player_idx].name, strlen(players[new_player_idx].name));
-
-                if (!packet_send(players[i].socket, PACKET_TYPE_PLAYER_ADD, &player_add_packet)) {
-                    LOG_ERROR("failed to send player add packet");
-                }
-            }
+    snprintf(message_packet.content, sizeof(message_packet.content), "new player <%s> joined the game!", new_player->name);
 
-            if (!packet_send(players[i].socket, PACKET_TYPE_MESSAGE, &message_packet)) {
-                LOG_ERROR("failed to send message packet");
-            }
-        }
-    }
+    broadcast_packet(PACKET_TYPE_MESSAGE, &message_packet, PLAYER_INVALID_ID);
 
     message_t msg = {0};
     msg.type = MESSAGE_TYPE_SYSTEM;
@@ -321,129 +410,247 @@ void handle_new_player_connection(i32 client_socket)
     // Send game world initialization data to the new player
     packet_game_world_init_t world_init_packet = {0};
     memcpy(&world_init_packet.map, &game_world.map, sizeof(game_map_t));
+    world_init_packet.chunk_streaming_mode = CHUNK_STREAMING_MODE;
 
-    if (!packet_send(players[new_player_idx].socket, PACKET_TYPE_GAME_WORLD_INIT, &world_init_packet)) {
+    if (!connection_send_packet(client_socket, PACKET_TYPE_GAME_WORLD_INIT, &world_init_packet)) {
         LOG_ERROR("failed to send world init packet");
     }
 }
 
-void handle_new_connection_request_event(void)
+/* Connect and disconnect events must never be lost, so wait for the tick thread to make room for them */
+static b8 push_client_event_reliable(const client_event_t *event)
+{
+    while (!mpsc_ring_buffer_enqueue(&client_events, event)) {
+        if (!running) {
+            return false;
+        }
+        sched_yield();
+    }
+
+    return true;
+}
+
+static void handshake_list_remove(io_thread_t *thread, i32 client_socket)
+{
+    u64 length = darray_length(thread->handshakes);
+    for (u64 i = 0; i < length; i++) {
+        if (thread->handshakes[i] == client_socket) {
+            thread->handshakes[i] = thread->handshakes[length - 1];
+            _darray_field_set(thread->handshakes, DARRAY_FIELD_LENGTH, length - 1);
+            return;
+        }
+    }
+}
+
+/* Closes a connection which never passed validation, the tick thread doesn't know about it */
+static void close_unvalidated_client(io_thread_t *thread, i32 client_socket)
 {
-    struct sockaddr_storage client_addr;
-    u32 client_addr_len = sizeof(client_addr);
+    handshake_list_remove(thread, client_socket);
+    event_loop_remove(&thread->event_loop, client_socket);
+    connection_close(client_socket);
+    close(client_socket);
+}
 
-    i32 client_socket = accept(server_socket, (struct sockaddr *)&client_addr, &client_addr_len);
-    if (client_socket == -1) {
-        LOG_ERROR("accept error: %s", strerror(errno));
+/* Stops watching the socket, it is closed by the tick thread after the player has been removed
+   so the descriptor can't be handed out to a new connection while the game still refers to it */
+static void drop_client(io_thread_t *thread, connection_t *connection)
+{
+    i32 client_socket = connection->socket;
+    if (connection->state == CONNECTION_STATE_VALIDATING) {
+        close_unvalidated_client(thread, client_socket);
         return;
     }
+    if (connection->state == CONNECTION_STATE_JOINING) {
+        handshake_list_remove(thread, client_socket);
+    }
+
+    event_loop_remove(&thread->event_loop, client_socket);
+
+    client_event_t event = { .type = CLIENT_EVENT_DISCONNECT, .socket = client_socket };
+    push_client_event_reliable(&event);
+}
+
+/* Validation data isn't framed like packets, it is written right away instead of waiting for the tick */
+static b8 send_handshake_bytes(connection_t *connection, const void *data, u64 size)
+{
+    struct iovec part = { .iov_base = (void *)data, .iov_len = size };
+    if (!send_queue_push(&connection->send_queue, &part, 1)) {
+        return false;
+    }
+
+    return send_queue_flush(&connection->send_queue, connection->socket) != SEND_QUEUE_FLUSH_ERROR;
+}
+
+/* Returns false if the client was dropped, otherwise the connection is either still waiting for
+   the rest of the answer or has moved on to joining */
+static b8 handle_validation_answer(io_thread_t *thread, connection_t *connection)
+{
+    u64 answer;
+    if (recv_buffer_length(&connection->recv_buffer) < sizeof(answer)) {
+        return true;
+    }
+
+    mem_copy(&answer, recv_buffer_data(&connection->recv_buffer), sizeof(answer));
+    recv_buffer_consume(&connection->recv_buffer, sizeof(answer));
+
+    b8 status = answer == connection->puzzle_answer;
+    if (!send_handshake_bytes(connection, &status, sizeof(status)) || !status) {
+        LOG_ERROR("client with socket fd=%d failed validation", connection->socket);
+        close_unvalidated_client(thread, connection->socket);
+        return false;
+    }
+
+    LOG_INFO("client with socket fd=%d passed validation", connection->socket);
+    connection->state = CONNECTION_STATE_JOINING;
+
+    // Player is created by the tick thread, which owns all game state
+    client_event_t event = {
+        .type = CLIENT_EVENT_CONNECT,
+        .socket = connection->socket,
+        .udp_token = create_udp_token(connection->socket)
+    };
+#if SERVER_UDP_ENABLED
+    // First packet after the validation status, the client answers over UDP if it wants to use the channel
+    packet_udp_offer_t udp_offer_packet = { .token = event.udp_token };
+    if (!connection_send_packet(connection->socket, PACKET_TYPE_UDP_OFFER, &udp_offer_packet)) {
+        LOG_ERROR("failed to send UDP offer to socket with fd=%d", connection->socket);
+    }
+#endif
+    push_client_event_reliable(&event);
+    return true;
+}
+
+/* Called on every tick wakeup, handshakes are never waited on so a stalled client only costs its own slot */
+static void expire_handshakes(io_thread_t *thread)
+{
+    u64 now = clock_get_absolute_time_ns();
+    for (u64 i = 0; i < darray_length(thread->handshakes);) {
+        connection_t *connection = connection_get(thread->handshakes[i]);
+        ASSERT(connection != NULL);
+        if (now < connection->handshake_deadline_ns) {
+            i++;
+            continue;
+        }
+
+        // Dropping removes the socket from the list, so the same index is checked again
+        LOG_ERROR("handshake of client with socket fd=%d timed out", connection->socket);
+        drop_client(thread, connection);
+    }
+}
 
+static void handle_new_client_socket(io_thread_t *thread, i32 client_socket, struct sockaddr_storage *client_addr)
+{
     char client_ip[INET6_ADDRSTRLEN] = {0};
-    inet_ntop(client_addr.ss_family,
-                get_in_addr((struct sockaddr *)&client_addr),
+    inet_ntop(client_addr->ss_family,
+                get_in_addr((struct sockaddr *)client_addr),
                 client_ip,
                 INET6_ADDRSTRLEN);
 
-    u16 port = client_addr.ss_family == AF_INET ?
-                ((struct sockaddr_in *)&client_addr)->sin_port :
-                ((struct sockaddr_in6 *)&client_addr)->sin6_port;
+    u16 port = client_addr->ss_family == AF_INET ?
+                ((struct sockaddr_in *)client_addr)->sin_port :
+                ((struct sockaddr_in6 *)client_addr)->sin6_port;
 
-    LOG_INFO("new connection from %s:%hu", client_ip, port);
+    LOG_INFO("new connection from %s:%hu (fd=%d)", client_ip, port, client_socket);
 
-    if (!validate_incoming_client(client_socket)) {
-        LOG_ERROR("%s:%hu failed validation", client_ip, port);
+    if (!net_set_nonblocking(client_socket)) {
+        LOG_ERROR("failed to set socket with fd=%d to non-blocking mode: %s", client_socket, strerror(errno));
+        close(client_socket);
+        return;
+    }
+    if (!connection_open(client_socket, thread->index)) {
+        close(client_socket);
+        return;
+    }
+    if (!event_loop_add(&thread->event_loop, client_socket)) {
+        LOG_ERROR("failed to add socket with fd=%d to the event loop", client_socket);
+        connection_close(client_socket);
         close(client_socket);
         return;
     }
 
-    LOG_INFO("%s:%hu passed validation", client_ip, port);
-    server_pfd_add(&fds, client_socket);
-    handle_new_player_connection(client_socket);
+    connection_t *connection = connection_get(client_socket);
+    u64 puzzle_value = clock_get_absolute_time_ns();
+    connection->puzzle_answer = puzzle_value ^ 0xDEADBEEFCAFEBABE; /* TODO: Come up with a better validation function */
+    connection->handshake_deadline_ns = puzzle_value + (u64)CONNECTION_HANDSHAKE_TIMEOUT_MS * 1000 * 1000;
+    darray_push(thread->handshakes, client_socket);
+
+    // The answer arrives as a regular readiness event, handled by handle_client_event
+    if (!send_handshake_bytes(connection, &puzzle_value, sizeof(puzzle_value))) {
+        LOG_ERROR("failed to send validation puzzle to socket with fd=%d: %s", client_socket, strerror(errno));
+        close_unvalidated_client(thread, client_socket);
+    }
 }
 
-b8 receive_client_data(i32 client_socket, u8 *recv_buffer, u32 buffer_size, i64 *bytes_read)
+static void handle_new_connection_request_event(io_thread_t *thread)
 {
-    ASSERT(recv_buffer);
-    ASSERT(bytes_read);
-
-    *bytes_read = net_recv(client_socket, recv_buffer, buffer_size, 0);
-    if (*bytes_read <= 0) {
-        if (*bytes_read == -1) {
-            LOG_ERROR("recv error: %s", strerror(errno));
-        } else if (*bytes_read == 0) {
-            LOG_INFO("orderly shutdown");
-
-            // Update other players that the user disconnected
-            b8 found_player_to_remove = false;
-            for (i32 i = 0; i < MAX_PLAYER_COUNT; i++) {
-                if (players[i].socket == client_socket) {
-                    found_player_to_remove = true;
-                    if (players[i].id == PLAYER_INVALID_ID) { // Already removed by packet_player_remove
-                        break;
-                    }
-                    LOG_INFO("removed player with id=%d", players[i].id);
+    // Listening socket is non-blocking, so accept all pending connections until EAGAIN
+    for (;;) {
+        struct sockaddr_storage client_addr;
+        u32 client_addr_len = sizeof(client_addr);
 
-                    packet_player_remove_t player_remove_packet = {
-                        .id = players[i].id
-                    };
+        i32 client_socket = accept(thread->listen_socket, (struct sockaddr *)&client_addr, &client_addr_len);
+        if (client_socket == -1) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                LOG_ERROR("accept error: %s", strerror(errno));
+            }
+            return;
+        }
 
-                    packet_message_t message_packet = {0};
-                    message_packet.type = MESSAGE_TYPE_SYSTEM;
-                    snprintf(message_packet.content, sizeof(message_packet.content), "player <%s> left the game!", players[i].name);
+        handle_new_client_socket(thread, client_socket, &client_addr);
+    }
+}
 
-                    for (i32 j = 0; j < MAX_PLAYER_COUNT; j++) {
-                        if (players[j].id != PLAYER_INVALID_ID && players[j].id != players[i].id) {
-                            if (!packet_send(players[j].socket, PACKET_TYPE_PLAYER_REMOVE, &player_remove_packet)) {
-                                LOG_ERROR("failed to send player remove packet for player with id=%u", players[j].id);
-                            }
-                            if (!packet_send(players[j].socket, PACKET_TYPE_MESSAGE, &message_packet)) {
-                                LOG_ERROR("failed to send message packet");
-                            }
-                        }
-                    }
+/* Tells everyone else that the player left and forgets it */
+static void remove_player(player_t *player)
+{
+    LOG_INFO("removed player with id=%d", player->id);
 
-                    message_t msg = {0};
-                    msg.type = MESSAGE_TYPE_SYSTEM;
-                    memcpy(msg.content, message_packet.content, strlen(message_packet.content));
-                    darray_push(messages, msg);
+    packet_message_t message_packet = {0};
+    message_packet.type = MESSAGE_TYPE_SYSTEM;
+    snprintf(message_packet.content, sizeof(message_packet.content), "player <%s> left the game!", player->name);
 
-                    players[i].id = PLAYER_INVALID_ID;
-                    break;
-                }
-            }
+    broadcast_packet(PACKET_TYPE_MESSAGE, &message_packet, player->id);
 
-            if (!found_player_to_remove) {
-                LOG_ERROR("failed to find player to remove after orderly shutdown");
-            }
+    message_t msg = {0};
+    msg.type = MESSAGE_TYPE_SYSTEM;
+    memcpy(msg.content, message_packet.content, strlen(message_packet.content));
+    darray_push(messages, msg);
 
-            server_pfd_remove(&fds, client_socket);
-            close(client_socket);
-        }
+    // Players who could see it get a PLAYER_REMOVE with the next snapshot
+    if (player->in_world) {
+        interest_grid_remove(&interest_grid, player->id, player->chunk);
+    }
+    hashmap_remove(&player_ids_by_socket, player->socket);
+    // Both move their last element into the hole, so the indices keep matching
+    player_store_remove(&player_store, player_index(player));
+    id_table_remove(&players, player->id);
+}
 
-        return false;
+static void handle_client_disconnect(i32 client_socket)
+{
+    // No player is found if it was already removed by packet_player_remove
+    // or the client was kicked before getting one
+    player_t *player = find_player_by_socket(client_socket);
+    if (player != NULL) {
+        remove_player(player);
     }
 
-    return true;
+    connection_close(client_socket);
+    if (!replaying) {
+        close(client_socket);
+    }
 }
 
-void handle_packet_type(i32 client_socket, u8 *packet_body_buffer, u32 type, u32 *out_received_data_size)
+/* Runs on the tick thread for packets queued by handle_packet_type */
+static void apply_client_packet(i32 client_socket, u32 type, void *packet_body_buffer)
 {
     ASSERT(packet_body_buffer);
 
-    u32 received_data_size = 0;
     switch (type) {
-        case PACKET_TYPE_NONE: {
-            LOG_WARN("received PACKET_TYPE_NONE, ignoring...");
-        } break;
-        case PACKET_TYPE_PING: { /* Bounce back the packet */
-            received_data_size = PACKET_TYPE_SIZE[PACKET_TYPE_PING];
-            packet_ping_t *ping_packet = (packet_ping_t *)packet_body_buffer;
-            if (!packet_send(client_socket, PACKET_TYPE_PING, ping_packet)) {
-                LOG_ERROR("failed to send ping packet");
-            }
+        case PACKET_TYPE_PLAYER_INIT_CONF: {
+            handle_player_init_confirm(client_socket, (packet_player_init_confirm_t *)packet_body_buffer);
         } break;
         case PACKET_TYPE_MESSAGE: {
-            received_data_size = PACKET_TYPE_SIZE[PACKET_TYPE_MESSAGE];
             packet_message_t *message = (packet_message_t *)packet_body_buffer;
             LOG_INFO("author: %s, content: %s", message->author, message->content);
 
@@ -456,219 +663,449 @@ void handle_packet_type(i32 client_socket, u8 *packet_body_buffer, u32 type, u32
             memcpy(msg.content, message->content, strlen(message->content));
             darray_push(messages, msg);
 
-            for (i32 i = 0; i < fds.count; i++) {
-                if (fds.fds[i].fd == server_socket) {
-                    continue;
-                }
-                if (!packet_send(fds.fds[i].fd, PACKET_TYPE_MESSAGE, message)) {
-                    LOG_ERROR("failed to send message packet to client with socket fd=%d", fds.fds[i].fd);
-                }
-            }
+            broadcast_packet(PACKET_TYPE_MESSAGE, message, PLAYER_INVALID_ID);
         } break;
         case PACKET_TYPE_PLAYER_REMOVE: {
-            received_data_size = PACKET_TYPE_SIZE[PACKET_TYPE_PLAYER_REMOVE];
             packet_player_remove_t *remove = (packet_player_remove_t *)packet_body_buffer;
-            b8 found_player_to_remove = false;
-            i32 player_idx;
-            for (player_idx = 0; player_idx < MAX_PLAYER_COUNT; player_idx++) {
-                if (players[player_idx].id == remove->id) {
-                    players[player_idx].id = PLAYER_INVALID_ID;
-                    found_player_to_remove = true;
-                    break;
-                }
-            }
-            if (!found_player_to_remove) {
-                LOG_ERROR("could not find player to remove with id=%d", remove->id);
+            player_t *player = find_packet_sender(client_socket, remove->id);
+            if (player == NULL) {
+                LOG_WARN("ignoring removal of player with id=%d requested by socket fd=%d", remove->id, client_socket);
             } else {
-                LOG_INFO("removed player with id=%d", remove->id);
-
-                packet_message_t message_packet = {0};
-                message_packet.type = MESSAGE_TYPE_SYSTEM;
-                snprintf(message_packet.content, sizeof(message_packet.content), "player <%s> left the game!", players[player_idx].name);
-
-                // Send updates to the rest of the players
-                for (i32 i = 0; i < MAX_PLAYER_COUNT; i++) {
-                    if (players[i].id != PLAYER_INVALID_ID && players[i].id != remove->id) {
-                        if (!packet_send(players[i].socket, PACKET_TYPE_PLAYER_REMOVE, remove)) {
-                            LOG_ERROR("failed to send player remove packet to player with id=%u", players[i].id);
-                        }
-                        if (!packet_send(players[i].socket, PACKET_TYPE_MESSAGE, &message_packet)) {
-                            LOG_ERROR("failed to send message packet");
-                        }
-                    }
-                }
-
-                message_t msg = {0};
-                msg.type = MESSAGE_TYPE_SYSTEM;
-                memcpy(msg.content, message_packet.content, strlen(message_packet.content));
-                darray_push(messages, msg);
+                remove_player(player);
             }
         } break;
         case PACKET_TYPE_PLAYER_UPDATE: {
-            received_data_size = PACKET_TYPE_SIZE[PACKET_TYPE_PLAYER_UPDATE];
             packet_player_update_t *update = (packet_player_update_t *)packet_body_buffer;
-            b8 found_player_to_update = false;
-            for (i32 i = 0; i < MAX_PLAYER_COUNT; i++) {
-                if (players[i].id == update->id) {
-                    players[i].position = update->position;
-                    found_player_to_update = true;
-                    break;
-                }
-            }
-            if (!found_player_to_update) {
-                LOG_ERROR("could not find player to update with id=%d", update->id);
+            player_t *player = find_packet_sender(client_socket, update->id);
+            if (player == NULL) {
+                LOG_WARN("ignoring update of player with id=%d sent by socket fd=%d", update->id, client_socket);
             } else {
-                // Send updates to the rest of the players
-                for (i32 i = 0; i < MAX_PLAYER_COUNT; i++) {
-                    if (players[i].id != PLAYER_INVALID_ID && players[i].id != update->id) {
-                        if (!packet_send(players[i].socket, PACKET_TYPE_PLAYER_UPDATE, update)) {
-                            LOG_ERROR("failed to send player update packet to player with id=%u", players[i].id);
-                        }
-                    }
-                }
+                // Reaches the rest of the players with the next snapshot
+                player_store.positions[player_index(player)] = update->position;
+                player_update_chunk(player);
             }
         } break;
-        case PACKET_TYPE_PLAYER_KEYPRESS: {
-            received_data_size = PACKET_TYPE_SIZE[PACKET_TYPE_PLAYER_KEYPRESS];
-            packet_player_keypress_t *keypress = (packet_player_keypress_t *)packet_body_buffer;
+        case PACKET_TYPE_UDP_HELLO: {
+            udp_hello_event_t *udp_hello = (udp_hello_event_t *)packet_body_buffer;
+            player_t *player = find_player_by_socket(client_socket);
+            if (player == NULL) {
+                break;
+            }
 
-            b8 enqueue_status;
-            ring_buffer_enqueue(input_ring_buffer, *keypress, &enqueue_status);
-            if (!enqueue_status) {
-                LOG_ERROR("failed to enqueue new player input");
+            // Sent until the echo arrives, so it also follows the client to a new address
+            if (player->udp_address_length == 0) {
+                LOG_INFO("player with id=%u switched to UDP", player->id);
             }
+            player->udp_address = udp_hello->address;
+            player->udp_address_length = udp_hello->address_length;
+            datagram_send(io_threads[0].udp_socket, player->udp_token, PACKET_TYPE_UDP_HELLO, &udp_hello->hello,
+                          (struct sockaddr *)&player->udp_address, player->udp_address_length);
         } break;
-        case PACKET_TYPE_CHUNK_REQUEST: {
-            received_data_size = PACKET_TYPE_SIZE[PACKET_TYPE_CHUNK_REQUEST];
-            packet_chunk_request_t *request = (packet_chunk_request_t *)packet_body_buffer;
-
-            b8 found_chunk = false;
-            u64 chunks_length = darray_length(chunks);
-            for (u64 i = 0; i < chunks_length; i++) {
-                chunk_base_t *chunk = &chunks[i];
-                if (chunk->x == request->x && chunk->y == request->y) {
-                    packet_chunk_response_t response = { .chunk = *chunk };
-                    if (!packet_send(client_socket, PACKET_TYPE_CHUNK_RESPONSE, &response)) {
-                        LOG_ERROR("failed to send chunk response packet to player with socket=%u", client_socket);
-                    } 
-#if LOG_CHUNK_TRANSACTIONS
-                    else {
-                        LOG_TRACE("sent cached chunk %i:%i", request->x, request->y);
-                    }
-#endif
-                    found_chunk = true;
-                    break;
-                }
+        case PACKET_TYPE_PLAYER_SNAPSHOT_ACK: {
+            packet_player_snapshot_ack_t *ack = (packet_player_snapshot_ack_t *)packet_body_buffer;
+            player_t *player = find_player_by_socket(client_socket);
+            // Acks may be overtaken by newer ones, SNAPSHOT_NONE means the client lost track and needs everything
+            if (player == NULL) {
+                break;
             }
-            
-            if (!found_chunk) {
-#if LOG_CHUNK_TRANSACTIONS
-                LOG_TRACE("requested chunk %i:%i but did not find in cache, generating...", request->x, request->y);
-#endif
-                chunk_base_t *new_chunk = NULL;
-                generate_chunk(request->x, request->y, &new_chunk);
-
-                ASSERT_MSG(new_chunk, "chunk generation failure");
-
-                packet_chunk_response_t response = { .chunk = *new_chunk };
-                if (!packet_send(client_socket, PACKET_TYPE_CHUNK_RESPONSE, &response)) {
-                    LOG_ERROR("failed to send chunk response packet to player with socket=%u", client_socket);
-                }
-#if LOG_CHUNK_TRANSACTIONS
-                else {
-                    LOG_TRACE("sent newly generated chunk %i:%i", request->x, request->y);
-                }
-#endif
+            if (ack->number == SNAPSHOT_NONE ||
+                (ack->number > player->acked_snapshot && ack->number >= player->interest_snapshot)) {
+                player->acked_snapshot = ack->number;
             }
         } break;
         default:
-            LOG_WARN("received unknown packet type, ignoring...");
-    }
-
-    if (out_received_data_size) {
-        *out_received_data_size = received_data_size;
+            LOG_WARN("received unexpected packet type %u from the client event queue, ignoring...", type);
     }
 }
 
-void handle_client_event(i32 client_socket)
+/* Queues the chunk on the connection's chunk stream in the order it was requested and starts loading it */
+static void request_chunk(i32 client_socket, i32 x, i32 y)
 {
-    const u32 packet_header_size = PACKET_TYPE_SIZE[PACKET_TYPE_HEADER];
+    connection_t *connection = connection_get(client_socket);
+    ASSERT(connection);
 
-    i64 bytes_read;
-    u8 recv_buffer[INPUT_BUFFER_SIZE + INPUT_OVERFLOW_BUFFER_SIZE] = {0};
-    if (!receive_client_data(client_socket, recv_buffer, INPUT_BUFFER_SIZE, &bytes_read)) {
+    if (!chunk_stream_push(&connection->chunk_stream, x, y)) {
+        LOG_WARN("ignoring request for chunk %i:%i from socket fd=%d, it is already queued or too many are", x, y, client_socket);
         return;
     }
 
-    if (bytes_read < packet_header_size) { /* Check if at least 'header' amount of bytes were read */
-        LOG_WARN("unimplemented: read less bytes than the header size"); /* TODO: Handle the case of having read less than header size */
-    } else {
-        // Check if multiple packets included in single tcp data reception
-        u8 *buffer = recv_buffer;
-        for (;;) {
-            packet_header_t *header = (packet_header_t *)buffer;
-
-            i32 packet_body_remaining_bytes = bytes_read - ((buffer - recv_buffer) + packet_header_size);
-            // If not enough bytes were received in the buffer to make a complete packet body, read remaining amount of bytes
-            if (packet_body_remaining_bytes < header->size) {
-                ASSERT(INPUT_BUFFER_SIZE + INPUT_OVERFLOW_BUFFER_SIZE - (buffer - recv_buffer) >= packet_body_remaining_bytes);
-
-                i64 num_remaining_body_bytes_read = 0;
-                u8 *packet_body_buffer_ptr = buffer + packet_header_size + header->size - packet_body_remaining_bytes;
-                if (!receive_client_data(client_socket, packet_body_buffer_ptr, packet_body_remaining_bytes, &num_remaining_body_bytes_read)) {
-                    return;
-                }
-
-                ASSERT(num_remaining_body_bytes_read == packet_body_remaining_bytes);
-                // At this point the rest of the packet body has been read and can be parsed based on header type
-            }
-
-            u32 received_packet_data_size;
-            handle_packet_type(client_socket, buffer + packet_header_size, header->type, &received_packet_data_size);
+    // Completed right away for stored chunks, otherwise from a generation worker once the chunk is ready
+    chunk_generator_request(x, y, client_socket);
+}
 
-            buffer += packet_header_size + received_packet_data_size;
+/* Runs on the I/O thread owning the socket. Packets touching game state are handed over to the tick thread.
+   Returns false if the payload could not be deserialized */
+static b8 handle_packet_type(i32 client_socket, u32 type, const u8 *packet_body_buffer, u32 packet_body_size)
+{
+    ASSERT(packet_body_buffer);
 
-            packet_header_t *next_header = (packet_header_t *)buffer;
-            i32 bytes_remaining = bytes_read - (buffer - recv_buffer);
+    switch (type) {
+        case PACKET_TYPE_PING: { /* Bounce back the packet */
+            packet_ping_t ping_packet;
+            if (!packet_deserialize(type, packet_body_buffer, packet_body_size, &ping_packet)) {
+                return false;
+            }
+            if (!connection_send_packet(client_socket, PACKET_TYPE_PING, &ping_packet)) {
+                LOG_ERROR("failed to send ping packet");
+            }
+        } break;
+        case PACKET_TYPE_CHUNK_REQUEST: {
+            packet_chunk_request_t request;
+            if (!packet_deserialize(type, packet_body_buffer, packet_body_size, &request)) {
+                return false;
+            }
+            request_chunk(client_socket, request.x, request.y);
+        } break;
+        case PACKET_TYPE_CHUNK_BATCH_REQUEST: {
+            packet_chunk_batch_request_t batch;
+            if (!packet_deserialize(type, packet_body_buffer, packet_body_size, &batch)) {
+                return false;
+            }
+            for (u32 i = 0; i < batch.count; i++) {
+                request_chunk(client_socket, batch.chunks[i].x, batch.chunks[i].y);
+            }
+        } break;
+        case PACKET_TYPE_PLAYER_INIT_CONF:
+        case PACKET_TYPE_MESSAGE:
+        case PACKET_TYPE_PLAYER_REMOVE:
+        case PACKET_TYPE_PLAYER_UPDATE:
+        case PACKET_TYPE_PLAYER_SNAPSHOT_ACK:
+        case PACKET_TYPE_PLAYER_KEYPRESS: {
+            client_event_t event = {
+                .type = CLIENT_EVENT_PACKET,
+                .socket = client_socket,
+                .packet_type = type
+            };
+            if (!packet_deserialize(type, packet_body_buffer, packet_body_size, &event.packet)) {
+                return false;
+            }
 
-            if (bytes_remaining == 0) {
-                // Finished parsing through all data in the receive buffer
-                break;
-            } else if (bytes_remaining < packet_header_size) {
-                // Part of the header is inside of the buffer, so we need to read the remaining bytes of the header
-                i32 header_bytes_left = packet_header_size - bytes_remaining;
-
-                // Read remaining header bytes into the INPUT_OVERFLOW_BUFFER_SIZE memory
-                i32 remaining_header_bytes_read = net_recv(client_socket, &recv_buffer[INPUT_BUFFER_SIZE], header_bytes_left, 0);
-                UNUSED(remaining_header_bytes_read); // prevents compiler warning in release mode
-                ASSERT(remaining_header_bytes_read == header_bytes_left);
-
-                // Now the recv_buffer should be filled with additional 'header_bytes_left' bytes so we can inspect the header values
-                // Finish the iteration by handling the packet type from the header, by reading additional header->size bytes and handling the packet
-                u8 *next_packet_data_ptr = (u8 *)next_header + packet_header_size;
-                received_packet_data_size = net_recv(client_socket, next_packet_data_ptr, next_header->size, 0);
-                ASSERT(received_packet_data_size == next_header->size);
-
-                handle_packet_type(client_socket, next_packet_data_ptr, next_header->type, NULL);
-                break;
-            } else if (next_header->type <= PACKET_TYPE_NONE || next_header->type >= PACKET_TYPE_COUNT) {
-                LOG_WARN("received invalid packet type: %u", next_header->type);
-                break;
+            if (!mpsc_ring_buffer_enqueue(&client_events, &event)) {
+                LOG_ERROR("client event queue is full, dropping packet of type %u", type);
             }
-        }
+        } break;
+        default:
+            LOG_WARN("received unexpected packet type %u, ignoring...", type);
     }
-}
 
-void signal_handler(i32 sig)
-{
-    running = false;
+    return true;
 }
 
-static b8 rect_collide(vec2 center1, vec2 size1, vec2 center2, vec2 size2)
+/* Datagrams are handed to the tick thread as they are, it checks their token against the player's */
+static void handle_datagram_event(io_thread_t *thread)
 {
-    f32 left1 = center1.x - size1.x/2;
-    f32 right1 = center1.x + size1.x/2;
-    f32 top1 = center1.y - size1.y/2;
+    u8 buffer[DATAGRAM_MAX_SIZE];
+
+    // Non-blocking and edge-triggered like the client sockets, so read until there is nothing left
+    for (;;) {
+        struct sockaddr_storage address;
+        u32 address_length;
+        i64 size = net_recv_from(thread->udp_socket, buffer, sizeof(buffer), &address, &address_length);
+        if (size == -1) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                LOG_ERROR("recvfrom error: %s", strerror(errno));
+            }
+            return;
+        }
+
+        u64 token;
+        u32 type, payload_size;
+        const u8 *payload;
+        if (!datagram_decode(buffer, (u32)size, &token, &type, &payload, &payload_size)) {
+            continue;
+        }
+
+        client_event_t event = {
+            .type = CLIENT_EVENT_PACKET,
+            .socket = udp_token_get_socket(token),
+            .packet_type = type,
+            .udp_token = token
+        };
+
+        b8 status = false;
+        switch (type) {
+            case PACKET_TYPE_UDP_HELLO: {
+                status = packet_deserialize(type, payload, payload_size, &event.packet.udp_hello.hello);
+                event.packet.udp_hello.address = address;
+                event.packet.udp_hello.address_length = address_length;
+            } break;
+            case PACKET_TYPE_PLAYER_INPUT:
+            case PACKET_TYPE_PLAYER_SNAPSHOT_ACK: {
+                status = packet_deserialize(type, payload, payload_size, &event.packet);
+            } break;
+            default:
+                break;
+        }
+        if (!status) {
+            continue; // Anyone can send us datagrams, so nothing is logged for the ones which make no sense
+        }
+
+        if (!mpsc_ring_buffer_enqueue(&client_events, &event)) {
+            LOG_ERROR("client event queue is full, dropping datagram of type %u", type);
+        }
+    }
+}
+
+/* Handles every complete packet in the connection's receive buffer, returns false if the client had to be dropped */
+static b8 parse_client_packets(io_thread_t *thread, connection_t *connection)
+{
+    i32 client_socket = connection->socket;
+    recv_buffer_t *buffer = &connection->recv_buffer;
+    const u32 packet_header_size = sizeof(packet_header_t);
+
+    while (recv_buffer_length(buffer) >= packet_header_size) {
+        packet_header_t *header = (packet_header_t *)recv_buffer_data(buffer);
+
+        // The header is all there is to frame the stream with, so a bogus one can't be recovered from
+        if (header->type <= PACKET_TYPE_HEADER || header->type >= PACKET_TYPE_COUNT ||
+            header->size == 0 || header->size > PACKET_MAX_SIZE ||
+            header->size > buffer->capacity - packet_header_size) {
+            LOG_ERROR("received malformed packet (type=%u, size=%u) from socket with fd=%d", header->type, header->size, client_socket);
+            drop_client(thread, connection);
+            return false;
+        }
+
+        if (recv_buffer_length(buffer) < packet_header_size + header->size) {
+            break; // Rest of the body hasn't arrived yet, it stays buffered until the next readiness event
+        }
+
+        if (header->type == PACKET_TYPE_PLAYER_INIT_CONF && connection->state == CONNECTION_STATE_JOINING) {
+            connection->state = CONNECTION_STATE_ESTABLISHED;
+            handshake_list_remove(thread, client_socket);
+        }
+
+        if (!handle_packet_type(client_socket, header->type, recv_buffer_data(buffer) + packet_header_size, header->size)) {
+            LOG_ERROR("failed to deserialize packet (type=%u, size=%u) from socket with fd=%d", header->type, header->size, client_socket);
+            drop_client(thread, connection);
+            return false;
+        }
+        recv_buffer_consume(buffer, packet_header_size + header->size);
+    }
+
+    return true;
+}
+
+static void handle_client_event(io_thread_t *thread, i32 client_socket)
+{
+    connection_t *connection = connection_get(client_socket);
+    if (connection == NULL) {
+        LOG_ERROR("received data on socket fd=%d without an open connection", client_socket);
+        return;
+    }
+
+    // Client sockets are non-blocking and edge-triggered, so keep reading until there is no more data
+    for (;;) {
+        switch (recv_buffer_fill(&connection->recv_buffer, client_socket)) {
+            case RECV_BUFFER_FILL_OK:
+                break;
+            case RECV_BUFFER_FILL_WOULD_BLOCK:
+                return;
+            case RECV_BUFFER_FILL_FULL: /* Can't happen as long as packet sizes are validated against the capacity */
+                LOG_ERROR("receive buffer of socket fd=%d is full", client_socket);
+                drop_client(thread, connection);
+                return;
+            case RECV_BUFFER_FILL_CLOSED:
+                LOG_INFO("orderly shutdown");
+                drop_client(thread, connection);
+                return;
+            case RECV_BUFFER_FILL_ERROR:
+                LOG_ERROR("recv error: %s", strerror(errno));
+                drop_client(thread, connection);
+                return;
+        }
+
+        if (connection->state == CONNECTION_STATE_VALIDATING) {
+            if (!handle_validation_answer(thread, connection)) {
+                return;
+            }
+            if (connection->state == CONNECTION_STATE_VALIDATING) {
+                continue; // Rest of the answer hasn't arrived yet
+            }
+        }
+
+        if (!parse_client_packets(thread, connection)) {
+            return;
+        }
+    }
+}
+
+static void io_thread_wake(io_thread_t *thread)
+{
+    u64 value = 1;
+    if (write(thread->wakeup_fd, &value, sizeof(value)) == -1 && errno != EAGAIN) {
+        LOG_ERROR("failed to wake up I/O thread %u: %s", thread->index, strerror(errno));
+    }
+}
+
+static void *io_thread_run(void *args)
+{
+    io_thread_t *thread = (io_thread_t *)args;
+    event_loop_event_t events[SERVER_MAX_EVENTS];
+
+    while (running) {
+        i32 num_events = event_loop_wait(&thread->event_loop, events, EVENT_LOOP_INFINITE_TIMEOUT);
+        if (num_events == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            LOG_FATAL("event loop wait error: %s", strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+
+        for (i32 i = 0; i < num_events; i++) {
+            if (events[i].fd == thread->listen_socket) { /* New connection request */
+                handle_new_connection_request_event(thread);
+            } else if (events[i].fd == thread->udp_socket) { /* Datagrams from any client */
+                handle_datagram_event(thread);
+            } else if (events[i].fd == thread->wakeup_fd) { /* Tick finished or server is shutting down */
+                u64 value;
+                while (read(thread->wakeup_fd, &value, sizeof(value)) > 0);
+                if (running) {
+                    connection_flush_shard(thread->index);
+                    expire_handshakes(thread);
+                }
+            } else { /* Client trying to send data or hung up */
+                handle_client_event(thread, events[i].fd);
+            }
+        }
+    }
+
+    return NULL;
+}
+
+/* Binds a socket of the given type to the port on a wildcard address, every I/O thread may bind its own */
+static i32 create_bound_socket(const char *port, i32 socktype, b8 log_address)
+{
+    struct addrinfo hints;
+    struct addrinfo *result, *rp;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_socktype = socktype;
+    hints.ai_family = AF_UNSPEC;     /* Allow IPv4 or IPv6 */
+    hints.ai_flags = AI_PASSIVE;     /* For wildcard IP addresses */
+
+    i32 status = getaddrinfo(NULL, port, &hints, &result);
+    if (status != 0) {
+        LOG_FATAL("getaddrinfo error: %s", gai_strerror(status));
+        return -1;
+    }
+
+    i32 listen_socket = -1;
+    for (rp = result; rp != NULL; rp = rp->ai_next) {
+        listen_socket = socket(rp->ai_family, rp->ai_socktype, rp->ai_protocol);
+        if (listen_socket == -1) {
+            continue;
+        }
+
+        static i32 yes = 1;
+        if (setsockopt(listen_socket, SOL_SOCKET, SO_REUSEADDR, (void *)&yes, sizeof(i32)) == -1) {
+            LOG_ERROR("setsockopt reuse address error: %s", strerror(errno));
+        }
+        // Lets every I/O thread bind its own listener to the same port
+        if (setsockopt(listen_socket, SOL_SOCKET, SO_REUSEPORT, (void *)&yes, sizeof(i32)) == -1) {
+            LOG_ERROR("setsockopt reuse port error: %s", strerror(errno));
+        }
+
+        if (bind(listen_socket, rp->ai_addr, rp->ai_addrlen) == 0) {
+            if (log_address) {
+                const char *ip_version = rp->ai_family == AF_INET  ? "IPv4" :
+                                         rp->ai_family == AF_INET6 ? "IPv6" : "UNKNOWN";
+                const char *socktype_str = rp->ai_socktype == SOCK_STREAM ? "TCP" :
+                                           rp->ai_socktype == SOCK_DGRAM  ? "UDP" : "UNKNOWN";
+                char ip_buffer[INET6_ADDRSTRLEN] = {0};
+                inet_ntop(rp->ai_family, get_in_addr(rp->ai_addr), ip_buffer, INET6_ADDRSTRLEN);
+                LOG_INFO("bound %s %s socket to %s port %s", ip_version, socktype_str, ip_buffer, port);
+            }
+            break;
+        }
+
+        LOG_ERROR("failed to bind socket with fd=%d: %s", listen_socket, strerror(errno));
+        close(listen_socket);
+        listen_socket = -1;
+    }
+
+    freeaddrinfo(result);
+
+    if (listen_socket == -1) { /* No address succeeded */
+        LOG_FATAL("could not bind to port %s", port);
+        return -1;
+    }
+
+    if (!net_set_nonblocking(listen_socket)) {
+        LOG_FATAL("failed to set socket to non-blocking mode: %s", strerror(errno));
+        close(listen_socket);
+        return -1;
+    }
+
+    return listen_socket;
+}
+
+static i32 create_listening_socket(const char *port, b8 log_address)
+{
+    i32 listen_socket = create_bound_socket(port, SOCK_STREAM, log_address);
+    if (listen_socket == -1) {
+        return -1;
+    }
+
+    if (listen(listen_socket, SERVER_BACKLOG) == -1) {
+        LOG_FATAL("failed to start listening: %s", strerror(errno));
+        close(listen_socket);
+        return -1;
+    }
+
+    return listen_socket;
+}
+
+static b8 io_thread_init(io_thread_t *thread, u32 index, const char *port)
+{
+    thread->index = index;
+    thread->handshakes = darray_create(sizeof(i32));
+    thread->listen_socket = create_listening_socket(port, index == 0);
+    if (thread->listen_socket == -1) {
+        return false;
+    }
+
+    thread->udp_socket = -1;
+#if SERVER_UDP_ENABLED
+    if (index == 0) {
+        thread->udp_socket = create_bound_socket(port, SOCK_DGRAM, true);
+        if (thread->udp_socket == -1) {
+            return false;
+        }
+    }
+#endif
+
+    thread->wakeup_fd = eventfd(0, EFD_NONBLOCK);
+    if (thread->wakeup_fd == -1) {
+        LOG_FATAL("failed to create I/O thread wakeup eventfd: %s", strerror(errno));
+        return false;
+    }
+
+    return event_loop_create(SERVER_MAX_EVENTS, &thread->event_loop) &&
+           event_loop_add(&thread->event_loop, thread->listen_socket) &&
+           event_loop_add(&thread->event_loop, thread->wakeup_fd) &&
+           (thread->udp_socket == -1 || event_loop_add(&thread->event_loop, thread->udp_socket));
+}
+
+static void io_thread_shutdown(io_thread_t *thread)
+{
+    darray_destroy(thread->handshakes);
+    event_loop_destroy(&thread->event_loop);
+
+    if (close(thread->listen_socket) == -1) {
+        LOG_ERROR("error while closing the socket: %s", strerror(errno));
+    }
+    close(thread->wakeup_fd);
+    if (thread->udp_socket != -1) {
+        close(thread->udp_socket);
+    }
+}
+
+static b8 rect_collide(vec2 center1, vec2 size1, vec2 center2, vec2 size2)
+{
+    f32 left1 = center1.x - size1.x/2;
+    f32 right1 = center1.x + size1.x/2;
+    f32 top1 = center1.y - size1.y/2;
     f32 bottom1 = center1.y + size1.y/2;
 
     f32 left2 = center2.x - size2.x/2;
@@ -684,6 +1121,12 @@ static b8 is_player_key(u32 key)
     return key == KEYCODE_W || key == KEYCODE_S || key == KEYCODE_A || key == KEYCODE_D || key == KEYCODE_Space || key == KEYCODE_LeftShift;
 }
 
+/* Chunk holding the given global tile column or row */
+static i32 tile_floor_div(i32 tile)
+{
+    return tile >= 0 ? tile / CHUNK_LENGTH : (tile - CHUNK_LENGTH + 1) / CHUNK_LENGTH;
+}
+
 static vec2 tile_get_world_pos(i32 chunk_x, i32 chunk_y, u32 tile_idx)
 {
     i32 tile_col = tile_idx % CHUNK_LENGTH;
@@ -698,560 +1141,812 @@ static vec2 tile_get_world_pos(i32 chunk_x, i32 chunk_y, u32 tile_idx)
     };
 }
 
-static vec2i player_position_to_chunk_position(vec2 player_position)
+static void process_player_input(u32 key, u32 mods, player_t *player)
 {
-    return (vec2i){
-        .x = (player_position.x + (player_position.x < 0 ? -1 : 1) * (CHUNK_WIDTH_PX  * 0.5f)) / CHUNK_WIDTH_PX,
-        .y = (player_position.y + (player_position.y < 0 ? -1 : 1) * (CHUNK_HEIGHT_PX * 0.5f)) / CHUNK_HEIGHT_PX
-     };
-}
+    u32 index = player_index(player);
+    vec2 *position = &player_store.positions[index];
 
-static void process_player_input(u32 key, u32 mods, player_t *player, u32 damaged_players[MAX_PLAYER_COUNT])
-{
     if (key == KEYCODE_LeftShift) {
-        if (player->roll_cooldown > 0.0f) {
+        if (player_store.roll_cooldowns[index] > 0.0f) {
             LOG_WARN("received LeftShift keypress (roll) but roll_cooldown > 0");
             return;
         }
-        player->state = PLAYER_STATE_ROLL;
-        player->roll_cooldown = PLAYER_ROLL_COOLDOWN;
-        player->roll_accumulator = 0.0f;
-        if (player->direction == PLAYER_DIRECTION_UP) {
-            player->roll_start = player->position.y;
-            player->position.y += PLAYER_ROLL_DISTANCE;
-        } else if (player->direction == PLAYER_DIRECTION_DOWN) {
-            player->roll_start = player->position.y;
-            player->position.y -= PLAYER_ROLL_DISTANCE;
-        } else if (player->direction == PLAYER_DIRECTION_LEFT) {
-            player->roll_start = player->position.x;
-            player->position.x -= PLAYER_ROLL_DISTANCE;
-        } else if (player->direction == PLAYER_DIRECTION_RIGHT) {
-            player->roll_start = player->position.x;
-            player->position.x += PLAYER_ROLL_DISTANCE;
+        player_store.states[index] = PLAYER_STATE_ROLL;
+        player_store.roll_cooldowns[index] = PLAYER_ROLL_COOLDOWN;
+        player_store.roll_accumulators[index] = 0.0f;
+        if (player_store.directions[index] == PLAYER_DIRECTION_UP) {
+            player_store.roll_starts[index] = position->y;
+            position->y += PLAYER_ROLL_DISTANCE;
+        } else if (player_store.directions[index] == PLAYER_DIRECTION_DOWN) {
+            player_store.roll_starts[index] = position->y;
+            position->y -= PLAYER_ROLL_DISTANCE;
+        } else if (player_store.directions[index] == PLAYER_DIRECTION_LEFT) {
+            player_store.roll_starts[index] = position->x;
+            position->x -= PLAYER_ROLL_DISTANCE;
+        } else if (player_store.directions[index] == PLAYER_DIRECTION_RIGHT) {
+            player_store.roll_starts[index] = position->x;
+            position->x += PLAYER_ROLL_DISTANCE;
         }
     } else {
         if (key == KEYCODE_Space) {
-            if (player->attack_cooldown > 0.0f) {
+            if (player_store.attack_cooldowns[index] > 0.0f) {
                 LOG_WARN("received Space keypress (attack) but attack_cooldown > 0");
                 return;
             }
-            player->state = PLAYER_STATE_ATTACK;
-            player->attack_cooldown = PLAYER_ATTACK_COOLDOWN;
-            player->attack_accumulator = 0.0f;
+            player_store.states[index] = PLAYER_STATE_ATTACK;
+            player_store.attack_cooldowns[index] = PLAYER_ATTACK_COOLDOWN;
+            player_store.attack_accumulators[index] = 0.0f;
 
             static const f32 size = 32.0f;
 
-            vec2 attack_center = player->position;
+            vec2 attack_center = *position;
             vec2 attack_size = vec2_create(size, size);
-            if (player->direction == PLAYER_DIRECTION_UP) {
+            if (player_store.directions[index] == PLAYER_DIRECTION_UP) {
                 attack_center.y += size/2;
                 attack_size.y /= 3.0f;
-            } else if (player->direction == PLAYER_DIRECTION_DOWN) {
+            } else if (player_store.directions[index] == PLAYER_DIRECTION_DOWN) {
                 attack_center.y -= size/2;
                 attack_size.y /= 3.0f;
-            } else if (player->direction == PLAYER_DIRECTION_LEFT) {
+            } else if (player_store.directions[index] == PLAYER_DIRECTION_LEFT) {
                 attack_center.x -= size/2;
                 attack_size.x /= 3.0f;
-            } else if (player->direction == PLAYER_DIRECTION_RIGHT) {
+            } else if (player_store.directions[index] == PLAYER_DIRECTION_RIGHT) {
                 attack_center.x += size/2;
                 attack_size.x /= 3.0f;
             }
 
-            for (i32 j = 0; j < MAX_PLAYER_COUNT; j++) {
-                if (players[j].id != PLAYER_INVALID_ID && players[j].id != player->id) {
-                    player_t *other_player = &players[j];
-                    if (rect_collide(attack_center, attack_size, other_player->position, vec2_create(size, size))) {
-                        damaged_players[j] += PLAYER_DAMAGE_VALUE;
+            // Only the players filed under the chunks the attack box reaches into can be hit
+            static player_id candidate_ids[MAX_PLAYER_COUNT]; /* Only used by the tick thread */
+            vec2 reach = vec2_create((attack_size.x + size) / 2, (attack_size.y + size) / 2);
+            vec2i min_chunk = player_position_to_chunk_position(vec2_create(attack_center.x - reach.x, attack_center.y - reach.y));
+            vec2i max_chunk = player_position_to_chunk_position(vec2_create(attack_center.x + reach.x, attack_center.y + reach.y));
+            u32 candidate_count = interest_grid_query_area(&interest_grid, min_chunk, max_chunk, candidate_ids, MAX_PLAYER_COUNT);
+            for (u32 j = 0; j < candidate_count; j++) {
+                player_t *other_player = id_table_find(&players, candidate_ids[j]);
+                if (other_player != NULL && other_player->id != player->id) {
+                    u32 other_index = player_index(other_player);
+                    if (rect_collide(attack_center, attack_size, player_store.positions[other_index], vec2_create(size, size))) {
+                        player_store.pending_damage[other_index] += PLAYER_DAMAGE_VALUE;
                     }
                 }
             }
 
-            u64 chunks_length = darray_length(chunks);
-            vec2i chunk_coords = player_position_to_chunk_position(player->position);
-            for (u64 i = 0; i < chunks_length; i++) {
-                chunk_base_t *chunk = &chunks[i];
-                // Check for all chunks around the player's chunk
-                if (math_abs(chunk_coords.x - chunk->x) <= 1 && math_abs(chunk_coords.y - chunk->y) <= 1) {
-                    for (u32 j = 0; j < CHUNK_NUM_TILES; j++) {
-                        if (chunk->tiles[j].object_index != INVALID_OBJECT_INDEX) {
+            // Tiles form a uniform grid starting half a chunk left of and below the chunk's center,
+            // so the range of tiles under the attack box follows from its edges
+            i32 tile_left   = (i32)math_ceil ((attack_center.x - attack_size.x/2 + CHUNK_WIDTH_PX/2)  / TILE_WIDTH_PX) - 1;
+            i32 tile_right  = (i32)math_floor((attack_center.x + attack_size.x/2 + CHUNK_WIDTH_PX/2)  / TILE_WIDTH_PX);
+            i32 tile_bottom = (i32)math_ceil ((attack_center.y - attack_size.y/2 + CHUNK_HEIGHT_PX/2) / TILE_HEIGHT_PX) - 1;
+            i32 tile_top    = (i32)math_floor((attack_center.y + attack_size.y/2 + CHUNK_HEIGHT_PX/2) / TILE_HEIGHT_PX);
+            for (i32 chunk_y = tile_floor_div(tile_bottom); chunk_y <= tile_floor_div(tile_top); chunk_y++) {
+                for (i32 chunk_x = tile_floor_div(tile_left); chunk_x <= tile_floor_div(tile_right); chunk_x++) {
+                    chunk_base_t *chunk = chunk_store_find(chunk_x, chunk_y);
+                    if (chunk == NULL) {
+                        continue;
+                    }
+
+                    i32 first_column = math_max(tile_left   - chunk_x * CHUNK_LENGTH, 0);
+                    i32 last_column  = (i32)math_min(tile_right  - chunk_x * CHUNK_LENGTH, CHUNK_LENGTH - 1);
+                    i32 first_row    = math_max(tile_bottom - chunk_y * CHUNK_LENGTH, 0);
+                    i32 last_row     = (i32)math_min(tile_top    - chunk_y * CHUNK_LENGTH, CHUNK_LENGTH - 1);
+                    for (i32 row = first_row; row <= last_row; row++) {
+                        for (i32 column = first_column; column <= last_column; column++) {
+                            u32 j = row * CHUNK_LENGTH + column;
+                            if (chunk->tiles[j].object_index == INVALID_OBJECT_INDEX) {
+                                continue;
+                            }
+
                             vec2 object_position = tile_get_world_pos(chunk->x, chunk->y, j);
                             if (rect_collide(attack_center, attack_size, object_position, vec2_create(TILE_WIDTH_PX, TILE_HEIGHT_PX))) {
-                                // Remove object
+                                // Remove object. The tile is cleared together with the revision bump, so a chunk sent
+                                // meanwhile either still has the object at the old revision or neither at the new one
                                 packet_game_world_object_remove_t object_remove_packet = {
                                     .chunk_x = chunk->x,
                                     .chunk_y = chunk->y,
-                                    .tile_idx = j,
-                                    .type = chunk->objects[chunk->tiles[j].object_index].type
+                                    .tile_idx = j
                                 };
-
-                                for (i32 k = 0; k < MAX_PLAYER_COUNT; k++) {
-                                    if (players[k].id != PLAYER_INVALID_ID) {
-                                        if (!packet_send(players[k].socket, PACKET_TYPE_GAME_WORLD_OBJECT_REMOVE, &object_remove_packet)) {
-                                            LOG_ERROR("failed to send object remove packet to player with id=%u (%s)", players[k].id, players[k].name);
-                                        }
-                                    }
+                                if (chunk_store_remove_object(chunk, j, &object_remove_packet.type, &object_remove_packet.revision)) {
+                                    send_to_chunk_subscribers((vec2i){ .x = chunk->x, .y = chunk->y },
+                                                              PACKET_TYPE_GAME_WORLD_OBJECT_REMOVE, &object_remove_packet);
                                 }
-
-                                chunk->tiles[j].object_index = INVALID_OBJECT_INDEX;
                             }
                         }
                     }
+
+                    chunk_store_release(chunk);
                 }
             }
         }
 
         f32 velocity = CLIENT_TICK_DURATION * PLAYER_VELOCITY;
         if (key == KEYCODE_W) {
-            player->position.y += velocity;
-            player->position.y = (i32)player->position.y;
-            if (player->state != PLAYER_STATE_ATTACK || player->direction != PLAYER_DIRECTION_UP) {
-                player->state = PLAYER_STATE_WALK;
+            position->y += velocity;
+            position->y = (i32)position->y;
+            if (player_store.states[index] != PLAYER_STATE_ATTACK || player_store.directions[index] != PLAYER_DIRECTION_UP) {
+                player_store.states[index] = PLAYER_STATE_WALK;
             }
-            player->direction = PLAYER_DIRECTION_UP;
+            player_store.directions[index] = PLAYER_DIRECTION_UP;
         } else if (key == KEYCODE_S) {
-            player->position.y -= velocity;
-            player->position.y = (i32)player->position.y;
-            if (player->state != PLAYER_STATE_ATTACK || player->direction != PLAYER_DIRECTION_DOWN) {
-                player->state = PLAYER_STATE_WALK;
+            position->y -= velocity;
+            position->y = (i32)position->y;
+            if (player_store.states[index] != PLAYER_STATE_ATTACK || player_store.directions[index] != PLAYER_DIRECTION_DOWN) {
+                player_store.states[index] = PLAYER_STATE_WALK;
             }
-            player->direction = PLAYER_DIRECTION_DOWN;
+            player_store.directions[index] = PLAYER_DIRECTION_DOWN;
         } else if (key == KEYCODE_A) {
-            player->position.x -= velocity;
-            player->position.x = (i32)player->position.x;
-            if (player->state != PLAYER_STATE_ATTACK || player->direction != PLAYER_DIRECTION_LEFT) {
-                player->state = PLAYER_STATE_WALK;
+            position->x -= velocity;
+            position->x = (i32)position->x;
+            if (player_store.states[index] != PLAYER_STATE_ATTACK || player_store.directions[index] != PLAYER_DIRECTION_LEFT) {
+                player_store.states[index] = PLAYER_STATE_WALK;
             }
-            player->direction = PLAYER_DIRECTION_LEFT;
+            player_store.directions[index] = PLAYER_DIRECTION_LEFT;
         } else if (key == KEYCODE_D) {
-            player->position.x += velocity;
-            player->position.x = (i32)player->position.x;
-            if (player->state != PLAYER_STATE_ATTACK || player->direction != PLAYER_DIRECTION_RIGHT) {
-                player->state = PLAYER_STATE_WALK;
+            position->x += velocity;
+            position->x = (i32)position->x;
+            if (player_store.states[index] != PLAYER_STATE_ATTACK || player_store.directions[index] != PLAYER_DIRECTION_RIGHT) {
+                player_store.states[index] = PLAYER_STATE_WALK;
             }
-            player->direction = PLAYER_DIRECTION_RIGHT;
+            player_store.directions[index] = PLAYER_DIRECTION_RIGHT;
         }
     }
 }
 
-void process_pending_input(f64 delta_time)
+static i32 player_id_compare(const void *a, const void *b)
 {
-    b8 dequeue_status;
-    u32 processed_input_count = 0;
-    packet_player_keypress_t keypress;
-    u32 modified_players[MAX_PLAYER_COUNT] = {0};
-    u32 damaged_players[MAX_PLAYER_COUNT] = {0};
+    player_id id_a = *(const player_id *)a;
+    player_id id_b = *(const player_id *)b;
+    return (id_a > id_b) - (id_a < id_b);
+}
 
-    for (;;) {
-        ring_buffer_dequeue(input_ring_buffer, &keypress, &dequeue_status);
-        if (!dequeue_status) {
-            break; // Finished processing all input from the queue
+INLINE b8 player_sees(const player_t *player, player_id id)
+{
+    return bsearch(&id, player->visible_ids, player->visible_count, sizeof(player_id), player_id_compare) != NULL;
+}
+
+/* Works out which players every client sees and tells it about the ones which came into or went out of
+   reach. Returns true if any visible set changed, those clients need a full snapshot of their new set */
+static b8 update_player_interest(void)
+{
+    static interest_candidate_t candidates[MAX_PLAYER_COUNT]; /* Only used by the tick thread */
+    static player_id visible_ids[MAX_PLAYER_COUNT];           /* Only used by the tick thread */
+
+    // Positions are refiled as they change, this only catches whatever slipped through
+    for (u64 i = 0; i < id_table_length(&players); i++) {
+        player_update_chunk(id_table_at(&players, i));
+    }
+
+    b8 any_changed = false;
+    for (u64 i = 0; i < id_table_length(&players); i++) {
+        player_t *player = id_table_at(&players, i);
+
+        u32 visible_count = 0;
+        visible_ids[visible_count++] = player->id;
+        if (player->in_world) {
+            u32 count = interest_grid_query(&interest_grid, player->chunk, INTEREST_RADIUS_CHUNKS + 1, candidates, MAX_PLAYER_COUNT);
+            for (u32 j = 0; j < count; j++) {
+                // Players are only lost a chunk past the radius, so walking along its border doesn't make them flicker
+                if (candidates[j].id != player->id &&
+                    (candidates[j].distance <= INTEREST_RADIUS_CHUNKS || player_sees(player, candidates[j].id))) {
+                    visible_ids[visible_count++] = candidates[j].id;
+                }
+            }
+            qsort(visible_ids, visible_count, sizeof(player_id), player_id_compare);
         }
 
-        if (is_player_key(keypress.key)) {
-            i32 sender_idx = -1;
-            for (i32 i = 0; i < MAX_PLAYER_COUNT; i++) {
-                if (players[i].id == keypress.id) {
-                    sender_idx = i;
-                    break;
+        // Both sets are sorted, so entering and leaving players fall out of a merge
+        b8 changed = false;
+        u32 old_index = 0, new_index = 0;
+        while (old_index < player->visible_count || new_index < visible_count) {
+            player_id old_id = old_index < player->visible_count ? player->visible_ids[old_index] : PLAYER_INVALID_ID;
+            player_id new_id = new_index < visible_count ? visible_ids[new_index] : PLAYER_INVALID_ID;
+            if (old_id == new_id) {
+                old_index++;
+                new_index++;
+            } else if (new_id == PLAYER_INVALID_ID || (old_id != PLAYER_INVALID_ID && old_id < new_id)) {
+                packet_player_remove_t player_remove_packet = { .id = old_id };
+                if (old_id != player->id && !connection_send_packet(player->socket, PACKET_TYPE_PLAYER_REMOVE, &player_remove_packet)) {
+                    LOG_ERROR("failed to send player remove packet");
+                }
+                changed = true;
+                old_index++;
+            } else {
+                player_t *entered = id_table_find(&players, new_id);
+                if (new_id != player->id && entered != NULL) {
+                    send_player_add(player->socket, entered);
                 }
+                changed = true;
+                new_index++;
             }
+        }
 
-            ASSERT(sender_idx != -1);
-            process_player_input(keypress.key, keypress.mods, &players[sender_idx], damaged_players);
+        if (changed) {
+            mem_copy(player->visible_ids, visible_ids, visible_count * sizeof(player_id));
+            player->visible_count = visible_count;
+            // The client's baselines were filtered by the old set, so it starts over from the snapshot about to be sent
+            player->acked_snapshot = SNAPSHOT_NONE;
+            player->interest_snapshot = snapshot_history.latest + 1;
+            any_changed = true;
+        }
+    }
 
-            players[sender_idx].seq_nr = keypress.seq_nr;
+    return any_changed;
+}
 
-            if (modified_players[sender_idx] == 0) {
-                modified_players[sender_idx] = 1;
-            }
+/* Clients animate rolls on their own, so a rolling player is published where the roll started */
+static vec2 player_get_published_position(u32 index)
+{
+    vec2 position = player_store.positions[index];
+    u8 direction = player_store.directions[index];
+    if (player_store.states[index] == PLAYER_STATE_ROLL) {
+        if (direction == PLAYER_DIRECTION_UP || direction == PLAYER_DIRECTION_DOWN) {
+            position.y = player_store.roll_starts[index];
+        } else if (direction == PLAYER_DIRECTION_LEFT || direction == PLAYER_DIRECTION_RIGHT) {
+            position.x = player_store.roll_starts[index];
         }
+    }
 
-        processed_input_count++;
-        if (processed_input_count >= PROCESSED_INPUT_LIMIT_PER_UPDATE) {
-            break;
-        }
+    return position;
+}
+
+/* Takes a snapshot of all players and sends every client what changed among the players
+   it can see since the snapshot it acknowledged */
+static void send_player_snapshots(void)
+{
+    static snapshot_t snapshot;              /* Only used by the tick thread */
+    static snapshot_t visible_latest;        /* Only used by the tick thread */
+    static snapshot_t visible_baseline;      /* Only used by the tick thread */
+    static packet_player_snapshot_t packet;  /* Only used by the tick thread */
+
+    b8 interest_changed = update_player_interest();
+
+    snapshot.count = 0;
+    for (u64 i = 0; i < id_table_length(&players); i++) {
+        player_t *player = id_table_at(&players, i);
+        vec2 position = player_get_published_position(i);
+        snapshot.players[snapshot.count++] = (snapshot_player_t){
+            .id        = player->id,
+            .seq_nr    = player->seq_nr,
+            .x         = snapshot_quantize(position.x),
+            .y         = snapshot_quantize(position.y),
+            .health    = player_store.health[i],
+            .state     = player_store.states[i],
+            .direction = player_store.directions[i]
+        };
+    }
+    snapshot_sort(&snapshot);
+
+    // Numbers only advance when something changed, so an idle world keeps every baseline alive
+    const snapshot_t *latest = snapshot_history_find(&snapshot_history, snapshot_history.latest);
+    if (latest == NULL || !snapshot_equal(latest, &snapshot) || interest_changed) {
+        snapshot.number = snapshot_history.latest + 1;
+        snapshot_history_push(&snapshot_history, &snapshot);
+        latest = snapshot_history_find(&snapshot_history, snapshot.number);
     }
 
-    for (u64 i = 0; i < MAX_PLAYER_COUNT; i++) {
-        player_t *player = &players[i];
-        // Check if new input has been processed for a player
-        if (modified_players[i] > 0) {
-            vec2 position = player->position;
-            // Roll was just initiated, so the update will contain new state and the initial roll position
-            if (player->roll_cooldown == PLAYER_ROLL_COOLDOWN) {
-                if (player->direction == PLAYER_DIRECTION_UP || player->direction == PLAYER_DIRECTION_DOWN) {
-                    position.y = player->roll_start;
-                } else if (player->direction == PLAYER_DIRECTION_LEFT || player->direction == PLAYER_DIRECTION_RIGHT) {
-                    position.x = player->roll_start;
-                }
-            }
+    for (u64 i = 0; i < id_table_length(&players); i++) {
+        player_t *player = id_table_at(&players, i);
+        if (player->acked_snapshot == latest->number) {
+            continue;
+        }
 
-            // Send updated players' state to all other players including the sender
-            packet_player_update_t player_update_packet = {
-                .seq_nr    = player->seq_nr,
-                .id        = player->id,
-                .position  = position,
-                .direction = player->direction,
-                .state     = player->state
-            };
+        // The client only ever received the players it could see, its baseline is filtered the same way
+        snapshot_filter(latest, player->visible_ids, player->visible_count, &visible_latest);
+        const snapshot_t *baseline = snapshot_history_find(&snapshot_history, player->acked_snapshot);
+        if (baseline != NULL) {
+            snapshot_filter(baseline, player->visible_ids, player->visible_count, &visible_baseline);
+            baseline = &visible_baseline;
+        }
+        snapshot_diff(baseline, &visible_latest, player->id, &packet);
+        // Changes the client doesn't care about still advance its baseline before it falls out of the history
+        if (packet.count == 0 && baseline != NULL && latest->number - baseline->number < SNAPSHOT_HISTORY_LENGTH / 2) {
+            continue;
+        }
 
-            for (i32 j = 0; j < MAX_PLAYER_COUNT; j++) {
-                if (players[j].id != PLAYER_INVALID_ID) {
-                    if (!packet_send(players[j].socket, PACKET_TYPE_PLAYER_UPDATE, &player_update_packet)) {
-                        LOG_ERROR("failed to send player update packet");
-                    }
-                }
-            }
+        if (player->udp_address_length > 0) {
+            // A lost snapshot needs no special care, the next one is still encoded against the last acknowledged one
+            datagram_send(io_threads[0].udp_socket, player->udp_token, PACKET_TYPE_PLAYER_SNAPSHOT, &packet,
+                          (struct sockaddr *)&player->udp_address, player->udp_address_length);
+        } else if (!connection_send_packet(player->socket, PACKET_TYPE_PLAYER_SNAPSHOT, &packet)) {
+            LOG_ERROR("failed to send snapshot %u to player with id=%u", packet.number, player->id);
         }
+    }
+}
 
-        // Check if any damage was dealt to a player
-        if (damaged_players[i] > 0 && player->health > 0) {
-            player->health -= damaged_players[i];
-            packet_player_death_t player_death_packet = {0};
-            packet_message_t message_death_packet = {0};
+static void handle_player_keypress(player_t *sender, const packet_player_keypress_t *keypress)
+{
+    // Datagrams repeat the latest keypresses, and some may already have arrived over TCP before the switch
+    if (!is_player_key(keypress->key) || keypress->seq_nr <= sender->seq_nr) {
+        return;
+    }
 
-            b8 player_died = player->health <= 0;
+    process_player_input(keypress->key, keypress->mods, sender);
+    player_update_chunk(sender);
 
-            if (player_died) {
-                player->state = PLAYER_STATE_DEAD;
-                player->respawn_cooldown = PLAYER_RESPAWN_COOLDOWN;
-                player_death_packet.id = player->id;
+    sender->seq_nr = keypress->seq_nr;
+}
 
-                message_death_packet.type = MESSAGE_TYPE_SYSTEM;
-                snprintf(message_death_packet.content,
-                         sizeof(message_death_packet.content),
-                         "player <%s> died! respawning in %.2f seconds...",
-                         player->name, PLAYER_RESPAWN_COOLDOWN);
+/* Only the part of the packet union used by the event's packet type ends up in the input log */
+static u32 client_event_packet_size(const client_event_t *event)
+{
+    if (event->type != CLIENT_EVENT_PACKET) {
+        return 0;
+    }
 
-                message_t msg = {0};
-                msg.type = MESSAGE_TYPE_SYSTEM;
-                memcpy(msg.content, message_death_packet.content, strlen(message_death_packet.content));
-                darray_push(messages, msg);
-            }
+    switch (event->packet_type) {
+        case PACKET_TYPE_PLAYER_KEYPRESS:     return sizeof(packet_player_keypress_t);
+        case PACKET_TYPE_PLAYER_INIT_CONF:    return sizeof(packet_player_init_confirm_t);
+        case PACKET_TYPE_MESSAGE:             return sizeof(packet_message_t);
+        case PACKET_TYPE_PLAYER_UPDATE:       return sizeof(packet_player_update_t);
+        case PACKET_TYPE_PLAYER_REMOVE:       return sizeof(packet_player_remove_t);
+        case PACKET_TYPE_PLAYER_SNAPSHOT_ACK: return sizeof(packet_player_snapshot_ack_t);
+        case PACKET_TYPE_UDP_HELLO:           return sizeof(udp_hello_event_t);
+        case PACKET_TYPE_PLAYER_INPUT:
+            return offsetof(packet_player_input_t, keypresses) + event->packet.input.count * sizeof(packet_player_keypress_t);
+        default:
+            return sizeof(event->packet);
+    }
+}
 
-            // Send health updates to all players
-            packet_player_health_t player_health_packet = {
-                .id     = player->id,
-                .damage = damaged_players[i]
-            };
+/* Fields of a client event written in front of its packet */
+typedef struct {
+    u64 udp_token;
+    i32 socket;
+    u32 type;
+    u32 packet_type;
+    u32 packet_size;
+} recorded_event_header_t;
 
-            for (i32 j = 0; j < MAX_PLAYER_COUNT; j++) {
-                if (players[j].id != PLAYER_INVALID_ID) {
-                    if (!packet_send(players[j].socket, PACKET_TYPE_PLAYER_HEALTH, &player_health_packet)) {
-                        LOG_ERROR("failed to send player health packet");
-                    }
+/* Event count followed by every event of a tick */
+#define RECORDED_TICK_MAX_SIZE (sizeof(u32) + PROCESSED_INPUT_LIMIT_PER_UPDATE * (sizeof(recorded_event_header_t) + sizeof(client_event_t)))
 
-                    if (player_died) {
-                        if (!packet_send(players[j].socket, PACKET_TYPE_PLAYER_DEATH, &player_death_packet)) {
-                            LOG_ERROR("failed to send player death packet");
-                        }
-                        if (!packet_send(players[j].socket, PACKET_TYPE_MESSAGE, &message_death_packet)) {
-                            LOG_ERROR("failed to send message death packet");
-                        }
-                    }
-                }
-            }
+static void record_client_events(const client_event_t *events, u64 event_count)
+{
+    static u8 buffer[RECORDED_TICK_MAX_SIZE]; /* Only used by the tick thread */
+
+    u32 count = (u32)event_count;
+    u32 size = sizeof(count);
+    mem_copy(buffer, &count, sizeof(count));
+
+    for (u64 e = 0; e < event_count; e++) {
+        const client_event_t *event = &events[e];
+        recorded_event_header_t header = {
+            .udp_token   = event->udp_token,
+            .socket      = event->socket,
+            .type        = event->type,
+            .packet_type = event->packet_type,
+            .packet_size = client_event_packet_size(event)
+        };
+        mem_copy(buffer + size, &header, sizeof(header));
+        size += sizeof(header);
+        mem_copy(buffer + size, &event->packet, header.packet_size);
+        size += header.packet_size;
+    }
+
+    if (!input_log_write_tick(&input_log, tick_number, buffer, size)) {
+        LOG_ERROR("stopped recording input after %llu ticks", tick_number);
+        input_log_close(&input_log);
+    }
+}
+
+/* Inverse of record_client_events, returns false if the data doesn't make sense */
+static b8 load_recorded_events(const u8 *data, u32 size, client_event_t *out_events, u64 *out_event_count)
+{
+    u32 count;
+    if (size < sizeof(count)) {
+        return false;
+    }
+    mem_copy(&count, data, sizeof(count));
+    if (count > PROCESSED_INPUT_LIMIT_PER_UPDATE) {
+        return false;
+    }
+
+    u32 offset = sizeof(count);
+    for (u32 e = 0; e < count; e++) {
+        recorded_event_header_t header;
+        if (size - offset < sizeof(header)) {
+            return false;
         }
+        mem_copy(&header, data + offset, sizeof(header));
+        offset += sizeof(header);
+        if (header.packet_size > sizeof(out_events[e].packet) || size - offset < header.packet_size) {
+            return false;
+        }
+
+        client_event_t *event = &out_events[e];
+        mem_zero(event, sizeof(*event));
+        event->type = (client_event_type_e)header.type;
+        event->socket = header.socket;
+        event->packet_type = header.packet_type;
+        event->udp_token = header.udp_token;
+        mem_copy(&event->packet, data + offset, header.packet_size);
+        offset += header.packet_size;
     }
 
-    for (i32 i = 0; i < MAX_PLAYER_COUNT; i++) {
-        player_t *player = &players[i];
-        if (player->id != PLAYER_INVALID_ID) {
-            b8 should_update = false;
-            // Check if any players are dead and should be respawned
-            if (player->state == PLAYER_STATE_DEAD) {
-                if (player->respawn_cooldown <= 0.0f) {
-                    // Found player who should be respawned
-                    // Update player state and send respawn packet to all players
-                    player->state = PLAYER_STATE_IDLE;
-                    player->health = PLAYER_START_HEALTH;
-                    player->position = vec2_create(PLAYER_SPAWN_POSITION_X, PLAYER_SPAWN_POSITION_Y);
-                    player->direction = PLAYER_DIRECTION_DOWN;
-
-                    packet_player_respawn_t player_respawn_packet = {
-                        .id        = player->id,
-                        .health    = player->health,
-                        .state     = player->state,
-                        .position  = player->position,
-                        .direction = player->direction
-                    };
-
-                    for (i32 j = 0; j < MAX_PLAYER_COUNT; j++) {
-                        if (players[j].id != PLAYER_INVALID_ID) {
-                            if (!packet_send(players[j].socket, PACKET_TYPE_PLAYER_RESPAWN, &player_respawn_packet)) {
-                                LOG_ERROR("failed to send player health packet");
-                            }
-                        }
-                    }
-                } else {
-                    player->respawn_cooldown -= delta_time;
-                }
-            } else if (player->state == PLAYER_STATE_ROLL) {
-                player->roll_accumulator += delta_time;
-                if (player->roll_accumulator >= PLAYER_ROLL_DURATION) {
-                    player->roll_accumulator = 0.0f;
-                    player->state = PLAYER_STATE_IDLE;
-                    should_update = true;
-                }
-            } else if (player->state == PLAYER_STATE_ATTACK) {
-                player->attack_accumulator += delta_time;
-                if (player->attack_accumulator >= PLAYER_ATTACK_DURATION) {
-                    player->attack_accumulator = 0.0f;
-                    player->state = PLAYER_STATE_IDLE;
-                    should_update = true;
-                }
-            }
+    *out_event_count = count;
+    return offset == size;
+}
 
-            if (should_update) {
-                packet_player_update_t player_update_packet = {
-                    .seq_nr    = player->seq_nr,
-                    .id        = player->id,
-                    .position  = player->position,
-                    .direction = player->direction,
-                    .state     = player->state
-                };
-
-                for (i32 j = 0; j < MAX_PLAYER_COUNT; j++) {
-                    if (players[j].id != PLAYER_INVALID_ID && players[j].id != player->id) {
-                        if (!packet_send(players[j].socket, PACKET_TYPE_PLAYER_UPDATE, &player_update_packet)) {
-                            LOG_ERROR("failed to send player update packet");
-                        }
+/* Applies one tick's client events and advances the game by delta_time, the same for live and replayed sessions */
+static void simulate_tick(client_event_t *events, u64 event_count, f64 delta_time)
+{
+    for (u64 e = 0; e < event_count; e++) {
+        client_event_t *event = &events[e];
+        if (event->type == CLIENT_EVENT_CONNECT) {
+            handle_player_join(event->socket, event->udp_token);
+            continue;
+        }
+        if (event->type == CLIENT_EVENT_DISCONNECT) {
+            handle_client_disconnect(event->socket);
+            continue;
+        }
+
+        if (event->udp_token != 0) {
+            // Datagrams name their connection through the token, which has to be the one it was given
+            player_t *sender = find_player_by_socket(event->socket);
+            if (sender == NULL || sender->udp_token != event->udp_token) {
+                continue;
+            }
+            if (event->packet_type == PACKET_TYPE_PLAYER_INPUT) {
+                for (u32 i = 0; i < event->packet.input.count; i++) {
+                    if (event->packet.input.keypresses[i].id == sender->id) {
+                        handle_player_keypress(sender, &event->packet.input.keypresses[i]);
                     }
                 }
+                continue;
             }
+        }
 
-            // Update cooldowns
-            if (player->attack_cooldown > 0.0f) {
-                player->attack_cooldown -= delta_time;
-            }
-            if (player->roll_cooldown > 0.0f) {
-                player->roll_cooldown -= delta_time;
-            }
+        if (event->packet_type != PACKET_TYPE_PLAYER_KEYPRESS) {
+            apply_client_packet(event->socket, event->packet_type, &event->packet);
+            continue;
+        }
+
+        packet_player_keypress_t *keypress = &event->packet.keypress;
+        player_t *sender = find_packet_sender(event->socket, keypress->id);
+        if (sender != NULL) { // Player may have disconnected while its input was still queued, or it isn't theirs
+            handle_player_keypress(sender, keypress);
         }
     }
+
+    // Check if any damage was dealt to a player, clients see the new health in the next snapshot
+    for (u32 i = 0; i < player_store.count; i++) {
+        u32 damage = player_store.pending_damage[i];
+        player_store.pending_damage[i] = 0;
+        if (damage == 0 || player_store.health[i] <= 0) {
+            continue;
+        }
+
+        player_store.health[i] -= damage;
+        if (player_store.health[i] <= 0) {
+            player_store.states[i] = PLAYER_STATE_DEAD;
+            player_store.respawn_cooldowns[i] = PLAYER_RESPAWN_COOLDOWN;
+
+            player_t *player = id_table_at(&players, i);
+            packet_message_t message_death_packet = {0};
+            message_death_packet.type = MESSAGE_TYPE_SYSTEM;
+            snprintf(message_death_packet.content,
+                     sizeof(message_death_packet.content),
+                     "player <%s> died! respawning in %.2f seconds...",
+                     player->name, PLAYER_RESPAWN_COOLDOWN);
+
+            message_t msg = {0};
+            msg.type = MESSAGE_TYPE_SYSTEM;
+            memcpy(msg.content, message_death_packet.content, strlen(message_death_packet.content));
+            darray_push(messages, msg);
+
+            broadcast_packet(PACKET_TYPE_MESSAGE, &message_death_packet, PLAYER_INVALID_ID);
+        }
+    }
+
+    // Respawned players are refiled under their new chunk along with everyone else before the snapshot
+    player_store_update(&player_store, delta_time);
+
+    send_player_snapshots();
+    tick_number++;
+}
+
+void process_pending_input(f64 delta_time)
+{
+    static client_event_t events[PROCESSED_INPUT_LIMIT_PER_UPDATE]; /* Only used by the tick thread */
+
+    // Drain up to the per-update limit in one pass, the rest is left for the next tick
+    u64 event_count = mpsc_ring_buffer_dequeue_batch(&client_events, events, PROCESSED_INPUT_LIMIT_PER_UPDATE);
+    if (event_count > 0 && input_log.file != NULL) {
+        record_client_events(events, event_count);
+    }
+
+    simulate_tick(events, event_count, delta_time);
 }
 
 void *process_input_queue(void *args)
 {
-    static const u32 us_to_sleep = 1.0f / SERVER_TICK_RATE * 1000 * 1000;
+    // Every tick advances the game by the same amount, the scheduler makes sure they happen that often
     static const f64 delta_time = 1.0 / SERVER_TICK_RATE;
+    f64 chunk_flush_accumulator = 0.0;
+
+    tick_scheduler_t scheduler;
+    tick_scheduler_create(SERVER_TICK_RATE, TICK_CATCH_UP_LIMIT, TICK_REPORT_INTERVAL_SECONDS, &scheduler);
+
     while (running) {
+        tick_scheduler_begin_tick(&scheduler);
+
         process_pending_input(delta_time);
+        // Each I/O thread writes out the packets queued for its own connections
+        for (u32 i = 0; i < SERVER_IO_THREAD_COUNT; i++) {
+            io_thread_wake(&io_threads[i]);
+        }
         net_update(delta_time);
-        usleep(us_to_sleep);
+        datagram_shim_flush();
+
+        chunk_flush_accumulator += delta_time;
+        if (chunk_flush_accumulator >= CHUNK_FLUSH_INTERVAL_SECONDS) {
+            chunk_flush_accumulator = 0.0;
+            chunk_store_flush_dirty();
+        }
+
+        tick_scheduler_end_tick(&scheduler);
     }
 
     return NULL;
 }
 
-static void generate_chunk(i32 x, i32 y, chunk_base_t **out_chunk)
+static void send_chunk_response(const chunk_base_t *chunk, i32 client_socket)
 {
-    f32 *perlin_noise_data = mem_alloc(CHUNK_NUM_TILES * sizeof(f32), MEMORY_TAG_GAME);
-
-    perlin_noise_config_t config = {
-        .pos_x = x * CHUNK_LENGTH,
-        .pos_y = y * CHUNK_LENGTH,
-        .width = CHUNK_LENGTH,
-        .height = CHUNK_LENGTH,
-        .seed = game_world.map.seed,
-        .octave_count = game_world.map.octave_count,
-        .scaling_bias = game_world.map.bias
-    };
-
-    perlin_noise_generate_2d(config, perlin_noise_data);
-
-    chunk_base_t new_chunk = {0};
-    new_chunk.x = x;
-    new_chunk.y = y;
-#if defined(DEBUG)
-    memcpy(new_chunk.noise_data, perlin_noise_data, CHUNK_NUM_TILES * sizeof(f32));
-#endif
-
-    u32 object_count = 0;
-    for (u32 i = 0; i < CHUNK_NUM_TILES; i++) {
-        tile_type_t tile_type = TILE_TYPE_NONE;
-        f32 value = perlin_noise_data[i];
-        if (value < 0.4f) {
-            tile_type = TILE_TYPE_WATER;
-        } else if (value < 0.45f) {
-            tile_type = TILE_TYPE_DIRT;
-        } else if (value < 0.8f) {
-            tile_type = TILE_TYPE_GRASS;
-        } else {
-            tile_type = TILE_TYPE_STONE;
+    if (CHUNK_STREAMING_MODE == CHUNK_STREAMING_MODE_SEED) {
+        // The client already generated the chunk on its own, so an unmodified one needs no answer at all.
+        // A removal racing with this is still applied by the client, its revision is newer than 0
+        packet_chunk_delta_t delta;
+        build_chunk_delta(chunk, &delta);
+        if (delta.revision == 0) {
+            connection_complete_chunk(client_socket, chunk->x, chunk->y, PACKET_TYPE_NONE, NULL);
+            return;
         }
 
-        ASSERT(tile_type > TILE_TYPE_NONE && tile_type < TILE_TYPE_COUNT);
-        new_chunk.tiles[i].type = tile_type;
-        new_chunk.tiles[i].object_index = INVALID_OBJECT_INDEX;
-
-        srand(game_world.map.seed + i * 17 + x * 29 + y * 43);
-        if (tile_type == TILE_TYPE_WATER) {
-            f32 random_value = math_frandom();
-            if (0.0f <= random_value && random_value <= 0.01f) {
-                new_chunk.objects[object_count].type = GAME_OBJECT_TYPE_LILY;
-                new_chunk.tiles[i].object_index = object_count;
-                object_count++;
-            }
-        } else if (tile_type == TILE_TYPE_GRASS) {
-            f32 random_value = math_frandom();
-            if (0.0f <= random_value && random_value <= 0.01f) {
-                new_chunk.objects[object_count].type = GAME_OBJECT_TYPE_BUSH;
-                new_chunk.tiles[i].object_index = object_count;
-                object_count++;
-            }
-        }
+        connection_complete_chunk(client_socket, chunk->x, chunk->y, PACKET_TYPE_CHUNK_DELTA, &delta);
+        return;
     }
 
-    u64 chunks_length = darray_length(chunks);
-    darray_push(chunks, new_chunk);
-    *out_chunk = &chunks[chunks_length];
+    packet_chunk_response_t response;
+    chunk_store_lock_contents();
+    response.chunk = *chunk;
+    chunk_store_unlock_contents();
+    connection_complete_chunk(client_socket, chunk->x, chunk->y, PACKET_TYPE_CHUNK_RESPONSE, &response);
+#if LOG_CHUNK_TRANSACTIONS
+    LOG_TRACE("chunk %i:%i is ready to be sent", chunk->x, chunk->y);
+#endif
+}
 
-#if LOG_CHUNK_MEMORY_FOOTPRINT
+/* State the simulation works on, shared by live and replayed sessions */
+static void simulation_create(void)
 {
-    static u64 prev_size_checkpoint = KiB(40);
-    u64 chunks_allocated_memory_size = darray_capacity(chunks) * sizeof(chunk_base_t);
-    if (chunks_allocated_memory_size > prev_size_checkpoint) {
-        f32 converted_value;
-        const char *unit = get_size_unit(chunks_allocated_memory_size, &converted_value);
-        LOG_INFO("allocated memory size for chunks crossed %0.2f %s", converted_value, unit);
-        prev_size_checkpoint *= 2;
-    }
+    messages = darray_create(sizeof(message_t));
+    id_table_create(sizeof(player_t), PLAYER_TABLE_INITIAL_CAPACITY, &players);
+    interest_grid_create(INTEREST_GRID_INITIAL_CAPACITY, &interest_grid);
+    snapshot_history_reset(&snapshot_history);
+    hashmap_create(PLAYER_TABLE_INITIAL_CAPACITY, &player_ids_by_socket);
 }
-#endif
 
-    mem_free(perlin_noise_data, CHUNK_NUM_TILES * sizeof(f32), MEMORY_TAG_GAME);
+static void simulation_destroy(void)
+{
+    // TODO: Permanently store messages to disk. For now just delete them all
+    darray_destroy(messages);
+    id_table_destroy(&players);
+    interest_grid_destroy(&interest_grid);
+    hashmap_destroy(&player_ids_by_socket);
 }
 
-int main(int argc, char *argv[])
+/* Runs the ticks of a recorded session back to back on the calling thread, without sockets or I/O threads,
+   and reports how fast the simulation went. Chunk requests aren't recorded, so no chunk is ever resident
+   and attacks only hit players */
+static b8 replay_input_log(const char *path)
 {
-    if (argc != 2) {
-        LOG_FATAL("usage: %s port\n", argv[0]);
-        exit(EXIT_FAILURE);
+    static u8 buffer[RECORDED_TICK_MAX_SIZE];
+    static client_event_t events[PROCESSED_INPUT_LIMIT_PER_UPDATE];
+
+    input_log_header_t header;
+    if (!input_log_open(path, &header, &input_log)) {
+        return false;
+    }
+    if (header.tick_rate != SERVER_TICK_RATE) {
+        LOG_WARN("input log was recorded at tick rate %u, replaying it at %u", header.tick_rate, SERVER_TICK_RATE);
     }
 
-    char hostname[256] = {0};
-    gethostname(hostname, 256);
-    LOG_INFO("starting the game server on host '%s'", hostname);
+    replaying = true;
+    game_world.map = header.map;
+    math_random_seed(header.random_seed);
+    connection_system_init();
+    chunk_store_init(CHUNK_STORE_MAX_RESIDENT_CHUNKS);
+    simulation_create();
+
+    const f64 delta_time = 1.0 / SERVER_TICK_RATE;
+    b8 status = true;
+    u64 start_ns = clock_get_absolute_time_ns();
+
+    u64 record_tick;
+    u32 size;
+    while (input_log_read_tick(&input_log, &record_tick, buffer, sizeof(buffer), &size)) {
+        // Ticks without events were left out of the log. Packets are still built and queued, but dropped after every tick
+        while (tick_number < record_tick) {
+            simulate_tick(events, 0, delta_time);
+            connection_discard_pending();
+        }
+        if (size == 0) {
+            continue; // Only marks how long the session ran
+        }
 
-    struct addrinfo hints;
-    struct addrinfo *result, *rp;
+        u64 event_count;
+        if (!load_recorded_events(buffer, size, events, &event_count)) {
+            LOG_ERROR("input log record of tick %llu is damaged", record_tick);
+            status = false;
+            break;
+        }
 
-    memset(&hints, 0, sizeof(hints));
-    hints.ai_socktype = SOCK_STREAM; /* Stream socket */
-    hints.ai_family = AF_UNSPEC;     /* Allow IPv4 or IPv6 */
-    hints.ai_flags = AI_PASSIVE;     /* For wildcard IP addresses */
+        u64 kept_count = 0;
+        for (u64 e = 0; e < event_count; e++) {
+            // Without a UDP socket snapshots keep going to the connection's queue, like before the client's hello
+            if (events[e].type == CLIENT_EVENT_PACKET && events[e].packet_type == PACKET_TYPE_UDP_HELLO) {
+                continue;
+            }
+            // Live, the I/O thread opened the connection when it accepted the socket
+            if (events[e].type == CLIENT_EVENT_CONNECT) {
+                connection_open(events[e].socket, 0);
+            }
+            events[kept_count++] = events[e];
+        }
 
-    i32 status = getaddrinfo(NULL, argv[1], &hints, &result);
-    if (status != 0) {
-        LOG_FATAL("getaddrinfo error: %s", gai_strerror(status));
-        exit(EXIT_FAILURE);
+        simulate_tick(events, kept_count, delta_time);
+        connection_discard_pending();
     }
 
-    for (rp = result; rp != NULL; rp = rp->ai_next) {
-        server_socket = socket(rp->ai_family, rp->ai_socktype, rp->ai_protocol);
-        if (server_socket == -1) {
-            continue;
-        }
+    f64 elapsed_seconds = (f64)(clock_get_absolute_time_ns() - start_ns) / 1000000000.0;
+    LOG_INFO("replayed %llu ticks (%.1f seconds of play) in %.3f seconds: %.0f ticks/s",
+             tick_number, (f64)tick_number / SERVER_TICK_RATE, elapsed_seconds,
+             elapsed_seconds > 0.0 ? tick_number / elapsed_seconds : 0.0);
+    LOG_INFO("input log: %llu records, %llu bytes", input_log.tick_count, input_log.byte_count);
 
-        const char *ip_version = rp->ai_family == AF_INET  ? "IPv4" :
-                                 rp->ai_family == AF_INET6 ? "IPv6" : "UNKNOWN";
-        const char *socktype_str = rp->ai_socktype == SOCK_STREAM ? "TCP" :
-                                   rp->ai_socktype == SOCK_DGRAM  ? "UDP" : "UNKNOWN";
-        LOG_INFO("successfully created an %s %s socket(fd=%d)", ip_version, socktype_str, server_socket);
+    simulation_destroy();
+    chunk_store_shutdown();
+    connection_system_shutdown();
+    input_log_close(&input_log);
 
-        static i32 yes = 1;
-        if (setsockopt(server_socket, SOL_SOCKET, SO_REUSEADDR, (void *)&yes, sizeof(i32)) == -1) {
-            LOG_ERROR("setsockopt reuse address error: %s", strerror(errno));
-        }
+    return status;
+}
 
-        if (bind(server_socket, rp->ai_addr, rp->ai_addrlen) == 0) {
-            LOG_INFO("successfully bound socket(fd=%d)", server_socket);
-            break;
-        } else {
-            LOG_ERROR("failed to bind socket with fd=%d", server_socket);
-            close(server_socket);
-        }
+int main(int argc, char *argv[])
+{
+    if (argc == 3 && strcmp(argv[1], "--replay") == 0) {
+        return replay_input_log(argv[2]) ? EXIT_SUCCESS : EXIT_FAILURE;
     }
 
-    if (rp == NULL) { /* No address succeeded */
-        LOG_FATAL("could not bind to port %s", argv[1]);
+    if (argc != 2 && argc != 3) {
+        LOG_FATAL("usage: %s port [world directory]\n       %s --replay input_log\n", argv[0], argv[0]);
         exit(EXIT_FAILURE);
     }
 
-    if (listen(server_socket, SERVER_BACKLOG) == -1) {
-        LOG_FATAL("failed to start listening: %s", strerror(errno));
-        exit(EXIT_FAILURE);
-    } else {
-        char ip_buffer[INET6_ADDRSTRLEN] = {0};
-        inet_ntop(rp->ai_family, get_in_addr(rp->ai_addr), ip_buffer, INET6_ADDRSTRLEN);
-        LOG_INFO("socket listening on %s port %s", ip_buffer, argv[1]);
+    const char *world_directory = argc == 3 ? argv[2] : SERVER_DEFAULT_WORLD_DIRECTORY;
+
+    const char *shim_spec = getenv(DATAGRAM_SHIM_ENV);
+    if (shim_spec != NULL) {
+        datagram_shim_config_t shim_config;
+        if (!datagram_shim_parse(shim_spec, &shim_config)) {
+            LOG_FATAL("invalid %s='%s'", DATAGRAM_SHIM_ENV, shim_spec);
+            exit(EXIT_FAILURE);
+        }
+        datagram_shim_configure(&shim_config);
+        LOG_WARN("UDP shim active: loss=%.2f latency=%ums jitter=%ums", shim_config.loss, shim_config.latency_ms, shim_config.jitter_ms);
     }
 
-    freeaddrinfo(result);
+    char hostname[256] = {0};
+    gethostname(hostname, 256);
+    LOG_INFO("starting the game server on host '%s'", hostname);
+
+    for (u32 i = 0; i < SERVER_IO_THREAD_COUNT; i++) {
+        if (!io_thread_init(&io_threads[i], i, argv[1])) {
+            LOG_FATAL("failed to initialize I/O thread %u", i);
+            exit(EXIT_FAILURE);
+        }
+    }
+    LOG_INFO("listening on port %s with %u I/O threads", argv[1], SERVER_IO_THREAD_COUNT);
 
-    server_pfd_init(5, &fds);
-    server_pfd_add(&fds, server_socket);
+    connection_system_init();
 
-    input_ring_buffer = ring_buffer_reserve(INPUT_RING_BUFFER_CAPACITY, sizeof(packet_player_keypress_t));
-    messages = darray_create(sizeof(message_t));
+    mpsc_ring_buffer_create(INPUT_RING_BUFFER_CAPACITY, sizeof(client_event_t), &client_events);
+    simulation_create();
 
     // Initialize game world
-    game_world.map.seed = math_random();
-    game_world.map.octave_count = 2;
-    game_world.map.bias = 2.0f;
+    if (!region_storage_init(world_directory)) {
+        LOG_FATAL("failed to initialize world storage in '%s'", world_directory);
+        exit(EXIT_FAILURE);
+    }
 
-    chunks = darray_create(sizeof(chunk_base_t));
+    if (region_storage_load_map(&game_world.map)) {
+        LOG_INFO("loaded world from '%s' with seed=%u", world_directory, game_world.map.seed);
+    } else {
+        game_world.map.seed = math_random();
+        game_world.map.octave_count = 2;
+        game_world.map.bias = 2.0f;
+        if (!region_storage_save_map(&game_world.map)) {
+            LOG_FATAL("failed to save new world to '%s'", world_directory);
+            exit(EXIT_FAILURE);
+        }
+        LOG_INFO("created new world in '%s' with seed=%u", world_directory, game_world.map.seed);
+    }
 
-    struct sigaction sa = {0};
-    sa.sa_flags = SA_RESTART; // Restart functions interruptable by EINTR like poll()
-    sa.sa_handler = &signal_handler;
-    sigaction(SIGINT, &sa, NULL);
+    // Every thread started from here on inherits the blocked mask, so termination signals
+    // are only ever picked up by the main thread waiting on them below
+    sigset_t termination_signals;
+    sigemptyset(&termination_signals);
+    sigaddset(&termination_signals, SIGINT);
+    sigaddset(&termination_signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &termination_signals, NULL);
+
+    chunk_store_init(CHUNK_STORE_MAX_RESIDENT_CHUNKS);
+    chunk_generator_init(game_world.map, CHUNK_GENERATOR_WORKER_COUNT, send_chunk_response);
+
+    // Seeded only now, creating the terrain generator reseeds rand for its permutation table
+    const char *input_log_path = getenv(INPUT_LOG_ENV);
+    if (input_log_path != NULL) {
+        input_log_header_t header = {
+            .tick_rate   = SERVER_TICK_RATE,
+            .random_seed = (u32)clock_get_absolute_time_ns(),
+            .map         = game_world.map
+        };
+        if (!input_log_create(input_log_path, &header, &input_log)) {
+            LOG_FATAL("failed to start recording input");
+            exit(EXIT_FAILURE);
+        }
+        math_random_seed(header.random_seed);
+        LOG_WARN("recording input to '%s'", input_log_path);
+    }
 
     running = true;
 
     pthread_t input_queue_processing_thread;
     pthread_create(&input_queue_processing_thread, NULL, process_input_queue, NULL);
 
-    LOG_INFO("server tick rate: %u", SERVER_TICK_RATE);
-
-    while (running) {
-        i32 num_events = poll(fds.fds, fds.count, POLL_INFINITE_TIMEOUT);
+    for (u32 i = 0; i < SERVER_IO_THREAD_COUNT; i++) {
+        pthread_create(&io_threads[i].thread, NULL, io_thread_run, &io_threads[i]);
+    }
 
-        if (num_events == -1) {
-            if (errno == EINTR) {
-                LOG_TRACE("interrupted 'poll' system call");
-                break;
-            }
-            LOG_FATAL("poll error: %s", strerror(errno));
-            exit(EXIT_FAILURE);
-        }
+    LOG_INFO("server tick rate: %u", SERVER_TICK_RATE);
 
-        for (i32 i = 0; i < fds.count; i++) {
-            if (fds.fds[i].revents & POLLIN) {
-                if (fds.fds[i].fd == server_socket) { /* New connection request */
-                    handle_new_connection_request_event();
-                    break;
-                } else { /* Client trying to send data */
-                    handle_client_event(fds.fds[i].fd);
-                }
-            }
-        }
-    }
+    i32 signal_number;
+    sigwait(&termination_signals, &signal_number);
 
     LOG_INFO("server shutting down");
+    running = false;
 
-    // TODO: Permanently store messages to disk. For now just delete them all
-    darray_destroy(messages);
-
-    server_pfd_shutdown(&fds);
+    for (u32 i = 0; i < SERVER_IO_THREAD_COUNT; i++) {
+        io_thread_wake(&io_threads[i]);
+        pthread_join(io_threads[i].thread, NULL);
+        io_thread_shutdown(&io_threads[i]);
+    }
+    LOG_INFO("shut down %u I/O threads", SERVER_IO_THREAD_COUNT);
 
     pthread_join(input_queue_processing_thread, NULL);
     LOG_INFO("shut down input queue processing thread");
 
-    if (close(server_socket) == -1) {
-        LOG_ERROR("error while closing the socket: %s", strerror(errno));
+    if (input_log.file != NULL) {
+        // A record without events marks how long the session ran
+        input_log_write_tick(&input_log, tick_number, NULL, 0);
+        LOG_INFO("recorded %llu ticks of input, %llu bytes", tick_number, input_log.byte_count);
+        input_log_close(&input_log);
     }
 
+    simulation_destroy();
+
+    chunk_generator_shutdown();
+    LOG_INFO("saving %u modified chunks", chunk_store_flush_dirty());
+
+    chunk_store_stats_t chunk_stats;
+    chunk_store_get_stats(&chunk_stats);
+    LOG_INFO("chunk store: resident=%llu hits=%llu misses=%llu evictions=%llu writebacks=%llu",
+             chunk_stats.resident, chunk_stats.hits, chunk_stats.misses, chunk_stats.evictions, chunk_stats.writebacks);
+
+    connection_system_shutdown();
+    datagram_shim_shutdown();
+    mpsc_ring_buffer_destroy(&client_events);
+    chunk_store_shutdown();
+    region_storage_shutdown();
+
     return EXIT_SUCCESS;
 }
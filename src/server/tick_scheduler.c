@@ -0,0 +1,104 @@
+#include "tick_scheduler.h"
+
+#include <time.h>
+#include <errno.h>
+#include <stdint.h>
+
+#include "config.h"
+#include "common/clock.h"
+#include "common/logger.h"
+#include "common/asserts.h"
+#include "common/memory/memutils.h"
+
+#define NS_PER_SECOND 1000000000ULL
+#define NS_PER_MS     1000000.0
+
+static void tick_stats_reset(tick_stats_t *stats)
+{
+    mem_zero(stats, sizeof(tick_stats_t));
+    stats->slack_ns_min = UINT64_MAX;
+}
+
+static void tick_scheduler_report(tick_scheduler_t *scheduler, u64 now)
+{
+    tick_stats_t *stats = &scheduler->stats;
+    if (stats->ticks > 0) {
+#if LOG_TICK_STATS
+        f64 interval_seconds = (f64)(now - scheduler->last_report_ns) / NS_PER_SECOND;
+        LOG_INFO("tick: %.1f Hz, work avg=%.3fms max=%.3fms, min slack=%.3fms, overruns=%u, dropped=%u",
+                 stats->ticks / interval_seconds,
+                 stats->work_ns_total / (f64)stats->ticks / NS_PER_MS,
+                 stats->work_ns_max / NS_PER_MS,
+                 stats->slack_ns_min == UINT64_MAX ? 0.0 : stats->slack_ns_min / NS_PER_MS,
+                 stats->overruns, stats->dropped_ticks);
+#endif
+    }
+
+    tick_stats_reset(stats);
+    scheduler->last_report_ns = now;
+}
+
+void tick_scheduler_create(u32 tick_rate, u32 catch_up_limit, f64 report_interval_seconds, tick_scheduler_t *out_scheduler)
+{
+    ASSERT(out_scheduler);
+    ASSERT(tick_rate > 0);
+
+    u64 now = clock_get_absolute_time_ns();
+    out_scheduler->tick_duration_ns = NS_PER_SECOND / tick_rate;
+    out_scheduler->next_tick_ns = now;
+    out_scheduler->tick_start_ns = now;
+    out_scheduler->catch_up_limit = catch_up_limit;
+    out_scheduler->report_interval_ns = (u64)(report_interval_seconds * NS_PER_SECOND);
+    out_scheduler->last_report_ns = now;
+    tick_stats_reset(&out_scheduler->stats);
+}
+
+void tick_scheduler_begin_tick(tick_scheduler_t *scheduler)
+{
+    ASSERT(scheduler);
+
+    scheduler->tick_start_ns = clock_get_absolute_time_ns();
+}
+
+void tick_scheduler_end_tick(tick_scheduler_t *scheduler)
+{
+    ASSERT(scheduler);
+
+    tick_stats_t *stats = &scheduler->stats;
+    u64 now = clock_get_absolute_time_ns();
+    u64 work_ns = now - scheduler->tick_start_ns;
+    stats->ticks++;
+    stats->work_ns_total += work_ns;
+    if (work_ns > stats->work_ns_max) {
+        stats->work_ns_max = work_ns;
+    }
+
+    scheduler->next_tick_ns += scheduler->tick_duration_ns;
+    if (now >= scheduler->next_tick_ns) {
+        stats->overruns++;
+        stats->slack_ns_min = 0;
+
+        // Behind by more ticks than may be caught up on, the rest of the game time is lost
+        u64 ticks_behind = (now - scheduler->next_tick_ns) / scheduler->tick_duration_ns;
+        if (ticks_behind >= scheduler->catch_up_limit) {
+            stats->dropped_ticks += ticks_behind;
+            scheduler->next_tick_ns = now;
+        }
+    } else {
+        u64 slack_ns = scheduler->next_tick_ns - now;
+        if (slack_ns < stats->slack_ns_min) {
+            stats->slack_ns_min = slack_ns;
+        }
+    }
+
+    if (now - scheduler->last_report_ns >= scheduler->report_interval_ns) {
+        tick_scheduler_report(scheduler, now);
+    }
+
+    // Absolute deadline, so neither the work above nor an interrupted sleep shift the schedule
+    struct timespec deadline = {
+        .tv_sec  = scheduler->next_tick_ns / NS_PER_SECOND,
+        .tv_nsec = scheduler->next_tick_ns % NS_PER_SECOND
+    };
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR);
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "defines.h"
+
+/********************************************************************************
+ *  Fixed-timestep scheduler for the simulation thread. Tick deadlines are      *
+ *  absolute points on the monotonic clock, each one a tick duration after the  *
+ *  previous deadline rather than after the previous tick finished, so the      *
+ *  time spent working never stretches the tick. A late tick is followed by     *
+ *  the missed ones back to back, but never more than the catch-up limit -      *
+ *  past that the backlog is dropped and the schedule restarts from now.        *
+ ********************************************************************************/
+
+typedef struct {
+    u32 ticks;
+    u32 overruns;       /* Ticks which ended after the next one was due */
+    u32 dropped_ticks;  /* Ticks given up on because catching up would have taken too long */
+    u64 work_ns_total;
+    u64 work_ns_max;
+    u64 slack_ns_min;   /* Least time left before a deadline, 0 once a tick overran */
+} tick_stats_t;
+
+typedef struct {
+    u64 tick_duration_ns;
+    u64 next_tick_ns;   /* Deadline of the next tick */
+    u64 tick_start_ns;
+    u32 catch_up_limit;
+    tick_stats_t stats; /* Since the last report */
+    u64 report_interval_ns;
+    u64 last_report_ns;
+} tick_scheduler_t;
+
+void tick_scheduler_create(u32 tick_rate, u32 catch_up_limit, f64 report_interval_seconds, tick_scheduler_t *out_scheduler);
+
+/* Call right before the tick's work */
+void tick_scheduler_begin_tick(tick_scheduler_t *scheduler);
+/* Call after the tick's work, sleeps until the next tick is due */
+void tick_scheduler_end_tick(tick_scheduler_t *scheduler);
@@ -3,8 +3,20 @@
 #include "src/containers/stack_tests.h"
 #include "src/containers/darray_tests.h"
 #include "src/containers/ring_buffer_tests.h"
+#include "src/containers/mpsc_ring_buffer_tests.h"
+#include "src/containers/hashmap_tests.h"
+#include "src/containers/id_table_tests.h"
 
 #include "src/memory/arena_allocator_tests.h"
+#include "src/memory/pool_allocator_tests.h"
+
+#include "src/noise/perlin_noise_tests.h"
+
+#include "src/network/packet_tests.h"
+#include "src/network/datagram_tests.h"
+
+#include "src/storage/region_file_tests.h"
+#include "src/storage/chunk_store_tests.h"
 
 int main(void)
 {
@@ -13,8 +25,20 @@ int main(void)
     stack_register_tests();
     darray_register_tests();
     ring_buffer_register_tests();
+    mpsc_ring_buffer_register_tests();
+    hashmap_register_tests();
+    id_table_register_tests();
 
     arena_allocator_register_tests();
+    pool_allocator_register_tests();
+
+    perlin_noise_register_tests();
+
+    packet_register_tests();
+    datagram_register_tests();
+
+    region_file_register_tests();
+    chunk_store_register_tests();
 
     test_manager_run_all_tests();
     test_manager_shutdown();
@@ -0,0 +1,95 @@
+#include "../../expect.h"
+#include "../../test_manager.h"
+
+#include "common/containers/hashmap.h"
+
+b8 hashmap_create_and_destroy(void)
+{
+    hashmap_t hashmap;
+    hashmap_create(10, &hashmap);
+    expect_true(hashmap.entries != 0);
+    expect_equal(hashmap.capacity, 16);
+    expect_equal(hashmap_length(&hashmap), 0);
+
+    hashmap_destroy(&hashmap);
+    expect_true(hashmap.entries == 0);
+    expect_equal(hashmap.capacity, 0);
+
+    return true;
+}
+
+b8 hashmap_set_get_and_overwrite(void)
+{
+    hashmap_t hashmap;
+    hashmap_create(4, &hashmap);
+
+    u64 value = 0;
+    expect_false(hashmap_get(&hashmap, 42, &value));
+
+    hashmap_set(&hashmap, 42, 1);
+    hashmap_set(&hashmap, 0, 2);
+    hashmap_set(&hashmap, 0xFFFFFFFFFFFFFFFFULL, 3);
+    expect_equal(hashmap_length(&hashmap), 3);
+
+    expect_true(hashmap_get(&hashmap, 42, &value));
+    expect_equal(value, 1);
+    expect_true(hashmap_get(&hashmap, 0, &value));
+    expect_equal(value, 2);
+    expect_true(hashmap_get(&hashmap, 0xFFFFFFFFFFFFFFFFULL, &value));
+    expect_equal(value, 3);
+
+    hashmap_set(&hashmap, 42, 100);
+    expect_equal(hashmap_length(&hashmap), 3);
+    expect_true(hashmap_get(&hashmap, 42, &value));
+    expect_equal(value, 100);
+
+    hashmap_destroy(&hashmap);
+
+    return true;
+}
+
+b8 hashmap_grow_and_remove(void)
+{
+    hashmap_t hashmap;
+    hashmap_create(2, &hashmap);
+
+    const u64 count = 10000;
+    for (u64 i = 0; i < count; i++) {
+        hashmap_set(&hashmap, i * 7919, i);
+    }
+
+    expect_equal(hashmap_length(&hashmap), count);
+    expect_true(hashmap.capacity >= count);
+
+    // Remove every other key, the remaining ones must still be reachable through the shifted clusters
+    for (u64 i = 0; i < count; i += 2) {
+        expect_true(hashmap_remove(&hashmap, i * 7919));
+    }
+    expect_false(hashmap_remove(&hashmap, 0));
+    expect_equal(hashmap_length(&hashmap), count / 2);
+
+    for (u64 i = 0; i < count; i++) {
+        u64 value = 0;
+        if (i % 2 == 0) {
+            expect_false(hashmap_get(&hashmap, i * 7919, &value));
+        } else {
+            expect_true(hashmap_get(&hashmap, i * 7919, &value));
+            expect_equal(value, i);
+        }
+    }
+
+    hashmap_clear(&hashmap);
+    expect_equal(hashmap_length(&hashmap), 0);
+    expect_false(hashmap_get(&hashmap, 7919, 0));
+
+    hashmap_destroy(&hashmap);
+
+    return true;
+}
+
+void hashmap_register_tests(void)
+{
+    test_manager_register_test(hashmap_create_and_destroy, "hashmap: create and destroy");
+    test_manager_register_test(hashmap_set_get_and_overwrite, "hashmap: set, get and overwrite");
+    test_manager_register_test(hashmap_grow_and_remove, "hashmap: grow and remove");
+}
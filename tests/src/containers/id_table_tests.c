@@ -0,0 +1,85 @@
+#include "../../expect.h"
+#include "../../test_manager.h"
+
+#include "common/containers/id_table.h"
+
+typedef struct {
+    u32 id;
+    f32 value;
+} id_table_test_element_t;
+
+b8 id_table_insert_and_find(void)
+{
+    id_table_t table;
+    id_table_create(sizeof(id_table_test_element_t), 2, &table);
+    expect_equal(id_table_length(&table), 0);
+    expect_true(id_table_find(&table, 1000) == 0);
+
+    for (u32 i = 0; i < 100; i++) {
+        id_table_test_element_t *element = id_table_insert(&table, 1000 + i);
+        expect_true(element != 0);
+        expect_equal(element->id, 0);
+        element->id = 1000 + i;
+        element->value = i * 0.5f;
+    }
+    expect_equal(id_table_length(&table), 100);
+    expect_true(table.capacity >= 100);
+
+    // Duplicate ids are rejected
+    expect_true(id_table_insert(&table, 1042) == 0);
+    expect_equal(id_table_length(&table), 100);
+
+    for (u32 i = 0; i < 100; i++) {
+        id_table_test_element_t *element = id_table_find(&table, 1000 + i);
+        expect_true(element != 0);
+        expect_equal(element->id, 1000 + i);
+        expect_true(element->value == i * 0.5f);
+    }
+
+    id_table_destroy(&table);
+    expect_true(table.elements == 0);
+
+    return true;
+}
+
+b8 id_table_remove_keeps_table_dense(void)
+{
+    id_table_t table;
+    id_table_create(sizeof(id_table_test_element_t), 8, &table);
+
+    for (u32 i = 1; i <= 8; i++) {
+        id_table_test_element_t *element = id_table_insert(&table, i);
+        element->id = i;
+    }
+
+    expect_true(id_table_remove(&table, 3));
+    expect_false(id_table_remove(&table, 3));
+    expect_true(id_table_remove(&table, 8)); /* Last element, nothing has to move */
+    expect_true(id_table_remove(&table, 1));
+    expect_equal(id_table_length(&table), 5);
+
+    // Every remaining element is reachable by id and sits in the first 'length' indices
+    u32 id_sum = 0;
+    for (u64 i = 0; i < id_table_length(&table); i++) {
+        id_table_test_element_t *element = id_table_at(&table, i);
+        expect_true(id_table_find(&table, element->id) == element);
+        expect_equal(id_table_index_of(&table, element), i);
+        id_sum += element->id;
+    }
+    expect_equal(id_sum, 2 + 4 + 5 + 6 + 7);
+
+    id_table_clear(&table);
+    expect_equal(id_table_length(&table), 0);
+    expect_true(id_table_find(&table, 2) == 0);
+    expect_true(id_table_insert(&table, 2) != 0);
+
+    id_table_destroy(&table);
+
+    return true;
+}
+
+void id_table_register_tests(void)
+{
+    test_manager_register_test(id_table_insert_and_find, "id table: insert and find");
+    test_manager_register_test(id_table_remove_keeps_table_dense, "id table: remove keeps table dense");
+}
@@ -0,0 +1,3 @@
+#pragma once
+
+void id_table_register_tests(void);
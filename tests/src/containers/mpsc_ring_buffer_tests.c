@@ -0,0 +1,165 @@
+#include "../../expect.h"
+#include "../../test_manager.h"
+
+#include <sched.h>
+#include <pthread.h>
+
+#include "common/containers/mpsc_ring_buffer.h"
+
+b8 mpsc_ring_buffer_create_and_destroy(void)
+{
+    mpsc_ring_buffer_t ring_buffer;
+    mpsc_ring_buffer_create(5, sizeof(i32), &ring_buffer);
+    expect_true(ring_buffer.cells != 0);
+    expect_equal(ring_buffer.capacity, 8);
+    expect_equal(ring_buffer.stride, sizeof(i32));
+    expect_equal(mpsc_ring_buffer_length(&ring_buffer), 0);
+
+    mpsc_ring_buffer_destroy(&ring_buffer);
+    expect_true(ring_buffer.cells == 0);
+    expect_equal(ring_buffer.capacity, 0);
+    expect_equal(ring_buffer.stride, 0);
+
+    return true;
+}
+
+b8 mpsc_ring_buffer_enqueue_and_dequeue(void)
+{
+    struct mydata {
+        i32 foo;
+        i64 bar;
+    };
+
+    mpsc_ring_buffer_t ring_buffer;
+    mpsc_ring_buffer_create(4, sizeof(struct mydata), &ring_buffer);
+
+    for (i32 i = 0; i < 4; i++) {
+        struct mydata md = { .foo = i, .bar = 100 + i };
+        expect_true(mpsc_ring_buffer_enqueue(&ring_buffer, &md));
+    }
+
+    expect_equal(mpsc_ring_buffer_length(&ring_buffer), 4);
+
+    struct mydata overflow = { .foo = 4, .bar = 104 };
+    expect_false(mpsc_ring_buffer_enqueue(&ring_buffer, &overflow));
+
+    for (i32 i = 0; i < 4; i++) {
+        struct mydata omd = {0};
+        expect_true(mpsc_ring_buffer_dequeue(&ring_buffer, &omd));
+        expect_equal(omd.foo, i);
+        expect_equal(omd.bar, 100 + i);
+    }
+
+    struct mydata omd = {0};
+    expect_false(mpsc_ring_buffer_dequeue(&ring_buffer, &omd));
+    expect_equal(mpsc_ring_buffer_length(&ring_buffer), 0);
+
+    mpsc_ring_buffer_destroy(&ring_buffer);
+
+    return true;
+}
+
+b8 mpsc_ring_buffer_dequeue_batch_wraps_around(void)
+{
+    mpsc_ring_buffer_t ring_buffer;
+    mpsc_ring_buffer_create(8, sizeof(u32), &ring_buffer);
+
+    u32 next_value = 0;
+    u32 expected_value = 0;
+    u32 out[8];
+
+    // Interleave pushes and partial batch drains so head and tail lap the buffer several times
+    for (u32 round = 0; round < 10; round++) {
+        for (u32 i = 0; i < 6; i++) {
+            expect_true(mpsc_ring_buffer_enqueue(&ring_buffer, &next_value));
+            next_value++;
+        }
+
+        u64 count = mpsc_ring_buffer_dequeue_batch(&ring_buffer, out, 4);
+        expect_equal(count, 4);
+        for (u64 i = 0; i < count; i++) {
+            expect_equal(out[i], expected_value);
+            expected_value++;
+        }
+
+        count = mpsc_ring_buffer_dequeue_batch(&ring_buffer, out, 8);
+        expect_equal(count, 2);
+        for (u64 i = 0; i < count; i++) {
+            expect_equal(out[i], expected_value);
+            expected_value++;
+        }
+    }
+
+    expect_equal(mpsc_ring_buffer_dequeue_batch(&ring_buffer, out, 8), 0);
+
+    mpsc_ring_buffer_destroy(&ring_buffer);
+
+    return true;
+}
+
+#define PRODUCER_COUNT 4
+#define ELEMENTS_PER_PRODUCER 20000
+
+typedef struct {
+    mpsc_ring_buffer_t *ring_buffer;
+    u32 producer_id;
+} producer_args_t;
+
+static void *producer_thread(void *args)
+{
+    producer_args_t *producer = args;
+    for (u32 i = 0; i < ELEMENTS_PER_PRODUCER; i++) {
+        u32 value[2] = { producer->producer_id, i };
+        while (!mpsc_ring_buffer_enqueue(producer->ring_buffer, value)) {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+b8 mpsc_ring_buffer_multiple_producers(void)
+{
+    mpsc_ring_buffer_t ring_buffer;
+    mpsc_ring_buffer_create(64, sizeof(u32) * 2, &ring_buffer);
+
+    pthread_t threads[PRODUCER_COUNT];
+    producer_args_t args[PRODUCER_COUNT];
+    for (u32 i = 0; i < PRODUCER_COUNT; i++) {
+        args[i] = (producer_args_t){ .ring_buffer = &ring_buffer, .producer_id = i };
+        pthread_create(&threads[i], NULL, producer_thread, &args[i]);
+    }
+
+    // Every producer's elements must arrive exactly once and in the order they were pushed
+    u32 next_expected[PRODUCER_COUNT] = {0};
+    u32 received = 0;
+    u32 batch[16][2];
+    while (received < PRODUCER_COUNT * ELEMENTS_PER_PRODUCER) {
+        u64 count = mpsc_ring_buffer_dequeue_batch(&ring_buffer, batch, 16);
+        for (u64 i = 0; i < count; i++) {
+            u32 producer_id = batch[i][0];
+            expect_true(producer_id < PRODUCER_COUNT);
+            expect_equal(batch[i][1], next_expected[producer_id]);
+            next_expected[producer_id]++;
+        }
+        received += count;
+    }
+
+    for (u32 i = 0; i < PRODUCER_COUNT; i++) {
+        pthread_join(threads[i], NULL);
+        expect_equal(next_expected[i], ELEMENTS_PER_PRODUCER);
+    }
+
+    expect_equal(mpsc_ring_buffer_length(&ring_buffer), 0);
+
+    mpsc_ring_buffer_destroy(&ring_buffer);
+
+    return true;
+}
+
+void mpsc_ring_buffer_register_tests(void)
+{
+    test_manager_register_test(mpsc_ring_buffer_create_and_destroy, "mpsc ring buffer: create and destroy");
+    test_manager_register_test(mpsc_ring_buffer_enqueue_and_dequeue, "mpsc ring buffer: enqueue and dequeue");
+    test_manager_register_test(mpsc_ring_buffer_dequeue_batch_wraps_around, "mpsc ring buffer: batch dequeue wraps around");
+    test_manager_register_test(mpsc_ring_buffer_multiple_producers, "mpsc ring buffer: multiple producers");
+}
@@ -0,0 +1,3 @@
+#pragma once
+
+void mpsc_ring_buffer_register_tests(void);
@@ -0,0 +1,80 @@
+#include "../../expect.h"
+#include "../../test_manager.h"
+
+#include "common/memory/pool_allocator.h"
+
+b8 pool_allocator_create_and_destroy(void)
+{
+    pool_allocator_t allocator;
+    pool_allocator_create(sizeof(u32), 8, &allocator);
+
+    expect_equal(allocator.block_size, 16);
+    expect_equal(allocator.blocks_per_slab, 8);
+    expect_equal(allocator.slab_count, 0);
+    expect_equal(allocator.allocated_count, 0);
+
+    pool_allocator_destroy(&allocator);
+    expect_equal(allocator.block_size, 0);
+    expect_true(allocator.slabs == 0);
+
+    return true;
+}
+
+b8 pool_allocator_blocks_stay_valid_across_slabs(void)
+{
+    typedef struct {
+        u64 id;
+        u8 payload[100];
+    } item_t;
+
+    pool_allocator_t allocator;
+    pool_allocator_create(sizeof(item_t), 4, &allocator);
+
+    item_t *items[20];
+    for (u64 i = 0; i < 20; i++) {
+        items[i] = pool_allocator_allocate(&allocator);
+        expect_not_equal(items[i], 0);
+        expect_equal(items[i]->id, 0);
+        items[i]->id = i;
+    }
+
+    expect_equal(allocator.slab_count, 5);
+    expect_equal(allocator.allocated_count, 20);
+
+    // Earlier blocks are untouched by the slabs added after them
+    for (u64 i = 0; i < 20; i++) {
+        expect_equal(items[i]->id, i);
+    }
+
+    pool_allocator_destroy(&allocator);
+    return true;
+}
+
+b8 pool_allocator_reuses_freed_blocks(void)
+{
+    pool_allocator_t allocator;
+    pool_allocator_create(sizeof(u64), 4, &allocator);
+
+    u64 *first = pool_allocator_allocate(&allocator);
+    u64 *second = pool_allocator_allocate(&allocator);
+    *second = 1234;
+
+    pool_allocator_free(&allocator, first);
+    expect_equal(allocator.allocated_count, 1);
+
+    u64 *third = pool_allocator_allocate(&allocator);
+    expect_true(third == first);
+    expect_equal(*third, 0);
+    expect_equal(*second, 1234);
+    expect_equal(allocator.slab_count, 1);
+
+    pool_allocator_destroy(&allocator);
+    return true;
+}
+
+void pool_allocator_register_tests(void)
+{
+    test_manager_register_test(pool_allocator_create_and_destroy, "pool allocator: create and destroy");
+    test_manager_register_test(pool_allocator_blocks_stay_valid_across_slabs, "pool allocator: blocks stay valid across slabs");
+    test_manager_register_test(pool_allocator_reuses_freed_blocks, "pool allocator: reuses freed blocks");
+}
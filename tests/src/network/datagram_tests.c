@@ -0,0 +1,141 @@
+#include "../../expect.h"
+#include "../../test_manager.h"
+
+#include <unistd.h>
+#include <string.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "common/net.h"
+#include "common/datagram.h"
+
+/* Two UDP sockets on loopback, the first one connected to the second */
+static b8 datagram_test_open_pair(i32 *out_sender, i32 *out_receiver)
+{
+    struct sockaddr_in address = {0};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t address_length = sizeof(address);
+
+    *out_receiver = socket(AF_INET, SOCK_DGRAM, 0);
+    *out_sender = socket(AF_INET, SOCK_DGRAM, 0);
+    return *out_receiver != -1 && *out_sender != -1 &&
+           bind(*out_receiver, (struct sockaddr *)&address, sizeof(address)) == 0 &&
+           getsockname(*out_receiver, (struct sockaddr *)&address, &address_length) == 0 &&
+           connect(*out_sender, (struct sockaddr *)&address, address_length) == 0;
+}
+
+static u32 datagram_test_count_received(i32 receiver, u64 token)
+{
+    u8 buffer[DATAGRAM_MAX_SIZE];
+    u32 count = 0;
+
+    // Loopback delivers synchronously, whatever was sent is already waiting
+    i64 size;
+    while ((size = net_recv_from(receiver, buffer, sizeof(buffer), NULL, NULL)) > 0) {
+        u64 received_token;
+        u32 type, payload_size;
+        const u8 *payload;
+        packet_udp_hello_t hello;
+        if (datagram_decode(buffer, (u32)size, &received_token, &type, &payload, &payload_size) &&
+            received_token == token && type == PACKET_TYPE_UDP_HELLO &&
+            packet_deserialize(type, payload, payload_size, &hello)) {
+            count++;
+        }
+    }
+
+    return count;
+}
+
+b8 datagram_encode_decode_round_trip(void)
+{
+    packet_udp_hello_t hello = { .time = 0x0102030405060708 };
+    u8 buffer[DATAGRAM_MAX_SIZE];
+    u32 size = datagram_encode(0xabcdef0012345678, PACKET_TYPE_UDP_HELLO, &hello, buffer, sizeof(buffer));
+    expect_equal(size, sizeof(u64) + sizeof(packet_header_t) + sizeof(u64));
+
+    u64 token;
+    u32 type, payload_size;
+    const u8 *payload;
+    expect_true(datagram_decode(buffer, size, &token, &type, &payload, &payload_size));
+    expect_equal(token, 0xabcdef0012345678);
+    expect_equal(type, PACKET_TYPE_UDP_HELLO);
+
+    packet_udp_hello_t result;
+    expect_true(packet_deserialize(type, payload, payload_size, &result));
+    expect_equal(result.time, hello.time);
+
+    // Truncated or padded datagrams, and a buffer too small to encode into
+    expect_false(datagram_decode(buffer, size - 1, &token, &type, &payload, &payload_size));
+    expect_false(datagram_decode(buffer, sizeof(u64), &token, &type, &payload, &payload_size));
+    buffer[size] = 0;
+    expect_false(datagram_decode(buffer, size + 1, &token, &type, &payload, &payload_size));
+    expect_equal(datagram_encode(1, PACKET_TYPE_UDP_HELLO, &hello, buffer, size - 1), 0);
+
+    return true;
+}
+
+b8 datagram_shim_parse_spec(void)
+{
+    datagram_shim_config_t config;
+    expect_true(datagram_shim_parse("loss=0.25,latency=50,jitter=20,seed=7", &config));
+    expect_true(config.loss == 0.25f);
+    expect_equal(config.latency_ms, 50);
+    expect_equal(config.jitter_ms, 20);
+    expect_equal(config.seed, 7);
+
+    expect_true(datagram_shim_parse("latency=10", &config));
+    expect_true(config.loss == 0.0f);
+    expect_equal(config.latency_ms, 10);
+
+    expect_false(datagram_shim_parse("loss=2", &config));
+    expect_false(datagram_shim_parse("delay=10", &config));
+    expect_false(datagram_shim_parse("loss", &config));
+
+    return true;
+}
+
+b8 datagram_shim_drops_and_delays(void)
+{
+    i32 sender, receiver;
+    expect_true(datagram_test_open_pair(&sender, &receiver));
+    packet_udp_hello_t hello = { .time = 1 };
+
+    datagram_shim_config_t config = { .loss = 1.0f, .seed = 1 };
+    datagram_shim_configure(&config);
+    for (u32 i = 0; i < 10; i++) {
+        expect_true(datagram_send(sender, 42, PACKET_TYPE_UDP_HELLO, &hello, NULL, 0));
+    }
+    expect_equal(datagram_test_count_received(receiver, 42), 0);
+
+    config = (datagram_shim_config_t){ .latency_ms = 20, .seed = 1 };
+    datagram_shim_configure(&config);
+    for (u32 i = 0; i < 10; i++) {
+        expect_true(datagram_send(sender, 42, PACKET_TYPE_UDP_HELLO, &hello, NULL, 0));
+    }
+    datagram_shim_flush();
+    expect_equal(datagram_test_count_received(receiver, 42), 0);
+
+    usleep(30 * 1000);
+    datagram_shim_flush();
+    expect_equal(datagram_test_count_received(receiver, 42), 10);
+
+    // Without the shim every datagram goes out right away, the token is what tells them apart
+    config = (datagram_shim_config_t){0};
+    datagram_shim_configure(&config);
+    expect_true(datagram_send(sender, 42, PACKET_TYPE_UDP_HELLO, &hello, NULL, 0));
+    expect_true(datagram_send(sender, 43, PACKET_TYPE_UDP_HELLO, &hello, NULL, 0));
+    expect_equal(datagram_test_count_received(receiver, 42), 1);
+
+    datagram_shim_shutdown();
+    close(sender);
+    close(receiver);
+    return true;
+}
+
+void datagram_register_tests(void)
+{
+    test_manager_register_test(datagram_encode_decode_round_trip, "datagram: encode decode round trip");
+    test_manager_register_test(datagram_shim_parse_spec, "datagram: shim parse spec");
+    test_manager_register_test(datagram_shim_drops_and_delays, "datagram: shim drops and delays");
+}
@@ -0,0 +1,3 @@
+#pragma once
+
+void datagram_register_tests(void);
@@ -0,0 +1,477 @@
+#include "../../expect.h"
+#include "../../test_manager.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "common/packet.h"
+#include "common/snapshot.h"
+
+b8 packet_message_round_trip_writes_used_bytes_only(void)
+{
+    packet_message_t message = {0};
+    message.type = MESSAGE_TYPE_PLAYER;
+    message.timestamp = 1700000000;
+    strcpy(message.author, "alice");
+    strcpy(message.content, "hi");
+
+    u8 buffer[PACKET_MAX_SIZE];
+    u32 size = packet_serialize(PACKET_TYPE_MESSAGE, &message, buffer, sizeof(buffer));
+    // type + timestamp + two length prefixes + the characters themselves
+    expect_equal(size, 1 + 8 + 2 + 5 + 2 + 2);
+    expect_true(size < sizeof(packet_message_t));
+
+    packet_message_t result;
+    memset(&result, 0xff, sizeof(result));
+    expect_true(packet_deserialize(PACKET_TYPE_MESSAGE, buffer, size, &result));
+    expect_equal(result.type, MESSAGE_TYPE_PLAYER);
+    expect_equal(result.timestamp, 1700000000);
+    expect_true(strcmp(result.author, "alice") == 0);
+    expect_true(strcmp(result.content, "hi") == 0);
+    expect_equal(result.content[MESSAGE_MAX_CONTENT_LENGTH - 1], 0);
+
+    return true;
+}
+
+b8 packet_message_history_round_trip(void)
+{
+    packet_message_history_t history = {0};
+    history.count = MAX_MESSAGE_HISTORY_LENGTH;
+    for (u32 i = 0; i < history.count; i++) {
+        history.history[i].type = MESSAGE_TYPE_SYSTEM;
+        snprintf(history.history[i].content, MESSAGE_MAX_CONTENT_LENGTH, "message %u", i);
+    }
+    // Unterminated arrays are sent in full
+    memset(history.history[0].author, 'x', PLAYER_MAX_NAME_LENGTH);
+
+    u8 buffer[PACKET_MAX_SIZE];
+    u32 size = packet_serialize(PACKET_TYPE_MESSAGE_HISTORY, &history, buffer, sizeof(buffer));
+    expect_not_equal(size, 0);
+    expect_true(size < sizeof(packet_message_history_t) / 10);
+
+    packet_message_history_t result;
+    expect_true(packet_deserialize(PACKET_TYPE_MESSAGE_HISTORY, buffer, size, &result));
+    expect_equal(result.count, MAX_MESSAGE_HISTORY_LENGTH);
+    expect_true(memcmp(result.history[0].author, history.history[0].author, PLAYER_MAX_NAME_LENGTH) == 0);
+    for (u32 i = 0; i < result.count; i++) {
+        expect_equal(result.history[i].type, MESSAGE_TYPE_SYSTEM);
+        expect_true(strcmp(result.history[i].content, history.history[i].content) == 0);
+    }
+
+    return true;
+}
+
+b8 packet_fixed_fields_round_trip(void)
+{
+    packet_player_add_t add = {
+        .id = 42,
+        .name = "bob",
+        .position = { .x = 12.5f, .y = -3.0f },
+        .color = { .r = 0.1f, .g = 0.2f, .b = 0.3f },
+        .health = 150,
+        .state = PLAYER_STATE_ROLL,
+        .direction = PLAYER_DIRECTION_LEFT
+    };
+
+    u8 buffer[PACKET_MAX_SIZE];
+    u32 size = packet_serialize(PACKET_TYPE_PLAYER_ADD, &add, buffer, sizeof(buffer));
+    expect_not_equal(size, 0);
+
+    packet_player_add_t result;
+    expect_true(packet_deserialize(PACKET_TYPE_PLAYER_ADD, buffer, size, &result));
+    expect_equal(result.id, 42);
+    expect_true(strcmp(result.name, "bob") == 0);
+    expect_true(result.position.x == 12.5f && result.position.y == -3.0f);
+    expect_true(result.color.r == 0.1f && result.color.g == 0.2f && result.color.b == 0.3f);
+    expect_equal(result.health, 150);
+    expect_equal(result.state, PLAYER_STATE_ROLL);
+    expect_equal(result.direction, PLAYER_DIRECTION_LEFT);
+
+    return true;
+}
+
+b8 packet_deserialize_rejects_malformed_payloads(void)
+{
+    packet_message_t message = {0};
+    strcpy(message.content, "hello");
+
+    u8 buffer[PACKET_MAX_SIZE];
+    u32 size = packet_serialize(PACKET_TYPE_MESSAGE, &message, buffer, sizeof(buffer));
+    expect_not_equal(size, 0);
+
+    packet_message_t result;
+    expect_false(packet_deserialize(PACKET_TYPE_MESSAGE, buffer, size - 1, &result)); /* Truncated */
+    expect_false(packet_deserialize(PACKET_TYPE_MESSAGE, buffer, size + 1, &result)); /* Trailing byte */
+    expect_false(packet_deserialize(PACKET_TYPE_NONE, buffer, size, &result));
+    expect_false(packet_deserialize(PACKET_TYPE_COUNT, buffer, size, &result));
+    expect_false(packet_deserialize(PACKET_TYPE_HEADER, buffer, size, &result));
+    expect_false(packet_deserialize(0xffffffff, buffer, size, &result));
+
+    // Message type past the end of its enum
+    buffer[0] = MESSAGE_TYPE_COUNT;
+    expect_false(packet_deserialize(PACKET_TYPE_MESSAGE, buffer, size, &result));
+    buffer[0] = MESSAGE_TYPE_NONE;
+
+    // Author length prefix past the array capacity
+    u16 bogus_length = PLAYER_MAX_NAME_LENGTH + 1;
+    memcpy(buffer + 1 + 8, &bogus_length, sizeof(bogus_length));
+    expect_false(packet_deserialize(PACKET_TYPE_MESSAGE, buffer, size, &result));
+
+    // Serializing into a buffer which is too small fails instead of truncating
+    expect_equal(packet_serialize(PACKET_TYPE_MESSAGE, &message, buffer, 4), 0);
+
+    return true;
+}
+
+static void packet_test_fill_chunk(chunk_base_t *chunk)
+{
+    memset(chunk, 0, sizeof(chunk_base_t));
+    chunk->x = -7;
+    chunk->y = 12;
+    chunk->revision = 3;
+    for (u32 i = 0; i < CHUNK_NUM_TILES; i++) {
+        chunk->tiles[i].type = i < 100 ? TILE_TYPE_WATER : (i < 110 ? TILE_TYPE_DIRT : (i < 250 ? TILE_TYPE_GRASS : TILE_TYPE_STONE));
+        chunk->tiles[i].object_index = INVALID_OBJECT_INDEX;
+        chunk->noise_data[i] = i / 255.0f;
+    }
+    // Object slots don't have to follow tile order, e.g. after one was removed
+    chunk->objects[0].type = GAME_OBJECT_TYPE_BUSH;
+    chunk->objects[1].type = GAME_OBJECT_TYPE_LILY;
+    chunk->objects[2].type = GAME_OBJECT_TYPE_BUSH;
+    chunk->tiles[200].object_index = 0;
+    chunk->tiles[5].object_index = 1;
+    chunk->tiles[255].object_index = 2;
+}
+
+b8 packet_chunk_response_round_trip(void)
+{
+    packet_chunk_response_t response;
+    packet_test_fill_chunk(&response.chunk);
+
+    u8 buffer[PACKET_MAX_SIZE];
+    u32 size = packet_serialize(PACKET_TYPE_CHUNK_RESPONSE, &response, buffer, sizeof(buffer));
+    expect_not_equal(size, 0);
+    expect_true(size < sizeof(packet_chunk_response_t) / 8);
+
+    packet_chunk_response_t result;
+    expect_true(packet_deserialize(PACKET_TYPE_CHUNK_RESPONSE, buffer, size, &result));
+    expect_equal(result.chunk.x, -7);
+    expect_equal(result.chunk.y, 12);
+    expect_equal(result.chunk.revision, 3);
+    u32 object_count = 0;
+    for (u32 i = 0; i < CHUNK_NUM_TILES; i++) {
+        expect_equal(result.chunk.tiles[i].type, response.chunk.tiles[i].type);
+        expect_equal((u8)(result.chunk.noise_data[i] * 255.0f), (u8)(response.chunk.noise_data[i] * 255.0f));
+
+        i32 expected_index = response.chunk.tiles[i].object_index;
+        i32 object_index = result.chunk.tiles[i].object_index;
+        if (expected_index == INVALID_OBJECT_INDEX) {
+            expect_equal(object_index, INVALID_OBJECT_INDEX);
+        } else {
+            expect_not_equal(object_index, INVALID_OBJECT_INDEX);
+            expect_equal(result.chunk.objects[object_index].type, response.chunk.objects[expected_index].type);
+            object_count++;
+        }
+    }
+    expect_equal(object_count, 3);
+
+    return true;
+}
+
+b8 packet_chunk_response_uniform_chunk(void)
+{
+    packet_chunk_response_t response;
+    packet_test_fill_chunk(&response.chunk);
+    for (u32 i = 0; i < CHUNK_NUM_TILES; i++) {
+        response.chunk.tiles[i].type = TILE_TYPE_GRASS;
+        response.chunk.tiles[i].object_index = INVALID_OBJECT_INDEX;
+    }
+
+    u8 buffer[PACKET_MAX_SIZE];
+    u32 size = packet_serialize(PACKET_TYPE_CHUNK_RESPONSE, &response, buffer, sizeof(buffer));
+    // Coordinates and revision, one palette entry, a single run covering the chunk, no objects, noise flag and data
+    expect_equal(size, 12 + 2 + 1 + 2 + 1 + CHUNK_NUM_TILES);
+
+    packet_chunk_response_t result;
+    expect_true(packet_deserialize(PACKET_TYPE_CHUNK_RESPONSE, buffer, size, &result));
+    for (u32 i = 0; i < CHUNK_NUM_TILES; i++) {
+        expect_equal(result.chunk.tiles[i].type, TILE_TYPE_GRASS);
+    }
+
+    // A run reaching past the end of the chunk is rejected. Two palette entries leave 7 bits for run lengths
+    u8 overflowing_runs[] = {
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        2, TILE_TYPE_GRASS, TILE_TYPE_DIRT,
+        0x01, 0x7f, 0xff,
+        0, 0,
+        0
+    };
+    expect_false(packet_deserialize(PACKET_TYPE_CHUNK_RESPONSE, overflowing_runs, sizeof(overflowing_runs), &result));
+    overflowing_runs[17] = 0xfd; /* 2 + 128 + 126 tiles cover the chunk exactly */
+    expect_true(packet_deserialize(PACKET_TYPE_CHUNK_RESPONSE, overflowing_runs, sizeof(overflowing_runs), &result));
+    expect_equal(result.chunk.tiles[CHUNK_NUM_TILES - 1].type, TILE_TYPE_DIRT);
+
+    return true;
+}
+
+b8 packet_chunk_delta_round_trip(void)
+{
+    packet_chunk_delta_t delta = {
+        .x = 4,
+        .y = -9,
+        .revision = 17,
+        .removed_object_count = 3,
+        .removed_object_tiles = { 0, 77, 255 }
+    };
+
+    u8 buffer[PACKET_MAX_SIZE];
+    u32 size = packet_serialize(PACKET_TYPE_CHUNK_DELTA, &delta, buffer, sizeof(buffer));
+    expect_equal(size, 4 + 4 + 4 + 2 + 3);
+
+    packet_chunk_delta_t result;
+    expect_true(packet_deserialize(PACKET_TYPE_CHUNK_DELTA, buffer, size, &result));
+    expect_equal(result.x, 4);
+    expect_equal(result.y, -9);
+    expect_equal(result.revision, 17);
+    expect_equal(result.removed_object_count, 3);
+    expect_equal(result.removed_object_tiles[1], 77);
+    expect_equal(result.removed_object_tiles[2], 255);
+
+    // Removal count larger than the amount of tiles in a chunk
+    u16 bogus_count = CHUNK_NUM_TILES + 1;
+    memcpy(buffer + 12, &bogus_count, sizeof(bogus_count));
+    expect_false(packet_deserialize(PACKET_TYPE_CHUNK_DELTA, buffer, size, &result));
+
+    return true;
+}
+
+b8 packet_chunk_batch_request_round_trip(void)
+{
+    packet_chunk_batch_request_t batch = {
+        .count = 3,
+        .chunks = { { 0, 0 }, { -1, 0 }, { 2, -3 } }
+    };
+
+    u8 buffer[PACKET_MAX_SIZE];
+    u32 size = packet_serialize(PACKET_TYPE_CHUNK_BATCH_REQUEST, &batch, buffer, sizeof(buffer));
+    expect_equal(size, 2 + 3 * (4 + 4));
+
+    packet_chunk_batch_request_t result;
+    expect_true(packet_deserialize(PACKET_TYPE_CHUNK_BATCH_REQUEST, buffer, size, &result));
+    expect_equal(result.count, 3);
+    expect_equal(result.chunks[1].x, -1);
+    expect_equal(result.chunks[2].x, 2);
+    expect_equal(result.chunks[2].y, -3);
+
+    // More coordinates than a batch can hold
+    u16 bogus_count = CHUNK_BATCH_REQUEST_MAX_COUNT + 1;
+    memcpy(buffer, &bogus_count, sizeof(bogus_count));
+    expect_false(packet_deserialize(PACKET_TYPE_CHUNK_BATCH_REQUEST, buffer, size, &result));
+
+    return true;
+}
+
+b8 packet_encode_prepends_header(void)
+{
+    packet_ping_t ping = { .time = 42 };
+
+    u8 buffer[sizeof(packet_header_t) + PACKET_MAX_SIZE];
+    u32 size = packet_encode(PACKET_TYPE_PING, &ping, buffer, sizeof(buffer));
+    expect_equal(size, sizeof(packet_header_t) + 8);
+
+    packet_header_t header;
+    memcpy(&header, buffer, sizeof(header));
+    expect_equal(header.type, PACKET_TYPE_PING);
+    expect_equal(header.size, 8);
+
+    // Not even room for the payload
+    expect_equal(packet_encode(PACKET_TYPE_PING, &ping, buffer, sizeof(packet_header_t) + 4), 0);
+
+    return true;
+}
+
+static snapshot_player_t packet_test_snapshot_player(player_id id, f32 x, f32 y, i32 health, player_state_e state)
+{
+    return (snapshot_player_t){
+        .id = id,
+        .x = snapshot_quantize(x),
+        .y = snapshot_quantize(y),
+        .health = health,
+        .state = state,
+        .direction = PLAYER_DIRECTION_DOWN
+    };
+}
+
+b8 packet_player_snapshot_delta_round_trip(void)
+{
+    static snapshot_t baseline, current, result;
+    static packet_player_snapshot_t packet, received;
+
+    baseline.number = 7;
+    baseline.count = 3;
+    baseline.players[0] = packet_test_snapshot_player(1000, 10.0f, 20.0f, 200, PLAYER_STATE_IDLE);
+    baseline.players[1] = packet_test_snapshot_player(1001, -5.5f, 0.0f, 200, PLAYER_STATE_WALK);
+    baseline.players[2] = packet_test_snapshot_player(1003, 0.0f, 0.0f, 200, PLAYER_STATE_IDLE);
+    baseline.players[0].seq_nr = 41;
+
+    // 1000 walked and took damage, 1001 stayed, 1003 left and 1004 joined
+    current.number = 9;
+    current.count = 3;
+    current.players[0] = packet_test_snapshot_player(1000, 14.0f, 20.0f, 190, PLAYER_STATE_WALK);
+    current.players[1] = baseline.players[1];
+    current.players[2] = packet_test_snapshot_player(1004, 0.0f, 0.0f, 200, PLAYER_STATE_IDLE);
+    current.players[0].seq_nr = 44;
+
+    snapshot_diff(&baseline, &current, 1000, &packet);
+    expect_equal(packet.number, 9);
+    expect_equal(packet.baseline, 7);
+    expect_equal(packet.count, 3);
+    expect_equal(packet.entries[0].fields, (SNAPSHOT_FIELD_POSITION | SNAPSHOT_FIELD_STATE | SNAPSHOT_FIELD_HEALTH | SNAPSHOT_FIELD_SEQ_NR));
+    expect_equal(packet.entries[0].x_delta, 4 * SNAPSHOT_POSITION_SCALE);
+    expect_equal(packet.entries[0].seq_nr_delta, 3);
+    expect_equal(packet.entries[1].id, 1003);
+    expect_equal(packet.entries[1].fields, SNAPSHOT_FIELD_REMOVED);
+    expect_equal(packet.entries[2].id, 1004);
+
+    u8 buffer[PACKET_MAX_SIZE];
+    u32 size = packet_serialize(PACKET_TYPE_PLAYER_SNAPSHOT, &packet, buffer, sizeof(buffer));
+    // Header varints, then id, fields, x and y, state, health and sequence number of 1000, two bytes for 1003 and 1004
+    expect_equal(size, 3 + (2 + 1 + 2 + 1 + 1 + 1 + 1) + 2 + (1 + 1 + 2));
+
+    expect_true(packet_deserialize(PACKET_TYPE_PLAYER_SNAPSHOT, buffer, size, &received));
+    expect_true(snapshot_apply(&baseline, &received, &result));
+    expect_true(snapshot_equal(&result, &current));
+    expect_true(snapshot_player_position(&result.players[0]).x == 14.0f);
+
+    // Nothing changed, nothing to send
+    snapshot_diff(&current, &current, 1000, &packet);
+    expect_equal(packet.count, 0);
+
+    // Only the receiving player's sequence number is sent
+    current.players[1].seq_nr++;
+    snapshot_diff(&baseline, &current, 1000, &packet);
+    expect_equal(packet.count, 3);
+
+    // Wrong baseline, and removing a player the baseline doesn't have
+    expect_false(snapshot_apply(&current, &received, &result));
+    snapshot_diff(&baseline, &current, 1000, &packet);
+    baseline.count = 2;
+    expect_false(snapshot_apply(&baseline, &packet, &result));
+
+    return true;
+}
+
+b8 packet_player_snapshot_full_fits_max_players(void)
+{
+    static snapshot_t current, result;
+    static packet_player_snapshot_t packet, received;
+
+    current.number = 1;
+    current.count = MAX_PLAYER_COUNT;
+    for (u32 i = 0; i < MAX_PLAYER_COUNT; i++) {
+        // Ids are assigned sequentially, a player quitting leaves a gap
+        f32 offset = (f32)i * 19.25f;
+        current.players[i] = packet_test_snapshot_player(1000 + i * 2, -5000.0f + offset, 5000.0f - offset, 200, PLAYER_STATE_WALK);
+    }
+
+    snapshot_diff(NULL, &current, 1000, &packet);
+    expect_equal(packet.baseline, SNAPSHOT_NONE);
+    expect_equal(packet.count, MAX_PLAYER_COUNT);
+
+    u8 buffer[PACKET_MAX_SIZE];
+    u32 size = packet_serialize(PACKET_TYPE_PLAYER_SNAPSHOT, &packet, buffer, sizeof(buffer));
+    expect_not_equal(size, 0);
+    expect_true(packet_deserialize(PACKET_TYPE_PLAYER_SNAPSHOT, buffer, size, &received));
+    expect_true(snapshot_apply(NULL, &received, &result));
+    expect_true(snapshot_equal(&result, &current));
+
+    // Baseline has to be older than the snapshot
+    buffer[1] = buffer[0];
+    expect_false(packet_deserialize(PACKET_TYPE_PLAYER_SNAPSHOT, buffer, size, &received));
+
+    return true;
+}
+
+b8 packet_player_snapshot_filter_by_interest(void)
+{
+    static snapshot_t current, baseline, visible_current, visible_baseline, result;
+    static packet_player_snapshot_t packet, received;
+
+    current.number = 7;
+    current.count = 4;
+    current.players[0] = packet_test_snapshot_player(1000, 0.0f, 0.0f, 100, PLAYER_STATE_IDLE);
+    current.players[1] = packet_test_snapshot_player(1001, 10.0f, 0.0f, 100, PLAYER_STATE_IDLE);
+    current.players[2] = packet_test_snapshot_player(1002, 5000.0f, 0.0f, 100, PLAYER_STATE_WALK);
+    current.players[3] = packet_test_snapshot_player(1003, 20.0f, 0.0f, 100, PLAYER_STATE_IDLE);
+
+    // Ids which the snapshot doesn't contain (e.g. players who just left) are skipped
+    player_id visible_ids[] = { 1000, 1001, 1003, 1004 };
+    snapshot_filter(&current, visible_ids, 4, &visible_current);
+    expect_equal(visible_current.number, 7);
+    expect_equal(visible_current.count, 3);
+    expect_equal(visible_current.players[0].id, 1000);
+    expect_equal(visible_current.players[1].id, 1001);
+    expect_equal(visible_current.players[2].id, 1003);
+
+    snapshot_filter(&current, NULL, 0, &result);
+    expect_equal(result.count, 0);
+
+    // Players out of reach don't show up in the delta, even if they changed
+    baseline = current;
+    baseline.number = 6;
+    baseline.players[1].x += 16;
+    baseline.players[2].x += 16;
+    snapshot_filter(&baseline, visible_ids, 4, &visible_baseline);
+    snapshot_diff(&visible_baseline, &visible_current, 1000, &packet);
+    expect_equal(packet.count, 1);
+    expect_equal(packet.entries[0].id, 1001);
+
+    u8 buffer[PACKET_MAX_SIZE];
+    u32 size = packet_serialize(PACKET_TYPE_PLAYER_SNAPSHOT, &packet, buffer, sizeof(buffer));
+    expect_true(packet_deserialize(PACKET_TYPE_PLAYER_SNAPSHOT, buffer, size, &received));
+    expect_true(snapshot_apply(&visible_baseline, &received, &result));
+    expect_true(snapshot_equal(&result, &visible_current));
+
+    return true;
+}
+
+b8 packet_player_input_round_trip(void)
+{
+    packet_player_input_t input = {0};
+    input.count = PLAYER_INPUT_REDUNDANCY;
+    for (u32 i = 0; i < input.count; i++) {
+        input.keypresses[i] = (packet_player_keypress_t){ .id = 1000, .seq_nr = 100 + i, .key = 87 + i, .mods = i % 2, .action = 1 };
+    }
+
+    u8 buffer[PACKET_MAX_SIZE];
+    u32 size = packet_serialize(PACKET_TYPE_PLAYER_INPUT, &input, buffer, sizeof(buffer));
+    expect_not_equal(size, 0);
+
+    packet_player_input_t result;
+    expect_true(packet_deserialize(PACKET_TYPE_PLAYER_INPUT, buffer, size, &result));
+    expect_equal(result.count, input.count);
+    expect_true(memcmp(result.keypresses, input.keypresses, sizeof(input.keypresses)) == 0);
+
+    // More keypresses than any client sends
+    buffer[0] = PLAYER_INPUT_REDUNDANCY + 1;
+    expect_false(packet_deserialize(PACKET_TYPE_PLAYER_INPUT, buffer, size, &result));
+
+    return true;
+}
+
+void packet_register_tests(void)
+{
+    test_manager_register_test(packet_message_round_trip_writes_used_bytes_only, "packet: message round trip writes used bytes only");
+    test_manager_register_test(packet_message_history_round_trip, "packet: message history round trip");
+    test_manager_register_test(packet_fixed_fields_round_trip, "packet: fixed fields round trip");
+    test_manager_register_test(packet_deserialize_rejects_malformed_payloads, "packet: deserialize rejects malformed payloads");
+    test_manager_register_test(packet_chunk_response_round_trip, "packet: chunk response round trip");
+    test_manager_register_test(packet_chunk_response_uniform_chunk, "packet: chunk response uniform chunk");
+    test_manager_register_test(packet_chunk_delta_round_trip, "packet: chunk delta round trip");
+    test_manager_register_test(packet_chunk_batch_request_round_trip, "packet: chunk batch request round trip");
+    test_manager_register_test(packet_encode_prepends_header, "packet: encode prepends header");
+    test_manager_register_test(packet_player_snapshot_delta_round_trip, "packet: player snapshot delta round trip");
+    test_manager_register_test(packet_player_snapshot_full_fits_max_players, "packet: player snapshot full fits max players");
+    test_manager_register_test(packet_player_snapshot_filter_by_interest, "packet: player snapshot filter by interest");
+    test_manager_register_test(packet_player_input_round_trip, "packet: player input round trip");
+}
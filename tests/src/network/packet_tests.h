@@ -0,0 +1,3 @@
+#pragma once
+
+void packet_register_tests(void);
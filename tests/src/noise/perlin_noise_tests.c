@@ -0,0 +1,90 @@
+#include "../../expect.h"
+#include "../../test_manager.h"
+
+#include <math.h>
+
+#include "common/global.h"
+#include "common/perlin_noise.h"
+
+b8 perlin_noise_context_is_deterministic(void)
+{
+    perlin_context_t first, second;
+    perlin_context_create(1234, &first);
+    perlin_context_create(1234, &second);
+
+    for (u32 i = 0; i < PERLIN_SIZE * 2; i++) {
+        expect_equal(first.perm[i], second.perm[i]);
+    }
+
+    return true;
+}
+
+static b8 compare_with_scalar(u32 width, i32 octave_count, b8 expect_exact)
+{
+    f32 scalar_output[32 * 32];
+    f32 output[32 * 32];
+
+    for (u32 seed = 1; seed < 4000000000u; seed += 987654321u) {
+        perlin_context_t context;
+        perlin_context_create(seed, &context);
+
+        for (i32 chunk_y = -4; chunk_y < 4; chunk_y++) {
+            for (i32 chunk_x = -4; chunk_x < 4; chunk_x++) {
+                perlin_noise_config_t config = {
+                    .pos_x = chunk_x * (i32)width,
+                    .pos_y = chunk_y * (i32)width,
+                    .width = width,
+                    .height = width,
+                    .octave_count = octave_count,
+                    .scaling_bias = 2.0f
+                };
+
+                perlin_noise_generate_2d_scalar(&context, config, scalar_output);
+                perlin_noise_generate_2d(&context, config, output);
+
+                for (u32 i = 0; i < width * width; i++) {
+                    if (expect_exact) {
+                        expect_true(output[i] == scalar_output[i]);
+                    } else {
+                        expect_true(fabsf(output[i] - scalar_output[i]) <= PERLIN_NOISE_SIMD_TOLERANCE);
+                    }
+                }
+            }
+        }
+    }
+
+    return true;
+}
+
+b8 perlin_noise_chunk_matches_scalar(void)
+{
+    LOG_INFO("perlin noise kernel for chunks: %s", perlin_noise_kernel_name(perlin_noise_select_kernel(CHUNK_LENGTH)));
+
+    for (i32 octave_count = 1; octave_count <= 4; octave_count++) {
+        if (!compare_with_scalar(CHUNK_LENGTH, octave_count, true)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+b8 perlin_noise_other_widths_within_tolerance(void)
+{
+    // 4 and 12 take the SSE2 path even when AVX2 is available
+    u32 widths[] = { 4, 12, 20, 32 };
+    for (u32 i = 0; i < ARRAY_SIZE(widths); i++) {
+        if (!compare_with_scalar(widths[i], 3, false)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void perlin_noise_register_tests(void)
+{
+    test_manager_register_test(perlin_noise_context_is_deterministic, "perlin noise: context is deterministic");
+    test_manager_register_test(perlin_noise_chunk_matches_scalar, "perlin noise: chunk matches scalar bit-for-bit");
+    test_manager_register_test(perlin_noise_other_widths_within_tolerance, "perlin noise: other widths within tolerance");
+}
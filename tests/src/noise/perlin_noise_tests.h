@@ -0,0 +1,3 @@
+#pragma once
+
+void perlin_noise_register_tests(void);
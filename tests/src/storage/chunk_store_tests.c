@@ -0,0 +1,95 @@
+#include "../../expect.h"
+#include "../../test_manager.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "server/chunk_store.h"
+#include "server/region_file.h"
+
+static void remove_region_files(const char *directory)
+{
+    char path[256];
+    snprintf(path, sizeof(path), "%s/r.0.0.region", directory);
+    unlink(path);
+    rmdir(directory);
+}
+
+b8 chunk_store_writes_flushed_chunks(void)
+{
+    char directory[] = "/tmp/starlore_chunk_store_test_XXXXXX";
+    expect_true(mkdtemp(directory) != NULL);
+    expect_true(region_storage_init(directory));
+    chunk_store_init(4);
+
+    static chunk_base_t chunk;
+    memset(&chunk, 0, sizeof(chunk));
+    chunk.x = 1;
+    chunk.y = 2;
+    chunk.revision = 5;
+    chunk_base_t *stored = chunk_store_insert(&chunk, NULL, 0, true);
+    chunk_store_release(stored);
+    expect_equal(chunk_store_flush_dirty(), 1);
+
+    // Either the copy waiting for the writer thread or the region file, both hold the flushed revision
+    static chunk_base_t loaded;
+    expect_true(chunk_store_load(1, 2, &loaded));
+    expect_equal(loaded.revision, 5);
+
+    // Shutdown finishes every queued write
+    chunk_store_shutdown();
+    memset(&loaded, 0, sizeof(loaded));
+    expect_true(region_storage_load_chunk(1, 2, &loaded));
+    expect_equal(loaded.revision, 5);
+
+    region_storage_shutdown();
+    remove_region_files(directory);
+
+    return true;
+}
+
+b8 chunk_store_keeps_evicted_modifications(void)
+{
+    char directory[] = "/tmp/starlore_chunk_store_test_XXXXXX";
+    expect_true(mkdtemp(directory) != NULL);
+    expect_true(region_storage_init(directory));
+    chunk_store_init(2);
+
+    // Every insert past the budget evicts one of the earlier, released chunks
+    static chunk_base_t chunk;
+    memset(&chunk, 0, sizeof(chunk));
+    for (i32 i = 0; i < 6; i++) {
+        chunk.x = i;
+        chunk.revision = 10 + i;
+        chunk_base_t *stored = chunk_store_insert(&chunk, NULL, 0, true);
+        chunk_store_release(stored);
+    }
+    expect_equal(chunk_store_count(), 2);
+
+    static chunk_base_t loaded;
+    for (i32 i = 0; i < 6; i++) {
+        chunk_base_t *resident = chunk_store_find(i, 0);
+        if (resident != NULL) {
+            expect_equal(resident->revision, 10 + i);
+            chunk_store_release(resident);
+            continue;
+        }
+
+        expect_true(chunk_store_load(i, 0, &loaded));
+        expect_equal(loaded.revision, 10 + i);
+    }
+
+    chunk_store_shutdown();
+    region_storage_shutdown();
+    remove_region_files(directory);
+
+    return true;
+}
+
+void chunk_store_register_tests(void)
+{
+    test_manager_register_test(chunk_store_writes_flushed_chunks, "chunk store: writes flushed chunks");
+    test_manager_register_test(chunk_store_keeps_evicted_modifications, "chunk store: keeps evicted modifications");
+}
@@ -0,0 +1,3 @@
+#pragma once
+
+void chunk_store_register_tests(void);
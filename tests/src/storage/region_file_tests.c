@@ -0,0 +1,65 @@
+#include "../../expect.h"
+#include "../../test_manager.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "server/region_file.h"
+#include "common/filesystem.h"
+
+b8 region_file_replaces_incompatible_version(void)
+{
+    char directory[] = "/tmp/starlore_region_test_XXXXXX";
+    expect_true(mkdtemp(directory) != NULL);
+
+    char path[256], old_path[sizeof(path) + 4];
+    snprintf(path, sizeof(path), "%s/r.0.0.region", directory);
+    snprintf(old_path, sizeof(old_path), "%s.old", path);
+
+    // Header of the previous format followed by a slot table claiming chunk 0:0 was saved
+    region_file_header_t old_header = {
+        .magic = REGION_FILE_MAGIC,
+        .version = 1,
+        .region_length = REGION_LENGTH,
+        .record_size = sizeof(region_chunk_record_t) - sizeof(u32),
+        .chunk_count = 1
+    };
+    u32 slots[REGION_CHUNK_COUNT] = { 1 };
+    FILE *file = fopen(path, "wb");
+    expect_true(file != NULL);
+    fwrite(&old_header, sizeof(old_header), 1, file);
+    fwrite(slots, sizeof(slots), 1, file);
+    fclose(file);
+
+    expect_true(region_storage_init(directory));
+
+    static chunk_base_t chunk;
+    expect_false(region_storage_load_chunk(0, 0, &chunk));
+    expect_true(filesystem_exists(old_path));
+
+    // The recreated file takes saves again
+    memset(&chunk, 0, sizeof(chunk));
+    chunk.x = 3;
+    chunk.y = 4;
+    chunk.revision = 7;
+    expect_true(region_storage_save_chunk(&chunk));
+
+    static chunk_base_t loaded;
+    expect_true(region_storage_load_chunk(3, 4, &loaded));
+    expect_equal(loaded.revision, 7);
+
+    region_storage_shutdown();
+
+    unlink(path);
+    unlink(old_path);
+    rmdir(directory);
+
+    return true;
+}
+
+void region_file_register_tests(void)
+{
+    test_manager_register_test(region_file_replaces_incompatible_version, "region file: replaces incompatible version");
+}
@@ -0,0 +1,3 @@
+#pragma once
+
+void region_file_register_tests(void);